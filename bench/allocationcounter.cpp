@@ -0,0 +1,110 @@
+#include "allocationcounter.h"
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+// Plain thread-locals in the executable need no allocation of their own,
+// so they are safe to touch from inside malloc
+thread_local bool counting = false;
+thread_local quint64 allocations = 0;
+
+inline void countAllocation()
+{
+    if (counting) {
+        ++allocations;
+    }
+}
+
+}
+
+void AllocationCounter::start()
+{
+    allocations = 0;
+    counting = true;
+}
+
+quint64 AllocationCounter::stop()
+{
+    counting = false;
+    return allocations;
+}
+
+#if defined(__GLIBC__)
+
+extern "C" {
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+
+void *malloc(size_t size)
+{
+    countAllocation();
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    countAllocation();
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size)
+{
+    countAllocation();
+    return __libc_realloc(pointer, size);
+}
+
+}
+
+bool AllocationCounter::countsMalloc()
+{
+    return true;
+}
+
+#else
+
+bool AllocationCounter::countsMalloc()
+{
+    return false;
+}
+
+#endif
+
+// With glibc, malloc above already counts these
+void *operator new(std::size_t size)
+{
+#if !defined(__GLIBC__)
+    countAllocation();
+#endif
+    if (void *pointer = std::malloc(size ? size : 1)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void *pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
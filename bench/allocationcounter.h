@@ -0,0 +1,24 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <QtGlobal>
+
+// Counts heap allocations made by the calling thread between start() and
+// stop(), so a benchmark can assert that a code path does not allocate.
+//
+// The bench replaces the global operator new and, with glibc, interposes
+// malloc/calloc/realloc as well, which is where Qt containers and strings
+// get their memory. Without glibc only operator new is counted; see
+// countsMalloc(). None of this is linked into the application.
+class AllocationCounter
+{
+public:
+    static void start();
+    
+    // Allocations since start()
+    static quint64 stop();
+    
+    static bool countsMalloc();
+};
+
+#endif // ALLOCATIONCOUNTER_H
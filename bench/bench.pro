@@ -0,0 +1,76 @@
+QT += core gui widgets
+
+TARGET = tslimx2bench
+TEMPLATE = app
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+# Build with: qmake bench/bench.pro && make
+# Run with:   ./tslimx2bench [--quick] [--filter <name>] [--output results.json]
+
+INCLUDEPATH += ..
+
+SOURCES += \
+    main.cpp \
+    allocationcounter.cpp \
+    ../models/glucosemodel.cpp \
+    ../models/insulinmodel.cpp \
+    ../models/insulinindex.cpp \
+    ../models/deliveryengine.cpp \
+    ../models/pumpmodel.cpp \
+    ../models/profilemodel.cpp \
+    ../models/profileschedule.cpp \
+    ../models/insulinhistorycursor.cpp \
+    ../controllers/pumpcontroller.cpp \
+    ../controllers/alertcontroller.cpp \
+    ../controllers/historyquery.cpp \
+    ../views/graphview.cpp \
+    ../utils/datastorage.cpp \
+    ../utils/errorhandler.cpp \
+    ../utils/settingsstore.cpp \
+    ../utils/controlloopmonitor.cpp \
+    ../utils/controliqalgorithm.cpp \
+    ../utils/timeseriesstore.cpp \
+    ../utils/glucoserollup.cpp \
+    ../utils/agpengine.cpp \
+    ../utils/csvexporter.cpp \
+    ../utils/stringpool.cpp \
+    ../utils/timestamp.cpp \
+    ../utils/tracing.cpp \
+    ../utils/metrics.cpp \
+    ../utils/reminderscheduler.cpp \
+    ../utils/alertruleengine.cpp \
+    ../utils/alertqueue.cpp
+
+HEADERS += \
+    allocationcounter.h \
+    ../models/glucosemodel.h \
+    ../models/insulinmodel.h \
+    ../models/insulinindex.h \
+    ../models/deliveryengine.h \
+    ../models/pumpmodel.h \
+    ../models/profilemodel.h \
+    ../models/profileschedule.h \
+    ../models/insulinhistorycursor.h \
+    ../controllers/pumpcontroller.h \
+    ../controllers/alertcontroller.h \
+    ../controllers/historyquery.h \
+    ../views/graphview.h \
+    ../utils/datastorage.h \
+    ../utils/errorhandler.h \
+    ../utils/settingsstore.h \
+    ../utils/controlloopmonitor.h \
+    ../utils/controliqalgorithm.h \
+    ../utils/timeseriesstore.h \
+    ../utils/glucoserollup.h \
+    ../utils/agpengine.h \
+    ../utils/csvexporter.h \
+    ../utils/stringpool.h \
+    ../utils/timestamp.h \
+    ../utils/historyview.h \
+    ../utils/ringbuffer.h \
+    ../utils/tracing.h \
+    ../utils/metrics.h \
+    ../utils/reminderscheduler.h \
+    ../utils/alertruleengine.h \
+    ../utils/alertqueue.h
@@ -0,0 +1,976 @@
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QStringList>
+#include <QtMath>
+#include <cstdio>
+#include "models/glucosemodel.h"
+#include "models/insulinmodel.h"
+#include "models/pumpmodel.h"
+#include "models/profilemodel.h"
+#include "models/insulinhistorycursor.h"
+#include "controllers/pumpcontroller.h"
+#include "views/graphview.h"
+#include "utils/datastorage.h"
+#include "utils/controliqalgorithm.h"
+#include "utils/agpengine.h"
+#include "utils/alertruleengine.h"
+#include "utils/alertqueue.h"
+#include "utils/timestamp.h"
+#include "utils/reminderscheduler.h"
+#include "allocationcounter.h"
+
+// Benchmarks for the model, storage and rendering hot paths. Results are
+// written as one JSON document so runs can be diffed or tracked over time.
+
+namespace {
+
+struct Measurement {
+    qint64 iterations;
+    qint64 totalNs;
+};
+
+// Runs fn once to warm up, then repeatedly until minTimeNs has passed
+template <typename Fn>
+Measurement measure(Fn &&fn, qint64 minTimeNs = 200000000LL)
+{
+    fn();
+    
+    QElapsedTimer timer;
+    qint64 iterations = 0;
+    timer.start();
+    do {
+        fn();
+        ++iterations;
+    } while (timer.nsecsElapsed() < minTimeNs);
+    
+    return {iterations, timer.nsecsElapsed()};
+}
+
+// Runs fn exactly once
+template <typename Fn>
+qint64 measureOnce(Fn &&fn)
+{
+    QElapsedTimer timer;
+    timer.start();
+    fn();
+    return timer.nsecsElapsed();
+}
+
+// Keeps results alive so the optimiser cannot drop the work
+volatile double sink = 0.0;
+
+class BenchRunner
+{
+public:
+    BenchRunner(bool quick, const QString &filter)
+        : quick(quick),
+          filter(filter)
+    {
+    }
+    
+    bool wants(const QString &name) const
+    {
+        return filter.isEmpty() || name.contains(filter);
+    }
+    
+    // Sizes from 1k upwards; --quick stops at 100k
+    QVector<int> sizes(int largest = 1000000) const
+    {
+        QVector<int> result;
+        for (int n = 1000; n <= largest && (!quick || n <= 100000); n *= 10) {
+            result.append(n);
+        }
+        return result;
+    }
+    
+    void report(const QString &name, qint64 n, qint64 operations, qint64 totalNs,
+                const QJsonObject &extra = QJsonObject())
+    {
+        QJsonObject result = extra;
+        result["name"] = name;
+        result["n"] = n;
+        result["operations"] = operations;
+        result["total_ms"] = totalNs / 1e6;
+        result["ns_per_op"] = operations > 0 ? static_cast<double>(totalNs) / operations : 0.0;
+        results.append(result);
+        
+        fprintf(stderr, "%-40s n=%-8lld %14.1f ns/op\n", qPrintable(name),
+                static_cast<long long>(n), result["ns_per_op"].toDouble());
+    }
+    
+    // Marks the run as failed; main() then exits non-zero
+    void fail(const QString &message)
+    {
+        failures.append(message);
+        fprintf(stderr, "FAILED: %s\n", qPrintable(message));
+    }
+    
+    QJsonArray results;
+    QStringList failures;
+
+private:
+    bool quick;
+    QString filter;
+};
+
+// Regular five minute readings ending now
+TimeSeriesStore makeGlucoseSeries(int count)
+{
+    TimeSeriesStore series;
+    series.reserve(count);
+    
+    const qint64 step = 5 * 60 * 1000;
+    const qint64 end = QDateTime::currentMSecsSinceEpoch();
+    qint64 timestamp = end - (count - 1) * step;
+    for (int i = 0; i < count; ++i, timestamp += step) {
+        series.append(timestamp, 7.0 + 3.0 * qSin(i / 36.0));
+    }
+    return series;
+}
+
+QVector<QPair<QDateTime, double>> makeGlucosePairs(int count)
+{
+    TimeSeriesStore series = makeGlucoseSeries(count);
+    return series.toPairs(series.at(0).timestamp, series.last().timestamp);
+}
+
+// Roughly one bolus every two hours ending now
+QVector<InsulinModel::BolusDelivery> makeBoluses(int count)
+{
+    QVector<InsulinModel::BolusDelivery> boluses;
+    boluses.reserve(count);
+    
+    QDateTime now = QDateTime::currentDateTime();
+    for (int i = count - 1; i >= 0; --i) {
+        boluses.append({now.addSecs(-i * 7200LL), 2.0 + (i % 5), "Bench", false, 0, true});
+    }
+    return boluses;
+}
+
+QVector<InsulinModel::BasalDelivery> makeBasalSegments(int count)
+{
+    QVector<InsulinModel::BasalDelivery> segments;
+    segments.reserve(count);
+    
+    QDateTime now = QDateTime::currentDateTime();
+    for (int i = count; i > 0; --i) {
+        segments.append({now.addSecs(-i * 3600LL), now.addSecs(-(i - 1) * 3600LL), 0.8, "Default", i % 3 != 0});
+    }
+    return segments;
+}
+
+void benchGlucoseModel(BenchRunner &runner)
+{
+    for (int n : runner.sizes()) {
+        if (runner.wants("glucose.addReading")) {
+            // The model keeps the last 24 h, so this measures the steady state
+            // append + trim path as well as the initial fill
+            GlucoseModel model;
+            QDateTime start = QDateTime::currentDateTime().addSecs(-n * 300LL);
+            qint64 ns = measureOnce([&]() {
+                for (int i = 0; i < n; ++i) {
+                    model.addReading(7.0 + (i % 40) * 0.1, start.addSecs(i * 300LL));
+                }
+            });
+            
+            QJsonObject extra;
+            extra["retained"] = model.getReadingSeries().size();
+            runner.report("glucose.addReading", n, n, ns, extra);
+        }
+        
+        if (runner.wants("glucose.getReadings")) {
+            GlucoseModel model;
+            model.setReadingSeries(makeGlucoseSeries(n));
+            
+            QDateTime end = QDateTime::currentDateTime();
+            int returned = 0;
+            
+            Measurement day = measure([&]() {
+                returned = model.getReadings(end.addSecs(-24 * 3600), end).size();
+            });
+            QJsonObject dayExtra;
+            dayExtra["returned"] = returned;
+            runner.report("glucose.getReadings.last24h", n, day.iterations, day.totalNs, dayExtra);
+            
+            Measurement all = measure([&]() {
+                returned = model.getReadings(QDateTime::fromMSecsSinceEpoch(0), end).size();
+            });
+            QJsonObject allExtra;
+            allExtra["returned"] = returned;
+            runner.report("glucose.getReadings.all", n, all.iterations, all.totalNs, allExtra);
+        }
+        
+        if (runner.wants("glucose.getReadingsView")) {
+            GlucoseModel model;
+            model.setReadingSeries(makeGlucoseSeries(n));
+            
+            // Same ranges as above, iterated in place
+            const Timestamp end = Timestamp::now();
+            double total = 0.0;
+            
+            Measurement day = measure([&]() {
+                for (const auto &sample : model.getReadingsView(end.addSecs(-24 * 3600), end)) {
+                    total += sample.value;
+                }
+            });
+            runner.report("glucose.getReadingsView.last24h", n, day.iterations, day.totalNs);
+            
+            Measurement all = measure([&]() {
+                for (const auto &sample : model.getReadingsView(Timestamp(0), end)) {
+                    total += sample.value;
+                }
+            });
+            runner.report("glucose.getReadingsView.all", n, all.iterations, all.totalNs);
+            sink = sink + total;
+        }
+    }
+}
+
+void benchInsulinModel(BenchRunner &runner)
+{
+    if (runner.wants("insulin.updateIOB")) {
+        for (int n : runner.sizes(100000)) {
+            InsulinModel model;
+            model.appendHistory(makeBoluses(n), QVector<InsulinModel::BasalDelivery>());
+            
+            Measurement m = measure([&]() {
+                model.updateIOB();
+            });
+            runner.report("insulin.updateIOB", n, m.iterations, m.totalNs);
+        }
+    }
+    
+    if (runner.wants("insulin.getTotalInsulin")) {
+        for (int n : runner.sizes(100000)) {
+            InsulinModel model;
+            model.appendHistory(makeBoluses(n), makeBasalSegments(n));
+            
+            // One day in the middle of the history
+            const QDateTime end = QDateTime::currentDateTime().addDays(-7);
+            const QDateTime start = end.addDays(-1);
+            
+            Measurement m = measure([&]() {
+                sink = sink + model.getTotalInsulin(start, end);
+            });
+            runner.report("insulin.getTotalInsulin", n, m.iterations, m.totalNs);
+        }
+    }
+}
+
+void benchDataStorage(BenchRunner &runner, const QString &directory)
+{
+    const int n = 10000;
+    DataStorage storage;
+    
+    auto saveAndLoad = [&](const QString &type, auto save, auto load) {
+        const QString filename = directory + "/" + type + ".json";
+        
+        if (runner.wants("storage.save." + type)) {
+            Measurement m = measure(save, 100000000LL);
+            QJsonObject extra;
+            extra["bytes"] = QFileInfo(filename).size();
+            runner.report("storage.save." + type, n, m.iterations, m.totalNs, extra);
+        }
+        
+        if (runner.wants("storage.load." + type)) {
+            if (!QFile::exists(filename)) {
+                save();
+            }
+            Measurement m = measure(load, 100000000LL);
+            runner.report("storage.load." + type, n, m.iterations, m.totalNs);
+        }
+    };
+    
+    const QVector<QPair<QDateTime, double>> glucose = makeGlucosePairs(n);
+    saveAndLoad("glucose",
+                [&]() { storage.saveGlucoseData(glucose, directory + "/glucose.json"); },
+                [&]() { sink = sink + storage.loadGlucoseData(directory + "/glucose.json").size(); });
+    
+    saveAndLoad("insulin",
+                [&]() { storage.saveInsulinData(glucose, directory + "/insulin.json"); },
+                [&]() { sink = sink + storage.loadInsulinData(directory + "/insulin.json").size(); });
+    
+    QVector<DataStorage::BolusRecord> boluses;
+    for (const auto &bolus : makeBoluses(n)) {
+        boluses.append({bolus.timestamp, bolus.units, bolus.reason, bolus.extended, bolus.duration, bolus.completed});
+    }
+    saveAndLoad("bolus",
+                [&]() { storage.saveBolusHistory(boluses, directory + "/bolus.json"); },
+                [&]() { sink = sink + storage.loadBolusHistory(directory + "/bolus.json").size(); });
+    
+    QVector<DataStorage::BasalRecord> basal;
+    for (const auto &segment : makeBasalSegments(n)) {
+        basal.append({segment.startTime, segment.endTime, segment.rate, segment.profileName, segment.automatic});
+    }
+    saveAndLoad("basal",
+                [&]() { storage.saveBasalHistory(basal, directory + "/basal.json"); },
+                [&]() { sink = sink + storage.loadBasalHistory(directory + "/basal.json").size(); });
+    
+    QVector<DataStorage::ProfileRecord> profiles;
+    for (int i = 0; i < 100; ++i) {
+        profiles.append({QString("Profile %1").arg(i), 0.8, 10.0, 2.0, 5.5});
+    }
+    saveAndLoad("profile",
+                [&]() { storage.saveProfiles(profiles, directory + "/profile.json"); },
+                [&]() { sink = sink + storage.loadProfiles(directory + "/profile.json").size(); });
+    
+    QVector<DataStorage::LogEvent> events;
+    QDateTime now = QDateTime::currentDateTime();
+    for (int i = 0; i < n; ++i) {
+        events.append({now.addSecs(-i * 60LL), QString("Event %1").arg(i), i % 3});
+    }
+    saveAndLoad("eventlog",
+                [&]() { storage.saveEventLog(events, directory + "/eventlog.json"); },
+                [&]() { sink = sink + storage.loadEventLog(directory + "/eventlog.json").size(); });
+}
+
+void benchStatistics(BenchRunner &runner, const QString &directory)
+{
+    DataStorage storage;
+    
+    // 30 days and one year of five minute readings
+    for (int n : {8640, 105120}) {
+        const QVector<QPair<QDateTime, double>> glucose = makeGlucosePairs(n);
+        const QVector<QPair<QDateTime, double>> insulin = makeGlucosePairs(n / 12);
+        const QDateTime start = glucose.first().first;
+        const QDateTime end = glucose.last().first;
+        
+        if (runner.wants("stats.calculateDailyStatistics")) {
+            Measurement m = measure([&]() {
+                sink = sink + storage.calculateDailyStatistics(start, end, glucose).size();
+            });
+            runner.report("stats.calculateDailyStatistics", n, m.iterations, m.totalNs);
+        }
+        
+        if (runner.wants("stats.calculateHourlyAverages")) {
+            Measurement m = measure([&]() {
+                sink = sink + storage.calculateHourlyAverages(start, end, glucose).size();
+            });
+            runner.report("stats.calculateHourlyAverages", n, m.iterations, m.totalNs);
+        }
+        
+        // Same statistics over a view of the stored series
+        TimeSeriesStore series;
+        series.reserve(glucose.size());
+        for (const auto &reading : glucose) {
+            series.append(reading.first, reading.second);
+        }
+        
+        if (runner.wants("stats.calculateDailyStatistics.view")) {
+            Measurement m = measure([&]() {
+                sink = sink + storage.calculateDailyStatistics(start, end, series.view(start.toMSecsSinceEpoch(), end.toMSecsSinceEpoch())).size();
+            });
+            runner.report("stats.calculateDailyStatistics.view", n, m.iterations, m.totalNs);
+        }
+        
+        if (runner.wants("stats.calculateHourlyAverages.view")) {
+            Measurement m = measure([&]() {
+                sink = sink + storage.calculateHourlyAverages(start, end, series.view(start.toMSecsSinceEpoch(), end.toMSecsSinceEpoch())).size();
+            });
+            runner.report("stats.calculateHourlyAverages.view", n, m.iterations, m.totalNs);
+        }
+        
+        // Same statistics from the incrementally maintained rollup
+        GlucoseRollup rollup;
+        for (const auto &reading : glucose) {
+            rollup.add(reading.first, reading.second);
+        }
+        
+        if (runner.wants("stats.calculateDailyStatistics.rollup")) {
+            Measurement m = measure([&]() {
+                sink = sink + storage.calculateDailyStatistics(start, end, rollup).size();
+            });
+            runner.report("stats.calculateDailyStatistics.rollup", n, m.iterations, m.totalNs);
+        }
+        
+        if (runner.wants("stats.calculateHourlyAverages.rollup")) {
+            Measurement m = measure([&]() {
+                sink = sink + storage.calculateHourlyAverages(start, end, rollup).size();
+            });
+            runner.report("stats.calculateHourlyAverages.rollup", n, m.iterations, m.totalNs);
+        }
+        
+        if (runner.wants("stats.generateCSVReport")) {
+            int length = 0;
+            Measurement m = measure([&]() {
+                length = storage.generateCSVReport(start, end, glucose, insulin).size();
+            });
+            QJsonObject extra;
+            extra["chars"] = length;
+            runner.report("stats.generateCSVReport", n, m.iterations, m.totalNs, extra);
+        }
+        
+        // Streamed to disk from the stored series and an insulin history
+        // of hourly basal segments and a bolus every two hours, one row per
+        // timestamp and in 5 minute buckets
+        InsulinModel insulinModel;
+        insulinModel.appendHistory(makeBoluses(n / 24), makeBasalSegments(n / 12));
+        
+        for (int bucketMinutes : {0, 5}) {
+            const QString name = bucketMinutes == 0 ? "stats.exportCSVReport" : "stats.exportCSVReport.bucketed";
+            if (!runner.wants(name)) {
+                continue;
+            }
+            
+            const QString filename = directory + "/report.csv";
+            Measurement m = measure([&]() {
+                InsulinHistoryCursor cursor(insulinModel.getAllBoluses(), insulinModel.getAllBasalSegments(), start, end);
+                storage.exportCSVReport(filename, series.view(start.toMSecsSinceEpoch(), end.toMSecsSinceEpoch()),
+                                        cursor, bucketMinutes);
+            });
+            QJsonObject extra;
+            extra["bytes"] = QFileInfo(filename).size();
+            runner.report(name, n, m.iterations, m.totalNs, extra);
+        }
+    }
+}
+
+void benchControlIQ(BenchRunner &runner)
+{
+    if (!runner.wants("controliq.calculateBasalAdjustment")) {
+        return;
+    }
+    
+    ControlIQAlgorithm algorithm;
+    const GlucoseModel::TrendDirection trends[] = {
+        GlucoseModel::FallingQuickly, GlucoseModel::Falling, GlucoseModel::Stable,
+        GlucoseModel::Rising, GlucoseModel::RisingQuickly
+    };
+    
+    // Sweep glucose from 2.5 to 20 mmol/L across every trend
+    const int callsPerBatch = 10000;
+    Measurement m = measure([&]() {
+        double total = 0.0;
+        for (int i = 0; i < callsPerBatch; ++i) {
+            double glucose = 2.5 + (i % 176) * 0.1;
+            total += algorithm.calculateBasalAdjustment(glucose, trends[i % 5], 0.8, 6.1, (i % 40) * 0.1);
+        }
+        sink = sink + total;
+    });
+    runner.report("controliq.calculateBasalAdjustment", callsPerBatch, m.iterations * callsPerBatch, m.totalNs);
+}
+
+void benchProfileSchedule(BenchRunner &runner)
+{
+    if (!runner.wants("profile.schedule")) {
+        return;
+    }
+    
+    // A typical day: overnight, dawn, daytime and evening settings
+    Profile profile;
+    profile.name = "Segmented";
+    profile.basalRate = 0.7;
+    profile.carbRatio = 12.0;
+    profile.correctionFactor = 2.2;
+    profile.targetGlucose = 6.0;
+    profile.segments = {
+        {4 * 60, 1.1, 12.0, 2.0, 5.5},
+        {9 * 60, 0.9, 10.0, 2.0, 5.5},
+        {18 * 60 + 30, 0.8, 11.0, 2.2, 5.8},
+        {22 * 60, 0.7, 12.0, 2.4, 6.0}
+    };
+    
+    if (runner.wants("profile.schedule.compile")) {
+        Measurement m = measure([&]() {
+            ProfileSchedule schedule(profile);
+            sink = sink + schedule.at(0).basalRate;
+        });
+        runner.report("profile.schedule.compile", ProfileSchedule::SlotCount, m.iterations, m.totalNs);
+    }
+    
+    if (runner.wants("profile.schedule.lookup")) {
+        ProfileModel model;
+        model.createProfile(profile);
+        model.setActiveProfile(profile.name);
+        
+        // Every setting at every minute of the day
+        const int lookupsPerBatch = 24 * 60;
+        Measurement m = measure([&]() {
+            const ProfileSetSnapshot profiles = model.getSnapshot();
+            const ProfileSchedule &schedule = profiles->activeSchedule();
+            double total = 0.0;
+            for (int minute = 0; minute < lookupsPerBatch; ++minute) {
+                const ProfileSchedule::Slot &slot = schedule.at(minute / ProfileSchedule::SlotMinutes);
+                total += slot.basalRate + slot.carbRatio + slot.correctionFactor + slot.targetGlucose;
+            }
+            sink = sink + total;
+        });
+        runner.report("profile.schedule.lookup", lookupsPerBatch, m.iterations * lookupsPerBatch, m.totalNs);
+    }
+}
+
+void benchDeliveryEngine(BenchRunner &runner)
+{
+    if (!runner.wants("delivery.engine")) {
+        return;
+    }
+    
+    // Simulated days of pump time in 5 second ticks: a basal rate that
+    // Control-IQ changes every five minutes and a combo bolus every three
+    // hours
+    for (int days : {1, 7}) {
+        const qint64 start = QDateTime::currentMSecsSinceEpoch();
+        qint64 pulses = 0;
+        
+        qint64 ns = measureOnce([&]() {
+            DeliveryEngine engine;
+            engine.setBasalRate(0.8, start);
+            
+            for (qint64 t = start; t < start + days * 86400000LL; t += 5000) {
+                const qint64 elapsed = t - start;
+                if (elapsed % 300000 == 0) {
+                    engine.setBasalRate(0.8 + 0.4 * qSin(elapsed / 3600000.0), t);
+                }
+                if (elapsed % (3 * 3600000LL) == 0) {
+                    engine.startBolus(2.0, 1.5, 90, t);
+                }
+                pulses += engine.advance(t, [](const DeliveryEngine::Pulse &pulse) {
+                    sink = sink + pulse.time;
+                });
+            }
+        });
+        
+        QJsonObject extra;
+        extra["pulses"] = pulses;
+        runner.report("delivery.engine.days", days, pulses, ns, extra);
+    }
+}
+
+void benchReminderScheduler(BenchRunner &runner)
+{
+    if (!runner.wants("reminders.scheduler")) {
+        return;
+    }
+    
+    // Reminders spread over a month, added out of order and then fired a
+    // day at a time. The scheduler is never loaded from QSettings, so it
+    // leaves the user's reminders alone.
+    SimulationClock::setFixedTime(Timestamp::now());
+    const Timestamp start = Timestamp::now();
+    
+    for (int n : {1000, 10000}) {
+        ReminderScheduler scheduler;
+        scheduler.start();
+        
+        qint64 addNs = measureOnce([&]() {
+            for (int i = 0; i < n; ++i) {
+                const qint64 offset = (i * 7919LL) % n * (30LL * 86400000 / n);
+                scheduler.addReminder("Site Change", start.addMSecs(offset));
+            }
+        });
+        runner.report("reminders.scheduler.add", n, n, addNs);
+        
+        int fired = 0;
+        qint64 fireNs = measureOnce([&]() {
+            for (int day = 0; day <= 30; ++day) {
+                SimulationClock::setFixedTime(start.addMSecs(day * 86400000LL));
+                fired += scheduler.processDue();
+            }
+        });
+        
+        if (fired != n) {
+            runner.fail(QString("reminders.scheduler fired %1 of %2 reminders").arg(fired).arg(n));
+        }
+        runner.report("reminders.scheduler.fire", n, fired, fireNs);
+    }
+    
+    SimulationClock::reset();
+}
+
+void benchAgpEngine(BenchRunner &runner)
+{
+    if (!runner.wants("agp.add")) {
+        return;
+    }
+    
+    const qint64 minuteMs = 60 * 1000;
+    const qint64 dayMs = 24 * 60 * minuteMs;
+    const qint64 start = QDateTime::currentMSecsSinceEpoch() - 90 * dayMs;
+    
+    // A reading that arrives an hour late still leaves the window before
+    // the newer one that came in ahead of it
+    AgpEngine late;
+    late.add(start, 6.0);
+    late.add(start - 60 * minuteMs, 7.0);
+    late.add(start + 14 * dayMs - 30 * minuteMs, 8.0);
+    if (late.count() != 2) {
+        runner.fail(QString("agp.add counts %1 readings after the window passed a late one, expected 2")
+                        .arg(late.count()));
+    }
+    
+    // 90 days of five minute readings through the 14 day window
+    const int n = 90 * 288;
+    Measurement m = measure([&]() {
+        AgpEngine engine;
+        engine.reserve(n);
+        for (int i = 0; i < n; ++i) {
+            engine.add(start + i * 5 * minuteMs, 7.0 + 3.0 * qSin(i / 36.0));
+        }
+        sink = sink + engine.count();
+    });
+    runner.report("agp.add", n, m.iterations * n, m.totalNs);
+}
+
+void benchAlertRules(BenchRunner &runner)
+{
+    if (!runner.wants("alerts.rules.evaluate")) {
+        return;
+    }
+    
+    // A day of readings every five minutes that dip below the low
+    // threshold and climb past the high one, with noise that would cross
+    // each threshold several times without hysteresis. Each alert is
+    // withdrawn by the engine once its condition has cleared.
+    const int readingsPerDay = 288;
+    double readings[readingsPerDay];
+    for (int i = 0; i < readingsPerDay; ++i) {
+        readings[i] = 7.25 + 3.5 * qSin(i * 2.0 * M_PI / 96.0) + ((i * 37) % 7 - 3) * 0.05;
+    }
+    
+    const Timestamp start = Timestamp::now();
+    AlertRuleEngine engine;
+    int raised = 0;
+    auto evaluateDay = [&]() {
+        engine.reset();
+        raised = 0;
+        for (int i = 0; i < readingsPerDay; ++i) {
+            const Timestamp now = start.addSecs(i * 300);
+            AlertRuleEngine::Sample sample;
+            sample.set(AlertRuleEngine::Glucose, readings[i]);
+            sample.set(AlertRuleEngine::GlucoseRate, (readings[i] - readings[qMax(0, i - 1)]) / 5.0);
+            sample.set(AlertRuleEngine::InsulinRemaining, 300.0 - i * 0.5);
+            sample.set(AlertRuleEngine::BatteryLevel, 100 - i / 4);
+            
+            const AlertRuleEngine::Changes changes = engine.evaluate(sample, now);
+            raised += qPopulationCount(changes.raised);
+        }
+    };
+    
+    // Three lows and three highs in the day, each raised once
+    evaluateDay();
+    if (raised != 6) {
+        runner.fail(QString("alerts.rules.evaluate raised %1 alerts, expected 6").arg(raised));
+    }
+    
+    // An acknowledged urgent low is snoozed; the low alert shows meanwhile
+    // and makes way again when the snooze runs out
+    engine.reset();
+    AlertRuleEngine::Sample low;
+    low.set(AlertRuleEngine::Glucose, 2.8);
+    engine.evaluate(low, start);
+    engine.acknowledge(AlertRuleEngine::UrgentLowGlucose, start);
+    engine.evaluate(low, start.addSecs(300));
+    if (!engine.isShown(AlertRuleEngine::LowGlucose)) {
+        runner.fail("alerts.rules.evaluate hid the low alert while the urgent low was snoozed");
+    }
+    engine.evaluate(low, start.addSecs(20 * 60));
+    if (!engine.isShown(AlertRuleEngine::UrgentLowGlucose) || engine.isShown(AlertRuleEngine::LowGlucose)) {
+        runner.fail("alerts.rules.evaluate did not bring the urgent low back after its snooze");
+    }
+    
+    Measurement m = measure([&]() {
+        evaluateDay();
+        sink = sink + raised;
+    });
+    
+    QJsonObject extra;
+    extra["raised"] = raised;
+    runner.report("alerts.rules.evaluate", readingsPerDay, m.iterations * readingsPerDay, m.totalNs, extra);
+}
+
+void benchAlertQueue(BenchRunner &runner)
+{
+    if (!runner.wants("alerts.queue.storm")) {
+        return;
+    }
+    
+    // A storm of warnings cycling through more distinct messages than the
+    // queue holds, with a critical alert every thousandth post. Without an
+    // event loop the delivery timer never fires, so after the first alert
+    // everything but the critical ones stays queued.
+    const int posts = 100000;
+    const int distinct = 100;
+    QStringList messages;
+    for (int i = 0; i < distinct; ++i) {
+        messages.append(QString("Warning %1").arg(i));
+    }
+    
+    AlertQueue queue;
+    int delivered = 0;
+    int critical = 0;
+    QObject::connect(&queue, &AlertQueue::alertReady, [&](const QString &, PumpModel::AlertLevel level, int) {
+        ++delivered;
+        if (level == PumpModel::Critical) {
+            ++critical;
+        }
+    });
+    
+    qint64 ns = measureOnce([&]() {
+        for (int i = 0; i < posts; ++i) {
+            if (i % 1000 == 999) {
+                queue.post("Occlusion detected", PumpModel::Critical);
+            } else {
+                queue.post(messages.at(i % distinct), PumpModel::Warning);
+            }
+        }
+    });
+    
+    if (critical != posts / 1000) {
+        runner.fail(QString("alerts.queue.storm delivered %1 of %2 critical alerts").arg(critical).arg(posts / 1000));
+    }
+    if (queue.pendingCount() > AlertQueue::Capacity) {
+        runner.fail(QString("alerts.queue.storm holds %1 alerts").arg(queue.pendingCount()));
+    }
+    
+    queue.flush();
+    
+    QJsonObject extra;
+    extra["delivered"] = delivered;
+    extra["dropped"] = queue.droppedCount();
+    runner.report("alerts.queue.storm", posts, posts, ns, extra);
+}
+
+void benchSimulationTick(BenchRunner &runner, const QString &directory)
+{
+    if (!runner.wants("tick.steadyState")) {
+        return;
+    }
+    
+    // The controller keeps its logs and settings under the home directory;
+    // point it at the scratch directory rather than the real one
+    qputenv("HOME", directory.toLocal8Bit());
+    
+    // PumpController's own slots, called the way its timers drive them:
+    // delivery pulses every 5 second tick, IOB every minute, and battery
+    // drain, a CGM reading, alert checks and a Control-IQ cycle every five
+    // minutes. A fixed simulation clock is stepped by each tick.
+    SimulationClock::setFixedTime(Timestamp::now());
+    
+    PumpController controller;
+    controller.startPump();
+    
+    int alerts = 0;
+    QObject::connect(controller.getAlertController(), &AlertController::ruleAlertRaised,
+                     [&alerts](const QString &, const QString &, PumpModel::AlertLevel) {
+        ++alerts;
+    });
+    
+    // Glucose wanders slowly through the target range and the reservoir and
+    // battery are topped up, so no alerts fire. CGM readings come in
+    // through the test panel's entry point rather than the random walk, so
+    // every run sees the same values. In the low glucose phase it is held
+    // below the suspend threshold instead.
+    qint64 tickCount = 0;
+    bool lowGlucose = false;
+    auto tick = [&]() {
+        SimulationClock::advance(5000);
+        ++tickCount;
+        
+        controller.updateBasalConsumption();
+        if (controller.getInsulinRemaining() < 100.0) {
+            controller.updateInsulinRemaining(300.0);
+        }
+        
+        if (tickCount % 12 == 0) {
+            controller.updateInsulinOnBoard();
+        }
+        
+        if (tickCount % 60 == 0) {
+            controller.simulateBatteryDrain();
+            if (controller.getBatteryLevel() < 50) {
+                controller.updateBatteryLevel(100);
+            }
+            
+            controller.updateGlucoseLevel(lowGlucose ? 3.5 : 6.5 + 1.5 * qSin(tickCount / 3600.0));
+            controller.runControlIQ();
+        }
+    };
+    
+    // Two simulated days fill every bounded history past its first trim
+    for (int i = 0; i < 2 * 24 * 720; ++i) {
+        tick();
+    }
+    
+    // A 5 U standard bolus takes five minutes at the standard rate; the
+    // minute alert checks over the next twelve must not take that for an
+    // overrun
+    if (!controller.deliverBolus(5.0)) {
+        runner.fail("tick.steadyState could not deliver a 5 U bolus");
+    }
+    for (int i = 0; i < 12 * 12; ++i) {
+        tick();
+        if (tickCount % 12 == 0) {
+            controller.getAlertController()->checkMiscAlerts();
+        }
+    }
+    if (alerts > 0) {
+        runner.fail(QString("tick.steadyState raised %1 alerts during a 5 U bolus").arg(alerts));
+        alerts = 0;
+    }
+    
+    // Steady state: the growing histories have room for the whole run
+    const qint64 ticks = runner.sizes().last();
+    controller.reserveHistory(static_cast<int>(ticks / 720 + 1));
+    
+    AllocationCounter::start();
+    const qint64 ns = measureOnce([&]() {
+        for (qint64 i = 0; i < ticks; ++i) {
+            tick();
+        }
+    });
+    const quint64 allocations = AllocationCounter::stop();
+    
+    QJsonObject extra;
+    extra["allocations"] = static_cast<qint64>(allocations);
+    extra["counts_malloc"] = AllocationCounter::countsMalloc();
+    extra["alerts"] = alerts;
+    runner.report("tick.steadyState", ticks, ticks, ns, extra);
+    
+    if (alerts > 0) {
+        runner.fail(QString("tick.steadyState raised %1 alerts").arg(alerts));
+    }
+    if (allocations > 0) {
+        runner.fail(QString("tick.steadyState allocated %1 times in %2 ticks").arg(allocations).arg(ticks));
+    }
+    
+    // Low glucose: the first hour raises the low alerts and Control-IQ
+    // suspends basal and logs it. Every cycle after that finds basal
+    // suspended again, and must neither log, alert nor allocate.
+    lowGlucose = true;
+    for (int i = 0; i < 720; ++i) {
+        tick();
+    }
+    alerts = 0;
+    controller.reserveHistory(static_cast<int>(ticks / 720 + 1));
+    
+    AllocationCounter::start();
+    const qint64 lowNs = measureOnce([&]() {
+        for (qint64 i = 0; i < ticks; ++i) {
+            tick();
+        }
+    });
+    const quint64 lowAllocations = AllocationCounter::stop();
+    
+    controller.stopPump();
+    SimulationClock::reset();
+    
+    QJsonObject lowExtra;
+    lowExtra["allocations"] = static_cast<qint64>(lowAllocations);
+    lowExtra["counts_malloc"] = AllocationCounter::countsMalloc();
+    lowExtra["alerts"] = alerts;
+    runner.report("tick.steadyState.lowGlucose", ticks, ticks, lowNs, lowExtra);
+    
+    if (alerts > 0) {
+        runner.fail(QString("tick.steadyState.lowGlucose raised %1 alerts").arg(alerts));
+    }
+    if (lowAllocations > 0) {
+        runner.fail(QString("tick.steadyState.lowGlucose allocated %1 times in %2 ticks")
+                        .arg(lowAllocations).arg(ticks));
+    }
+}
+
+void benchGraphView(BenchRunner &runner)
+{
+    if (!runner.wants("graph.paint")) {
+        return;
+    }
+    
+    // 48 hours, 30 days and one year of readings
+    for (int hours : {48, 24 * 30, 24 * 365}) {
+        const int n = hours * 12;
+        
+        GraphView view;
+        view.resize(800, 300);
+        view.setGlucoseSeries(makeGlucoseSeries(n));
+        view.setTimeRangeHours(hours);
+        view.setTimeRange(QDateTime::currentDateTime().addSecs(-hours * 3600LL), QDateTime::currentDateTime());
+        
+        QImage image(view.size(), QImage::Format_ARGB32_Premultiplied);
+        Measurement m = measure([&]() {
+            view.render(&image);
+        });
+        
+        QJsonObject extra;
+        extra["hours"] = hours;
+        runner.report("graph.paint", n, m.iterations, m.totalNs, extra);
+    }
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    // GraphView needs a QApplication, but not a display
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    
+    QApplication app(argc, argv);
+    
+    QStringList args = app.arguments();
+    bool quick = args.contains("--quick");
+    QString filter;
+    QString outputFile;
+    
+    int filterIndex = args.indexOf("--filter");
+    if (filterIndex >= 0 && filterIndex + 1 < args.size()) {
+        filter = args.at(filterIndex + 1);
+    }
+    
+    int outputIndex = args.indexOf("--output");
+    if (outputIndex >= 0 && outputIndex + 1 < args.size()) {
+        outputFile = args.at(outputIndex + 1);
+    }
+    
+    QTemporaryDir tempDir;
+    if (!tempDir.isValid()) {
+        fprintf(stderr, "Could not create a temporary directory\n");
+        return 1;
+    }
+    
+    BenchRunner runner(quick, filter);
+    benchGlucoseModel(runner);
+    benchInsulinModel(runner);
+    benchDataStorage(runner, tempDir.path());
+    benchStatistics(runner, tempDir.path());
+    benchControlIQ(runner);
+    benchProfileSchedule(runner);
+    benchDeliveryEngine(runner);
+    benchReminderScheduler(runner);
+    benchAgpEngine(runner);
+    benchAlertRules(runner);
+    benchAlertQueue(runner);
+    benchSimulationTick(runner, tempDir.path());
+    benchGraphView(runner);
+    
+    QJsonObject root;
+    root["suite"] = "tslimx2bench";
+    root["qt_version"] = QString(qVersion());
+    root["timestamp"] = QDateTime::currentDateTime().toString(Qt::ISODate);
+    root["quick"] = quick;
+    root["results"] = runner.results;
+    root["failures"] = QJsonArray::fromStringList(runner.failures);
+    
+    QByteArray json = QJsonDocument(root).toJson();
+    const int status = runner.failures.isEmpty() ? 0 : 1;
+    
+    if (outputFile.isEmpty()) {
+        fwrite(json.constData(), 1, json.size(), stdout);
+        return status;
+    }
+    
+    QFile file(outputFile);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        fprintf(stderr, "Could not write %s\n", qPrintable(outputFile));
+        return 1;
+    }
+    file.write(json);
+    return status;
+}
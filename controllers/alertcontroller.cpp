@@ -7,16 +7,14 @@ AlertController::AlertController(QObject *parent)
       pumpModel(nullptr),
       glucoseModel(nullptr),
       insulinModel(nullptr),
-      lowGlucoseThreshold(3.9),
-      highGlucoseThreshold(10.0),
-      urgentLowGlucoseThreshold(3.1),
-      urgentHighGlucoseThreshold(13.9),
-      lowInsulinThreshold(50.0),
-      criticalLowInsulinThreshold(10.0),
-      lowBatteryThreshold(20),
-      criticalLowBatteryThreshold(5),
       alertsEnabled(true)
 {
+    // Alerts reach the screens through a rate-limited queue
+    alertQueue = new AlertQueue(this);
+    connect(alertQueue, &AlertQueue::alertReady, this, [this](const QString &message, PumpModel::AlertLevel level, int) {
+        emit alertAdded(message, level);
+    });
+    
     // Setup alert monitoring timer
     alertTimer = new QTimer(this);
     connect(alertTimer, &QTimer::timeout, this, [this]() {
@@ -66,11 +64,11 @@ void AlertController::addAlert(const QString &message, PumpModel::AlertLevel lev
     }
     
     // Add to active alerts
-    activeAlerts.append(qMakePair(message, level));
-    alertTimes.append(QDateTime::currentDateTime());
+    activeAlerts.append({-1, message, level, Timestamp::now()});
+    activeMessages.insert(message);
     
     // Notify
-    emit alertAdded(message, level);
+    alertQueue->post(message, level);
     
     // For critical alerts, emit special signal
     if (level == PumpModel::Critical) {
@@ -81,7 +79,7 @@ void AlertController::addAlert(const QString &message, PumpModel::AlertLevel lev
     if (autoAcknowledge && level == PumpModel::Info) {
         QTimer::singleShot(5000, this, [this, message]() {
             for (int i = 0; i < activeAlerts.size(); ++i) {
-                if (activeAlerts[i].first == message) {
+                if (activeAlerts[i].rule < 0 && activeAlerts[i].message == message) {
                     acknowledgeAlert(i);
                     break;
                 }
@@ -96,9 +94,16 @@ bool AlertController::acknowledgeAlert(int index)
         return false;
     }
     
+    // A rule alert is snoozed while its condition holds
+    const ActiveAlert &alert = activeAlerts.at(index);
+    if (alert.rule >= 0) {
+        rules.acknowledge(static_cast<AlertRuleEngine::Rule>(alert.rule), Timestamp::now());
+    } else {
+        activeMessages.remove(alert.message);
+    }
+    
     // Remove from active alerts
     activeAlerts.removeAt(index);
-    alertTimes.removeAt(index);
     
     emit alertAcknowledged(index);
     
@@ -107,15 +112,24 @@ bool AlertController::acknowledgeAlert(int index)
 
 void AlertController::acknowledgeAllAlerts()
 {
+    rules.acknowledgeAll(Timestamp::now());
     activeAlerts.clear();
-    alertTimes.clear();
+    activeMessages.clear();
     
     emit allAlertsAcknowledged();
 }
 
 QVector<QPair<QString, PumpModel::AlertLevel>> AlertController::getActiveAlerts() const
 {
-    return activeAlerts;
+    QVector<QPair<QString, PumpModel::AlertLevel>> result;
+    result.reserve(activeAlerts.size());
+    for (const ActiveAlert &alert : activeAlerts) {
+        const QString message = alert.rule >= 0
+            ? rules.message(static_cast<AlertRuleEngine::Rule>(alert.rule))
+            : alert.message;
+        result.append(qMakePair(message, alert.level));
+    }
+    return result;
 }
 
 bool AlertController::hasActiveAlerts() const
@@ -125,8 +139,8 @@ bool AlertController::hasActiveAlerts() const
 
 bool AlertController::hasCriticalAlerts() const
 {
-    for (const auto &alert : activeAlerts) {
-        if (alert.second == PumpModel::Critical) {
+    for (const ActiveAlert &alert : activeAlerts) {
+        if (alert.level == PumpModel::Critical) {
             return true;
         }
     }
@@ -136,22 +150,22 @@ bool AlertController::hasCriticalAlerts() const
 
 void AlertController::setGlucoseAlertThresholds(double lowThreshold, double highThreshold, double urgentLowThreshold, double urgentHighThreshold)
 {
-    lowGlucoseThreshold = lowThreshold;
-    highGlucoseThreshold = highThreshold;
-    urgentLowGlucoseThreshold = urgentLowThreshold;
-    urgentHighGlucoseThreshold = urgentHighThreshold;
+    rules.setThreshold(AlertRuleEngine::LowGlucose, lowThreshold);
+    rules.setThreshold(AlertRuleEngine::HighGlucose, highThreshold);
+    rules.setThreshold(AlertRuleEngine::UrgentLowGlucose, urgentLowThreshold);
+    rules.setThreshold(AlertRuleEngine::UrgentHighGlucose, urgentHighThreshold);
 }
 
 void AlertController::setInsulinAlertThresholds(double lowInsulinThreshold, double criticalLowInsulinThreshold)
 {
-    this->lowInsulinThreshold = lowInsulinThreshold;
-    this->criticalLowInsulinThreshold = criticalLowInsulinThreshold;
+    rules.setThreshold(AlertRuleEngine::LowInsulin, lowInsulinThreshold);
+    rules.setThreshold(AlertRuleEngine::CriticalInsulin, criticalLowInsulinThreshold);
 }
 
 void AlertController::setBatteryAlertThresholds(int lowBatteryThreshold, int criticalLowBatteryThreshold)
 {
-    this->lowBatteryThreshold = lowBatteryThreshold;
-    this->criticalLowBatteryThreshold = criticalLowBatteryThreshold;
+    rules.setThreshold(AlertRuleEngine::LowBattery, lowBatteryThreshold);
+    rules.setThreshold(AlertRuleEngine::CriticalBattery, criticalLowBatteryThreshold);
 }
 
 void AlertController::enableAlerts(bool enable)
@@ -180,33 +194,11 @@ void AlertController::checkGlucoseAlerts()
         return;
     }
     
-    double currentGlucose = glucoseModel->getCurrentGlucose();
-    
-    // Check for urgent low glucose (highest priority)
-    if (currentGlucose <= urgentLowGlucoseThreshold) {
-        addAlert("URGENT LOW GLUCOSE: " + QString::number(currentGlucose, 'f', 1) + " mmol/L", PumpModel::Critical);
-    }
-    // Check for low glucose
-    else if (currentGlucose < lowGlucoseThreshold) {
-        addAlert("Low glucose: " + QString::number(currentGlucose, 'f', 1) + " mmol/L", PumpModel::Warning);
-    }
-    // Check for urgent high glucose
-    else if (currentGlucose >= urgentHighGlucoseThreshold) {
-        addAlert("URGENT HIGH GLUCOSE: " + QString::number(currentGlucose, 'f', 1) + " mmol/L", PumpModel::Critical);
-    }
-    // Check for high glucose
-    else if (currentGlucose > highGlucoseThreshold) {
-        addAlert("High glucose: " + QString::number(currentGlucose, 'f', 1) + " mmol/L", PumpModel::Warning);
-    }
-    
-    // Check for rapid changes in glucose
-    GlucoseModel::TrendDirection trend = glucoseModel->getTrendDirection();
-    
-    if (trend == GlucoseModel::RisingQuickly) {
-        addAlert("Glucose rising quickly", PumpModel::Warning);
-    } else if (trend == GlucoseModel::FallingQuickly) {
-        addAlert("Glucose falling quickly", PumpModel::Warning);
-    }
+    // Level and rapid change rules in one pass
+    AlertRuleEngine::Sample sample;
+    sample.set(AlertRuleEngine::Glucose, glucoseModel->getCurrentGlucose());
+    sample.set(AlertRuleEngine::GlucoseRate, glucoseModel->getRateOfChange());
+    evaluate(sample);
 }
 
 void AlertController::checkInsulinAlerts()
@@ -215,16 +207,9 @@ void AlertController::checkInsulinAlerts()
         return;
     }
     
-    double insulinRemaining = pumpModel->getInsulinRemaining();
-    
-    // Check for critically low insulin
-    if (insulinRemaining <= criticalLowInsulinThreshold) {
-        addAlert("INSULIN CRITICALLY LOW: " + QString::number(insulinRemaining, 'f', 1) + " units remaining", PumpModel::Critical);
-    }
-    // Check for low insulin
-    else if (insulinRemaining <= lowInsulinThreshold) {
-        addAlert("Insulin low: " + QString::number(insulinRemaining, 'f', 1) + " units remaining", PumpModel::Warning);
-    }
+    AlertRuleEngine::Sample sample;
+    sample.set(AlertRuleEngine::InsulinRemaining, pumpModel->getInsulinRemaining());
+    evaluate(sample);
 }
 
 void AlertController::checkBatteryAlerts()
@@ -233,16 +218,9 @@ void AlertController::checkBatteryAlerts()
         return;
     }
     
-    int batteryLevel = pumpModel->getBatteryLevel();
-    
-    // Check for critically low battery
-    if (batteryLevel <= criticalLowBatteryThreshold) {
-        addAlert("BATTERY CRITICALLY LOW: " + QString::number(batteryLevel) + "% remaining", PumpModel::Critical);
-    }
-    // Check for low battery
-    else if (batteryLevel <= lowBatteryThreshold) {
-        addAlert("Battery low: " + QString::number(batteryLevel) + "% remaining", PumpModel::Warning);
-    }
+    AlertRuleEngine::Sample sample;
+    sample.set(AlertRuleEngine::BatteryLevel, pumpModel->getBatteryLevel());
+    evaluate(sample);
 }
 
 void AlertController::checkMiscAlerts()
@@ -251,33 +229,68 @@ void AlertController::checkMiscAlerts()
         return;
     }
     
-    // Check for CGM data gap (no readings for over 10 mins)
-    QDateTime lastReadingTime = glucoseModel->getLastReadingTime();
-    if (lastReadingTime.isValid() && lastReadingTime.secsTo(QDateTime::currentDateTime()) > 600) {
-        addAlert("CGM data gap: No readings for " + 
-                 QString::number(lastReadingTime.secsTo(QDateTime::currentDateTime()) / 60) + 
-                 " minutes", PumpModel::Warning);
-    }
+    AlertRuleEngine::Sample sample;
+    
+    // CGM data gap
+    const Timestamp now = Timestamp::now();
+    sample.set(AlertRuleEngine::CgmGapMinutes, glucoseModel->getLastReadingTimestamp().secsTo(now) / 60.0);
     
-    // Check for active bolus that's running longer than expected
+    // Active bolus running longer than expected. The immediate part goes
+    // out at the pump's standard rate and the extended part follows over
+    // its duration; a combo bolus's split is not kept, so its expected
+    // time counts all of it at the standard rate. Boluses are timed on the
+    // pump's clock.
+    double overrunMinutes = 0.0;
     if (insulinModel->isBolusActive()) {
         InsulinModel::BolusDelivery currentBolus = insulinModel->getCurrentBolus();
-        int expectedDuration = currentBolus.extended ? currentBolus.duration : 1; // 1 minute for standard bolus
-        
-        // If bolus is running more than 2 minutes longer than expected
-        if (currentBolus.timestamp.secsTo(QDateTime::currentDateTime()) > (expectedDuration + 2) * 60) {
-            addAlert("Bolus delivery taking longer than expected", PumpModel::Warning);
+        double expectedDuration = currentBolus.units / DeliveryEngine::StandardBolusUnitsPerMinute;
+        if (currentBolus.extended) {
+            expectedDuration += currentBolus.duration;
         }
+        const Timestamp started = Timestamp::fromDateTime(currentBolus.timestamp);
+        overrunMinutes = started.secsTo(insulinModel->getCurrentTime()) / 60.0 - expectedDuration;
     }
+    sample.set(AlertRuleEngine::BolusOverrunMinutes, overrunMinutes);
+    
+    evaluate(sample);
 }
 
-bool AlertController::isAlertActive(const QString &message) const
+void AlertController::evaluate(const AlertRuleEngine::Sample &sample)
 {
-    for (const auto &alert : activeAlerts) {
-        if (alert.first == message) {
-            return true;
+    const Timestamp now = Timestamp::now();
+    const AlertRuleEngine::Changes changes = rules.evaluate(sample, now);
+    
+    // Alerts whose condition cleared or that a more severe one of their
+    // group replaced
+    if (changes.withdrawn) {
+        for (int i = activeAlerts.size() - 1; i >= 0; --i) {
+            const int rule = activeAlerts.at(i).rule;
+            if (rule >= 0 && (changes.withdrawn & (1u << rule))) {
+                activeAlerts.removeAt(i);
+                emit alertAcknowledged(i);
+            }
         }
     }
     
-    return false;
+    for (int rule = 0; rule < AlertRuleEngine::RuleCount; ++rule) {
+        if (!(changes.raised & (1u << rule))) {
+            continue;
+        }
+        
+        const AlertRuleEngine::Definition &definition = rules.definition(static_cast<AlertRuleEngine::Rule>(rule));
+        activeAlerts.append({rule, QString(), definition.level, now});
+        
+        const QString message = rules.message(static_cast<AlertRuleEngine::Rule>(rule));
+        alertQueue->post(message, definition.level);
+        emit ruleAlertRaised(message, QString::fromLatin1(definition.source), definition.level);
+        
+        if (definition.level == PumpModel::Critical) {
+            emit criticalAlertActive(message);
+        }
+    }
+}
+
+bool AlertController::isAlertActive(const QString &message) const
+{
+    return activeMessages.contains(message);
 }
@@ -5,10 +5,14 @@
 #include <QTimer>
 #include <QVector>
 #include <QPair>
+#include <QSet>
 #include <QDateTime>
 #include "../models/pumpmodel.h"
 #include "../models/glucosemodel.h"
 #include "../models/insulinmodel.h"
+#include "../utils/timestamp.h"
+#include "../utils/alertruleengine.h"
+#include "../utils/alertqueue.h"
 
 class AlertController : public QObject
 {
@@ -48,35 +52,41 @@ public slots:
     void checkMiscAlerts();
     
 signals:
+    // Rate-limited (see AlertQueue); Critical alerts are never held back
     void alertAdded(const QString &message, PumpModel::AlertLevel level);
     void alertAcknowledged(int index);
     void allAlertsAcknowledged();
     void criticalAlertActive(const QString &message);
     
+    // An alert from the rule table came up; source names the component it
+    // concerns, for the error log
+    void ruleAlertRaised(const QString &message, const QString &source, PumpModel::AlertLevel level);
+
 private:
+    // Rule alerts keep only their rule; the message is formatted when the
+    // alerts are read
+    struct ActiveAlert {
+        int rule;         // AlertRuleEngine::Rule, or -1 if added by message
+        QString message;  // Alerts added by message only
+        PumpModel::AlertLevel level;
+        Timestamp time;
+    };
+    
     PumpModel *pumpModel;
     GlucoseModel *glucoseModel;
     InsulinModel *insulinModel;
     
-    QVector<QPair<QString, PumpModel::AlertLevel>> activeAlerts;
-    QVector<QDateTime> alertTimes;
-    
-    double lowGlucoseThreshold;
-    double highGlucoseThreshold;
-    double urgentLowGlucoseThreshold;
-    double urgentHighGlucoseThreshold;
-    
-    double lowInsulinThreshold;
-    double criticalLowInsulinThreshold;
-    
-    int lowBatteryThreshold;
-    int criticalLowBatteryThreshold;
+    AlertRuleEngine rules;
+    QVector<ActiveAlert> activeAlerts;
+    QSet<QString> activeMessages;
+    AlertQueue *alertQueue;
     
     bool alertsEnabled;
     
     QTimer *alertTimer;
     
     bool isAlertActive(const QString &message) const;
+    void evaluate(const AlertRuleEngine::Sample &sample);
 };
 
 #endif // ALERTCONTROLLER_H
@@ -1,4 +1,5 @@
 #include "boluscontroller.h"
+#include "../utils/timestamp.h"
 
 BolusController::BolusController(QObject *parent)
     : QObject(parent),
@@ -37,17 +38,19 @@ double BolusController::calculateSuggestedBolus(double glucoseValue, double carb
         return 0.0;
     }
     
-    // Get active profile
-    Profile activeProfile = profileModel->getActiveProfile();
+    // Active profile settings for this time of day on the pump's clock
+    const ProfileSetSnapshot profiles = profileModel->getSnapshot();
+    const ProfileSchedule::Slot &settings =
+        profiles->activeSchedule().at(insulinModel->getCurrentTime().toDateTime());
     
     // Calculate carb bolus
-    double carbBolus = calculateCarbBolus(carbAmount, activeProfile.carbRatio);
+    double carbBolus = calculateCarbBolus(carbAmount, settings.carbRatio);
     
     // Calculate correction bolus
     double correctionBolus = calculateCorrectionBolus(
         glucoseValue, 
-        activeProfile.targetGlucose, 
-        activeProfile.correctionFactor
+        settings.targetGlucose, 
+        settings.correctionFactor
     );
     
     // Total bolus
@@ -181,24 +184,24 @@ QVector<InsulinModel::BolusDelivery> BolusController::getRecentBoluses(int count
         return QVector<InsulinModel::BolusDelivery>();
     }
     
-    QDateTime now = QDateTime::currentDateTime();
-    QDateTime startTime = now.addDays(-7); // Get boluses from last 7 days
+    // Boluses are timed on the pump's clock
+    const Timestamp now = insulinModel->getCurrentTime();
+    const qint64 startTime = now.addSecs(-7 * 24 * 3600).toMSecsSinceEpoch(); // Get boluses from last 7 days
     
-    QVector<InsulinModel::BolusDelivery> allBoluses = 
-        insulinModel->getBolusHistory(startTime, now);
-    
-    // Sort by timestamp (most recent first)
-    std::sort(allBoluses.begin(), allBoluses.end(), 
-              [](const InsulinModel::BolusDelivery &a, const InsulinModel::BolusDelivery &b) {
-                  return a.timestamp > b.timestamp;
-              });
-    
-    // Return requested number of boluses
-    if (count > 0 && allBoluses.size() > count) {
-        return allBoluses.mid(0, count);
+    // The history is sorted oldest first, so walk it backwards for most recent first
+    const QVector<InsulinModel::BolusRecord> &history = insulinModel->getAllBoluses();
+    QVector<InsulinModel::BolusDelivery> recentBoluses;
+    for (int i = history.size() - 1; i >= 0; --i) {
+        const InsulinModel::BolusRecord &bolus = history.at(i);
+        if (bolus.timestamp < startTime || (count > 0 && recentBoluses.size() >= count)) {
+            break;
+        }
+        if (bolus.timestamp <= now.toMSecsSinceEpoch()) {
+            recentBoluses.append(bolus.toDelivery());
+        }
     }
     
-    return allBoluses;
+    return recentBoluses;
 }
 
 bool BolusController::validateSettings()
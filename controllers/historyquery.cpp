@@ -0,0 +1,160 @@
+#include "historyquery.h"
+#include <QMetaObject>
+
+HistoryQueryRunner::HistoryQueryRunner(QObject *parent)
+    : QObject(parent),
+      generation(0),
+      pendingGeneration(0)
+{
+    // History queries are bursty and short; two workers is plenty and keeps
+    // them from competing with the simulation for the global pool
+    pool.setMaxThreadCount(2);
+}
+
+HistoryQueryRunner::~HistoryQueryRunner()
+{
+    // Workers capture this, so they must be gone before we are
+    cancel();
+    pool.waitForDone();
+}
+
+quint64 HistoryQueryRunner::submit(const HistorySnapshot &snapshot, const QDateTime &start, const QDateTime &end)
+{
+    // Supersede whatever is still running
+    activeToken.cancel();
+    activeToken = CancellationToken();
+    
+    const quint64 queryGeneration = ++generation;
+    pendingGeneration = queryGeneration;
+    const CancellationToken token = activeToken;
+    
+    // Sampled here: the simulation clock belongs to the GUI thread
+    const QDateTime now = Timestamp::now().toDateTime();
+    
+    pool.start([this, snapshot, start, end, now, token, queryGeneration]() {
+        const InsulinHistory insulinHistory =
+            buildInsulinHistory(snapshot.boluses, snapshot.basalSegments, start, end, token);
+        if (token.isCancelled()) {
+            return;
+        }
+        
+        const EventHistory events = buildEventHistory(start, end, now);
+        if (token.isCancelled()) {
+            return;
+        }
+        
+        // Hand the results back to the GUI thread; drop them there if a
+        // newer query was submitted in the meantime
+        QMetaObject::invokeMethod(this, [this, insulinHistory, events, queryGeneration]() {
+            if (queryGeneration != generation) {
+                return;
+            }
+            
+            pendingGeneration = 0;
+            emit insulinHistoryReady(queryGeneration, insulinHistory);
+            emit eventHistoryReady(queryGeneration, events);
+            emit queryFinished(queryGeneration);
+        }, Qt::QueuedConnection);
+    });
+    
+    return queryGeneration;
+}
+
+void HistoryQueryRunner::cancel()
+{
+    activeToken.cancel();
+    pendingGeneration = 0;
+    
+    // Invalidate results that are already queued
+    ++generation;
+}
+
+InsulinHistory HistoryQueryRunner::buildInsulinHistory(
+    const QVector<InsulinModel::BolusRecord> &boluses,
+    const QVector<InsulinModel::BasalRecord> &basalSegments,
+    const QDateTime &start,
+    const QDateTime &end,
+    const CancellationToken &token)
+{
+    InsulinHistory result;
+    int checked = 0;
+    
+    // Bolus deliveries and hourly basal samples come out of the cursor
+    // already in time order
+    for (InsulinHistoryCursor cursor(boluses, basalSegments, start, end); !cursor.atEnd(); cursor.next()) {
+        if ((++checked & 0x3ff) == 0 && token.isCancelled()) {
+            return InsulinHistory();
+        }
+        
+        const InsulinHistoryCursor::Entry &entry = cursor.current();
+        result.entries.append(entry);
+        result.series.append(entry.timestamp.toMSecsSinceEpoch(), entry.value);
+    }
+    
+    if (token.isCancelled()) {
+        return InsulinHistory();
+    }
+    
+    return result;
+}
+
+EventHistory HistoryQueryRunner::buildEventHistory(const QDateTime &start, const QDateTime &end, const QDateTime &now)
+{
+    EventHistory events;
+    
+    // A Control-IQ decision every hour
+    for (int i = 0; i < 10; i++) {
+        const QDateTime timestamp = now.addSecs(-i * 3600);
+        if (timestamp < start || timestamp > end) {
+            continue;
+        }
+        
+        EventHistory::ControlIQEvent event;
+        event.time = Timestamp::fromDateTime(timestamp);
+        event.action = (i % 3 == 0) ? "Decreased Basal" : (i % 3 == 1) ? "Increased Basal" : "No Change";
+        event.reason = (i % 3 == 0) ? "Glucose Trending Down" :
+                       (i % 3 == 1) ? "Glucose Trending Up" : "Stable Glucose";
+        event.adjustment = (i % 3 == 0) ? -0.1 - (i % 5) * 0.1 :
+                           (i % 3 == 1) ? 0.1 + (i % 5) * 0.1 : 0.0;
+        events.controlIQ.append(event);
+    }
+    
+    // An alert every two hours
+    const QStringList alertMessages = {
+        "Low Glucose: 3.2 mmol/L",
+        "High Glucose: 13.8 mmol/L",
+        "Insulin Reservoir Low",
+        "Battery Low: 15%",
+        "CGM Signal Lost",
+        "Basal Delivery Suspended"
+    };
+    
+    const QStringList alertLevels = {
+        "Warning",
+        "Warning",
+        "Info",
+        "Warning",
+        "Warning",
+        "Critical"
+    };
+    
+    const QVector<QColor> alertColors = {
+        QColor(255, 59, 48),   // Red for critical/low glucose
+        QColor(255, 149, 0),   // Orange for high glucose
+        QColor(255, 255, 255), // White for info
+        QColor(255, 204, 0),   // Yellow for warnings
+        QColor(255, 204, 0),   // Yellow for warnings
+        QColor(255, 59, 48)    // Red for critical
+    };
+    
+    for (int i = 0; i < alertMessages.size(); i++) {
+        const QDateTime timestamp = now.addSecs(-i * 7200);
+        if (timestamp < start || timestamp > end) {
+            continue;
+        }
+        
+        events.alerts.append({Timestamp::fromDateTime(timestamp), alertMessages[i], alertLevels[i], alertColors[i]});
+    }
+    
+    return events;
+}
@@ -0,0 +1,108 @@
+#ifndef HISTORYQUERY_H
+#define HISTORYQUERY_H
+
+#include <QObject>
+#include <QDateTime>
+#include <QVector>
+#include <QPair>
+#include <QAtomicInt>
+#include <QSharedPointer>
+#include <QThreadPool>
+#include <QColor>
+#include "../models/insulinmodel.h"
+#include "../models/insulinhistorycursor.h"
+#include "../utils/timeseriesstore.h"
+#include "../utils/timestamp.h"
+
+// Shared cancel flag handed to a background query; copies refer to the same flag
+class CancellationToken
+{
+public:
+    CancellationToken() : flag(new QAtomicInt(0)) {}
+    
+    void cancel() { flag->storeRelaxed(1); }
+    bool isCancelled() const { return flag->loadRelaxed() != 0; }
+
+private:
+    QSharedPointer<QAtomicInt> flag;
+};
+
+// Copy of the insulin histories a query runs against. The vectors are
+// implicitly shared, so taking a snapshot on the GUI thread is O(1) and the
+// models can keep appending while a worker reads it.
+struct HistorySnapshot {
+    QVector<InsulinModel::BolusRecord> boluses;
+    QVector<InsulinModel::BasalRecord> basalSegments;
+};
+
+// Insulin inside a query's range: the cursor's merged stream for the table
+// and the same (timestamp, units) values as a series for the graph
+struct InsulinHistory {
+    QVector<InsulinHistoryCursor::Entry> entries;  // Time order
+    TimeSeriesStore series;
+};
+
+// Control-IQ decisions and alerts inside a query's range, newest first and
+// ready to be put in the history tables
+struct EventHistory {
+    struct ControlIQEvent {
+        Timestamp time;
+        QString action;
+        QString reason;
+        double adjustment;
+    };
+    
+    struct AlertEvent {
+        Timestamp time;
+        QString message;
+        QString level;
+        QColor color;
+    };
+    
+    QVector<ControlIQEvent> controlIQ;
+    QVector<AlertEvent> alerts;
+};
+
+// Runs history queries on a small private thread pool. Every submit() bumps
+// the generation and cancels the previous query, and results are only
+// delivered (on the GUI thread) if they belong to the latest generation.
+class HistoryQueryRunner : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit HistoryQueryRunner(QObject *parent = nullptr);
+    ~HistoryQueryRunner();
+    
+    quint64 submit(const HistorySnapshot &snapshot, const QDateTime &start, const QDateTime &end);
+    void cancel();
+    quint64 currentGeneration() const { return generation; }
+    bool isBusy() const { return pendingGeneration != 0; }
+    
+    // Merged bolus + hourly basal samples inside [start, end], in time
+    // order (see InsulinHistoryCursor). Returns an empty history if the
+    // token is cancelled part way.
+    static InsulinHistory buildInsulinHistory(
+        const QVector<InsulinModel::BolusRecord> &boluses,
+        const QVector<InsulinModel::BasalRecord> &basalSegments,
+        const QDateTime &start,
+        const QDateTime &end,
+        const CancellationToken &token = CancellationToken());
+    
+    // Control-IQ and alert events inside [start, end]. There is no stored
+    // log of either yet, so these are sample events leading up to now.
+    static EventHistory buildEventHistory(const QDateTime &start, const QDateTime &end, const QDateTime &now);
+
+signals:
+    void insulinHistoryReady(quint64 generation, const InsulinHistory &history);
+    void eventHistoryReady(quint64 generation, const EventHistory &events);
+    void queryFinished(quint64 generation);
+
+private:
+    QThreadPool pool;
+    CancellationToken activeToken;
+    quint64 generation;
+    quint64 pendingGeneration;
+};
+
+#endif // HISTORYQUERY_H
@@ -12,6 +12,15 @@ void ProfileController::setProfileModel(ProfileModel *model)
     profileModel = model;
     
     if (profileModel) {
+        // Keep the adjusted schedules in step with the profiles under them,
+        // before anyone hears about the change
+        connect(profileModel, &ProfileModel::profileCreated, this, &ProfileController::rebuildAdjustedSchedule);
+        connect(profileModel, &ProfileModel::profileUpdated, this, &ProfileController::rebuildAdjustedSchedule);
+        connect(profileModel, &ProfileModel::profileDeleted, this, [this](const QString &name) {
+            timeAdjustments.remove(name);
+            adjustedSchedules.remove(name);
+        });
+        
         connect(profileModel, &ProfileModel::profileCreated, this, &ProfileController::profileCreated);
         connect(profileModel, &ProfileModel::profileUpdated, this, &ProfileController::profileUpdated);
         connect(profileModel, &ProfileModel::profileDeleted, this, &ProfileController::profileDeleted);
@@ -21,6 +30,10 @@ void ProfileController::setProfileModel(ProfileModel *model)
             applyProfileToInsulinDelivery(profile);
             emit profileActivated(name);
         });
+        
+        for (const QString &name : timeAdjustments.keys()) {
+            rebuildAdjustedSchedule(name);
+        }
     }
 }
 
@@ -114,61 +127,38 @@ double ProfileController::calculateBasalRate(const QString &profileName, const Q
         return 0.0;
     }
     
-    // Get base basal rate from profile
-    Profile profile = profileModel->getProfile(profileName);
-    double baseRate = profile.basalRate;
-    
-    // Apply time-based adjustments if any
-    if (timeAdjustments.contains(profileName)) {
-        QTime timeOfDay = time.time();
-        for (const auto &adjustment : timeAdjustments[profileName]) {
-            if ((adjustment.startTime <= timeOfDay && timeOfDay < adjustment.endTime) ||
-                (adjustment.startTime > adjustment.endTime && // Handle overnight adjustments
-                 (timeOfDay >= adjustment.startTime || timeOfDay < adjustment.endTime))) {
-                
-                baseRate = baseRate * (adjustment.basalPercentage / 100.0);
-                break; // Apply only first matching adjustment
-            }
-        }
-    }
-    
-    return baseRate;
+    const ProfileSetSnapshot profiles = profileModel->getSnapshot();
+    return scheduleFor(*profiles, profileName).at(time).basalRate;
 }
 
 double ProfileController::calculateCarbRatio(const QString &profileName, const QDateTime &time) const
 {
-    Q_UNUSED(time);
     if (!profileModel) {
         return 0.0;
     }
     
-    // Get carb ratio from profile (currently we don't support time-based adjustments for this)
-    Profile profile = profileModel->getProfile(profileName);
-    return profile.carbRatio;
+    const ProfileSetSnapshot profiles = profileModel->getSnapshot();
+    return scheduleFor(*profiles, profileName).at(time).carbRatio;
 }
 
 double ProfileController::calculateCorrectionFactor(const QString &profileName, const QDateTime &time) const
 {
-    Q_UNUSED(time);
     if (!profileModel) {
         return 0.0;
     }
     
-    // Get correction factor from profile (currently we don't support time-based adjustments for this)
-    Profile profile = profileModel->getProfile(profileName);
-    return profile.correctionFactor;
+    const ProfileSetSnapshot profiles = profileModel->getSnapshot();
+    return scheduleFor(*profiles, profileName).at(time).correctionFactor;
 }
 
 double ProfileController::calculateTargetGlucose(const QString &profileName, const QDateTime &time) const
 {
-    Q_UNUSED(time);
     if (!profileModel) {
         return 0.0;
     }
     
-    // Get target glucose from profile (currently we don't support time-based adjustments for this)
-    Profile profile = profileModel->getProfile(profileName);
-    return profile.targetGlucose;
+    const ProfileSetSnapshot profiles = profileModel->getSnapshot();
+    return scheduleFor(*profiles, profileName).at(time).targetGlucose;
 }
 
 void ProfileController::setTimeBasedAdjustment(const QString &profileName, const QTime &startTime, const QTime &endTime, double basalPercentage)
@@ -185,6 +175,7 @@ void ProfileController::setTimeBasedAdjustment(const QString &profileName, const
     }
     
     timeAdjustments[profileName].append(adjustment);
+    rebuildAdjustedSchedule(profileName);
     
     // If this is the active profile, reapply it
     if (profileModel && profileName == profileModel->getActiveProfileName()) {
@@ -196,6 +187,7 @@ void ProfileController::clearTimeBasedAdjustments(const QString &profileName)
 {
     if (timeAdjustments.contains(profileName)) {
         timeAdjustments.remove(profileName);
+        adjustedSchedules.remove(profileName);
         
         // If this is the active profile, reapply it
         if (profileModel && profileName == profileModel->getActiveProfileName()) {
@@ -204,6 +196,44 @@ void ProfileController::clearTimeBasedAdjustments(const QString &profileName)
     }
 }
 
+const ProfileSchedule &ProfileController::scheduleFor(const ProfileSet &profiles,
+                                                      const QString &profileName) const
+{
+    auto it = adjustedSchedules.constFind(profileName);
+    if (it != adjustedSchedules.constEnd()) {
+        return it.value();
+    }
+    
+    return profiles.schedule(profileName);
+}
+
+void ProfileController::rebuildAdjustedSchedule(const QString &profileName)
+{
+    if (!profileModel || !timeAdjustments.contains(profileName)) {
+        return;
+    }
+    
+    // Scale each slot by the first adjustment covering its start, so
+    // lookups never have to search the adjustments
+    const QVector<TimeAdjustment> &adjustments = timeAdjustments[profileName];
+    ProfileSchedule schedule = profileModel->getSnapshot()->schedule(profileName);
+    
+    for (int slot = 0; slot < ProfileSchedule::SlotCount; ++slot) {
+        QTime timeOfDay = ProfileSchedule::slotStart(slot);
+        for (const auto &adjustment : adjustments) {
+            if ((adjustment.startTime <= timeOfDay && timeOfDay < adjustment.endTime) ||
+                (adjustment.startTime > adjustment.endTime && // Handle overnight adjustments
+                 (timeOfDay >= adjustment.startTime || timeOfDay < adjustment.endTime))) {
+                
+                schedule.scaleBasal(slot, adjustment.basalPercentage / 100.0);
+                break; // Apply only first matching adjustment
+            }
+        }
+    }
+    
+    adjustedSchedules[profileName] = schedule;
+}
+
 bool ProfileController::applyProfileToInsulinDelivery(const Profile &profile)
 {
     if (!insulinModel) {
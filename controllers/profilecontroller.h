@@ -58,6 +58,12 @@ private:
     
     QMap<QString, QVector<TimeAdjustment>> timeAdjustments;
     
+    // Profile schedules with the adjustments applied, for profiles that
+    // have any; the rest are read straight from the model
+    QMap<QString, ProfileSchedule> adjustedSchedules;
+    
+    const ProfileSchedule &scheduleFor(const ProfileSet &profiles, const QString &profileName) const;
+    void rebuildAdjustedSchedule(const QString &profileName);
     bool applyProfileToInsulinDelivery(const Profile &profile);
 };
 
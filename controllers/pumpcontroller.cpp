@@ -2,13 +2,46 @@
 #include <QDir>
 #include <QDateTime>
 #include <QRandomGenerator>
-#include <QSettings>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QMetaObject>
+#include "../utils/tracing.h"
+#include "../utils/stringpool.h"
+#include "../utils/metrics.h"
+
+namespace {
+
+// Pump time covered by one basal consumption tick
+const qint64 BasalTickMs = 5000;
+
+// Parsed root object of a saved state file, or an empty object if the file is
+// missing or unreadable
+QJsonObject readJsonObject(const QString &filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QJsonObject();
+    }
+    
+    QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
+    return doc.isObject() ? doc.object() : QJsonObject();
+}
+
+}
 
 PumpController::PumpController(QObject *parent)
     : QObject(parent),
       running(false),
       controlIQEnabled(true),
-      simulationSpeedFactor(30) // Simulation runs 30x faster than real-time
+      lastLoggedControlIQRate(-1.0),
+      lowGlucoseSuspended(false),
+      basalScheduleSlot(-1),
+      simulationSpeedFactor(30), // Simulation runs 30x faster than real-time
+      pumpTime(Timestamp::now()),
+      initialized(false),
+      initializing(false),
+      controlIQDeadlines("controliq")
 {
     // Initialize models
     pumpModel = new PumpModel(this);
@@ -36,30 +69,53 @@ PumpController::PumpController(QObject *parent)
         emit alertTriggered(message, PumpModel::Critical);
     });
     
+    // Threshold alerts are raised once by the alert rules and logged here
+    connect(alertController, &AlertController::ruleAlertRaised, this,
+            [this](const QString &message, const QString &source, PumpModel::AlertLevel level) {
+        const ErrorHandler::ErrorLevel errorLevel = level == PumpModel::Critical ? ErrorHandler::Critical
+                                                  : level == PumpModel::Warning ? ErrorHandler::Warning
+                                                                                : ErrorHandler::Info;
+        errorHandler->logError(message, source, errorLevel);
+    });
+    
+    // Settings are read once; the alert controller follows later changes
+    // made through the store
+    settingsStore = new SettingsStore(this);
+    connect(settingsStore, &SettingsStore::alertSettingsChanged, this, &PumpController::applyAlertSettings);
+    settingsStore->load();
+    
+    // Reminders are read from settings once; the scheduler only wakes up
+    // when the next one is due
+    reminderScheduler = new ReminderScheduler(this);
+    reminderScheduler->load();
+    connect(reminderScheduler, &ReminderScheduler::reminderDue, this, &PumpController::raiseReminder);
+    
     // Set up timers
     setupTimers();
     
     // Connect model signals
     connectModelSignals();
     
-    // Try to load data if available
-    loadPumpState();
-    
-    // Initialize simulator with 48 hours of data
-    initializeSimulator();
+    // Saved state and the 48 hour demo history are loaded by
+    // initializeAsync() once the UI is up, not on the startup path
 }
 
 PumpController::~PumpController()
 {
-    // Save state before shutdown
-    savePumpState();
+    // Startup workers post back to this object
+    backgroundPool.waitForDone();
+    
+    // Save state before shutdown, unless we never got as far as loading it
+    if (initialized) {
+        savePumpState();
+    }
     
     // Stop timers
     batteryTimer->stop();
     glucoseTimer->stop();
     iobTimer->stop();
     controlIQTimer->stop();
-    reminderTimer->stop();
+    reminderScheduler->stop();
     occlusionTimer->stop();
     basalConsumptionTimer->stop();
 }
@@ -77,21 +133,116 @@ void PumpController::initializeSimulator() {
     }
 }
 
+void PumpController::initializeAsync()
+{
+    if (initialized || initializing) {
+        return;
+    }
+    
+    initializing = true;
+    const QString dataPath = QDir::homePath() + "/.tslimx2simulator";
+    
+    // Stage 1: read and parse the saved state off the GUI thread
+    backgroundPool.start([this, dataPath]() {
+        TRACE_SCOPE_CAT("PumpController::readSavedState", "startup");
+        static LatencyHistogram *loadTime = Metrics::histogram("storage.load_state_ns");
+        LatencyTimer loadTimer(loadTime);
+        SavedStateFiles saved;
+        saved.pumpState = readJsonObject(dataPath + "/pump_state.json");
+        saved.profiles = readJsonObject(dataPath + "/profiles.json");
+        saved.glucoseReadings = readJsonObject(dataPath + "/glucose_readings.json");
+        saved.insulinData = readJsonObject(dataPath + "/insulin_data.json");
+        
+        QMetaObject::invokeMethod(this, [this, saved]() {
+            applySavedState(saved);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void PumpController::reserveHistory(int hours)
+{
+    // A reading and up to one Control-IQ basal segment every five minutes,
+    // and at most a bolus an hour
+    glucoseModel->reserveHistory(hours);
+    insulinModel->reserveHistory(hours, hours * 12);
+}
+
+bool PumpController::isInitialized() const
+{
+    return initialized;
+}
+
+void PumpController::applySavedState(const SavedStateFiles &saved)
+{
+    // Same order as loadData(); missing files leave the defaults in place
+    if (!saved.pumpState.isEmpty()) {
+        pumpModel->loadState(saved.pumpState);
+    }
+    
+    if (!saved.profiles.isEmpty()) {
+        profileModel->loadProfiles(saved.profiles);
+    }
+    
+    if (!saved.glucoseReadings.isEmpty()) {
+        glucoseModel->loadReadings(saved.glucoseReadings);
+    }
+    
+    if (!saved.insulinData.isEmpty()) {
+        insulinModel->loadInsulinData(saved.insulinData);
+    }
+    
+    //fix for battery reset
+    pumpModel->updateBatteryLevel(100);
+    
+    // Stage 2: generate the demo history against the now active profile
+    const ProfileSetSnapshot profiles = profileModel->getSnapshot();
+    const Timestamp now = Timestamp::now();
+    
+    backgroundPool.start([this, profiles, now]() {
+        TRACE_SCOPE_CAT("PumpController::buildDemoHistory", "startup");
+        TimeSeriesStore glucose = GlucoseModel::buildFixedPattern(48, now);
+        HistorySnapshot insulin = buildHistoricalInsulinData(48, now, profiles->activeProfile());
+        
+        QMetaObject::invokeMethod(this, [this, glucose, insulin]() {
+            glucoseModel->setReadingSeries(glucose);
+            insulinModel->appendHistory(insulin.boluses, insulin.basalSegments);
+            
+            // Room for a week of history before the tick has to grow it
+            reserveHistory(7 * 24);
+            
+            initializing = false;
+            initialized = true;
+            
+            if (!running) {
+                startPump();
+            }
+            
+            emit initializationFinished();
+        }, Qt::QueuedConnection);
+    });
+}
+
 void PumpController::generateHistoricalInsulinData(int hoursBack) {
-    QDateTime current = QDateTime::currentDateTime();
-    QDateTime start = current.addSecs(-hoursBack * 3600);
+    const ProfileSetSnapshot profiles = profileModel->getSnapshot();
+    HistorySnapshot history = buildHistoricalInsulinData(hoursBack, Timestamp::now(),
+                                                         profiles->activeProfile());
     
-    // Get default profile
-    Profile defaultProfile = profileModel->getActiveProfile();
+    // Update IOB based on generated history
+    insulinModel->appendHistory(history.boluses, history.basalSegments);
+}
+
+HistorySnapshot PumpController::buildHistoricalInsulinData(int hoursBack, Timestamp current,
+                                                           const Profile &defaultProfile)
+{
+    Timestamp start = current.addSecs(-hoursBack * 3600LL);
+    HistorySnapshot history;
     double basalRate = defaultProfile.basalRate;
+    const quint32 profileName = StringPool::intern(defaultProfile.name);
     
     // Generate basal history segments in 4-hour blocks
-    QDateTime segmentStart = start;
+    Timestamp segmentStart = start;
     while (segmentStart < current) {
-        QDateTime segmentEnd = segmentStart.addSecs(4 * 3600);
-        if (segmentEnd > current) {
-            segmentEnd = current;
-        }
+        Timestamp segmentEnd = qMin(segmentStart.addSecs(4 * 3600), current);
         
         // Determine if this should be a Control-IQ segment or regular basal
         bool isControlIQ = QRandomGenerator::global()->bounded(100) < 70; // 70% chance of Control-IQ
@@ -104,70 +255,58 @@ void PumpController::generateHistoricalInsulinData(int hoursBack) {
         }
         
         // Create the basal segment
-        InsulinModel::BasalDelivery segment;
-        segment.startTime = segmentStart;
-        segment.endTime = segmentEnd;
+        InsulinModel::BasalRecord segment;
+        segment.startTime = segmentStart.toMSecsSinceEpoch();
+        segment.endTime = segmentEnd.toMSecsSinceEpoch();
         segment.rate = adjustedRate;
-        segment.profileName = defaultProfile.name;
-        segment.automatic = isControlIQ;
+        segment.profileName = profileName;
+        segment.flags = isControlIQ ? InsulinModel::BasalRecord::Automatic : 0;
+        segment.reserved[0] = segment.reserved[1] = segment.reserved[2] = 0;
         
         // Add to history
-        insulinModel->addBasalToHistory(segment);
+        history.basalSegments.append(segment);
         
         // Move to next segment
         segmentStart = segmentEnd;
     }
     
+    // Meal times are local, so resolve them through QDateTime once per day
+    auto addBolus = [&](const QDate &date, const QTime &time, double units, const QString &reason,
+                        bool extended, int duration) {
+        const Timestamp when = Timestamp::fromDateTime(QDateTime(date, time));
+        if (when >= start && when <= current) {
+            history.boluses.append(InsulinModel::BolusRecord::fromDelivery(
+                {when.toDateTime(), units, reason, extended, duration, true}));
+        }
+    };
+    
     // Add boluses for each day in the history
-    QDateTime day = start;
-    while (day < current) {
+    const QDate lastDay = current.toDateTime().date();
+    for (QDate day = start.toDateTime().date(); day <= lastDay; day = day.addDays(1)) {
         // Breakfast bolus (around 7:15 AM)
-        QDateTime breakfastTime = day;
-        breakfastTime.setTime(QTime(7, 15));
-        if (breakfastTime >= start && breakfastTime <= current) {
-            double units = 4.0 + (QRandomGenerator::global()->generateDouble() - 0.5) * 1.0;
-            insulinModel->addBolusToHistory(breakfastTime, units, "Breakfast", false, 0, true);
-        }
+        addBolus(day, QTime(7, 15), 4.0 + (QRandomGenerator::global()->generateDouble() - 0.5) * 1.0,
+                 "Breakfast", false, 0);
         
         // Lunch bolus (around 12:30 PM)
-        QDateTime lunchTime = day;
-        lunchTime.setTime(QTime(12, 30));
-        if (lunchTime >= start && lunchTime <= current) {
-            double units = 5.0 + (QRandomGenerator::global()->generateDouble() - 0.5) * 1.5;
-            insulinModel->addBolusToHistory(lunchTime, units, "Lunch", false, 0, true);
-        }
+        addBolus(day, QTime(12, 30), 5.0 + (QRandomGenerator::global()->generateDouble() - 0.5) * 1.5,
+                 "Lunch", false, 0);
         
-        // Dinner bolus (around 6:45 PM)
-        QDateTime dinnerTime = day;
-        dinnerTime.setTime(QTime(18, 45));
-        if (dinnerTime >= start && dinnerTime <= current) {
-            double units = 6.0 + (QRandomGenerator::global()->generateDouble() - 0.5) * 2.0;
-            
-            // Sometimes make this an extended bolus
-            bool extended = QRandomGenerator::global()->bounded(100) < 30; // 30% chance
-            int duration = extended ? QRandomGenerator::global()->bounded(1, 4) * 30 : 0; // 30-120 minutes
-            
-            insulinModel->addBolusToHistory(dinnerTime, units, "Dinner", extended, duration, true);
-        }
+        // Dinner bolus (around 6:45 PM), sometimes extended
+        double units = 6.0 + (QRandomGenerator::global()->generateDouble() - 0.5) * 2.0;
+        bool extended = QRandomGenerator::global()->bounded(100) < 30; // 30% chance
+        int duration = extended ? QRandomGenerator::global()->bounded(1, 4) * 30 : 0; // 30-120 minutes
+        addBolus(day, QTime(18, 45), units, "Dinner", extended, duration);
         
         // Random correction bolus (afternoon or evening)
         if (QRandomGenerator::global()->bounded(100) < 40) { // 40% chance per day
-            QDateTime correctionTime = day;
             int hour = QRandomGenerator::global()->bounded(14, 22); // 2 PM to 10 PM
-            correctionTime.setTime(QTime(hour, QRandomGenerator::global()->bounded(60)));
-            
-            if (correctionTime >= start && correctionTime <= current) {
-                double units = 1.5 + QRandomGenerator::global()->generateDouble() * 1.5;
-                insulinModel->addBolusToHistory(correctionTime, units, "Correction", false, 0, true);
-            }
+            QTime correctionTime(hour, QRandomGenerator::global()->bounded(60));
+            addBolus(day, correctionTime, 1.5 + QRandomGenerator::global()->generateDouble() * 1.5,
+                     "Correction", false, 0);
         }
-        
-        // Move to next day
-        day = day.addDays(1);
     }
     
-    // Update IOB based on generated history
-    insulinModel->updateIOB();
+    return history;
 }
     
 void PumpController::setupTimers()
@@ -189,13 +328,9 @@ void PumpController::setupTimers()
     
     // Control-IQ timer (every 5 minutes in sim time)
     controlIQTimer = new QTimer(this);
-    connect(controlIQTimer, &QTimer::timeout, this, &PumpController::runControlIQ);
+    connect(controlIQTimer, &QTimer::timeout, this, &PumpController::runScheduledControlIQ);
     controlIQTimer->setInterval(300000 / simulationSpeedFactor); // 5 minutes / speed factor
-    
-    // Reminder check timer (every minute in real time)
-    reminderTimer = new QTimer(this);
-    connect(reminderTimer, &QTimer::timeout, this, &PumpController::checkReminders);
-    reminderTimer->setInterval(60000); // 1 minute (real time)
+    controlIQTimer->setTimerType(Qt::PreciseTimer); // Coarse timers may drift by 5% of the interval
     
     // Occlusion check timer (rare event, every minute in real time)
     occlusionTimer = new QTimer(this);
@@ -205,7 +340,7 @@ void PumpController::setupTimers()
     // Set up timer for basal consumption updates (every 5 seconds in sim time)
     basalConsumptionTimer = new QTimer(this);
     connect(basalConsumptionTimer, &QTimer::timeout, this, &PumpController::updateBasalConsumption);
-    basalConsumptionTimer->setInterval(5000 / simulationSpeedFactor); // 5 seconds / speed factor
+    basalConsumptionTimer->setInterval(BasalTickMs / simulationSpeedFactor); // 5 seconds / speed factor
 }
 
 void PumpController::connectModelSignals()
@@ -225,6 +360,7 @@ void PumpController::connectModelSignals()
     connect(insulinModel, &InsulinModel::bolusStarted, this, &PumpController::bolusDeliveryStarted);
     connect(insulinModel, &InsulinModel::bolusCompleted, this, &PumpController::bolusDeliveryCompleted);
     connect(insulinModel, &InsulinModel::bolusCancelled, this, &PumpController::bolusDeliveryCancelled);
+    connect(insulinModel, &InsulinModel::insulinDelivered, pumpModel, &PumpModel::reduceInsulin);
     connect(insulinModel, &InsulinModel::insulinOnBoardChanged, this, [this](double units) {
         pumpModel->updateInsulinOnBoard(units);
     });
@@ -238,8 +374,8 @@ void PumpController::connectModelSignals()
         
         // Apply profile settings when changed
         if (running) {
-            Profile profile = profileModel->getProfile(name);
-            insulinModel->startBasal(profile.basalRate, name);
+            insulinModel->startBasal(getScheduledSettings().basalRate, name);
+            basalScheduleSlot = ProfileSchedule::slotFor(pumpTime.toDateTime().time());
         }
     });
 }
@@ -253,9 +389,14 @@ void PumpController::startPump()
     running = true;
     pumpModel->setPumpState(PumpModel::PoweredOn);
     
-    // Start active profile basal
-    Profile activeProfile = profileModel->getActiveProfile();
-    insulinModel->startBasal(activeProfile.basalRate, activeProfile.name);
+    // Pump time never runs backwards, but does not stand still for the
+    // time the pump was off either
+    pumpTime = qMax(pumpTime, Timestamp::now());
+    insulinModel->advanceDelivery(pumpTime);
+    
+    // Start active profile basal at the rate scheduled for now
+    insulinModel->startBasal(getScheduledSettings().basalRate, profileModel->getActiveProfileName());
+    basalScheduleSlot = ProfileSchedule::slotFor(pumpTime.toDateTime().time());
     
     // Start simulation
     startSimulation();
@@ -389,6 +530,16 @@ QString PumpController::getActiveProfileName() const
     return profileModel->getActiveProfileName();
 }
 
+ProfileSchedule::Slot PumpController::getScheduledSettings() const
+{
+    return profileModel->getSnapshot()->activeSchedule().at(pumpTime.toDateTime());
+}
+
+ProfileSetSnapshot PumpController::getProfileSnapshot() const
+{
+    return profileModel->getSnapshot();
+}
+
 QVector<Profile> PumpController::getAllProfiles() const
 {
     return profileModel->getAllProfiles();
@@ -414,33 +565,42 @@ QVector<QPair<QDateTime, double>> PumpController::getGlucoseHistory(const QDateT
     return glucoseModel->getReadings(start, end);
 }
 
+const TimeSeriesStore &PumpController::getGlucoseSeries() const
+{
+    return glucoseModel->getReadingSeries();
+}
+
 QVector<QPair<QDateTime, double>> PumpController::getInsulinHistory(const QDateTime &start, const QDateTime &end) const
 {
-    QVector<QPair<QDateTime, double>> result;
-    
-    // Get bolus history
-    QVector<InsulinModel::BolusDelivery> bolusHistory = insulinModel->getBolusHistory(start, end);
-    for (const auto &bolus : bolusHistory) {
-        result.append(qMakePair(bolus.timestamp, bolus.units));
-    }
-    
-    // Get basal history (sampled at hourly intervals)
-    QVector<InsulinModel::BasalDelivery> basalHistory = insulinModel->getBasalHistory(start, end);
-    for (const auto &basal : basalHistory) {
-        // Sample basal rate at hourly intervals
-        QDateTime sampleTime = basal.startTime;
-        while (sampleTime <= basal.endTime) {
-            result.append(qMakePair(sampleTime, basal.rate));
-            sampleTime = sampleTime.addSecs(60 * 60); // Add 1 hour
-        }
-    }
-    
-    // Sort by timestamp
-    std::sort(result.begin(), result.end(), [](const auto &a, const auto &b) {
-        return a.first < b.first;
-    });
-    
-    return result;
+    return getInsulinHistoryCursor(start, end).toPairs();
+}
+
+InsulinHistoryCursor PumpController::getInsulinHistoryCursor(const QDateTime &start, const QDateTime &end) const
+{
+    return InsulinHistoryCursor(insulinModel->getAllBoluses(), insulinModel->getAllBasalSegments(), start, end);
+}
+
+HistorySnapshot PumpController::getHistorySnapshot() const
+{
+    HistorySnapshot snapshot;
+    snapshot.boluses = insulinModel->getAllBoluses();
+    snapshot.basalSegments = insulinModel->getAllBasalSegments();
+    return snapshot;
+}
+
+void PumpController::publishMetrics() const
+{
+    static MetricGauge *glucoseReadings = Metrics::gauge("history.glucose_readings");
+    static MetricGauge *boluses = Metrics::gauge("history.insulin_boluses");
+    static MetricGauge *basalSegments = Metrics::gauge("history.insulin_basal_segments");
+    static MetricGauge *errors = Metrics::gauge("history.errors");
+    static MetricGauge *events = Metrics::gauge("history.event_log");
+    
+    glucoseReadings->set(glucoseModel->getReadingSeries().size());
+    boluses->set(insulinModel->getAllBoluses().size());
+    basalSegments->set(insulinModel->getAllBasalSegments().size());
+    errors->set(errorHandler->getErrorCount());
+    events->set(dataStorage->getEventLogSize());
 }
 
 bool PumpController::deliverBolus(double units, bool extended, int duration)
@@ -455,13 +615,12 @@ bool PumpController::deliverBolus(double units, bool extended, int duration)
         return false;
     }
     
-    // Deliver bolus
+    // Deliver bolus; the reservoir goes down as the pulses are delivered
     bool success = insulinModel->deliverBolus(units, "Manual", extended, duration);
     
-    if (success) {
-        // Reduce insulin reservoir
-        pumpModel->reduceInsulin(units);
-    }
+    static MetricCounter *delivered = Metrics::counter("bolus.delivered");
+    static MetricCounter *rejected = Metrics::counter("bolus.rejected");
+    (success ? delivered : rejected)->increment();
     
     return success;
 }
@@ -472,7 +631,13 @@ bool PumpController::cancelBolus()
         return false;
     }
     
-    return insulinModel->cancelBolus();
+    bool cancelled = insulinModel->cancelBolus();
+    if (cancelled) {
+        static MetricCounter *cancelledBoluses = Metrics::counter("bolus.cancelled");
+        cancelledBoluses->increment();
+    }
+    
+    return cancelled;
 }
 
 bool PumpController::isBolusActive() const
@@ -480,8 +645,23 @@ bool PumpController::isBolusActive() const
     return insulinModel->isBolusActive();
 }
 
+bool PumpController::exportHistoryCSV(const QString &filename, const QDateTime &start, const QDateTime &end,
+                                      int bucketMinutes) const
+{
+    InsulinHistoryCursor insulin = getInsulinHistoryCursor(start, end);
+    return dataStorage->exportCSVReport(filename,
+                                        glucoseModel->getReadingsView(Timestamp::fromDateTime(start),
+                                                                      Timestamp::fromDateTime(end)),
+                                        insulin,
+                                        bucketMinutes);
+}
+
 bool PumpController::saveData(const QString &directory)
 {
+    TRACE_SCOPE("PumpController::saveData");
+    static LatencyHistogram *saveTime = Metrics::histogram("storage.save_state_ns");
+    LatencyTimer saveTimer(saveTime);
+    
     QDir dir(directory);
     if (!dir.exists()) {
         dir.mkpath(".");
@@ -494,11 +674,25 @@ bool PumpController::saveData(const QString &directory)
     success &= glucoseModel->saveReadings(directory + "/glucose_readings.json");
     success &= insulinModel->saveInsulinData(directory + "/insulin_data.json");
     
+    // Control-IQ cycle timing is diagnostic; failing to write it does not fail the save
+    controlIQDeadlines.writeBinary(directory + "/controliq_cycles.bin");
+    
+    // Account for what actually reached the disk
+    static MetricCounter *bytesWritten = Metrics::counter("storage.bytes_written");
+    for (const char *name : {"/pump_state.json", "/profiles.json", "/glucose_readings.json", "/insulin_data.json",
+                             "/controliq_cycles.bin"}) {
+        bytesWritten->increment(QFileInfo(directory + name).size());
+    }
+    
     return success;
 }
 
 bool PumpController::loadData(const QString &directory)
 {
+    TRACE_SCOPE("PumpController::loadData");
+    static LatencyHistogram *loadTime = Metrics::histogram("storage.load_state_ns");
+    LatencyTimer loadTimer(loadTime);
+    
     bool success = true;
     
     if (QFile::exists(directory + "/pump_state.json")) {
@@ -540,8 +734,7 @@ void PumpController::updateGlucoseLevel(double value)
     emit glucoseLevelChanged(value);
     
     // Update the graph data
-    emit graphDataChanged(getGlucoseHistory(QDateTime::currentDateTime().addSecs(-3 * 60 * 60), 
-                                           QDateTime::currentDateTime()));
+    emit graphDataChanged(glucoseModel->getReadingSeries());
 }
 
 void PumpController::updateGlucoseTrend(GlucoseModel::TrendDirection trend)
@@ -553,8 +746,7 @@ void PumpController::updateGlucoseTrend(GlucoseModel::TrendDirection trend)
     emit glucoseTrendChanged(trend);
     
     // Update graph data
-    emit graphDataChanged(getGlucoseHistory(QDateTime::currentDateTime().addSecs(-3 * 60 * 60), 
-                                           QDateTime::currentDateTime()));
+    emit graphDataChanged(glucoseModel->getReadingSeries());
 }
 
 void PumpController::generateTestAlert(const QString &message, PumpModel::AlertLevel level)
@@ -608,14 +800,12 @@ void PumpController::processGlucoseReading(double value, const QDateTime &timest
     emit glucoseLevelChanged(value);
     
     // Update graph data
-    emit graphDataChanged(getGlucoseHistory(QDateTime::currentDateTime().addSecs(-6 * 60 * 60), QDateTime::currentDateTime()));
-    
-    // Check for alerts
-    checkGlucoseAlerts();
+    emit graphDataChanged(glucoseModel->getReadingSeries());
 }
 
 void PumpController::updateInsulinOnBoard()
 {
+    TRACE_SCOPE("PumpController::updateInsulinOnBoard");
     if (!running) {
         return;
     }
@@ -626,56 +816,51 @@ void PumpController::updateInsulinOnBoard()
 
 void PumpController::updateBasalConsumption()
 {
+    TRACE_SCOPE("PumpController::updateBasalConsumption");
     if (!running) {
         return;
     }
     
-    // Calculate basal rate for current 5-second period
-    double basalRate = insulinModel->getCurrentBasalRate();
-    double bolusRate = 0.0;
-    
-    // Check if a bolus is active
-    if (insulinModel->isBolusActive()) {
-        InsulinModel::BolusDelivery bolus = insulinModel->getCurrentBolus();
+    // Manual basal follows the active profile's schedule. Control-IQ sets
+    // automatic rates relative to it on its own cycle, and a suspended
+    // basal stays suspended.
+    pumpTime = pumpTime.addMSecs(BasalTickMs);
+    const Timestamp now = pumpTime;
+    const int slot = ProfileSchedule::slotFor(now.toDateTime().time());
+    if (slot != basalScheduleSlot) {
+        basalScheduleSlot = slot;
         
-        // Calculate rate depending on bolus type
-        if (bolus.extended) {
-            // Extended bolus delivers evenly over the duration
-            int durationSecs = bolus.duration * 60; // Convert minutes to seconds
-            bolusRate = bolus.units / durationSecs; // Units per second
-        } else {
-            // Standard bolus delivers at fixed rate (e.g., 1u per minute)
-            bolusRate = 1.0 / 60.0; // 1u per minute = 1/60 u per second
+        const double scheduledRate = profileModel->getSnapshot()->activeSchedule().at(slot).basalRate;
+        if (insulinModel->isBasalActive() && !insulinModel->isBasalAutomatic() &&
+            insulinModel->getCurrentBasalRate() != scheduledRate) {
+            insulinModel->adjustBasalRate(scheduledRate, false);
         }
-
-        // Calculate insulin used in this 5-second period and actually use it
-        double bolusUsed = bolusRate * 5.0; // for 5-second interval
-        pumpModel->reduceInsulin(bolusUsed); // Actually use the calculated value
     }
     
-    // Calculate basal insulin used in 5-second period
-    double basalUsed = (basalRate / 3600.0) * 5.0; // Convert hourly rate to 5-second amount
-    
-    // Reduce insulin in reservoir
-    pumpModel->reduceInsulin(basalUsed);
+    // Deliver the motor pulses due since the last tick. The reservoir
+    // follows InsulinModel::insulinDelivered, and bolus progress and IOB
+    // come from the same pulses.
+    insulinModel->advanceDelivery(now);
 }
 
 void PumpController::simulateGlucoseReading() {
+    TRACE_SCOPE("PumpController::simulateGlucoseReading");
     if (!running) {
         return;
     }
     
     // Get the current time
-    QDateTime now = QDateTime::currentDateTime();
+    const Timestamp now = Timestamp::now();
     
-    // Fetch last 1 hour of glucose readings
-    QVector<QPair<QDateTime, double>> recentReadings = 
-        glucoseModel->getReadings(now.addSecs(-3600), now);
+    // Find the last hour of glucose readings in place
+    const TimeSeriesStore &series = glucoseModel->getReadingSeries();
+    const int firstRecent = series.lowerBound(now.addSecs(-3600).toMSecsSinceEpoch());
+    const int endRecent = series.upperBound(now.toMSecsSinceEpoch());
     
     // If we have no recent readings, generate one based on time of day
-    if (recentReadings.isEmpty()) {
+    if (firstRecent >= endRecent) {
         // Get hour of day (0-23)
-        int hour = now.time().hour();
+        int hour = now.toDateTime().time().hour();
         
         // Base value depending on time of day
         double baseValue = 5.5; // Default
@@ -716,37 +901,52 @@ void PumpController::simulateGlucoseReading() {
     
     // Just advance along our pre-generated curve by taking a nearby reading 
     // and adding slight random variation
-    double lastValue = recentReadings.last().second;
+    double lastValue = series.at(endRecent - 1).value;
     double randomVariation = (QRandomGenerator::global()->generateDouble() - 0.5) * 0.3;
     
     // Add the reading with small random change
     glucoseModel->addReading(lastValue + randomVariation);
 }
 
+void PumpController::runScheduledControlIQ()
+{
+    // Account for every timer driven cycle, including ones where the loop is off
+    controlIQDeadlines.beginCycle();
+    const bool active = running && controlIQEnabled;
+    runControlIQ();
+    controlIQDeadlines.endCycle(active);
+}
+
 void PumpController::runControlIQ() {
+    TRACE_SCOPE("PumpController::runControlIQ");
     if (!running || !controlIQEnabled) {
         return;
     }
     
+    static MetricCounter *decisions = Metrics::counter("controliq.decisions");
+    static LatencyHistogram *runTime = Metrics::histogram("controliq.run_ns");
+    LatencyTimer runTimer(runTime);
+    decisions->increment();
+    
     // Get current glucose and trend
     double currentGlucose = glucoseModel->getCurrentGlucose();
     GlucoseModel::TrendDirection trend = glucoseModel->getTrendDirection();
     
-    // Get active profile
-    Profile profile = profileModel->getActiveProfile();
+    // Active profile settings for this time of day
+    const ProfileSchedule::Slot settings = getScheduledSettings();
     
     // Get a fixed basal adjustment based on current glucose and trend
     double basalAdjustment = controlIQAlgorithm->calculateBasalAdjustment(
         currentGlucose,
         trend,
-        profile.basalRate,
-        profile.targetGlucose,
+        settings.basalRate,
+        settings.targetGlucose,
         pumpModel->getInsulinOnBoard()
     );
     
     // If we have a non-zero adjustment, apply it
     if (qAbs(basalAdjustment) > 0.01) {
-        double newBasalRate = qMax(0.0, profile.basalRate + basalAdjustment);
+        double newBasalRate = qMax(0.0, settings.basalRate + basalAdjustment);
         
         // Apply the adjustment through insulin model
         insulinModel->adjustBasalRate(newBasalRate, true);
@@ -757,56 +957,51 @@ void PumpController::runControlIQ() {
         // Emit signal for UI update
         emit controlIQActionChanged(basalAdjustment);
         
-        // Log the action
-        QString message;
-        if (basalAdjustment > 0) {
-            message = QString("Control-IQ increased basal rate to %1 u/hr").arg(newBasalRate, 0, 'f', 2);
-            errorHandler->logError(message, "ControlIQ", ErrorHandler::Info);
-        } else {
-            message = QString("Control-IQ decreased basal rate to %1 u/hr").arg(newBasalRate, 0, 'f', 2);
-            errorHandler->logError(message, "ControlIQ", ErrorHandler::Info);
+        // Log the action when the commanded rate changes; repeating the same
+        // decision every cycle would only fill the log with copies
+        if (newBasalRate != lastLoggedControlIQRate) {
+            lastLoggedControlIQRate = newBasalRate;
+            
+            QString message;
+            if (basalAdjustment > 0) {
+                message = QString("Control-IQ increased basal rate to %1 u/hr").arg(newBasalRate, 0, 'f', 2);
+                errorHandler->logError(message, "ControlIQ", ErrorHandler::Info);
+            } else {
+                message = QString("Control-IQ decreased basal rate to %1 u/hr").arg(newBasalRate, 0, 'f', 2);
+                errorHandler->logError(message, "ControlIQ", ErrorHandler::Info);
+            }
         }
+    } else {
+        lastLoggedControlIQRate = -1.0;
     }
     
-    // Check for suspend at low glucose
+    // Check for suspend at low glucose. The check runs every cycle, but
+    // only the suspend and the resume are logged.
     if (currentGlucose < 3.9) {
         insulinModel->suspendBasal();
-        errorHandler->logError("Basal delivery suspended - Low glucose", "ControlIQ", ErrorHandler::Warning);
-    } else if (insulinModel->getCurrentBasalRate() == 0.0 && currentGlucose >= 4.4) {
+        if (!lowGlucoseSuspended) {
+            lowGlucoseSuspended = true;
+            errorHandler->logError("Basal delivery suspended - Low glucose", "ControlIQ", ErrorHandler::Warning);
+        }
+    } else {
         // Resume basal if suspended and glucose is back up
-        insulinModel->resumeBasal();
-        errorHandler->logError("Basal delivery resumed", "ControlIQ", ErrorHandler::Info);
+        if (insulinModel->getCurrentBasalRate() == 0.0 && currentGlucose >= 4.4) {
+            insulinModel->resumeBasal();
+        }
+        if (lowGlucoseSuspended && insulinModel->isBasalActive()) {
+            lowGlucoseSuspended = false;
+            errorHandler->logError("Basal delivery resumed", "ControlIQ", ErrorHandler::Info);
+        }
     }
 }
 
-void PumpController::checkReminders()
+void PumpController::raiseReminder(quint32 id, const QString &type)
 {
-    if (!running) {
-        return;
-    }
+    Q_UNUSED(id);
     
-    // Read reminders from settings
-    QSettings settings("TandemDiabetes", "tslimx2simulator");
-    settings.beginGroup("Alerts");
-    
-    int reminderCount = settings.beginReadArray("Reminders");
-    for (int i = 0; i < reminderCount; ++i) {
-        settings.setArrayIndex(i);
-        QString type = settings.value("Type").toString();
-        QDateTime time = settings.value("Time").toDateTime();
-        bool acknowledged = settings.value("Acknowledged", false).toBool();
-        
-        // Check if the reminder is due and not acknowledged
-        if (!acknowledged && time <= QDateTime::currentDateTime()) {
-            // Trigger an alert using error handler
-            errorHandler->logError("Reminder: " + type, "ReminderSystem", ErrorHandler::Warning);
-            
-            // Mark as acknowledged to prevent repeated alerts
-            settings.setValue("Acknowledged", true);
-        }
-    }
-    settings.endArray();
-    settings.endGroup();
+    // Trigger an alert using error handler; the scheduler has already
+    // marked the reminder acknowledged so it is not raised again
+    errorHandler->logError("Reminder: " + type, "ReminderSystem", ErrorHandler::Warning);
 }
 
 void PumpController::startSimulation()
@@ -816,7 +1011,8 @@ void PumpController::startSimulation()
     glucoseTimer->start();
     iobTimer->start();
     controlIQTimer->start();
-    reminderTimer->start();
+    controlIQDeadlines.start(controlIQTimer->interval());
+    reminderScheduler->start();
     occlusionTimer->start();
     basalConsumptionTimer->start();
     
@@ -837,17 +1033,40 @@ void PumpController::stopSimulation()
     glucoseTimer->stop();
     iobTimer->stop();
     controlIQTimer->stop();
-    reminderTimer->stop();
+    controlIQDeadlines.stop();
+    reminderScheduler->stop();
     occlusionTimer->stop();
     basalConsumptionTimer->stop();
 }
 
+void PumpController::applyAlertSettings(const AlertSettings &settings)
+{
+    alertController->enableAlerts(settings.alertsEnabled);
+    
+    alertController->setGlucoseAlertThresholds(
+        settings.lowGlucoseThreshold,
+        settings.highGlucoseThreshold,
+        settings.urgentLowGlucoseThreshold,
+        settings.urgentHighGlucoseThreshold
+    );
+    
+    alertController->setInsulinAlertThresholds(
+        settings.lowInsulinThreshold,
+        settings.criticalInsulinThreshold
+    );
+    
+    alertController->setBatteryAlertThresholds(
+        settings.lowBatteryThreshold,
+        settings.criticalBatteryThreshold
+    );
+}
+
 void PumpController::checkLowBattery()
 {
     int level = pumpModel->getBatteryLevel();
     
-    // Use the dedicated error handler method
-    errorHandler->lowBatteryAlert(level);
+    // Alerts come from the alert rules
+    alertController->checkBatteryAlerts();
     
     // Force shutdown if battery is extremely low
     if (level <= 1) {
@@ -859,34 +1078,8 @@ void PumpController::checkLowBattery()
 
 void PumpController::checkLowInsulin()
 {
-    double insulin = pumpModel->getInsulinRemaining();
-    
-    // Use the dedicated error handler method
-    errorHandler->lowInsulinAlert(insulin);
-}
-
-void PumpController::checkGlucoseAlerts()
-{
-    double glucose = glucoseModel->getCurrentGlucose();
-    GlucoseModel::TrendDirection trend = glucoseModel->getTrendDirection();
-    
-    // Use the dedicated error handler methods
-    errorHandler->lowGlucoseAlert(glucose);
-    errorHandler->highGlucoseAlert(glucose);
-    
-    // Check for rapid changes in glucose
-    if (trend == GlucoseModel::RisingQuickly) {
-        errorHandler->logError("Glucose rising quickly", "GlucoseModel", ErrorHandler::Warning);
-    } else if (trend == GlucoseModel::FallingQuickly) {
-        errorHandler->logError("Glucose falling quickly", "GlucoseModel", ErrorHandler::Warning);
-    }
-    
-    // Check CGM data gap (no readings for over 10 mins)
-    QDateTime lastReadingTime = glucoseModel->getLastReadingTime();
-    if (lastReadingTime.isValid() && lastReadingTime.secsTo(QDateTime::currentDateTime()) > 600) {
-        int minutesSinceLastReading = lastReadingTime.secsTo(QDateTime::currentDateTime()) / 60;
-        errorHandler->cgmDisconnectedAlert(minutesSinceLastReading);
-    }
+    // Alerts come from the alert rules
+    alertController->checkInsulinAlerts();
 }
 
 void PumpController::checkForOcclusion()
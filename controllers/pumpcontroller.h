@@ -3,6 +3,8 @@
 
 #include <QObject>
 #include <QTimer>
+#include <QThreadPool>
+#include <QJsonObject>
 #include "../models/pumpmodel.h"
 #include "../models/profilemodel.h"
 #include "../models/glucosemodel.h"
@@ -10,7 +12,12 @@
 #include "../utils/controliqalgorithm.h"
 #include "../utils/datastorage.h"
 #include "../utils/errorhandler.h"
+#include "../utils/controlloopmonitor.h"
+#include "../utils/reminderscheduler.h"
+#include "../utils/settingsstore.h"
+#include "../utils/timestamp.h"
 #include "../controllers/alertcontroller.h"
+#include "../controllers/historyquery.h"
 
 class PumpController : public QObject
 {
@@ -23,6 +30,17 @@ public:
     // Initialization
     void initializeSimulator();
     void generateHistoricalInsulinData(int hoursBack = 48);
+    static HistorySnapshot buildHistoricalInsulinData(int hoursBack, Timestamp end,
+                                                      const Profile &profile);
+    
+    // Loads saved state and generates the demo history on a worker thread,
+    // then starts the pump and emits initializationFinished()
+    void initializeAsync();
+    bool isInitialized() const;
+    
+    // Room for this many more hours of history, so the simulation tick
+    // does not reallocate it
+    void reserveHistory(int hours);
     
     // Pump state
     void startPump();
@@ -54,6 +72,8 @@ public:
     // Alerts
     AlertController* getAlertController() const { return alertController; }
     ErrorHandler* getErrorHandler() const;
+    ReminderScheduler* getReminderScheduler() const { return reminderScheduler; }
+    SettingsStore* getSettingsStore() const { return settingsStore; }
     DataStorage* getDataStorage() const;
     
     // Profile management
@@ -65,9 +85,28 @@ public:
     bool updateProfile(const QString &name, const Profile &profile);
     bool deleteProfile(const QString &name);
     
+    // Active profile settings for the current time of day
+    ProfileSchedule::Slot getScheduledSettings() const;
+    
+    // Immutable view of every profile for readers on other threads
+    ProfileSetSnapshot getProfileSnapshot() const;
+    
     // Data access
     QVector<QPair<QDateTime, double>> getGlucoseHistory(const QDateTime &start, const QDateTime &end) const;
     QVector<QPair<QDateTime, double>> getInsulinHistory(const QDateTime &start, const QDateTime &end) const;
+    InsulinHistoryCursor getInsulinHistoryCursor(const QDateTime &start, const QDateTime &end) const;
+    const TimeSeriesStore &getGlucoseSeries() const;
+    HistorySnapshot getHistorySnapshot() const;
+    
+    // Refresh the history size gauges in the metrics registry
+    void publishMetrics() const;
+    
+    // Timers watched by the stall monitor
+    QTimer *getControlIQTimer() const { return controlIQTimer; }
+    QTimer *getBasalConsumptionTimer() const { return basalConsumptionTimer; }
+    
+    // Deadline accounting for the Control-IQ cycle
+    const ControlLoopMonitor &getControlIQDeadlines() const { return controlIQDeadlines; }
     
     // Bolus delivery
     bool deliverBolus(double units, bool extended = false, int duration = 0);
@@ -78,6 +117,11 @@ public:
     bool saveData(const QString &directory);
     bool loadData(const QString &directory);
     
+    // Writes the glucose readings and insulin history in [start, end] to a
+    // CSV file, streamed from the histories in place (see CsvExporter)
+    bool exportHistoryCSV(const QString &filename, const QDateTime &start, const QDateTime &end,
+                          int bucketMinutes = 0) const;
+    
     // Test panel methods
     void updateBatteryLevel(int level);
     void updateInsulinRemaining(double units);
@@ -91,7 +135,7 @@ public slots:
     void updateInsulinOnBoard();
     void updateBasalConsumption();
     void runControlIQ();
-    void checkReminders();
+    void raiseReminder(quint32 id, const QString &type);
     void checkForOcclusion();
     void simulateGlucoseReading();
     void savePumpState();
@@ -113,8 +157,9 @@ signals:
     void bolusDeliveryCompleted(double units);
     void bolusDeliveryCancelled(double delivered, double requested);
     void alertTriggered(const QString &message, PumpModel::AlertLevel level);
-    void graphDataChanged(const QVector<QPair<QDateTime, double>> &data);
+    void graphDataChanged(const TimeSeriesStore &series);
     void shutdownRequested();
+    void initializationFinished();
     
 private:
     PumpModel *pumpModel;
@@ -125,27 +170,50 @@ private:
     DataStorage *dataStorage;
     ErrorHandler *errorHandler;
     AlertController *alertController;
+    ReminderScheduler *reminderScheduler;
+    SettingsStore *settingsStore;
     
     QTimer *batteryTimer;
     QTimer *glucoseTimer;
     QTimer *iobTimer;
     QTimer *controlIQTimer;
-    QTimer *reminderTimer;
     QTimer *occlusionTimer;
     QTimer *basalConsumptionTimer;
     
     bool running;
     bool controlIQEnabled;
+    double lastLoggedControlIQRate;  // -1 when the last cycle made no adjustment
+    bool lowGlucoseSuspended;  // Control-IQ suspended basal for low glucose and has not resumed it
+    int basalScheduleSlot;  // Schedule slot the manual basal rate was last set for
     int simulationSpeedFactor;
     
+    // Simulated pump clock. Each basal consumption tick moves it on by
+    // 5 s, simulationSpeedFactor times the tick's real interval; insulin
+    // delivery, the basal schedule and boluses run on it.
+    Timestamp pumpTime;
+    bool initialized;
+    bool initializing;
+    QThreadPool backgroundPool;
+    ControlLoopMonitor controlIQDeadlines;
+    
+    // Saved state files parsed by the startup worker
+    struct SavedStateFiles {
+        QJsonObject pumpState;
+        QJsonObject profiles;
+        QJsonObject glucoseReadings;
+        QJsonObject insulinData;
+    };
+    
+    void applySavedState(const SavedStateFiles &saved);
     void setupTimers();
+    void runScheduledControlIQ();
     void connectModelSignals();
     void startSimulation();
     void stopSimulation();
     
+    void applyAlertSettings(const AlertSettings &settings);
     void checkLowBattery();
     void checkLowInsulin();
-    void checkGlucoseAlerts();
 };
 
 #endif // PUMPCONTROLLER_H
@@ -6,6 +6,8 @@
 #include <QFile>
 #include <iostream>
 #include <QFontDatabase>
+#include <QElapsedTimer>
+#include "utils/tracing.h"
 
 // Helper function to remove fixed size constraints from UI file
 bool removeFixedSizeConstraints()
@@ -100,8 +102,22 @@ bool removeAllFixedSizeConstraints()
 
 int main(int argc, char *argv[])
 {
-    // Remove size constraints from UI files before creating QApplication
-    removeAllFixedSizeConstraints();
+    // Startup is measured from here to the first painted frame
+    QElapsedTimer startupTimer;
+    startupTimer.start();
+    
+    // The .ui files are compiled by uic at build time, so rewriting them on
+    // every launch only slowed startup. It is now an explicit maintenance step.
+    for (int i = 1; i < argc; ++i) {
+        if (qstrcmp(argv[i], "--strip-ui-constraints") == 0) {
+            return removeAllFixedSizeConstraints() ? 0 : 1;
+        }
+    }
+    
+    // TSLIM_TRACE=1 records from startup; otherwise use Tools > Enable Tracing
+    if (qEnvironmentVariableIntValue("TSLIM_TRACE") != 0) {
+        Tracer::setEnabled(true);
+    }
     
     QApplication app(argc, argv);
     app.setApplicationName("t:slim X2 Simulator");
@@ -140,6 +156,7 @@ int main(int argc, char *argv[])
     
     // Create and show the main window
     MainWindow mainWindow;
+    mainWindow.setStartupTimer(startupTimer);
     
     // Set a reasonable initial size
     QScreen *screen = QGuiApplication::primaryScreen();
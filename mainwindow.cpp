@@ -14,16 +14,32 @@
 #include "testpanel.h"
 #include "forceresizable.h"
 #include "views/alertsscreen.h"
+#include "utils/tracing.h"
+#include "utils/metrics.h"
+#include "utils/stallmonitor.h"
 #include <QCoreApplication>
+#include <QEvent>
 #include <iostream>
 
 
 // Constructor with improved resizing approach
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent),
+      bolusScreen(nullptr),
+      profileScreen(nullptr),
+      optionsScreen(nullptr),
+      historyScreen(nullptr),
+      controlIQScreen(nullptr),
+      alertsScreen(nullptr),
+      pinLockScreen(nullptr),
+      pinSettingsScreen(nullptr),
+      testPanel(nullptr),
       isPoweredOn(false),
       isLocked(false),
-      isSleeping(false)
+      isSleeping(false),
+      metricsDumpEnabled(false),
+      firstFrameShown(false),
+      initializationStarted(false)
 {
     // Set window title
     setWindowTitle("t:slim X2 Simulator");
@@ -43,8 +59,12 @@ MainWindow::MainWindow(QWidget *parent)
     // Start the pump in powered off state
     powerOff();
     
-    // Simulate power on for demo purposes
-    QTimer::singleShot(500, this, &MainWindow::powerOn);
+    // Saved state and history are loaded once the home screen has been
+    // painted (see eventFilter); the pump powers on when that finishes.
+    // Fall back to a timer in case the window is never painted, e.g. when
+    // started minimised.
+    homeScreen->installEventFilter(this);
+    QTimer::singleShot(1000, this, &MainWindow::startDeferredInitialization);
 }
 
 MainWindow::~MainWindow()
@@ -90,27 +110,10 @@ void MainWindow::setupUi()
     sleepOverlay->setGeometry(this->rect());
     sleepOverlay->hide();
     
-    // Create all screen widgets
+    // Only the home screen is needed for the first frame; the others are
+    // created and added to the stack by their getters on first navigation
     homeScreen = new HomeScreen(this);
-    bolusScreen = new BolusScreen(this);
-    profileScreen = new ProfileScreen(this);
-    optionsScreen = new OptionsScreen(this);
-    historyScreen = new HistoryScreen(this);
-    controlIQScreen = new ControlIQScreen(this);
-    alertsScreen = new AlertsScreen(this);
-    pinLockScreen = new PinLockScreen(this);
-    pinSettingsScreen = new PinSettingsScreen(this);
-    
-    // Add all screens to stacked widget
     stackedWidget->addWidget(homeScreen);
-    stackedWidget->addWidget(bolusScreen);
-    stackedWidget->addWidget(profileScreen);
-    stackedWidget->addWidget(optionsScreen);
-    stackedWidget->addWidget(historyScreen);
-    stackedWidget->addWidget(controlIQScreen);
-    stackedWidget->addWidget(alertsScreen);
-    stackedWidget->addWidget(pinLockScreen);
-    stackedWidget->addWidget(pinSettingsScreen);
     
     // Create menu bar with additional options
     QMenuBar *menuBar = new QMenuBar(this);
@@ -128,6 +131,20 @@ void MainWindow::setupUi()
     QAction *loadPumpAction = toolsMenu->addAction("Load Pump State");
     connect(loadPumpAction, &QAction::triggered, this, &MainWindow::loadPumpState);
     
+    toolsMenu->addSeparator();
+    
+    QAction *tracingAction = toolsMenu->addAction("Enable Tracing");
+    tracingAction->setCheckable(true);
+    tracingAction->setChecked(Tracer::isEnabled());
+    connect(tracingAction, &QAction::toggled, this, &MainWindow::setTracingEnabled);
+    
+    QAction *saveTraceAction = toolsMenu->addAction("Save Trace");
+    connect(saveTraceAction, &QAction::triggered, this, &MainWindow::saveTrace);
+    
+    QAction *metricsDumpAction = toolsMenu->addAction("Dump Metrics Periodically");
+    metricsDumpAction->setCheckable(true);
+    connect(metricsDumpAction, &QAction::toggled, this, &MainWindow::setMetricsDumpEnabled);
+    
     // View menu
     QAction *normalSizeAction = viewMenu->addAction("Normal Size (1x)");
     QAction *largeSizeAction = viewMenu->addAction("Large Size (1.5x)");
@@ -165,14 +182,7 @@ void MainWindow::setupPumpController()
 {
     pumpController = new PumpController(this);
     
-    // Set controller connections for screens
-    historyScreen->setPumpController(pumpController);
-    controlIQScreen->setPumpController(pumpController);
-    controlIQScreen->setControlIQAlgorithm(pumpController->getControlIQAlgorithm());
-    alertsScreen->setAlertController(pumpController->getAlertController());
-    
-    // Create test panel
-    testPanel = new TestPanel(pumpController, this);
+    // Screens that need the controller get it when they are created
     
     // Setup simulation data updates at faster intervals for testing
     simulationTimer = new QTimer(this);
@@ -198,6 +208,17 @@ void MainWindow::setupPumpController()
         }
     });
     backgroundTimer->start(5000); // Every 5 seconds for background updates
+    
+    // Event loop lag, stall detection and jitter of the safety-relevant timers
+    stallMonitor = new StallMonitor(this);
+    stallMonitor->watchTimer(pumpController->getControlIQTimer(), "controliq");
+    stallMonitor->watchTimer(pumpController->getBasalConsumptionTimer(), "basal_consumption");
+    stallMonitor->start();
+    
+    // Refresh history gauges (and dump them if enabled) every 10 seconds
+    metricsTimer = new QTimer(this);
+    connect(metricsTimer, &QTimer::timeout, this, &MainWindow::updateMetrics);
+    metricsTimer->start(10000);
 }
 
 void MainWindow::connectSignals()
@@ -214,44 +235,6 @@ void MainWindow::connectSignals()
     
     connect(homeScreen, &HomeScreen::controlIQButtonClicked, this, &MainWindow::showControlIQScreen);
     
-    // Connect navigation signals from other screens
-    connect(bolusScreen, &BolusScreen::backButtonClicked, this, &MainWindow::showOptionsScreen);
-    connect(profileScreen, &ProfileScreen::backButtonClicked, this, &MainWindow::showOptionsScreen);
-    connect(optionsScreen, &OptionsScreen::backButtonClicked, this, &MainWindow::showHomeScreen);
-    connect(historyScreen, &HistoryScreen::backButtonClicked, this, &MainWindow::showOptionsScreen);
-    connect(controlIQScreen, &ControlIQScreen::backButtonClicked, this, &MainWindow::showOptionsScreen);
-    connect(alertsScreen, &AlertsScreen::backButtonClicked, this, &MainWindow::showOptionsScreen);
-    
-    // Connect PIN screen signals
-    connect(pinLockScreen, &PinLockScreen::pinAccepted, this, [this]() {
-        isLocked = false;
-        showHomeScreen();
-    });
-    
-    connect(pinLockScreen, &PinLockScreen::backButtonClicked, this, [this]() {
-        if (!pumpController->isPumpRunning()) {
-            // If pump is off, allow going back
-            showHomeScreen();
-        } else {
-            // Otherwise PIN is required
-            QMessageBox::warning(this, "PIN Required", "You must enter your PIN to access the pump.");
-        }
-    });
-    
-    connect(pinSettingsScreen, &PinSettingsScreen::backButtonClicked, this, &MainWindow::showOptionsScreen);
-    
-    // Connect options screen navigation
-    connect(optionsScreen, &OptionsScreen::profilesButtonClicked, this, &MainWindow::showProfileScreen);
-    connect(optionsScreen, &OptionsScreen::alertsButtonClicked, this, &MainWindow::showAlertsScreen);
-    connect(optionsScreen, &OptionsScreen::securitySettingsButtonClicked, this, &MainWindow::showPinSettingsScreen);
-    
-    // Use lambda for signals without parameters connecting to slots with parameters
-    connect(optionsScreen, &OptionsScreen::historyButtonClicked, this, [this]() {
-        showHistoryScreen(0); // Default to first tab
-    });
-    
-    connect(optionsScreen, &OptionsScreen::controlIQButtonClicked, this, &MainWindow::showControlIQScreen);
-    
     // Connect controller signals to UI updates
     connect(pumpController, &PumpController::batteryLevelChanged, homeScreen, &HomeScreen::updateBatteryLevel);
     connect(pumpController, &PumpController::insulinRemainingChanged, homeScreen, &HomeScreen::updateInsulinRemaining);
@@ -259,25 +242,161 @@ void MainWindow::connectSignals()
     connect(pumpController, &PumpController::glucoseTrendChanged, homeScreen, &HomeScreen::updateGlucoseTrend);
     connect(pumpController, &PumpController::insulinOnBoardChanged, homeScreen, &HomeScreen::updateInsulinOnBoard);
     connect(pumpController, &PumpController::controlIQActionChanged, homeScreen, &HomeScreen::updateControlIQAction);
-    connect(pumpController, &PumpController::graphDataChanged, homeScreen, &HomeScreen::updateGlucoseGraph);
+    connect(pumpController, &PumpController::graphDataChanged, homeScreen, &HomeScreen::updateGlucoseSeries);
     connect(pumpController, &PumpController::shutdownRequested, this, &MainWindow::handlePumpShutdown);
     
-    // Connect bolus controller signals
-    connect(bolusScreen, &BolusScreen::bolusRequested, pumpController, &PumpController::deliverBolus);
+    // Power on once saved state and history have been loaded
+    connect(pumpController, &PumpController::initializationFinished, this, &MainWindow::powerOn);
+    
+    // Signals of the other screens are connected by their getters
+}
+
+BolusScreen *MainWindow::getBolusScreen()
+{
+    if (!bolusScreen) {
+        bolusScreen = new BolusScreen(this);
+        stackedWidget->addWidget(bolusScreen);
+        
+        connect(bolusScreen, &BolusScreen::backButtonClicked, this, &MainWindow::showOptionsScreen);
+        connect(bolusScreen, &BolusScreen::homeButtonClicked, this, &MainWindow::showHomeScreen);
+        
+        // Connect bolus controller signals
+        connect(bolusScreen, &BolusScreen::bolusRequested, pumpController, &PumpController::deliverBolus);
+    }
+    
+    return bolusScreen;
+}
+
+ProfileScreen *MainWindow::getProfileScreen()
+{
+    if (!profileScreen) {
+        profileScreen = new ProfileScreen(this);
+        stackedWidget->addWidget(profileScreen);
+        
+        connect(profileScreen, &ProfileScreen::backButtonClicked, this, &MainWindow::showOptionsScreen);
+        connect(profileScreen, &ProfileScreen::homeButtonClicked, this, &MainWindow::showHomeScreen);
+        
+        // Connect profile signals
+        connect(profileScreen, &ProfileScreen::profileCreated, pumpController, &PumpController::createProfile);
+        connect(profileScreen, &ProfileScreen::profileUpdated, pumpController, &PumpController::updateProfile);
+        connect(profileScreen, &ProfileScreen::profileDeleted, pumpController, &PumpController::deleteProfile);
+        connect(profileScreen, &ProfileScreen::profileActivated, pumpController, &PumpController::setActiveProfile);
+    }
+    
+    return profileScreen;
+}
+
+OptionsScreen *MainWindow::getOptionsScreen()
+{
+    if (!optionsScreen) {
+        optionsScreen = new OptionsScreen(this);
+        stackedWidget->addWidget(optionsScreen);
+        
+        connect(optionsScreen, &OptionsScreen::backButtonClicked, this, &MainWindow::showHomeScreen);
+        connect(optionsScreen, &OptionsScreen::homeButtonClicked, this, &MainWindow::showHomeScreen);
+        
+        // Connect options screen navigation
+        connect(optionsScreen, &OptionsScreen::profilesButtonClicked, this, &MainWindow::showProfileScreen);
+        connect(optionsScreen, &OptionsScreen::alertsButtonClicked, this, &MainWindow::showAlertsScreen);
+        connect(optionsScreen, &OptionsScreen::securitySettingsButtonClicked, this, &MainWindow::showPinSettingsScreen);
+        
+        // Use lambda for signals without parameters connecting to slots with parameters
+        connect(optionsScreen, &OptionsScreen::historyButtonClicked, this, [this]() {
+            showHistoryScreen(0); // Default to first tab
+        });
+        
+        connect(optionsScreen, &OptionsScreen::controlIQButtonClicked, this, &MainWindow::showControlIQScreen);
+    }
+    
+    return optionsScreen;
+}
+
+HistoryScreen *MainWindow::getHistoryScreen()
+{
+    if (!historyScreen) {
+        historyScreen = new HistoryScreen(this);
+        stackedWidget->addWidget(historyScreen);
+        historyScreen->setPumpController(pumpController);
+        
+        connect(historyScreen, &HistoryScreen::backButtonClicked, this, &MainWindow::showOptionsScreen);
+        connect(historyScreen, &HistoryScreen::homeButtonClicked, this, &MainWindow::showHomeScreen);
+    }
+    
+    return historyScreen;
+}
+
+ControlIQScreen *MainWindow::getControlIQScreen()
+{
+    if (!controlIQScreen) {
+        controlIQScreen = new ControlIQScreen(this);
+        stackedWidget->addWidget(controlIQScreen);
+        controlIQScreen->setPumpController(pumpController);
+        controlIQScreen->setControlIQAlgorithm(pumpController->getControlIQAlgorithm());
+        
+        connect(controlIQScreen, &ControlIQScreen::backButtonClicked, this, &MainWindow::showOptionsScreen);
+        connect(controlIQScreen, &ControlIQScreen::homeButtonClicked, this, &MainWindow::showHomeScreen);
+    }
+    
+    return controlIQScreen;
+}
+
+AlertsScreen *MainWindow::getAlertsScreen()
+{
+    if (!alertsScreen) {
+        alertsScreen = new AlertsScreen(this);
+        stackedWidget->addWidget(alertsScreen);
+        
+        // Picks up the alerts raised before the screen existed
+        alertsScreen->setAlertController(pumpController->getAlertController());
+        alertsScreen->setReminderScheduler(pumpController->getReminderScheduler());
+        alertsScreen->setSettingsStore(pumpController->getSettingsStore());
+        
+        connect(alertsScreen, &AlertsScreen::backButtonClicked, this, &MainWindow::showOptionsScreen);
+        connect(alertsScreen, &AlertsScreen::homeButtonClicked, this, &MainWindow::showHomeScreen);
+    }
+    
+    return alertsScreen;
+}
+
+PinLockScreen *MainWindow::getPinLockScreen()
+{
+    if (!pinLockScreen) {
+        pinLockScreen = new PinLockScreen(this);
+        pinLockScreen->setSettingsStore(pumpController->getSettingsStore());
+        stackedWidget->addWidget(pinLockScreen);
+        
+        // Connect PIN screen signals
+        connect(pinLockScreen, &PinLockScreen::pinAccepted, this, [this]() {
+            isLocked = false;
+            showHomeScreen();
+        });
+        
+        connect(pinLockScreen, &PinLockScreen::backButtonClicked, this, [this]() {
+            if (!pumpController->isPumpRunning()) {
+                // If pump is off, allow going back
+                showHomeScreen();
+            } else {
+                // Otherwise PIN is required
+                QMessageBox::warning(this, "PIN Required", "You must enter your PIN to access the pump.");
+            }
+        });
+    }
     
-    // Connect profile signals
-    connect(profileScreen, &ProfileScreen::profileCreated, pumpController, &PumpController::createProfile);
-    connect(profileScreen, &ProfileScreen::profileUpdated, pumpController, &PumpController::updateProfile);
-    connect(profileScreen, &ProfileScreen::profileDeleted, pumpController, &PumpController::deleteProfile);
-    connect(profileScreen, &ProfileScreen::profileActivated, pumpController, &PumpController::setActiveProfile);
+    return pinLockScreen;
+}
 
-    connect(bolusScreen, &BolusScreen::homeButtonClicked, this, &MainWindow::showHomeScreen);
-    connect(profileScreen, &ProfileScreen::homeButtonClicked, this, &MainWindow::showHomeScreen);
-    connect(optionsScreen, &OptionsScreen::homeButtonClicked, this, &MainWindow::showHomeScreen);
-    connect(historyScreen, &HistoryScreen::homeButtonClicked, this, &MainWindow::showHomeScreen);
-    connect(controlIQScreen, &ControlIQScreen::homeButtonClicked, this, &MainWindow::showHomeScreen);
-    connect(alertsScreen, &AlertsScreen::homeButtonClicked, this, &MainWindow::showHomeScreen);
-    connect(pinSettingsScreen, &PinSettingsScreen::homeButtonClicked, this, &MainWindow::showHomeScreen);
+PinSettingsScreen *MainWindow::getPinSettingsScreen()
+{
+    if (!pinSettingsScreen) {
+        pinSettingsScreen = new PinSettingsScreen(this);
+        pinSettingsScreen->setSettingsStore(pumpController->getSettingsStore());
+        stackedWidget->addWidget(pinSettingsScreen);
+        
+        connect(pinSettingsScreen, &PinSettingsScreen::backButtonClicked, this, &MainWindow::showOptionsScreen);
+        connect(pinSettingsScreen, &PinSettingsScreen::homeButtonClicked, this, &MainWindow::showHomeScreen);
+    }
+    
+    return pinSettingsScreen;
 }
 
 void MainWindow::setScaleFactor(double factor)
@@ -327,7 +446,7 @@ void MainWindow::navigateToScreen(const QString &screenName)
 void MainWindow::showHomeScreen()
 {
     // If PIN is enabled and screen is locked, show PIN screen instead
-    if (pinLockScreen->isPinEnabled() && isLocked) {
+    if (isLocked && getPinLockScreen()->isPinEnabled()) {
         showPinLockScreen();
         return;
     }
@@ -343,24 +462,24 @@ void MainWindow::showHomeScreen()
 
 void MainWindow::showBolusScreen()
 {
-    stackedWidget->setCurrentWidget(bolusScreen);
+    stackedWidget->setCurrentWidget(getBolusScreen());
     bolusScreen->updateCurrentValues(pumpController);
 }
 
 void MainWindow::showProfileScreen()
 {
-    stackedWidget->setCurrentWidget(profileScreen);
+    stackedWidget->setCurrentWidget(getProfileScreen());
     profileScreen->loadProfiles(pumpController);
 }
 
 void MainWindow::showOptionsScreen()
 {
-    stackedWidget->setCurrentWidget(optionsScreen);
+    stackedWidget->setCurrentWidget(getOptionsScreen());
 }
 
 void MainWindow::showHistoryScreen(int tabIndex)
 {
-    stackedWidget->setCurrentWidget(historyScreen);
+    stackedWidget->setCurrentWidget(getHistoryScreen());
     
     // If a specific tab index was provided, switch to that tab
     if (historyScreen->getTabWidget() && tabIndex >= 0 && tabIndex < historyScreen->getTabWidget()->count()) {
@@ -373,30 +492,30 @@ void MainWindow::showHistoryScreen(int tabIndex)
 
 void MainWindow::showControlIQScreen()
 {
-    stackedWidget->setCurrentWidget(controlIQScreen);
+    stackedWidget->setCurrentWidget(getControlIQScreen());
     controlIQScreen->updateUIFromSettings();
 }
 
 void MainWindow::showAlertsScreen()
 {
-    stackedWidget->setCurrentWidget(alertsScreen);
+    stackedWidget->setCurrentWidget(getAlertsScreen());
 }
 
 void MainWindow::showPinLockScreen()
 {
-    stackedWidget->setCurrentWidget(pinLockScreen);
+    stackedWidget->setCurrentWidget(getPinLockScreen());
 }
 
 void MainWindow::showPinSettingsScreen()
 {
-    pinSettingsScreen->updateSettings();
+    getPinSettingsScreen()->updateSettings();
     stackedWidget->setCurrentWidget(pinSettingsScreen);
 }
 
 void MainWindow::checkPinLock()
 {
-    // Check if PIN is enabled
-    if (pinLockScreen->isPinEnabled()) {
+    // Check if PIN is enabled (without building the PIN screen when it isn't)
+    if (pumpController->getSettingsStore()->security().pinEnabled) {
         // Lock the screen
         isLocked = true;
         showPinLockScreen();
@@ -409,6 +528,10 @@ void MainWindow::checkPinLock()
 
 void MainWindow::showTestPanel()
 {
+    if (!testPanel) {
+        testPanel = new TestPanel(pumpController, this);
+    }
+    
     testPanel->show();
 }
 
@@ -555,6 +678,51 @@ void MainWindow::loadPumpState()
     }
 }
 
+void MainWindow::setTracingEnabled(bool enabled)
+{
+    // Start each tracing session from an empty buffer
+    if (enabled && !Tracer::isEnabled()) {
+        Tracer::clear();
+    }
+    
+    Tracer::setEnabled(enabled);
+}
+
+void MainWindow::saveTrace()
+{
+    QString filename = QDir::homePath() + "/.tslimx2simulator/trace-" +
+                       QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss") + ".json";
+    
+    if (Tracer::writeChromeTrace(filename)) {
+        QString message = "Trace saved to " + filename + "\n\nOpen it in chrome://tracing or ui.perfetto.dev.";
+        if (Tracer::droppedEvents() > 0) {
+            message += QString("\n%1 events did not fit in the trace buffers.").arg(Tracer::droppedEvents());
+        }
+        QMessageBox::information(this, "Trace Saved", message);
+    } else {
+        QMessageBox::warning(this, "Save Failed", "Failed to write " + filename);
+    }
+}
+
+void MainWindow::setMetricsDumpEnabled(bool enabled)
+{
+    metricsDumpEnabled = enabled;
+    
+    // Write a first snapshot straight away
+    if (enabled) {
+        updateMetrics();
+    }
+}
+
+void MainWindow::updateMetrics()
+{
+    pumpController->publishMetrics();
+    
+    if (metricsDumpEnabled) {
+        Metrics::writeJson(QDir::homePath() + "/.tslimx2simulator/metrics.json");
+    }
+}
+
 // Override to ensure resizing works
 void MainWindow::resizeEvent(QResizeEvent *event)
 {
@@ -571,6 +739,41 @@ void MainWindow::resizeEvent(QResizeEvent *event)
     }
 }
 
+void MainWindow::setStartupTimer(const QElapsedTimer &timer)
+{
+    startupTimer = timer;
+}
+
+bool MainWindow::eventFilter(QObject *watched, QEvent *event)
+{
+    if (watched == homeScreen && event->type() == QEvent::Paint && !firstFrameShown) {
+        firstFrameShown = true;
+        homeScreen->removeEventFilter(this);
+        
+        static MetricGauge *firstFrame = Metrics::gauge("startup.first_frame_ms");
+        if (startupTimer.isValid()) {
+            firstFrame->set(startupTimer.elapsed());
+        }
+        
+        // Let this paint finish before queueing the background work
+        QTimer::singleShot(0, this, &MainWindow::startDeferredInitialization);
+    }
+    
+    return QMainWindow::eventFilter(watched, event);
+}
+
+// Runs once, on the first paint of the home screen or the fallback timer,
+// whichever comes first
+void MainWindow::startDeferredInitialization()
+{
+    if (initializationStarted) {
+        return;
+    }
+    
+    initializationStarted = true;
+    pumpController->initializeAsync();
+}
+
 void MainWindow::mousePressEvent(QMouseEvent *event)
 {
     if (isSleeping) {
@@ -5,6 +5,7 @@
 #include <QStackedWidget>
 #include <QResizeEvent>
 #include <QMouseEvent>
+#include <QElapsedTimer>
 #include "controllers/pumpcontroller.h"
 #include "views/homescreen.h"
 #include "views/bolusscreen.h"
@@ -19,6 +20,7 @@
 class TestPanel;
 class ForceResizable;
 class AlertsScreen;  // Add this forward declaration
+class StallMonitor;
 
 class MainWindow : public QMainWindow
 {
@@ -31,10 +33,14 @@ public:
     // Navigation methods
     void navigateToScreen(const QString &screenName);
     
+    // Started at the top of main(); used to report time to first frame
+    void setStartupTimer(const QElapsedTimer &timer);
+
 protected:
     // Override resize event to handle custom resizing behavior
     void resizeEvent(QResizeEvent *event) override;
     void mousePressEvent(QMouseEvent *event) override;
+    bool eventFilter(QObject *watched, QEvent *event) override;
     
 private slots:
     // Screen navigation
@@ -57,8 +63,13 @@ private slots:
     void powerOff();
     void savePumpState();
     void loadPumpState();
+    void setTracingEnabled(bool enabled);
+    void saveTrace();
+    void setMetricsDumpEnabled(bool enabled);
+    void updateMetrics();
     void setScaleFactor(double factor);
     void checkPinLock();
+    void startDeferredInitialization();
     
     // Sleep mode functions
     void enterSleepMode();
@@ -70,6 +81,16 @@ private:
     void setupPumpController();
     void connectSignals();
     
+    // Screens other than home are built on first navigation
+    BolusScreen *getBolusScreen();
+    ProfileScreen *getProfileScreen();
+    OptionsScreen *getOptionsScreen();
+    HistoryScreen *getHistoryScreen();
+    ControlIQScreen *getControlIQScreen();
+    AlertsScreen *getAlertsScreen();
+    PinLockScreen *getPinLockScreen();
+    PinSettingsScreen *getPinSettingsScreen();
+    
     // UI Components
     QStackedWidget *stackedWidget;
     HomeScreen *homeScreen;
@@ -96,8 +117,18 @@ private:
     QTimer *simulationTimer;
     QTimer *backgroundTimer;
     
+    // Metrics: stall monitor and periodic refresh/dump
+    StallMonitor *stallMonitor;
+    QTimer *metricsTimer;
+    bool metricsDumpEnabled;
+    
     // Sleep mode overlay
     QWidget *sleepOverlay;
+    
+    // Startup timing
+    QElapsedTimer startupTimer;  // Time to first frame goes to startup.first_frame_ms
+    bool firstFrameShown;
+    bool initializationStarted;
 };
 
 #endif // MAINWINDOW_H
\ No newline at end of file
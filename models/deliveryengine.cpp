@@ -0,0 +1,195 @@
+#include "deliveryengine.h"
+#include <QtGlobal>
+#include <algorithm>
+
+namespace {
+
+const double MsPerHour = 3600.0 * 1000.0;
+
+// Heap order: earliest first, basal before boluses at the same time
+bool later(qint64 aTime, quint32 aProgram, qint64 bTime, quint32 bProgram)
+{
+    return aTime != bTime ? aTime > bTime : aProgram > bProgram;
+}
+
+}
+
+DeliveryEngine::DeliveryEngine()
+    : nextBolusId(1)
+{
+    basal.rate = 0.0;
+    basal.accrued = 0.0;
+    basal.accruedAt = 0;
+    basal.generation = 0;
+    
+    // The basal rate and a bolus, plus room for stale basal entries left
+    // by rate changes
+    heap.reserve(16);
+    boluses.reserve(4);
+}
+
+int DeliveryEngine::pulsesFor(double units)
+{
+    return qMax(0, qRound(units / PulseUnits));
+}
+
+void DeliveryEngine::setBasalRate(double unitsPerHour, qint64 now)
+{
+    unitsPerHour = qMax(0.0, unitsPerHour);
+    
+    // Bank what the old rate delivered towards the next pulse
+    if (basal.rate > 0.0 && now > basal.accruedAt) {
+        basal.accrued += basal.rate * (now - basal.accruedAt) / MsPerHour;
+    }
+    basal.accruedAt = now;
+    basal.rate = unitsPerHour;
+    ++basal.generation;
+    
+    if (basal.rate > 0.0) {
+        const double remaining = qMax(0.0, PulseUnits - basal.accrued);
+        push({now + static_cast<qint64>(remaining / basal.rate * MsPerHour), 0, basal.generation});
+    }
+}
+
+quint32 DeliveryEngine::startBolus(double immediateUnits, double extendedUnits, int extendedMinutes, qint64 now)
+{
+    int immediatePulses = pulsesFor(immediateUnits);
+    int extendedPulses = pulsesFor(extendedUnits);
+    
+    // Without a duration the extended part is delivered straight away
+    if (extendedMinutes <= 0) {
+        immediatePulses += extendedPulses;
+        extendedPulses = 0;
+    }
+    
+    if (immediatePulses + extendedPulses == 0) {
+        return 0;
+    }
+    
+    BolusProgram bolus;
+    bolus.id = nextBolusId++;
+    if (nextBolusId == 0) {
+        nextBolusId = 1;
+    }
+    bolus.start = now;
+    bolus.immediatePulses = immediatePulses;
+    bolus.totalPulses = immediatePulses + extendedPulses;
+    bolus.delivered = 0;
+    bolus.immediateIntervalMs = static_cast<qint64>(PulseUnits / StandardBolusUnitsPerMinute * 60000.0);
+    bolus.extendedIntervalMs = extendedPulses > 0 ? extendedMinutes * 60000LL / extendedPulses : 0;
+    boluses.append(bolus);
+    
+    push({pulseTime(bolus, 0), bolus.id, 0});
+    return bolus.id;
+}
+
+double DeliveryEngine::cancelBolus(quint32 id)
+{
+    const int index = findBolus(id);
+    if (index < 0) {
+        return 0.0;
+    }
+    
+    // Its heap entry is dropped when it reaches the top
+    const int delivered = boluses.at(index).delivered;
+    boluses.remove(index);
+    return delivered * PulseUnits;
+}
+
+qint64 DeliveryEngine::nextPulseTime()
+{
+    dropStale();
+    return heap.isEmpty() ? -1 : heap.first().time;
+}
+
+bool DeliveryEngine::takeDue(qint64 now, Pulse &pulse)
+{
+    dropStale();
+    if (heap.isEmpty() || heap.first().time > now) {
+        return false;
+    }
+    
+    const Entry entry = heap.first();
+    pop();
+    
+    pulse.time = entry.time;
+    
+    if (entry.program == 0) {
+        pulse.source = Basal;
+        pulse.bolusId = 0;
+        pulse.last = false;
+        
+        // A whole pulse has accrued by now; start on the next one
+        basal.accrued = 0.0;
+        basal.accruedAt = entry.time;
+        const qint64 interval = qMax<qint64>(1, static_cast<qint64>(PulseUnits / basal.rate * MsPerHour));
+        push({entry.time + interval, 0, basal.generation});
+        return true;
+    }
+    
+    const int index = findBolus(entry.program);
+    BolusProgram &bolus = boluses[index];
+    ++bolus.delivered;
+    
+    pulse.source = Bolus;
+    pulse.bolusId = bolus.id;
+    pulse.last = bolus.delivered >= bolus.totalPulses;
+    
+    if (pulse.last) {
+        boluses.remove(index);
+    } else {
+        push({pulseTime(bolus, bolus.delivered), bolus.id, 0});
+    }
+    return true;
+}
+
+void DeliveryEngine::dropStale()
+{
+    while (!heap.isEmpty()) {
+        const Entry &top = heap.first();
+        const bool stale = top.program == 0 ? top.generation != basal.generation
+                                            : findBolus(top.program) < 0;
+        if (!stale) {
+            return;
+        }
+        pop();
+    }
+}
+
+void DeliveryEngine::push(const Entry &entry)
+{
+    heap.append(entry);
+    std::push_heap(heap.begin(), heap.end(), [](const Entry &a, const Entry &b) {
+        return later(a.time, a.program, b.time, b.program);
+    });
+}
+
+void DeliveryEngine::pop()
+{
+    std::pop_heap(heap.begin(), heap.end(), [](const Entry &a, const Entry &b) {
+        return later(a.time, a.program, b.time, b.program);
+    });
+    heap.removeLast();
+}
+
+int DeliveryEngine::findBolus(quint32 id) const
+{
+    for (int i = 0; i < boluses.size(); ++i) {
+        if (boluses.at(i).id == id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+qint64 DeliveryEngine::pulseTime(const BolusProgram &bolus, int pulse)
+{
+    // Immediate pulses go out back to back from the start
+    if (pulse < bolus.immediatePulses) {
+        return bolus.start + pulse * bolus.immediateIntervalMs;
+    }
+    
+    // Then the extended part, one interval apart, ending with its duration
+    const qint64 extendedStart = bolus.start + bolus.immediatePulses * bolus.immediateIntervalMs;
+    return extendedStart + (pulse - bolus.immediatePulses + 1) * bolus.extendedIntervalMs;
+}
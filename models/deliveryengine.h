@@ -0,0 +1,112 @@
+#ifndef DELIVERYENGINE_H
+#define DELIVERYENGINE_H
+
+#include <QVector>
+
+// Turns the basal rate and boluses into the pump's discrete motor pulses.
+//
+// Each active program (the basal rate and every running bolus) keeps its
+// next pulse in a min-heap ordered by time, so scheduling a program and
+// taking the next pulse are O(log n) in the number of programs. advance()
+// hands out every pulse due up to a time, oldest first; the caller applies
+// them to the reservoir, IOB and history.
+//
+// A basal rate accrues fractions of a pulse across rate changes, so
+// frequent changes (Control-IQ temp rates) neither lose nor add insulin.
+// A bolus delivers its immediate part at StandardBolusUnitsPerMinute and
+// then spreads its extended part evenly over the extended duration: a
+// standard bolus has no extended part, an extended bolus no immediate part
+// and a combo bolus both.
+//
+// Times are in ms since the epoch.
+class DeliveryEngine
+{
+public:
+    static constexpr double PulseUnits = 0.05;
+    static constexpr double StandardBolusUnitsPerMinute = 1.0;
+    
+    enum Source : quint8 {
+        Basal,
+        Bolus
+    };
+    
+    struct Pulse {
+        qint64 time;
+        Source source;
+        quint32 bolusId;  // 0 for basal pulses
+        bool last;        // Final pulse of its bolus
+    };
+    
+    DeliveryEngine();
+    
+    // A rate of 0 stops basal; the part of a pulse already accrued is kept
+    // for when it starts again
+    void setBasalRate(double unitsPerHour, qint64 now);
+    double basalRate() const { return basal.rate; }
+    
+    // Returns the new bolus's id, or 0 if it rounds to no pulses
+    quint32 startBolus(double immediateUnits, double extendedUnits, int extendedMinutes, qint64 now);
+    
+    // Stops a bolus and returns the units it had delivered
+    double cancelBolus(quint32 id);
+    
+    bool isBolusActive(quint32 id) const { return findBolus(id) >= 0; }
+    
+    // Time of the next pulse, or -1 if nothing is scheduled
+    qint64 nextPulseTime();
+    
+    // Calls deliver(const Pulse &) for every pulse due at or before now,
+    // in time order, and returns how many there were
+    template <typename Fn>
+    int advance(qint64 now, Fn &&deliver)
+    {
+        int count = 0;
+        Pulse pulse;
+        while (takeDue(now, pulse)) {
+            deliver(pulse);
+            ++count;
+        }
+        return count;
+    }
+    
+    static int pulsesFor(double units);
+
+private:
+    // Program 0 is the basal rate; any other is a bolus id
+    struct Entry {
+        qint64 time;
+        quint32 program;
+        quint32 generation;  // Basal entries from before a rate change are stale
+    };
+    
+    struct BasalProgram {
+        double rate;
+        double accrued;      // Units towards the next pulse as of accruedAt
+        qint64 accruedAt;
+        quint32 generation;
+    };
+    
+    struct BolusProgram {
+        quint32 id;
+        qint64 start;
+        int immediatePulses;
+        int totalPulses;
+        int delivered;
+        qint64 immediateIntervalMs;
+        qint64 extendedIntervalMs;
+    };
+    
+    QVector<Entry> heap;
+    BasalProgram basal;
+    QVector<BolusProgram> boluses;
+    quint32 nextBolusId;
+    
+    void push(const Entry &entry);
+    void pop();
+    void dropStale();
+    bool takeDue(qint64 now, Pulse &pulse);
+    int findBolus(quint32 id) const;
+    static qint64 pulseTime(const BolusProgram &bolus, int pulse);
+};
+
+#endif // DELIVERYENGINE_H
@@ -1,4 +1,5 @@
 #include "glucosemodel.h"
+#include "../utils/metrics.h"
 #include <QRandomGenerator>
 #include <QtMath>
 #include <QFile>
@@ -6,12 +7,39 @@
 #include <QJsonObject>
 #include <QJsonArray>
 
+namespace {
+
+// 24 hours at 5-minute intervals
+const int MaxReadings = 288;
+
+// Rate halfway into a trend's band, for trends not calculated from readings
+double typicalRate(GlucoseModel::TrendDirection trend)
+{
+    const double quickRate = GlucoseModel::QuickTrendRate + (GlucoseModel::QuickTrendRate - GlucoseModel::TrendRate) / 2;
+    const double rate = (GlucoseModel::TrendRate + GlucoseModel::QuickTrendRate) / 2;
+    
+    switch (trend) {
+    case GlucoseModel::RisingQuickly:
+        return quickRate;
+    case GlucoseModel::Rising:
+        return rate;
+    case GlucoseModel::Falling:
+        return -rate;
+    case GlucoseModel::FallingQuickly:
+        return -quickRate;
+    default:
+        return 0.0;
+    }
+}
+
+}
+
 GlucoseModel::GlucoseModel(QObject *parent)
     : QObject(parent),
-      currentTrend(Stable)
+      currentTrend(Stable),
+      rateOfChange(0.0)
 {
-    // Generate 48 hours of data on startup
-    generateFixedPattern(48);
+    // Demo history is generated off the startup path by PumpController
 }
 
 double GlucoseModel::getCurrentGlucose() const
@@ -20,16 +48,21 @@ double GlucoseModel::getCurrentGlucose() const
         return 5.5; // Default value
     }
     
-    return readings.last().second;
+    return readings.last().value;
 }
 
 QDateTime GlucoseModel::getLastReadingTime() const
+{
+    return getLastReadingTimestamp().toDateTime();
+}
+
+Timestamp GlucoseModel::getLastReadingTimestamp() const
 {
     if (readings.isEmpty()) {
-        return QDateTime::currentDateTime();
+        return Timestamp::now();
     }
     
-    return readings.last().first;
+    return Timestamp(readings.last().timestamp);
 }
 
 GlucoseModel::TrendDirection GlucoseModel::getTrendDirection() const
@@ -37,36 +70,69 @@ GlucoseModel::TrendDirection GlucoseModel::getTrendDirection() const
     return currentTrend;
 }
 
+double GlucoseModel::getRateOfChange() const
+{
+    return rateOfChange;
+}
+
 void GlucoseModel::forceTrend(TrendDirection trend)
 {
     currentTrend = trend;
+    rateOfChange = typicalRate(trend);
     emit trendDirectionChanged(currentTrend);
 }
 
 QVector<QPair<QDateTime, double>> GlucoseModel::getReadings(const QDateTime &start, const QDateTime &end) const
 {
-    QVector<QPair<QDateTime, double>> result;
-    
-    for (const auto &reading : readings) {
-        if (reading.first >= start && reading.first <= end) {
-            result.append(reading);
-        }
-    }
-    
-    return result;
+    return readings.toPairs(start.toMSecsSinceEpoch(), end.toMSecsSinceEpoch());
+}
+
+const TimeSeriesStore &GlucoseModel::getReadingSeries() const
+{
+    return readings;
+}
+
+HistoryView<TimeSeriesStore::Sample> GlucoseModel::getReadingsView(Timestamp start, Timestamp end) const
+{
+    return readings.view(start.toMSecsSinceEpoch(), end.toMSecsSinceEpoch());
+}
+
+const GlucoseRollup &GlucoseModel::getRollup() const
+{
+    return rollup;
+}
+
+const AgpEngine &GlucoseModel::getAgp() const
+{
+    return agp;
+}
+
+void GlucoseModel::setAgpWindowDays(int days)
+{
+    agp.setWindowDays(days);
+}
+
+void GlucoseModel::reserveHistory(int hours)
+{
+    // The raw series is capped, plus the one reading being added
+    readings.reserve(MaxReadings + 1);
+    rollup.reserve(hours);
+    agp.reserve(hours * 12);
 }
 
 void GlucoseModel::generateFixedPattern(int hoursBack)
 {
-    QDateTime current = QDateTime::currentDateTime();
-    QDateTime start = current.addSecs(-hoursBack * 3600);
-    
-    // Clear existing readings
-    readings.clear();
+    setReadingSeries(buildFixedPattern(hoursBack, Timestamp::now()));
+}
+
+TimeSeriesStore GlucoseModel::buildFixedPattern(int hoursBack, Timestamp current)
+{
+    Timestamp start = current.addSecs(-hoursBack * 3600LL);
+    TimeSeriesStore series;
     
     // Generate readings every 5 minutes
     const int intervalMinutes = 5;
-    QDateTime timestamp = start;
+    Timestamp timestamp = start;
     
     while (timestamp <= current) {
         // Base sine wave with 3-hour period, centered at 7.0 mmol/L with amplitude of 3.0
@@ -119,44 +185,72 @@ void GlucoseModel::generateFixedPattern(int hoursBack)
         glucoseValue = qBound(2.8, glucoseValue, 20.0);
         
         // Add the reading
-        readings.append(qMakePair(timestamp, glucoseValue));
+        series.append(timestamp.toMSecsSinceEpoch(), glucoseValue);
         
         // Move to next sample time
         timestamp = timestamp.addSecs(intervalMinutes * 60);
     }
     
+    return series;
+}
+
+void GlucoseModel::setReadingSeries(const TimeSeriesStore &series)
+{
+    readings = series;
+    
+    rollup.clear();
+    agp.clear();
+    for (const auto &sample : readings.rawSamples()) {
+        rollup.add(sample.timestamp, sample.value);
+        agp.add(sample.timestamp, sample.value);
+    }
+    
     // Calculate trend based on most recent readings
     calculateTrendDirection();
     
     // Notify about the new data
     if (!readings.isEmpty()) {
-        emit newReading(readings.last().second, readings.last().first);
+        emit newReading(readings.last().value, getLastReadingTime());
         emit trendDirectionChanged(currentTrend);
     }
 }
 
 void GlucoseModel::addReading(double value, const QDateTime &timestamp)
+{
+    addReading(value, Timestamp::fromDateTime(timestamp));
+}
+
+void GlucoseModel::addReading(double value, Timestamp timestamp)
 {
     // Add the new reading
-    readings.append(qMakePair(timestamp, value));
+    const qint64 time = timestamp.toMSecsSinceEpoch();
+    readings.append(time, value);
+    rollup.add(time, value);
+    agp.add(time, value);
+    
+    static MetricCounter *ingested = Metrics::counter("glucose.readings_ingested");
+    ingested->increment();
     
     // Keep history to a reasonable size (24 hours at 5-minute intervals = 288 readings)
-    while (readings.size() > 288) {
-        readings.removeFirst();
+    if (readings.size() > MaxReadings) {
+        readings.removeBefore(readings.at(readings.size() - MaxReadings).timestamp);
     }
     
     // Update the trend direction
     calculateTrendDirection();
     
     // Notify of the new reading
-    emit newReading(value, timestamp);
+    emit newReading(value, timestamp.toDateTime());
     emit trendDirectionChanged(currentTrend);
 }
 
 void GlucoseModel::clearReadings()
 {
     readings.clear();
+    rollup.clear();
+    agp.clear();
     currentTrend = Unknown;
+    rateOfChange = 0.0;
     emit trendDirectionChanged(currentTrend);
 }
 
@@ -165,22 +259,21 @@ void GlucoseModel::calculateTrendDirection()
     // Need at least 3 readings to calculate trend
     if (readings.size() < 3) {
         currentTrend = Stable;
+        rateOfChange = 0.0;
         return;
     }
     
-    // Get the most recent 3 readings
-    QVector<QPair<QDateTime, double>> recent;
-    for (int i = readings.size() - 3; i < readings.size(); i++) {
-        recent.append(readings[i]);
-    }
+    // Use the most recent 3 readings
+    const int n = 3;
+    const int first = readings.size() - n;
     
     // Calculate simple linear regression slope
     double sumX = 0, sumY = 0, sumXY = 0, sumX2 = 0;
-    double firstTime = recent[0].first.toSecsSinceEpoch();
+    qint64 firstTime = readings.at(first).timestamp / 1000;
     
-    for (int i = 0; i < recent.size(); i++) {
-        double x = recent[i].first.toSecsSinceEpoch() - firstTime;
-        double y = recent[i].second;
+    for (int i = first; i < readings.size(); i++) {
+        double x = readings.at(i).timestamp / 1000 - firstTime;
+        double y = readings.at(i).value;
         
         sumX += x;
         sumY += y;
@@ -188,17 +281,17 @@ void GlucoseModel::calculateTrendDirection()
         sumX2 += x * x;
     }
     
-    int n = recent.size();
     double slope = (n * sumXY - sumX * sumY) / (n * sumX2 - sumX * sumX);
+    rateOfChange = slope * 60.0;
     
     // Determine trend based on slope
-    if (slope > 0.05) {
+    if (rateOfChange > QuickTrendRate) {
         currentTrend = RisingQuickly;
-    } else if (slope > 0.02) {
+    } else if (rateOfChange > TrendRate) {
         currentTrend = Rising;
-    } else if (slope < -0.05) {
+    } else if (rateOfChange < -QuickTrendRate) {
         currentTrend = FallingQuickly;
-    } else if (slope < -0.02) {
+    } else if (rateOfChange < -TrendRate) {
         currentTrend = Falling;
     } else {
         currentTrend = Stable;
@@ -214,10 +307,10 @@ bool GlucoseModel::saveReadings(const QString &filename)
     
     // Save all readings
     QJsonArray readingsArray;
-    for (const auto &reading : readings) {
+    for (const auto &reading : readings.rawSamples()) {
         QJsonObject readingObj;
-        readingObj["timestamp"] = reading.first.toString(Qt::ISODate);
-        readingObj["value"] = reading.second;
+        readingObj["timestamp"] = QDateTime::fromMSecsSinceEpoch(reading.timestamp).toString(Qt::ISODate);
+        readingObj["value"] = reading.value;
         readingsArray.append(readingObj);
     }
     rootObj["readings"] = readingsArray;
@@ -250,10 +343,16 @@ bool GlucoseModel::loadReadings(const QString &filename)
         return false;
     }
     
-    QJsonObject rootObj = doc.object();
+    return loadReadings(doc.object());
+}
+
+bool GlucoseModel::loadReadings(const QJsonObject &rootObj)
+{
     
     // Clear existing readings
     readings.clear();
+    rollup.clear();
+    agp.clear();
     
     // Load all readings
     QJsonArray readingsArray = rootObj["readings"].toArray();
@@ -263,18 +362,21 @@ bool GlucoseModel::loadReadings(const QString &filename)
         QDateTime timestamp = QDateTime::fromString(readingObj["timestamp"].toString(), Qt::ISODate);
         double glucoseValue = readingObj["value"].toDouble();
         
-        readings.append(qMakePair(timestamp, glucoseValue));
+        readings.append(timestamp, glucoseValue);
+        rollup.add(timestamp, glucoseValue);
+        agp.add(timestamp, glucoseValue);
     }
     
     // Load current trend
     currentTrend = static_cast<TrendDirection>(rootObj["currentTrend"].toInt(Stable));
+    rateOfChange = typicalRate(currentTrend);
     
     // Notify about trend
     emit trendDirectionChanged(currentTrend);
     
     // Notify about the latest reading if available
     if (!readings.isEmpty()) {
-        emit newReading(readings.last().second, readings.last().first);
+        emit newReading(readings.last().value, getLastReadingTime());
     }
     
     return true;
@@ -2,8 +2,13 @@
 #define GLUCOSEMODEL_H
 
 #include <QObject>
+#include <QJsonObject>
 #include <QDateTime>
 #include <QVector>
+#include "../utils/timeseriesstore.h"
+#include "../utils/glucoserollup.h"
+#include "../utils/agpengine.h"
+#include "../utils/timestamp.h"
 
 class GlucoseModel : public QObject
 {
@@ -24,30 +29,62 @@ public:
     // Current glucose data
     double getCurrentGlucose() const;
     QDateTime getLastReadingTime() const;
+    Timestamp getLastReadingTimestamp() const;
     TrendDirection getTrendDirection() const;
     void forceTrend(TrendDirection trend);
     
+    // Slope of the last three readings in mmol/L per minute. A forced or
+    // loaded trend reports a rate typical of it. Beyond TrendRate the trend
+    // is Rising or Falling, beyond QuickTrendRate RisingQuickly or
+    // FallingQuickly.
+    double getRateOfChange() const;
+    static constexpr double TrendRate = 1.2;
+    static constexpr double QuickTrendRate = 3.0;
+    
     // Historical data
     QVector<QPair<QDateTime, double>> getReadings(const QDateTime &start, const QDateTime &end) const;
+    const TimeSeriesStore &getReadingSeries() const;
+    HistoryView<TimeSeriesStore::Sample> getReadingsView(Timestamp start, Timestamp end) const;
+    
+    // Hourly/daily aggregates of every reading since the history was last
+    // replaced; unlike the raw series these are not trimmed to 24 hours
+    const GlucoseRollup &getRollup() const;
+    
+    // Ambulatory glucose profile over the last 14 to 90 days of readings
+    const AgpEngine &getAgp() const;
+    void setAgpWindowDays(int days);
+    
+    // Preallocates room for this many more hours of readings
+    void reserveHistory(int hours);
     
     // Generate fixed pattern data for demo
     void generateFixedPattern(int hoursBack);
     
+    // Same pattern as a standalone series; touches no model state, so it can
+    // be built on a worker thread and handed over with setReadingSeries()
+    static TimeSeriesStore buildFixedPattern(int hoursBack, Timestamp end);
+    void setReadingSeries(const TimeSeriesStore &series);
+    
     // Add new reading
-    void addReading(double value, const QDateTime &timestamp = QDateTime::currentDateTime());
+    void addReading(double value, Timestamp timestamp = Timestamp::now());
+    void addReading(double value, const QDateTime &timestamp);
     void clearReadings();
     
     // Load/save 
     bool saveReadings(const QString &filename);
     bool loadReadings(const QString &filename);
+    bool loadReadings(const QJsonObject &rootObj);
     
 signals:
     void newReading(double value, const QDateTime &timestamp);
     void trendDirectionChanged(TrendDirection direction);
     
 private:
-    QVector<QPair<QDateTime, double>> readings;
+    TimeSeriesStore readings;
+    GlucoseRollup rollup;
+    AgpEngine agp;
     TrendDirection currentTrend;
+    double rateOfChange;
     
     void calculateTrendDirection();
 };
@@ -0,0 +1,124 @@
+#include "insulinhistorycursor.h"
+#include <algorithm>
+#include <limits>
+
+InsulinHistoryCursor::InsulinHistoryCursor(const QVector<InsulinModel::BolusRecord> &boluses,
+                                           const QVector<InsulinModel::BasalRecord> &basalSegments,
+                                           const QDateTime &start,
+                                           const QDateTime &end)
+    : boluses(boluses),
+      basalSegments(basalSegments),
+      rangeStart(start.toMSecsSinceEpoch()),
+      rangeEnd(end.toMSecsSinceEpoch()),
+      nextBolus(0),
+      bolusEnd(0),
+      nextSegment(0),
+      finished(false)
+{
+    entry.type = Bolus;
+    entry.value = 0.0;
+    entry.index = -1;
+    
+    // Boluses inside [start, end]
+    nextBolus = static_cast<int>(std::lower_bound(boluses.constBegin(), boluses.constEnd(), rangeStart,
+                                                  [](const InsulinModel::BolusRecord &bolus, qint64 t) {
+                                                      return bolus.timestamp < t;
+                                                  }) - boluses.constBegin());
+    bolusEnd = static_cast<int>(std::upper_bound(boluses.constBegin(), boluses.constEnd(), rangeEnd,
+                                                 [](qint64 t, const InsulinModel::BolusRecord &bolus) {
+                                                     return t < bolus.timestamp;
+                                                 }) - boluses.constBegin());
+    
+    next();
+}
+
+void InsulinHistoryCursor::next()
+{
+    const qint64 noMore = std::numeric_limits<qint64>::max();
+    qint64 bolusTime;
+    qint64 runTime;
+    
+    for (;;) {
+        bolusTime = nextBolus < bolusEnd ? boluses.at(nextBolus).timestamp : noMore;
+        runTime = activeRuns.isEmpty() ? noMore : activeRuns.first().next;
+        
+        // A segment that starts at or before the earliest candidate may have
+        // an earlier sample, so bring it in before deciding
+        if (nextSegment < basalSegments.size() &&
+            basalSegments.at(nextSegment).startTime <= qMin(qMin(bolusTime, runTime), rangeEnd)) {
+            admitSegment(nextSegment++);
+            continue;
+        }
+        break;
+    }
+    
+    if (bolusTime == noMore && runTime == noMore) {
+        finished = true;
+        return;
+    }
+    
+    // Boluses go first when they coincide with a basal sample
+    if (bolusTime <= runTime) {
+        const InsulinModel::BolusRecord &bolus = boluses.at(nextBolus);
+        entry.type = Bolus;
+        entry.timestamp = Timestamp(bolus.timestamp);
+        entry.value = bolus.units;
+        entry.index = nextBolus++;
+        return;
+    }
+    
+    std::pop_heap(activeRuns.begin(), activeRuns.end(), laterRun);
+    BasalRun &run = activeRuns.last();
+    const InsulinModel::BasalRecord &segment = basalSegments.at(run.segment);
+    
+    entry.type = segment.isAutomatic() ? AutoAdjustment : Basal;
+    entry.timestamp = Timestamp(run.next);
+    entry.value = segment.rate;
+    entry.index = run.segment;
+    
+    run.next += BasalSampleMs;
+    if (run.next <= run.last) {
+        std::push_heap(activeRuns.begin(), activeRuns.end(), laterRun);
+    } else {
+        activeRuns.removeLast();
+    }
+}
+
+QVector<QPair<QDateTime, double>> InsulinHistoryCursor::toPairs()
+{
+    QVector<QPair<QDateTime, double>> result;
+    for (; !finished; next()) {
+        result.append(qMakePair(entry.timestamp.toDateTime(), entry.value));
+    }
+    return result;
+}
+
+void InsulinHistoryCursor::admitSegment(int segment)
+{
+    const InsulinModel::BasalRecord &basal = basalSegments.at(segment);
+    
+    // First sample on the segment's hourly grid that is inside the range
+    BasalRun run;
+    run.next = basal.startTime;
+    if (run.next < rangeStart) {
+        run.next += (rangeStart - run.next + BasalSampleMs - 1) / BasalSampleMs * BasalSampleMs;
+    }
+    run.last = qMin(basal.endTime, rangeEnd);
+    run.segment = segment;
+    
+    if (run.next > run.last) {
+        return;
+    }
+    
+    activeRuns.append(run);
+    std::push_heap(activeRuns.begin(), activeRuns.end(), laterRun);
+}
+
+bool InsulinHistoryCursor::laterRun(const BasalRun &a, const BasalRun &b)
+{
+    // Ordering for a min-heap; earlier segments win ties
+    if (a.next != b.next) {
+        return a.next > b.next;
+    }
+    return a.segment > b.segment;
+}
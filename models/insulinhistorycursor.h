@@ -0,0 +1,83 @@
+#ifndef INSULINHISTORYCURSOR_H
+#define INSULINHISTORYCURSOR_H
+
+#include <QDateTime>
+#include <QVector>
+#include "insulinmodel.h"
+#include "../utils/timestamp.h"
+
+// Walks the bolus and basal histories of an InsulinModel as one stream in
+// time order, without building or sorting a combined list.
+//
+// Boluses form one sorted run. Each basal segment contributes an hourly
+// run of samples from its start to its end, and since segments overlap
+// those runs interleave; they are k-way merged with a small min-heap that
+// only holds the segments active at the current time. Segments are added
+// to the heap in start order, so the histories must be sorted, which
+// InsulinModel guarantees.
+//
+// The cursor keeps its own (implicitly shared) copy of the histories, so
+// the model can keep changing while it is in use, e.g. on a worker thread.
+//
+//     for (InsulinHistoryCursor cursor(boluses, basal, start, end); !cursor.atEnd(); cursor.next()) {
+//         const InsulinHistoryCursor::Entry &entry = cursor.current();
+//         ...
+//     }
+class InsulinHistoryCursor
+{
+public:
+    enum EntryType {
+        Bolus,          // value is the bolus in units
+        Basal,          // value is the basal rate in units/hour
+        AutoAdjustment  // Basal sample of a Control-IQ adjusted segment
+    };
+    
+    struct Entry {
+        EntryType type;
+        Timestamp timestamp;
+        double value;
+        int index;  // Into the bolus or basal history
+    };
+    
+    // Basal segments are sampled once an hour from their start time
+    static const qint64 BasalSampleMs = 60LL * 60 * 1000;
+    
+    InsulinHistoryCursor(const QVector<InsulinModel::BolusRecord> &boluses,
+                         const QVector<InsulinModel::BasalRecord> &basalSegments,
+                         const QDateTime &start,
+                         const QDateTime &end);
+    
+    bool atEnd() const { return finished; }
+    const Entry &current() const { return entry; }
+    void next();
+    
+    // Rest of the stream as (timestamp, units) pairs, the format the
+    // history table, graph and CSV export take
+    QVector<QPair<QDateTime, double>> toPairs();
+
+private:
+    // Remaining hourly samples of one basal segment
+    struct BasalRun {
+        qint64 next;
+        qint64 last;
+        int segment;
+    };
+    
+    QVector<InsulinModel::BolusRecord> boluses;
+    QVector<InsulinModel::BasalRecord> basalSegments;
+    qint64 rangeStart;
+    qint64 rangeEnd;
+    
+    int nextBolus;
+    int bolusEnd;
+    int nextSegment;
+    QVector<BasalRun> activeRuns;  // Min-heap on next sample time
+    
+    Entry entry;
+    bool finished;
+    
+    void admitSegment(int segment);
+    static bool laterRun(const BasalRun &a, const BasalRun &b);
+};
+
+#endif // INSULINHISTORYCURSOR_H
@@ -0,0 +1,140 @@
+#include "insulinindex.h"
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+const double MsPerHour = 60.0 * 60 * 1000;
+
+}
+
+BasalIntervalIndex::BasalIntervalIndex()
+    : origin(std::numeric_limits<qint64>::min()),
+      longest(0)
+{
+}
+
+void BasalIntervalIndex::insert(qint64 start, qint64 end, double rate)
+{
+    // The first segment fixes the origin for the lifetime of the index
+    if (origin == std::numeric_limits<qint64>::min()) {
+        origin = start;
+    }
+    
+    // Treat reversed segments as empty rather than negative deliveries
+    end = qMax(start, end);
+    longest = qMax(longest, end - start);
+    
+    insertEndpoint(starts, start, rate);
+    insertEndpoint(ends, end, rate);
+}
+
+void BasalIntervalIndex::clear()
+{
+    starts.clear();
+    ends.clear();
+    origin = std::numeric_limits<qint64>::min();
+    longest = 0;
+}
+
+void BasalIntervalIndex::reserve(int size)
+{
+    starts.reserve(size);
+    ends.reserve(size);
+}
+
+double BasalIntervalIndex::delivered(qint64 start, qint64 end) const
+{
+    if (end <= start || starts.isEmpty()) {
+        return 0.0;
+    }
+    
+    return qMax(0.0, deliveredBefore(end) - deliveredBefore(start));
+}
+
+void BasalIntervalIndex::insertEndpoint(QVector<Endpoint> &points, qint64 time, double rate)
+{
+    auto position = std::upper_bound(points.begin(), points.end(), time,
+                                     [](qint64 t, const Endpoint &point) {
+                                         return t < point.time;
+                                     });
+    int index = static_cast<int>(position - points.begin());
+    
+    Endpoint point;
+    point.time = time;
+    point.rate = rate;
+    points.insert(index, point);
+    
+    // Prefix sums from the insert point on; just the new point for appends
+    for (int i = index; i < points.size(); ++i) {
+        const double previousRate = i > 0 ? points[i - 1].rateSum : 0.0;
+        const double previousWeighted = i > 0 ? points[i - 1].weightedSum : 0.0;
+        points[i].rateSum = previousRate + points[i].rate;
+        points[i].weightedSum = previousWeighted + points[i].rate * hoursSinceOrigin(points[i].time);
+    }
+}
+
+double BasalIntervalIndex::deliveredBefore(qint64 time) const
+{
+    const double hours = hoursSinceOrigin(time);
+    
+    auto sumUpTo = [time, hours](const QVector<Endpoint> &points) {
+        auto it = std::upper_bound(points.constBegin(), points.constEnd(), time,
+                                   [](qint64 t, const Endpoint &point) {
+                                       return t < point.time;
+                                   });
+        if (it == points.constBegin()) {
+            return 0.0;
+        }
+        --it;
+        return hours * it->rateSum - it->weightedSum;
+    };
+    
+    return sumUpTo(starts) - sumUpTo(ends);
+}
+
+double BasalIntervalIndex::hoursSinceOrigin(qint64 time) const
+{
+    return (time - origin) / MsPerHour;
+}
+
+void BolusTotalsIndex::insert(qint64 timestamp, double units)
+{
+    auto position = std::upper_bound(times.begin(), times.end(), timestamp);
+    int index = static_cast<int>(position - times.begin());
+    
+    times.insert(index, timestamp);
+    cumulative.insert(index, (index > 0 ? cumulative[index - 1] : 0.0) + units);
+    
+    // Later boluses now also count this one
+    for (int i = index + 1; i < cumulative.size(); ++i) {
+        cumulative[i] += units;
+    }
+}
+
+void BolusTotalsIndex::clear()
+{
+    times.clear();
+    cumulative.clear();
+}
+
+void BolusTotalsIndex::reserve(int size)
+{
+    times.reserve(size);
+    cumulative.reserve(size);
+}
+
+double BolusTotalsIndex::delivered(qint64 start, qint64 end) const
+{
+    if (end < start) {
+        return 0.0;
+    }
+    
+    const int first = static_cast<int>(std::lower_bound(times.constBegin(), times.constEnd(), start) - times.constBegin());
+    const int last = static_cast<int>(std::upper_bound(times.constBegin(), times.constEnd(), end) - times.constBegin());
+    if (last <= first) {
+        return 0.0;
+    }
+    
+    return cumulative[last - 1] - (first > 0 ? cumulative[first - 1] : 0.0);
+}
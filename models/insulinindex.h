@@ -0,0 +1,75 @@
+#ifndef INSULININDEX_H
+#define INSULININDEX_H
+
+#include <QVector>
+
+// Delivered-insulin index over basal segments.
+//
+// Segment start and end points are kept in two sorted endpoint lists with
+// prefix sums of rate and rate * time. The basal insulin delivered up to a
+// time t is then
+//
+//     F(t) = sum(rate * (t - start), starts <= t) - sum(rate * (t - end), ends <= t)
+//
+// (segments that have ended contribute rate * length, ones still running
+// rate * (t - start)), so the total for [a, b] with partial overlaps clipped
+// exactly is F(b) - F(a): two binary searches per endpoint list.
+//
+// Times are in ms since the epoch. Inserting in time order is O(1); an
+// out-of-order insert recomputes the prefix sums after the insert point.
+class BasalIntervalIndex
+{
+public:
+    BasalIntervalIndex();
+    
+    void insert(qint64 start, qint64 end, double rate);
+    void clear();
+    void reserve(int size);
+    
+    int size() const { return starts.size(); }
+    
+    // Units delivered in [start, end]
+    double delivered(qint64 start, qint64 end) const;
+    
+    // Longest segment inserted, for bounding overlap searches over a list
+    // sorted by start time: nothing starting before t - maxDuration() can
+    // still be running at t
+    qint64 maxDuration() const { return longest; }
+
+private:
+    struct Endpoint {
+        qint64 time;
+        double rate;
+        double rateSum;      // Prefix sums up to and including this point
+        double weightedSum;  // rate * hours since origin
+    };
+    
+    QVector<Endpoint> starts;
+    QVector<Endpoint> ends;
+    qint64 origin;  // Keeps rate * time small enough for double precision
+    qint64 longest;
+    
+    void insertEndpoint(QVector<Endpoint> &points, qint64 time, double rate);
+    double deliveredBefore(qint64 time) const;
+    double hoursSinceOrigin(qint64 time) const;
+};
+
+// Prefix sums of bolus units in time order, for O(log n) range totals
+class BolusTotalsIndex
+{
+public:
+    void insert(qint64 timestamp, double units);
+    void clear();
+    void reserve(int size);
+    
+    int size() const { return times.size(); }
+    
+    // Units delivered in [start, end]
+    double delivered(qint64 start, qint64 end) const;
+
+private:
+    QVector<qint64> times;
+    QVector<double> cumulative;  // Units up to and including each bolus
+};
+
+#endif // INSULININDEX_H
@@ -4,6 +4,81 @@
 #include <QJsonObject>
 #include <QJsonArray>
 #include <QTimer>
+#include "../utils/tracing.h"
+#include "../utils/stringpool.h"
+#include <algorithm>
+
+namespace {
+
+// Appends a batch to a time-sorted history and keeps it sorted. Batches are
+// normally already sorted and newer than the history, which makes this an
+// append; otherwise the batch is sorted and merged in O(n log n).
+template <typename T, typename Less>
+void mergeSorted(QVector<T> &history, QVector<T> batch, Less less)
+{
+    if (!std::is_sorted(batch.begin(), batch.end(), less)) {
+        std::stable_sort(batch.begin(), batch.end(), less);
+    }
+    
+    const int middle = history.size();
+    history += batch;
+    
+    if (middle > 0 && !batch.isEmpty() && less(batch.first(), history.at(middle - 1))) {
+        std::inplace_merge(history.begin(), history.begin() + middle, history.end(), less);
+    }
+}
+
+}
+
+static_assert(sizeof(InsulinModel::BolusRecord) == 24, "BolusRecord layout changed");
+static_assert(sizeof(InsulinModel::BasalRecord) == 32, "BasalRecord layout changed");
+
+InsulinModel::BolusRecord InsulinModel::BolusRecord::fromDelivery(const BolusDelivery &bolus)
+{
+    BolusRecord record;
+    record.timestamp = bolus.timestamp.toMSecsSinceEpoch();
+    record.units = bolus.units;
+    record.reason = StringPool::intern(bolus.reason);
+    record.duration = static_cast<quint16>(qBound(0, bolus.duration, 0xffff));
+    record.flags = (bolus.extended ? Extended : 0) | (bolus.completed ? Completed : 0);
+    record.reserved = 0;
+    return record;
+}
+
+InsulinModel::BolusDelivery InsulinModel::BolusRecord::toDelivery() const
+{
+    BolusDelivery bolus;
+    bolus.timestamp = QDateTime::fromMSecsSinceEpoch(timestamp);
+    bolus.units = units;
+    bolus.reason = StringPool::lookup(reason);
+    bolus.extended = flags & Extended;
+    bolus.duration = duration;
+    bolus.completed = flags & Completed;
+    return bolus;
+}
+
+InsulinModel::BasalRecord InsulinModel::BasalRecord::fromDelivery(const BasalDelivery &segment)
+{
+    BasalRecord record;
+    record.startTime = segment.startTime.toMSecsSinceEpoch();
+    record.endTime = segment.endTime.toMSecsSinceEpoch();
+    record.rate = segment.rate;
+    record.profileName = StringPool::intern(segment.profileName);
+    record.flags = segment.automatic ? Automatic : 0;
+    record.reserved[0] = record.reserved[1] = record.reserved[2] = 0;
+    return record;
+}
+
+InsulinModel::BasalDelivery InsulinModel::BasalRecord::toDelivery() const
+{
+    BasalDelivery segment;
+    segment.startTime = QDateTime::fromMSecsSinceEpoch(startTime);
+    segment.endTime = QDateTime::fromMSecsSinceEpoch(endTime);
+    segment.rate = rate;
+    segment.profileName = StringPool::lookup(profileName);
+    segment.automatic = flags & Automatic;
+    return segment;
+}
 
 InsulinModel::InsulinModel(QObject *parent)
     : QObject(parent),
@@ -13,7 +88,10 @@ InsulinModel::InsulinModel(QObject *parent)
       currentProfileName(""),
       basalIsAutomatic(false),
       bolusActive(false),
-      lastControlIQAdjustment(0.0)
+      activeBolusId(0),
+      bolusPulsesDelivered(0),
+      lastControlIQAdjustment(0.0),
+      historyEpoch(0)
 {
     // Setup timer to update IOB every minute
     QTimer *iobTimer = new QTimer(this);
@@ -58,13 +136,7 @@ void InsulinModel::startBasal(double rate, const QString &profileName, bool auto
     
     // Record previous basal segment if active
     if (basalActive) {
-        BasalDelivery segment;
-        segment.startTime = QDateTime::currentDateTime().addSecs(-3600); // Assume it was running for an hour
-        segment.endTime = QDateTime::currentDateTime();
-        segment.rate = currentBasalRate;
-        segment.profileName = currentProfileName;
-        segment.automatic = basalIsAutomatic;
-        basalHistory.append(segment);
+        closeSegment();
     }
     
     // Update current state
@@ -72,6 +144,7 @@ void InsulinModel::startBasal(double rate, const QString &profileName, bool auto
     currentProfileName = profileName;
     basalIsAutomatic = automatic;
     basalActive = true;
+    updateBasalProgram();
     
     // Notify
     emit basalRateChanged(rate);
@@ -85,16 +158,11 @@ void InsulinModel::stopBasal()
     }
     
     // Record current segment
-    BasalDelivery segment;
-    segment.startTime = QDateTime::currentDateTime().addSecs(-3600); // Assume it was running for an hour
-    segment.endTime = QDateTime::currentDateTime();
-    segment.rate = currentBasalRate;
-    segment.profileName = currentProfileName;
-    segment.automatic = basalIsAutomatic;
-    basalHistory.append(segment);
+    closeSegment();
     
     // Update state
     basalActive = false;
+    updateBasalProgram();
     
     // Notify
     emit basalRateChanged(0.0);
@@ -128,13 +196,7 @@ void InsulinModel::adjustBasalRate(double newRate, bool automatic)
     }
     
     // Record previous segment
-    BasalDelivery segment;
-    segment.startTime = QDateTime::currentDateTime().addSecs(-3600); // Assume it was running for an hour
-    segment.endTime = QDateTime::currentDateTime();
-    segment.rate = currentBasalRate;
-    segment.profileName = currentProfileName;
-    segment.automatic = basalIsAutomatic;
-    basalHistory.append(segment);
+    closeSegment();
     
     // Record the adjustment amount
     double adjustment = newRate - currentBasalRate;
@@ -142,6 +204,7 @@ void InsulinModel::adjustBasalRate(double newRate, bool automatic)
     // Update state
     currentBasalRate = newRate;
     basalIsAutomatic = automatic;
+    updateBasalProgram();
     
     // For Control-IQ adjustments
     if (automatic) {
@@ -154,83 +217,45 @@ void InsulinModel::adjustBasalRate(double newRate, bool automatic)
 }
 
 bool InsulinModel::deliverBolus(double units, const QString &reason, bool extended, int duration)
+{
+    if (extended) {
+        return deliverComboBolus(0.0, units, duration, reason);
+    }
+    
+    return deliverComboBolus(units, 0.0, 0, reason);
+}
+
+bool InsulinModel::deliverComboBolus(double nowUnits, double extendedUnits, int duration, const QString &reason)
 {
     // Validation
     if (bolusActive) return false;
+    nowUnits = qMax(0.0, nowUnits);
+    extendedUnits = qMax(0.0, extendedUnits);
+    double units = nowUnits + extendedUnits;
     if (units <= 0.0) return false;
-    if (units > 25.0) units = 25.0; // Safety cap
+    
+    // Safety cap, taken proportionally from both parts
+    if (units > 25.0) {
+        nowUnits *= 25.0 / units;
+        extendedUnits *= 25.0 / units;
+        units = 25.0;
+    }
+    
+    // Schedule the pulses; too small a bolus rounds to none
+    const Timestamp now = getCurrentTime();
+    const quint32 id = engine.startBolus(nowUnits, extendedUnits, duration, now.toMSecsSinceEpoch());
+    if (id == 0) return false;
     
     // Setup bolus
-    currentBolus.timestamp = QDateTime::currentDateTime();
+    currentBolus.timestamp = now.toDateTime();
     currentBolus.units = units;
     currentBolus.reason = reason;
-    currentBolus.extended = extended;
+    currentBolus.extended = extendedUnits > 0.0;
     currentBolus.duration = duration;
     currentBolus.completed = false;
     bolusActive = true;
-    
-    // For standard bolus, complete quickly
-    if (!extended) {
-        // Deliver bolus after a short delay
-        QTimer::singleShot(2000, this, [this]() {
-            if (bolusActive) {
-                // Mark as complete
-                currentBolus.completed = true;
-                lastCompletedBolus = currentBolus;
-                
-                // Add to history
-                bolusHistory.append(currentBolus);
-                
-                // Reset state
-                bolusActive = false;
-                
-                // Update IOB
-                updateIOB();
-                
-                // Notify
-                emit bolusCompleted(currentBolus.units);
-            }
-        });
-    } else {
-        // Extended bolus simulation
-        int intervalMs = duration * 60 * 1000 / 10; // 10 steps
-        
-        QTimer *timer = new QTimer(this);
-        connect(timer, &QTimer::timeout, this, [this, timer]() {
-            static int stepsCompleted = 0;
-            if (!bolusActive) {
-                timer->stop();
-                timer->deleteLater();
-                return;
-            }
-            
-            stepsCompleted++;
-            if (stepsCompleted >= 10) {
-                // Mark as complete
-                currentBolus.completed = true;
-                lastCompletedBolus = currentBolus;
-                
-                // Add to history
-                bolusHistory.append(currentBolus);
-                
-                // Reset state
-                bolusActive = false;
-                
-                // Clean up
-                timer->stop();
-                timer->deleteLater();
-                stepsCompleted = 0;
-                
-                // Update IOB
-                updateIOB();
-                
-                // Notify
-                emit bolusCompleted(currentBolus.units);
-            }
-        });
-        
-        timer->start(intervalMs);
-    }
+    activeBolusId = id;
+    bolusPulsesDelivered = 0;
     
     // Notify of bolus start
     emit bolusStarted(units);
@@ -247,22 +272,24 @@ bool InsulinModel::cancelBolus()
         return false;
     }
     
-    // Calculate partial delivery (simplified)
-    double delivered = currentBolus.units * 0.5; // Assume half delivered
+    // Whatever the motor has delivered so far
+    double delivered = engine.cancelBolus(activeBolusId);
     
     // Record partial delivery
-    BolusDelivery partial = currentBolus;
-    partial.units = delivered;
-    partial.completed = false;
-    
-    // Add to history
-    bolusHistory.append(partial);
+    if (delivered > 0.0) {
+        BolusDelivery partial = currentBolus;
+        partial.units = delivered;
+        partial.completed = false;
+        insertBolus(BolusRecord::fromDelivery(partial));
+    }
     
     // Save requested amount
     double requested = currentBolus.units;
     
     // Reset state
     bolusActive = false;
+    activeBolusId = 0;
+    bolusPulsesDelivered = 0;
     
     // Update IOB
     updateIOB();
@@ -273,14 +300,73 @@ bool InsulinModel::cancelBolus()
     return true;
 }
 
+Timestamp InsulinModel::getCurrentTime() const
+{
+    return deliveryTime > Timestamp() ? deliveryTime : Timestamp::now();
+}
+
+void InsulinModel::advanceDelivery(Timestamp now)
+{
+    deliveryTime = qMax(deliveryTime, now);
+    
+    int pulses = 0;
+    int bolusPulses = 0;
+    bool bolusFinished = false;
+    
+    engine.advance(now.toMSecsSinceEpoch(), [&](const DeliveryEngine::Pulse &pulse) {
+        ++pulses;
+        if (pulse.source == DeliveryEngine::Bolus) {
+            ++bolusPulses;
+            bolusFinished = bolusFinished || pulse.last;
+        }
+    });
+    
+    if (pulses == 0) {
+        return;
+    }
+    
+    emit insulinDelivered(pulses * DeliveryEngine::PulseUnits);
+    
+    if (bolusPulses > 0) {
+        bolusPulsesDelivered += bolusPulses;
+        if (bolusFinished) {
+            completeBolus();
+        } else {
+            updateIOB();
+        }
+    }
+}
+
+void InsulinModel::completeBolus()
+{
+    // Record what was delivered, which is the request rounded to pulses
+    currentBolus.units = bolusPulsesDelivered * DeliveryEngine::PulseUnits;
+    currentBolus.completed = true;
+    lastCompletedBolus = currentBolus;
+    
+    // Add to history
+    insertBolus(BolusRecord::fromDelivery(currentBolus));
+    
+    // Reset state
+    bolusActive = false;
+    activeBolusId = 0;
+    bolusPulsesDelivered = 0;
+    
+    // Update IOB
+    updateIOB();
+    
+    // Notify
+    emit bolusCompleted(currentBolus.units);
+}
+
 QVector<InsulinModel::BolusDelivery> InsulinModel::getBolusHistory(const QDateTime &start, const QDateTime &end) const
 {
     QVector<BolusDelivery> result;
+    const HistoryView<BolusRecord> view = getBolusView(Timestamp::fromDateTime(start), Timestamp::fromDateTime(end));
+    result.reserve(view.size());
     
-    for (const auto &bolus : bolusHistory) {
-        if (bolus.timestamp >= start && bolus.timestamp <= end) {
-            result.append(bolus);
-        }
+    for (const auto &bolus : view) {
+        result.append(bolus.toDelivery());
     }
     
     return result;
@@ -289,19 +375,64 @@ QVector<InsulinModel::BolusDelivery> InsulinModel::getBolusHistory(const QDateTi
 QVector<InsulinModel::BasalDelivery> InsulinModel::getBasalHistory(const QDateTime &start, const QDateTime &end) const
 {
     QVector<BasalDelivery> result;
+    const qint64 startMs = start.toMSecsSinceEpoch();
     
-    for (const auto &basal : basalHistory) {
+    for (const auto &basal : getBasalView(Timestamp(startMs), Timestamp::fromDateTime(end))) {
         // Include if any part overlaps
-        if ((basal.startTime >= start && basal.startTime <= end) ||
-            (basal.endTime >= start && basal.endTime <= end) ||
-            (basal.startTime <= start && basal.endTime >= end)) {
-            result.append(basal);
+        if (basal.endTime >= startMs || basal.startTime >= startMs) {
+            result.append(basal.toDelivery());
         }
     }
     
     return result;
 }
 
+HistoryView<InsulinModel::BolusRecord> InsulinModel::getBolusView(Timestamp start, Timestamp end) const
+{
+    // History is sorted, so the range is one contiguous slice
+    auto first = std::lower_bound(bolusHistory.constBegin(), bolusHistory.constEnd(), start.toMSecsSinceEpoch(),
+                                  [](const BolusRecord &bolus, qint64 t) {
+                                      return bolus.timestamp < t;
+                                  });
+    auto last = std::upper_bound(first, bolusHistory.constEnd(), end.toMSecsSinceEpoch(),
+                                 [](qint64 t, const BolusRecord &bolus) {
+                                     return t < bolus.timestamp;
+                                 });
+    
+    return HistoryView<BolusRecord>(bolusHistory,
+                                    static_cast<int>(first - bolusHistory.constBegin()),
+                                    static_cast<int>(last - bolusHistory.constBegin()),
+                                    historyEpoch);
+}
+
+HistoryView<InsulinModel::BasalRecord> InsulinModel::getBasalView(Timestamp start, Timestamp end) const
+{
+    // Only segments starting within one maximum segment length before the
+    // range can still be running inside it
+    auto first = std::lower_bound(basalHistory.constBegin(), basalHistory.constEnd(),
+                                  start.toMSecsSinceEpoch() - basalIndex.maxDuration(),
+                                  [](const BasalRecord &basal, qint64 t) {
+                                      return basal.startTime < t;
+                                  });
+    auto last = std::upper_bound(first, basalHistory.constEnd(), end.toMSecsSinceEpoch(),
+                                 [](qint64 t, const BasalRecord &basal) {
+                                     return t < basal.startTime;
+                                 });
+    
+    return HistoryView<BasalRecord>(basalHistory,
+                                    static_cast<int>(first - basalHistory.constBegin()),
+                                    static_cast<int>(last - basalHistory.constBegin()),
+                                    historyEpoch);
+}
+
+void InsulinModel::reserveHistory(int boluses, int basalSegments)
+{
+    bolusHistory.reserve(bolusHistory.size() + boluses);
+    bolusIndex.reserve(bolusIndex.size() + boluses);
+    basalHistory.reserve(basalHistory.size() + basalSegments);
+    basalIndex.reserve(basalIndex.size() + basalSegments);
+}
+
 double InsulinModel::getTotalInsulin(const QDateTime &start, const QDateTime &end) const
 {
     return getTotalBasal(start, end) + getTotalBolus(start, end);
@@ -309,32 +440,13 @@ double InsulinModel::getTotalInsulin(const QDateTime &start, const QDateTime &en
 
 double InsulinModel::getTotalBasal(const QDateTime &start, const QDateTime &end) const
 {
-    double total = 0.0;
-    
-    for (const auto &basal : getBasalHistory(start, end)) {
-        // Calculate the overlap period
-        QDateTime overlapStart = basal.startTime < start ? start : basal.startTime;
-        QDateTime overlapEnd = basal.endTime > end ? end : basal.endTime;
-        
-        // Calculate hours
-        double hours = overlapStart.secsTo(overlapEnd) / 3600.0;
-        
-        // Add basal insulin
-        total += basal.rate * hours;
-    }
-    
-    return total;
+    // Overlapping segments are clipped to the range exactly
+    return basalIndex.delivered(start.toMSecsSinceEpoch(), end.toMSecsSinceEpoch());
 }
 
 double InsulinModel::getTotalBolus(const QDateTime &start, const QDateTime &end) const
 {
-    double total = 0.0;
-    
-    for (const auto &bolus : getBolusHistory(start, end)) {
-        total += bolus.units;
-    }
-    
-    return total;
+    return bolusIndex.delivered(start.toMSecsSinceEpoch(), end.toMSecsSinceEpoch());
 }
 
 void InsulinModel::addBolusToHistory(const QDateTime &timestamp, double units, const QString &reason, 
@@ -348,17 +460,56 @@ void InsulinModel::addBolusToHistory(const QDateTime &timestamp, double units, c
     bolus.duration = duration;
     bolus.completed = completed;
     
-    bolusHistory.append(bolus);
+    insertBolus(BolusRecord::fromDelivery(bolus));
     
     // Update IOB if recent
-    if (QDateTime::currentDateTime().secsTo(timestamp) > -14400) { // Within 4 hours
+    if (getCurrentTime().secsTo(Timestamp::fromDateTime(timestamp)) > -14400) { // Within 4 hours
         updateIOB();
     }
 }
 
 void InsulinModel::addBasalToHistory(const BasalDelivery &segment)
 {
-    basalHistory.append(segment);
+    insertBasal(BasalRecord::fromDelivery(segment));
+}
+
+void InsulinModel::appendHistory(const QVector<BolusDelivery> &boluses, const QVector<BasalDelivery> &basalSegments)
+{
+    QVector<BolusRecord> bolusRecords;
+    bolusRecords.reserve(boluses.size());
+    for (const auto &bolus : boluses) {
+        bolusRecords.append(BolusRecord::fromDelivery(bolus));
+    }
+    
+    QVector<BasalRecord> basalRecords;
+    basalRecords.reserve(basalSegments.size());
+    for (const auto &basal : basalSegments) {
+        basalRecords.append(BasalRecord::fromDelivery(basal));
+    }
+    
+    appendHistory(bolusRecords, basalRecords);
+}
+
+void InsulinModel::appendHistory(const QVector<BolusRecord> &boluses, const QVector<BasalRecord> &basalSegments)
+{
+    ++historyEpoch;
+    mergeSorted(bolusHistory, boluses, [](const BolusRecord &a, const BolusRecord &b) {
+        return a.timestamp < b.timestamp;
+    });
+    mergeSorted(basalHistory, basalSegments, [](const BasalRecord &a, const BasalRecord &b) {
+        return a.startTime < b.startTime;
+    });
+    
+    // Batches are normally newer than everything indexed, so these append
+    for (const auto &bolus : boluses) {
+        bolusIndex.insert(bolus.timestamp, bolus.units);
+    }
+    for (const auto &basal : basalSegments) {
+        basalIndex.insert(basal.startTime, basal.endTime, basal.rate);
+    }
+    
+    // One IOB update for the whole batch
+    updateIOB();
 }
 
 double InsulinModel::getLastControlIQAdjustment() const
@@ -368,30 +519,34 @@ double InsulinModel::getLastControlIQAdjustment() const
 
 void InsulinModel::updateIOB()
 {
+    TRACE_SCOPE("InsulinModel::updateIOB");
     // Simplified IOB calculation - just keep a running total based on recent boluses
     double total = 0.0;
     
-    // Get boluses from the last 4 hours
-    QDateTime now = QDateTime::currentDateTime();
-    QDateTime fourHoursAgo = now.addSecs(-4 * 3600);
-    
-    for (const auto &bolus : bolusHistory) {
-        if (bolus.timestamp >= fourHoursAgo) {
-            // Apply a simple linear decay over 4 hours
-            int secondsSince = bolus.timestamp.secsTo(now);
-            double hoursActive = 4.0;
-            double hoursElapsed = secondsSince / 3600.0;
-            
-            if (hoursElapsed < hoursActive) {
-                double remainingFraction = 1.0 - (hoursElapsed / hoursActive);
-                total += bolus.units * remainingFraction;
-            }
+    // Get boluses from the last 4 hours; the history is sorted, so skip
+    // straight to them
+    const qint64 now = getCurrentTime().toMSecsSinceEpoch();
+    const qint64 fourHoursAgo = now - 4 * 3600 * 1000LL;
+    auto it = std::lower_bound(bolusHistory.constBegin(), bolusHistory.constEnd(), fourHoursAgo,
+                               [](const BolusRecord &bolus, qint64 t) {
+                                   return bolus.timestamp < t;
+                               });
+    
+    for (; it != bolusHistory.constEnd(); ++it) {
+        // Apply a simple linear decay over 4 hours
+        qint64 secondsSince = (now - it->timestamp) / 1000;
+        double hoursActive = 4.0;
+        double hoursElapsed = secondsSince / 3600.0;
+        
+        if (hoursElapsed < hoursActive) {
+            double remainingFraction = 1.0 - (hoursElapsed / hoursActive);
+            total += it->units * remainingFraction;
         }
     }
     
-    // Include current active bolus if any
+    // Include what the current bolus has delivered so far
     if (bolusActive) {
-        total += currentBolus.units * 0.8; // Assume 80% still active
+        total += bolusPulsesDelivered * DeliveryEngine::PulseUnits;
     }
     
     // Update if changed
@@ -425,6 +580,7 @@ bool InsulinModel::saveInsulinData(const QString &filename)
         bolusObj["extended"] = currentBolus.extended;
         bolusObj["duration"] = currentBolus.duration;
         bolusObj["completed"] = currentBolus.completed;
+        bolusObj["delivered"] = bolusPulsesDelivered * DeliveryEngine::PulseUnits;
         rootObj["currentBolus"] = bolusObj;
     }
     
@@ -442,12 +598,12 @@ bool InsulinModel::saveInsulinData(const QString &filename)
     QJsonArray bolusHistoryArray;
     for (const auto &bolus : bolusHistory) {
         QJsonObject bolusObj;
-        bolusObj["timestamp"] = bolus.timestamp.toString(Qt::ISODate);
+        bolusObj["timestamp"] = QDateTime::fromMSecsSinceEpoch(bolus.timestamp).toString(Qt::ISODate);
         bolusObj["units"] = bolus.units;
-        bolusObj["reason"] = bolus.reason;
-        bolusObj["extended"] = bolus.extended;
+        bolusObj["reason"] = StringPool::lookup(bolus.reason);
+        bolusObj["extended"] = (bolus.flags & BolusRecord::Extended) != 0;
         bolusObj["duration"] = bolus.duration;
-        bolusObj["completed"] = bolus.completed;
+        bolusObj["completed"] = (bolus.flags & BolusRecord::Completed) != 0;
         bolusHistoryArray.append(bolusObj);
     }
     rootObj["bolusHistory"] = bolusHistoryArray;
@@ -456,11 +612,11 @@ bool InsulinModel::saveInsulinData(const QString &filename)
     QJsonArray basalHistoryArray;
     for (const auto &basal : basalHistory) {
         QJsonObject basalObj;
-        basalObj["startTime"] = basal.startTime.toString(Qt::ISODate);
-        basalObj["endTime"] = basal.endTime.toString(Qt::ISODate);
+        basalObj["startTime"] = QDateTime::fromMSecsSinceEpoch(basal.startTime).toString(Qt::ISODate);
+        basalObj["endTime"] = QDateTime::fromMSecsSinceEpoch(basal.endTime).toString(Qt::ISODate);
         basalObj["rate"] = basal.rate;
-        basalObj["profileName"] = basal.profileName;
-        basalObj["automatic"] = basal.automatic;
+        basalObj["profileName"] = StringPool::lookup(basal.profileName);
+        basalObj["automatic"] = basal.isAutomatic();
         basalHistoryArray.append(basalObj);
     }
     rootObj["basalHistory"] = basalHistoryArray;
@@ -493,7 +649,11 @@ bool InsulinModel::loadInsulinData(const QString &filename)
         return false;
     }
     
-    QJsonObject rootObj = doc.object();
+    return loadInsulinData(doc.object());
+}
+
+bool InsulinModel::loadInsulinData(const QJsonObject &rootObj)
+{
     
     // Load current state
     QJsonObject stateObj = rootObj["state"].toObject();
@@ -506,6 +666,7 @@ bool InsulinModel::loadInsulinData(const QString &filename)
     lastControlIQAdjustment = stateObj["lastControlIQAdjustment"].toDouble(0.0);
     
     // Load current bolus if active
+    double interruptedBolusUnits = 0.0;
     if (bolusActive) {
         QJsonObject bolusObj = rootObj["currentBolus"].toObject();
         currentBolus.timestamp = QDateTime::fromString(bolusObj["timestamp"].toString(), Qt::ISODate);
@@ -514,6 +675,7 @@ bool InsulinModel::loadInsulinData(const QString &filename)
         currentBolus.extended = bolusObj["extended"].toBool();
         currentBolus.duration = bolusObj["duration"].toInt();
         currentBolus.completed = bolusObj["completed"].toBool();
+        interruptedBolusUnits = bolusObj["delivered"].toDouble(0.0);
     }
     
     // Load last completed bolus
@@ -539,7 +701,7 @@ bool InsulinModel::loadInsulinData(const QString &filename)
         bolus.duration = bolusObj["duration"].toInt();
         bolus.completed = bolusObj["completed"].toBool();
         
-        bolusHistory.append(bolus);
+        bolusHistory.append(BolusRecord::fromDelivery(bolus));
     }
     
     // Load basal history
@@ -555,9 +717,34 @@ bool InsulinModel::loadInsulinData(const QString &filename)
         basal.profileName = basalObj["profileName"].toString();
         basal.automatic = basalObj["automatic"].toBool();
         
-        basalHistory.append(basal);
+        basalHistory.append(BasalRecord::fromDelivery(basal));
+    }
+    
+    // A bolus that was running when the state was saved is not resumed:
+    // the pump stopped in the meantime, and starting it again could deliver
+    // insulin twice. What it had delivered is recorded like a cancelled
+    // bolus. Files written by older versions do not say how much that was.
+    if (bolusActive) {
+        if (interruptedBolusUnits > 0.0) {
+            BolusDelivery partial = currentBolus;
+            partial.units = interruptedBolusUnits;
+            partial.completed = false;
+            bolusHistory.append(BolusRecord::fromDelivery(partial));
+        }
+        bolusActive = false;
     }
     
+    // Files written by older versions are not necessarily in time order
+    sortHistory();
+    rebuildIndexes();
+    ++historyEpoch;
+    
+    // Pick basal delivery up again from now
+    engine = DeliveryEngine();
+    updateBasalProgram();
+    activeBolusId = 0;
+    bolusPulsesDelivered = 0;
+    
     // Emit signals to update UI
     emit insulinOnBoardChanged(insulinOnBoard);
     emit basalRateChanged(currentBasalRate);
@@ -566,3 +753,76 @@ bool InsulinModel::loadInsulinData(const QString &filename)
     
     return true;
 }
+
+void InsulinModel::updateBasalProgram()
+{
+    // Pulses due at the old rate go out before the rate changes
+    const Timestamp now = getCurrentTime();
+    advanceDelivery(now);
+    engine.setBasalRate(basalActive ? currentBasalRate : 0.0, now.toMSecsSinceEpoch());
+    segmentStart = now;
+}
+
+void InsulinModel::closeSegment()
+{
+    // The running rate has been delivered since it was programmed
+    const qint64 now = getCurrentTime().toMSecsSinceEpoch();
+    if (now <= segmentStart.toMSecsSinceEpoch()) {
+        return;
+    }
+    
+    BasalRecord segment;
+    segment.startTime = segmentStart.toMSecsSinceEpoch();
+    segment.endTime = now;
+    segment.rate = currentBasalRate;
+    segment.profileName = StringPool::intern(currentProfileName);
+    segment.flags = basalIsAutomatic ? BasalRecord::Automatic : 0;
+    segment.reserved[0] = segment.reserved[1] = segment.reserved[2] = 0;
+    insertBasal(segment);
+}
+
+void InsulinModel::insertBolus(const BolusRecord &bolus)
+{
+    // Deliveries nearly always arrive in time order, so this is an append
+    auto position = std::upper_bound(bolusHistory.begin(), bolusHistory.end(), bolus,
+                                     [](const BolusRecord &a, const BolusRecord &b) {
+                                         return a.timestamp < b.timestamp;
+                                     });
+    bolusHistory.insert(position, bolus);
+    ++historyEpoch;
+    bolusIndex.insert(bolus.timestamp, bolus.units);
+}
+
+void InsulinModel::insertBasal(const BasalRecord &segment)
+{
+    auto position = std::upper_bound(basalHistory.begin(), basalHistory.end(), segment,
+                                     [](const BasalRecord &a, const BasalRecord &b) {
+                                         return a.startTime < b.startTime;
+                                     });
+    basalHistory.insert(position, segment);
+    ++historyEpoch;
+    basalIndex.insert(segment.startTime, segment.endTime, segment.rate);
+}
+
+void InsulinModel::sortHistory()
+{
+    std::stable_sort(bolusHistory.begin(), bolusHistory.end(), [](const BolusRecord &a, const BolusRecord &b) {
+        return a.timestamp < b.timestamp;
+    });
+    std::stable_sort(basalHistory.begin(), basalHistory.end(), [](const BasalRecord &a, const BasalRecord &b) {
+        return a.startTime < b.startTime;
+    });
+}
+
+void InsulinModel::rebuildIndexes()
+{
+    bolusIndex.clear();
+    for (const auto &bolus : bolusHistory) {
+        bolusIndex.insert(bolus.timestamp, bolus.units);
+    }
+    
+    basalIndex.clear();
+    for (const auto &basal : basalHistory) {
+        basalIndex.insert(basal.startTime, basal.endTime, basal.rate);
+    }
+}
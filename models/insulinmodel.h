@@ -2,9 +2,14 @@
 #define INSULINMODEL_H
 
 #include <QObject>
+#include <QJsonObject>
 #include <QDateTime>
 #include <QVector>
 #include <QPair>
+#include "insulinindex.h"
+#include "deliveryengine.h"
+#include "../utils/timestamp.h"
+#include "../utils/historyview.h"
 
 class InsulinModel : public QObject
 {
@@ -30,9 +35,49 @@ public:
         bool automatic; // Whether controlled by Control-IQ
     };
     
+    // Compact forms the histories are stored in. Times are ms since the
+    // epoch and strings are interned in StringPool, so the records are
+    // fixed-size PODs: long histories stay dense in memory and QVector
+    // copies them with memcpy.
+    struct BolusRecord {
+        enum Flag : quint8 {
+            Extended = 0x1,
+            Completed = 0x2
+        };
+        
+        qint64 timestamp;
+        double units;
+        quint32 reason;    // StringPool id
+        quint16 duration;  // Minutes for extended bolus
+        quint8 flags;
+        quint8 reserved;
+        
+        static BolusRecord fromDelivery(const BolusDelivery &bolus);
+        BolusDelivery toDelivery() const;
+    };
+    
+    struct BasalRecord {
+        enum Flag : quint8 {
+            Automatic = 0x1
+        };
+        
+        qint64 startTime;
+        qint64 endTime;
+        double rate;
+        quint32 profileName;  // StringPool id
+        quint8 flags;
+        quint8 reserved[3];
+        
+        static BasalRecord fromDelivery(const BasalDelivery &segment);
+        BasalDelivery toDelivery() const;
+        bool isAutomatic() const { return flags & Automatic; }
+    };
+    
     // Basic insulin delivery
     double getInsulinOnBoard() const;
     double getCurrentBasalRate() const;
+    bool isBasalActive() const { return basalActive; }
+    bool isBasalAutomatic() const { return basalIsAutomatic; }
     bool isBolusActive() const;
     BolusDelivery getCurrentBolus() const;
     BolusDelivery getLastCompletedBolus() const;
@@ -44,11 +89,37 @@ public:
     void resumeBasal();
     void adjustBasalRate(double newRate, bool automatic = true);
     bool deliverBolus(double units, const QString &reason = "Manual", bool extended = false, int duration = 0);
+    bool deliverComboBolus(double nowUnits, double extendedUnits, int duration, const QString &reason = "Manual");
     bool cancelBolus();
     
+    // Delivers the motor pulses due by now (see DeliveryEngine). The
+    // reservoir follows insulinDelivered(); bolus progress, completion and
+    // IOB are updated here.
+    //
+    // These calls are also the model's clock: boluses, rate changes and IOB
+    // are timed at the last time delivery was advanced to, so the model
+    // runs on whatever clock drives it (the pump's simulated clock in the
+    // app). Until the first call it follows Timestamp::now().
+    void advanceDelivery(Timestamp now);
+    Timestamp getCurrentTime() const;
+    
     // History
     QVector<BolusDelivery> getBolusHistory(const QDateTime &start, const QDateTime &end) const;
     QVector<BasalDelivery> getBasalHistory(const QDateTime &start, const QDateTime &end) const;
+    const QVector<BolusRecord> &getAllBoluses() const { return bolusHistory; }
+    const QVector<BasalRecord> &getAllBasalSegments() const { return basalHistory; }
+    
+    // Views of the histories without copying (see HistoryView). The basal
+    // view holds every segment that can overlap the range, so it may start
+    // with a few that ended before it; check endTime where that matters.
+    HistoryView<BolusRecord> getBolusView(Timestamp start, Timestamp end) const;
+    HistoryView<BasalRecord> getBasalView(Timestamp start, Timestamp end) const;
+    quint64 getHistoryEpoch() const { return historyEpoch; }
+    
+    // Preallocates room for this many more boluses and basal segments, so
+    // recording them does not reallocate the histories or their indexes
+    void reserveHistory(int boluses, int basalSegments);
+    
     double getTotalInsulin(const QDateTime &start, const QDateTime &end) const;
     double getTotalBasal(const QDateTime &start, const QDateTime &end) const;
     double getTotalBolus(const QDateTime &start, const QDateTime &end) const;
@@ -57,6 +128,8 @@ public:
     void addBolusToHistory(const QDateTime &timestamp, double units, const QString &reason, 
                          bool extended, int duration, bool completed);
     void addBasalToHistory(const BasalDelivery &segment);
+    void appendHistory(const QVector<BolusDelivery> &boluses, const QVector<BasalDelivery> &basalSegments);
+    void appendHistory(const QVector<BolusRecord> &boluses, const QVector<BasalRecord> &basalSegments);
     
     // ControlIQ
     double getLastControlIQAdjustment() const;
@@ -64,6 +137,7 @@ public:
     // Save and load
     bool saveInsulinData(const QString &filename);
     bool loadInsulinData(const QString &filename);
+    bool loadInsulinData(const QJsonObject &rootObj);
     
 signals:
     void insulinOnBoardChanged(double units);
@@ -72,6 +146,7 @@ signals:
     void bolusStarted(double units);
     void bolusCompleted(double units);
     void bolusCancelled(double unitsDelivered, double unitsRequested);
+    void insulinDelivered(double units);
     void controlIQAdjustmentChanged(double adjustment);
     
 public slots:
@@ -90,13 +165,37 @@ private:
     bool bolusActive;
     BolusDelivery currentBolus;
     BolusDelivery lastCompletedBolus;
+    quint32 activeBolusId;   // DeliveryEngine id of the current bolus
+    int bolusPulsesDelivered;
+    
+    // Every pulse the pump delivers comes from here
+    DeliveryEngine engine;
+    Timestamp deliveryTime;  // Last time delivery was advanced to; 0 before the first
+    Timestamp segmentStart;  // When the running basal rate was programmed
     
     // Control-IQ state
     double lastControlIQAdjustment;
     
-    // History
-    QVector<BolusDelivery> bolusHistory;
-    QVector<BasalDelivery> basalHistory;
+    // History, kept sorted by timestamp / start time so readers can
+    // binary search and merge them without sorting
+    QVector<BolusRecord> bolusHistory;
+    QVector<BasalRecord> basalHistory;
+    quint64 historyEpoch;  // Incremented by every change to either history
+    
+    // Range totals over the histories, updated alongside them
+    BasalIntervalIndex basalIndex;
+    BolusTotalsIndex bolusIndex;
+    
+    void updateBasalProgram();
+    void closeSegment();
+    void completeBolus();
+    void insertBolus(const BolusRecord &bolus);
+    void insertBasal(const BasalRecord &segment);
+    void sortHistory();
+    void rebuildIndexes();
 };
 
+Q_DECLARE_TYPEINFO(InsulinModel::BolusRecord, Q_PRIMITIVE_TYPE);
+Q_DECLARE_TYPEINFO(InsulinModel::BasalRecord, Q_PRIMITIVE_TYPE);
+
 #endif // INSULINMODEL_H
@@ -3,16 +3,118 @@
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
+#include <QMutexLocker>
+
+namespace {
+
+bool isValidProfile(const Profile &profile)
+{
+    if (profile.name.isEmpty() || 
+        profile.basalRate <= 0 || 
+        profile.carbRatio <= 0 || 
+        profile.correctionFactor <= 0 || 
+        profile.targetGlucose <= 0) {
+        return false;
+    }
+    
+    for (const ProfileSegment &segment : profile.segments) {
+        if (segment.startMinute < 0 || segment.startMinute >= 24 * 60 ||
+            segment.basalRate <= 0 ||
+            segment.carbRatio <= 0 ||
+            segment.correctionFactor <= 0 ||
+            segment.targetGlucose <= 0) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+QJsonArray segmentsToJson(const QVector<ProfileSegment> &segments)
+{
+    QJsonArray array;
+    for (const ProfileSegment &segment : segments) {
+        QJsonObject segmentObj;
+        segmentObj["startMinute"] = segment.startMinute;
+        segmentObj["basalRate"] = segment.basalRate;
+        segmentObj["carbRatio"] = segment.carbRatio;
+        segmentObj["correctionFactor"] = segment.correctionFactor;
+        segmentObj["targetGlucose"] = segment.targetGlucose;
+        array.append(segmentObj);
+    }
+    return array;
+}
+
+QVector<ProfileSegment> segmentsFromJson(const QJsonArray &array)
+{
+    QVector<ProfileSegment> segments;
+    for (const QJsonValue &value : array) {
+        QJsonObject segmentObj = value.toObject();
+        
+        ProfileSegment segment;
+        segment.startMinute = segmentObj["startMinute"].toInt();
+        segment.basalRate = segmentObj["basalRate"].toDouble();
+        segment.carbRatio = segmentObj["carbRatio"].toDouble();
+        segment.correctionFactor = segmentObj["correctionFactor"].toDouble();
+        segment.targetGlucose = segmentObj["targetGlucose"].toDouble();
+        segments.append(segment);
+    }
+    return segments;
+}
+
+} // namespace
+
+const Profile *ProfileSet::find(const QString &name) const
+{
+    auto it = profiles.constFind(name);
+    return it == profiles.constEnd() ? nullptr : &it.value();
+}
+
+const Profile &ProfileSet::profile(const QString &name) const
+{
+    static const Profile emptyProfile = Profile();
+    
+    const Profile *found = find(name);
+    return found ? *found : emptyProfile;
+}
+
+const ProfileSchedule &ProfileSet::schedule(const QString &name) const
+{
+    static const ProfileSchedule emptySchedule;
+    
+    auto it = schedules.constFind(name);
+    return it == schedules.constEnd() ? emptySchedule : it.value();
+}
+
+void ProfileSet::insert(const Profile &profile)
+{
+    profiles[profile.name] = profile;
+    schedules[profile.name] = ProfileSchedule(profile);
+}
+
+void ProfileSet::remove(const QString &name)
+{
+    profiles.remove(name);
+    schedules.remove(name);
+}
+
+void ProfileSet::resolveActive()
+{
+    activeProfileEntry = &profile(activeProfileName);
+    activeScheduleEntry = &schedule(activeProfileName);
+}
 
 ProfileModel::ProfileModel(QObject *parent)
-    : QObject(parent),
-      activeProfileName("Default")
+    : QObject(parent)
 {
     createDefaultProfiles();
 }
 
 void ProfileModel::createDefaultProfiles()
 {
+    std::shared_ptr<ProfileSet> next = std::make_shared<ProfileSet>();
+    next->activeProfileName = "Default";
+    
     // Create default profile
     Profile defaultProfile;
     defaultProfile.name = "Default";
@@ -20,7 +122,7 @@ void ProfileModel::createDefaultProfiles()
     defaultProfile.carbRatio = 10.0;
     defaultProfile.correctionFactor = 2.0;
     defaultProfile.targetGlucose = 5.5;
-    profiles[defaultProfile.name] = defaultProfile;
+    next->insert(defaultProfile);
     
     // Create sleep profile
     Profile sleepProfile;
@@ -29,7 +131,7 @@ void ProfileModel::createDefaultProfiles()
     sleepProfile.carbRatio = 10.0;
     sleepProfile.correctionFactor = 2.0;
     sleepProfile.targetGlucose = 6.0;
-    profiles[sleepProfile.name] = sleepProfile;
+    next->insert(sleepProfile);
     
     // Create exercise profile
     Profile exerciseProfile;
@@ -38,27 +140,52 @@ void ProfileModel::createDefaultProfiles()
     exerciseProfile.carbRatio = 15.0;
     exerciseProfile.correctionFactor = 2.5;
     exerciseProfile.targetGlucose = 6.5;
-    profiles[exerciseProfile.name] = exerciseProfile;
+    next->insert(exerciseProfile);
+    
+    publish(next);
+}
+
+ProfileSetSnapshot ProfileModel::getSnapshot() const
+{
+    QMutexLocker locker(&currentMutex);
+    return current;
+}
+
+std::shared_ptr<ProfileSet> ProfileModel::beginEdit() const
+{
+    return std::make_shared<ProfileSet>(*getSnapshot());
+}
+
+void ProfileModel::publish(const std::shared_ptr<ProfileSet> &next)
+{
+    // The copy's pointers may still refer to the entries of the set it was
+    // copied from
+    next->resolveActive();
+    
+    // The replaced set is released after the lock, in case this was the
+    // last reference to it
+    ProfileSetSnapshot previous(next);
+    QMutexLocker locker(&currentMutex);
+    current.swap(previous);
+    locker.unlock();
 }
 
 bool ProfileModel::createProfile(const Profile &profile)
 {
     // Validate profile data
-    if (profile.name.isEmpty() || 
-        profile.basalRate <= 0 || 
-        profile.carbRatio <= 0 || 
-        profile.correctionFactor <= 0 || 
-        profile.targetGlucose <= 0) {
+    if (!isValidProfile(profile)) {
         return false;
     }
     
     // Check if profile with this name already exists
-    if (profiles.contains(profile.name)) {
+    if (getSnapshot()->find(profile.name)) {
         return false;
     }
     
     // Add the profile
-    profiles[profile.name] = profile;
+    std::shared_ptr<ProfileSet> next = beginEdit();
+    next->insert(profile);
+    publish(next);
     emit profileCreated(profile.name);
     
     return true;
@@ -66,18 +193,17 @@ bool ProfileModel::createProfile(const Profile &profile)
 
 Profile ProfileModel::getProfile(const QString &name) const
 {
-    if (profiles.contains(name)) {
-        return profiles[name];
-    }
-    
-    // Return empty profile if not found
-    return Profile();
+    // Empty profile if not found
+    return getSnapshot()->profile(name);
 }
 
 QVector<Profile> ProfileModel::getAllProfiles() const
 {
+    const ProfileSetSnapshot snapshot = getSnapshot();
+    
     QVector<Profile> result;
-    for (const auto &profile : profiles) {
+    result.reserve(snapshot->profiles.size());
+    for (const auto &profile : snapshot->profiles) {
         result.append(profile);
     }
     return result;
@@ -86,40 +212,43 @@ QVector<Profile> ProfileModel::getAllProfiles() const
 bool ProfileModel::updateProfile(const QString &name, const Profile &updatedProfile)
 {
     // Validate profile data
-    if (updatedProfile.name.isEmpty() || 
-        updatedProfile.basalRate <= 0 || 
-        updatedProfile.carbRatio <= 0 || 
-        updatedProfile.correctionFactor <= 0 || 
-        updatedProfile.targetGlucose <= 0) {
+    if (!isValidProfile(updatedProfile)) {
         return false;
     }
     
     // Check if profile exists
-    if (!profiles.contains(name)) {
+    std::shared_ptr<ProfileSet> next = beginEdit();
+    if (!next->find(name)) {
         return false;
     }
     
     // Handle name change
+    bool renamedActive = false;
     if (name != updatedProfile.name) {
         // Check if new name conflicts with existing profile
-        if (profiles.contains(updatedProfile.name)) {
+        if (next->find(updatedProfile.name)) {
             return false;
         }
         
         // Remove old profile and add with new name
-        profiles.remove(name);
-        profiles[updatedProfile.name] = updatedProfile;
+        next->remove(name);
+        next->insert(updatedProfile);
         
         // Update active profile name if needed
-        if (activeProfileName == name) {
-            activeProfileName = updatedProfile.name;
-            emit activeProfileChanged(activeProfileName);
+        if (next->activeProfileName == name) {
+            next->activeProfileName = updatedProfile.name;
+            renamedActive = true;
         }
     } else {
         // Just update the profile
-        profiles[name] = updatedProfile;
+        next->insert(updatedProfile);
     }
     
+    publish(next);
+    
+    if (renamedActive) {
+        emit activeProfileChanged(updatedProfile.name);
+    }
     emit profileUpdated(updatedProfile.name);
     return true;
 }
@@ -132,17 +261,19 @@ bool ProfileModel::deleteProfile(const QString &name)
     }
     
     // Check if profile exists
-    if (!profiles.contains(name)) {
+    if (!getSnapshot()->find(name)) {
         return false;
     }
     
     // Switch to default profile if deleting active profile
-    if (activeProfileName == name) {
+    if (getActiveProfileName() == name) {
         setActiveProfile("Default");
     }
     
     // Remove the profile
-    profiles.remove(name);
+    std::shared_ptr<ProfileSet> next = beginEdit();
+    next->remove(name);
+    publish(next);
     emit profileDeleted(name);
     
     return true;
@@ -151,13 +282,16 @@ bool ProfileModel::deleteProfile(const QString &name)
 bool ProfileModel::setActiveProfile(const QString &name)
 {
     // Check if profile exists
-    if (!profiles.contains(name)) {
+    const ProfileSetSnapshot snapshot = getSnapshot();
+    if (!snapshot->find(name)) {
         return false;
     }
     
     // Set active profile
-    if (activeProfileName != name) {
-        activeProfileName = name;
+    if (snapshot->activeProfileName != name) {
+        std::shared_ptr<ProfileSet> next = beginEdit();
+        next->activeProfileName = name;
+        publish(next);
         emit activeProfileChanged(name);
     }
     
@@ -166,30 +300,32 @@ bool ProfileModel::setActiveProfile(const QString &name)
 
 Profile ProfileModel::getActiveProfile() const
 {
-    return getProfile(activeProfileName);
+    return getSnapshot()->activeProfile();
 }
 
 QString ProfileModel::getActiveProfileName() const
 {
-    return activeProfileName;
+    return getSnapshot()->activeProfileName;
 }
 
 bool ProfileModel::saveProfiles(const QString &filename)
 {
+    const ProfileSetSnapshot snapshot = getSnapshot();
     QJsonObject rootObj;
     
     // Save active profile name
-    rootObj["activeProfile"] = activeProfileName;
+    rootObj["activeProfile"] = snapshot->activeProfileName;
     
     // Save all profiles
     QJsonArray profilesArray;
-    for (const auto &profile : getAllProfiles()) {
+    for (const auto &profile : snapshot->profiles) {
         QJsonObject profileObj;
         profileObj["name"] = profile.name;
         profileObj["basalRate"] = profile.basalRate;
         profileObj["carbRatio"] = profile.carbRatio;
         profileObj["correctionFactor"] = profile.correctionFactor;
         profileObj["targetGlucose"] = profile.targetGlucose;
+        profileObj["segments"] = segmentsToJson(profile.segments);
         profilesArray.append(profileObj);
     }
     rootObj["profiles"] = profilesArray;
@@ -222,21 +358,21 @@ bool ProfileModel::loadProfiles(const QString &filename)
         return false;
     }
     
-    QJsonObject rootObj = doc.object();
-    
+    return loadProfiles(doc.object());
+}
+
+bool ProfileModel::loadProfiles(const QJsonObject &rootObj)
+{
     // Clear existing profiles (except Default)
-    QVector<QString> profilesToRemove;
-    for (const auto &name : profiles.keys()) {
+    std::shared_ptr<ProfileSet> next = beginEdit();
+    for (const auto &name : next->profiles.keys()) {
         if (name != "Default") {
-            profilesToRemove.append(name);
+            next->remove(name);
         }
     }
     
-    for (const auto &name : profilesToRemove) {
-        profiles.remove(name);
-    }
-    
     // Load all profiles
+    QVector<QString> loaded;
     QJsonArray profilesArray = rootObj["profiles"].toArray();
     for (const QJsonValue &value : profilesArray) {
         QJsonObject profileObj = value.toObject();
@@ -247,14 +383,31 @@ bool ProfileModel::loadProfiles(const QString &filename)
         profile.carbRatio = profileObj["carbRatio"].toDouble();
         profile.correctionFactor = profileObj["correctionFactor"].toDouble();
         profile.targetGlucose = profileObj["targetGlucose"].toDouble();
+        profile.segments = segmentsFromJson(profileObj["segments"].toArray());
         
         // Don't overwrite Default profile
         if (profile.name != "Default") {
-            profiles[profile.name] = profile;
-            emit profileCreated(profile.name);
+            next->insert(profile);
+            loaded.append(profile.name);
         }
     }
     
+    // The active profile may have been one of those removed
+    const bool activeRemoved = !next->find(next->activeProfileName);
+    if (activeRemoved) {
+        next->activeProfileName = "Default";
+    }
+    
+    // Readers see the whole file at once, never a partly loaded set
+    publish(next);
+    
+    for (const auto &name : loaded) {
+        emit profileCreated(name);
+    }
+    if (activeRemoved) {
+        emit activeProfileChanged("Default");
+    }
+    
     // Set active profile
     QString activeProfile = rootObj["activeProfile"].toString("Default");
     setActiveProfile(activeProfile);
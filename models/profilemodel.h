@@ -2,18 +2,57 @@
 #define PROFILEMODEL_H
 
 #include <QObject>
+#include <QJsonObject>
 #include <QString>
 #include <QVector>
 #include <QMap>
+#include <QMutex>
+#include <memory>
+#include "profileschedule.h"
 
+// A profile's own settings apply from midnight; segments override them for
+// later parts of the day. A profile without segments is the same all day.
 struct Profile {
     QString name;
     double basalRate;           // Units per hour
     double carbRatio;           // Grams of carbs per unit of insulin
     double correctionFactor;    // mmol/L per unit of insulin
     double targetGlucose;       // Target glucose in mmol/L
+    QVector<ProfileSegment> segments;
 };
 
+// Every profile, its compiled schedule and which one is active, as one
+// immutable value. ProfileModel never changes a published set: an edit
+// copies it, changes the copy and swaps the pointer, so a reader holding a
+// snapshot sees one consistent state for as long as it keeps it, on any
+// thread and without holding a lock.
+struct ProfileSet {
+    QMap<QString, Profile> profiles;
+    QMap<QString, ProfileSchedule> schedules;
+    QString activeProfileName;
+    
+    // nullptr if there is no such profile
+    const Profile *find(const QString &name) const;
+    
+    // An empty profile / all-zero schedule for unknown names
+    const Profile &profile(const QString &name) const;
+    const ProfileSchedule &schedule(const QString &name) const;
+    
+    // Resolved when the set is published, so these are pointer loads
+    const Profile &activeProfile() const { return *activeProfileEntry; }
+    const ProfileSchedule &activeSchedule() const { return *activeScheduleEntry; }
+    
+    // Used by ProfileModel on its private copy before publishing it
+    void insert(const Profile &profile);
+    void remove(const QString &name);
+    void resolveActive();
+    
+    const Profile *activeProfileEntry = nullptr;
+    const ProfileSchedule *activeScheduleEntry = nullptr;
+};
+
+typedef std::shared_ptr<const ProfileSet> ProfileSetSnapshot;
+
 class ProfileModel : public QObject
 {
     Q_OBJECT
@@ -33,9 +72,14 @@ public:
     Profile getActiveProfile() const;
     QString getActiveProfileName() const;
     
+    // The current profile set, including the compiled schedules. Safe to
+    // call from any thread; the snapshot stays valid while it is held.
+    ProfileSetSnapshot getSnapshot() const;
+    
     // Save and load profiles
     bool saveProfiles(const QString &filename);
     bool loadProfiles(const QString &filename);
+    bool loadProfiles(const QJsonObject &rootObj);
     
 signals:
     void profileCreated(const QString &name);
@@ -44,9 +88,15 @@ signals:
     void activeProfileChanged(const QString &name);
     
 private:
-    QMap<QString, Profile> profiles;
-    QString activeProfileName;
+    // Replaced, never modified, and only on the thread that owns the model.
+    // Taking a snapshot locks currentMutex just long enough to copy the
+    // pointer; edits build the new set before taking it, so readers only
+    // ever wait for another pointer copy.
+    ProfileSetSnapshot current;
+    mutable QMutex currentMutex;
     
+    std::shared_ptr<ProfileSet> beginEdit() const;
+    void publish(const std::shared_ptr<ProfileSet> &next);
     void createDefaultProfiles();
 };
 
@@ -0,0 +1,34 @@
+#include "profileschedule.h"
+#include "profilemodel.h"
+#include <algorithm>
+
+ProfileSchedule::ProfileSchedule()
+{
+    const Slot empty = {0.0, 0.0, 0.0, 0.0};
+    std::fill(table, table + SlotCount, empty);
+}
+
+ProfileSchedule::ProfileSchedule(const Profile &profile)
+{
+    QVector<ProfileSegment> segments = profile.segments;
+    std::sort(segments.begin(), segments.end(),
+              [](const ProfileSegment &a, const ProfileSegment &b) {
+                  return a.startMinute < b.startMinute;
+              });
+    
+    // The profile's own settings run from midnight until the first segment
+    Slot current = {profile.basalRate, profile.carbRatio,
+                    profile.correctionFactor, profile.targetGlucose};
+    int next = 0;
+    
+    for (int slot = 0; slot < SlotCount; ++slot) {
+        const int slotEnd = (slot + 1) * SlotMinutes;
+        while (next < segments.size() && segments[next].startMinute < slotEnd) {
+            const ProfileSegment &segment = segments[next];
+            current = {segment.basalRate, segment.carbRatio,
+                       segment.correctionFactor, segment.targetGlucose};
+            ++next;
+        }
+        table[slot] = current;
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef PROFILESCHEDULE_H
+#define PROFILESCHEDULE_H
+
+#include <QDateTime>
+#include <QTime>
+
+struct Profile;
+
+// A later part of the day in a segmented profile. The segment starts at
+// startMinute (minutes after midnight) and lasts until the next one.
+struct ProfileSegment {
+    int startMinute;
+    double basalRate;           // Units per hour
+    double carbRatio;           // Grams of carbs per unit of insulin
+    double correctionFactor;    // mmol/L per unit of insulin
+    double targetGlucose;       // Target glucose in mmol/L
+};
+
+// A profile's settings compiled into one slot per 5 minutes of the day.
+//
+// The table is built when the profile is edited, so reading any setting
+// for any time of day is a single indexed load instead of a search through
+// the segments. A segment that starts part way through a slot takes effect
+// for the whole slot.
+class ProfileSchedule
+{
+public:
+    static const int SlotMinutes = 5;
+    static const int SlotCount = 24 * 60 / SlotMinutes;  // 288
+    
+    struct Slot {
+        double basalRate;
+        double carbRatio;
+        double correctionFactor;
+        double targetGlucose;
+    };
+    
+    // All settings zero, for profiles that do not exist
+    ProfileSchedule();
+    explicit ProfileSchedule(const Profile &profile);
+    
+    static int slotFor(const QTime &time)
+    {
+        if (!time.isValid()) {
+            return 0;
+        }
+        return (time.hour() * 60 + time.minute()) / SlotMinutes;
+    }
+    static QTime slotStart(int slot) { return QTime::fromMSecsSinceStartOfDay(slot * SlotMinutes * 60000); }
+    
+    const Slot &at(int slot) const { return table[slot]; }
+    const Slot &at(const QTime &time) const { return table[slotFor(time)]; }
+    const Slot &at(const QDateTime &time) const { return table[slotFor(time.time())]; }
+    
+    // Scales the basal rate of a single slot, for time-based adjustments
+    void scaleBasal(int slot, double factor) { table[slot].basalRate *= factor; }
+
+private:
+    Slot table[SlotCount];
+};
+
+#endif // PROFILESCHEDULE_H
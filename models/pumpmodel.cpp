@@ -3,6 +3,30 @@
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
+#include <limits>
+#include "../utils/timestamp.h"
+
+namespace {
+
+// The glucose and delivery histories keep the last day. Trimming an hour
+// at a time keeps the per-sample cost small, and since the vectors never
+// shrink, appends reuse the freed capacity instead of allocating.
+const qint64 HistoryRetentionMs = 24LL * 60 * 60 * 1000;
+const qint64 HistoryTrimSlackMs = 60LL * 60 * 1000;
+
+void trimHistory(TimeSeriesStore &history)
+{
+    if (history.isEmpty()) {
+        return;
+    }
+    
+    const qint64 newest = history.last().timestamp;
+    if (newest - history.at(0).timestamp > HistoryRetentionMs + HistoryTrimSlackMs) {
+        history.removeBefore(newest - HistoryRetentionMs);
+    }
+}
+
+}
 
 PumpModel::PumpModel(QObject *parent)
     : QObject(parent),
@@ -76,7 +100,7 @@ void PumpModel::reduceInsulin(double units)
     if (newInsulin < 0) newInsulin = 0;
     
     updateInsulinRemaining(newInsulin);
-    addInsulinDelivery(QDateTime::currentDateTime(), units);
+    addInsulinDelivery(Timestamp::now().toDateTime(), units);
 }
 
 PumpModel::PumpState PumpModel::getPumpState() const
@@ -167,24 +191,36 @@ void PumpModel::clearAlert(int index)
 
 QVector<QPair<QDateTime, double>> PumpModel::getGlucoseHistory() const
 {
-    return glucoseHistory;
+    return glucoseHistory.toPairs(std::numeric_limits<qint64>::min(), std::numeric_limits<qint64>::max());
 }
 
 QVector<QPair<QDateTime, double>> PumpModel::getInsulinHistory() const
+{
+    return insulinHistory.toPairs(std::numeric_limits<qint64>::min(), std::numeric_limits<qint64>::max());
+}
+
+const TimeSeriesStore &PumpModel::getGlucoseSeries() const
+{
+    return glucoseHistory;
+}
+
+const TimeSeriesStore &PumpModel::getInsulinSeries() const
 {
     return insulinHistory;
 }
 
 void PumpModel::addGlucoseReading(QDateTime timestamp, double value)
 {
-    glucoseHistory.append(qMakePair(timestamp, value));
+    glucoseHistory.append(timestamp, value);
+    trimHistory(glucoseHistory);
     emit glucoseReadingAdded(timestamp, value);
     updateLastActionTime();
 }
 
 void PumpModel::addInsulinDelivery(QDateTime timestamp, double units)
 {
-    insulinHistory.append(qMakePair(timestamp, units));
+    insulinHistory.append(timestamp, units);
+    trimHistory(insulinHistory);
     emit insulinDeliveryAdded(timestamp, units);
     updateLastActionTime();
 }
@@ -215,20 +251,20 @@ bool PumpModel::saveState(const QString &filename)
     
     // Save glucose history
     QJsonArray glucoseArray;
-    for (const auto &reading : glucoseHistory) {
+    for (const auto &reading : glucoseHistory.rawSamples()) {
         QJsonObject readingObj;
-        readingObj["timestamp"] = reading.first.toString(Qt::ISODate);
-        readingObj["value"] = reading.second;
+        readingObj["timestamp"] = QDateTime::fromMSecsSinceEpoch(reading.timestamp).toString(Qt::ISODate);
+        readingObj["value"] = reading.value;
         glucoseArray.append(readingObj);
     }
     pumpState["glucoseHistory"] = glucoseArray;
     
     // Save insulin history
     QJsonArray insulinArray;
-    for (const auto &delivery : insulinHistory) {
+    for (const auto &delivery : insulinHistory.rawSamples()) {
         QJsonObject deliveryObj;
-        deliveryObj["timestamp"] = delivery.first.toString(Qt::ISODate);
-        deliveryObj["units"] = delivery.second;
+        deliveryObj["timestamp"] = QDateTime::fromMSecsSinceEpoch(delivery.timestamp).toString(Qt::ISODate);
+        deliveryObj["units"] = delivery.value;
         insulinArray.append(deliveryObj);
     }
     pumpState["insulinHistory"] = insulinArray;
@@ -261,7 +297,11 @@ bool PumpModel::loadState(const QString &filename)
         return false;
     }
     
-    QJsonObject pumpState = doc.object();
+    return loadState(doc.object());
+}
+
+bool PumpModel::loadState(const QJsonObject &pumpState)
+{
     
     // Load basic pump data
     batteryLevel = pumpState["batteryLevel"].toInt(100);
@@ -290,8 +330,9 @@ bool PumpModel::loadState(const QString &filename)
         QJsonObject readingObj = value.toObject();
         QDateTime timestamp = QDateTime::fromString(readingObj["timestamp"].toString(), Qt::ISODate);
         double glucoseValue = readingObj["value"].toDouble();
-        glucoseHistory.append(qMakePair(timestamp, glucoseValue));
+        glucoseHistory.append(timestamp, glucoseValue);
     }
+    trimHistory(glucoseHistory);
     
     // Load insulin history
     insulinHistory.clear();
@@ -300,8 +341,9 @@ bool PumpModel::loadState(const QString &filename)
         QJsonObject deliveryObj = value.toObject();
         QDateTime timestamp = QDateTime::fromString(deliveryObj["timestamp"].toString(), Qt::ISODate);
         double units = deliveryObj["units"].toDouble();
-        insulinHistory.append(qMakePair(timestamp, units));
+        insulinHistory.append(timestamp, units);
     }
+    trimHistory(insulinHistory);
     
     // Emit all signals to update UI
     emit batteryLevelChanged(batteryLevel);
@@ -2,10 +2,12 @@
 #define PUMPMODEL_H
 
 #include <QObject>
+#include <QJsonObject>
 #include <QDateTime>
 #include <QMap>
 #include <QVector>
 #include <QString>
+#include "../utils/timeseriesstore.h"
 
 class PumpModel : public QObject
 {
@@ -60,15 +62,20 @@ public:
     QVector<QPair<QString, AlertLevel>> getActiveAlerts() const;
     void clearAlert(int index);
     
-    // Data management
+    // Data management. Both histories hold the last 24 hours. The history
+    // getters copy everything out as QDateTime pairs;
+    // getGlucoseSeries().view(start, end) iterates in place instead.
     QVector<QPair<QDateTime, double>> getGlucoseHistory() const;
     QVector<QPair<QDateTime, double>> getInsulinHistory() const;
+    const TimeSeriesStore &getGlucoseSeries() const;
+    const TimeSeriesStore &getInsulinSeries() const;
     void addGlucoseReading(QDateTime timestamp, double value);
     void addInsulinDelivery(QDateTime timestamp, double units);
     
     // Save and load state
     bool saveState(const QString &filename);
     bool loadState(const QString &filename);
+    bool loadState(const QJsonObject &pumpState);
     
 signals:
     void batteryLevelChanged(int level);
@@ -92,8 +99,8 @@ private:
     double insulinOnBoard;
     double controlIQDelivery;
     QVector<QPair<QString, AlertLevel>> alerts;
-    QVector<QPair<QDateTime, double>> glucoseHistory;
-    QVector<QPair<QDateTime, double>> insulinHistory;
+    TimeSeriesStore glucoseHistory;
+    TimeSeriesStore insulinHistory;
     
     void updateLastActionTime();
 };
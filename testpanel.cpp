@@ -7,6 +7,24 @@
 #include <QScreen>
 #include <QApplication>
 #include <QInputDialog>
+#include <QHeaderView>
+#include <QJsonObject>
+#include "utils/metrics.h"
+
+namespace {
+
+// Histograms hold nanoseconds; show them in the most readable unit
+QString formatNanoseconds(double ns)
+{
+    if (ns >= 1e6) {
+        return QString::number(ns / 1e6, 'f', 2) + " ms";
+    } else if (ns >= 1e3) {
+        return QString::number(ns / 1e3, 'f', 1) + " us";
+    }
+    return QString::number(ns, 'f', 0) + " ns";
+}
+
+}
 
 TestPanel::TestPanel(PumpController *controller, QWidget *parent)
     : QDialog(parent),
@@ -91,6 +109,7 @@ void TestPanel::setupUi()
     insulinDeliveryTab = new QWidget();
     profileTab = new QWidget();
     securityTab = new QWidget();
+    metricsTab = new QWidget();
     
     // Set up each tab
     setupBasicControlsTab();
@@ -98,6 +117,7 @@ void TestPanel::setupUi()
     setupInsulinDeliveryTab();
     setupProfileTab();
     setupSecurityTab();
+    setupMetricsTab();
     
     // Add tabs to tab widget
     tabWidget->addTab(basicControlsTab, "Basic Controls");
@@ -105,6 +125,7 @@ void TestPanel::setupUi()
     tabWidget->addTab(insulinDeliveryTab, "Insulin Delivery");
     tabWidget->addTab(profileTab, "Profile Management");
     tabWidget->addTab(securityTab, "Security");
+    tabWidget->addTab(metricsTab, "Metrics");
     
     // Close button at the bottom
     QHBoxLayout *closeButtonLayout = new QHBoxLayout();
@@ -432,6 +453,68 @@ void TestPanel::setupSecurityTab()
     layout->addStretch(1);
 }
 
+void TestPanel::setupMetricsTab()
+{
+    QVBoxLayout *layout = new QVBoxLayout(metricsTab);
+    layout->setContentsMargins(8, 8, 8, 8);
+    layout->setSpacing(8);
+    
+    metricsTable = new QTableWidget(0, 2, metricsTab);
+    metricsTable->setHorizontalHeaderLabels({"Metric", "Value"});
+    metricsTable->horizontalHeader()->setSectionResizeMode(0, QHeaderView::ResizeToContents);
+    metricsTable->horizontalHeader()->setStretchLastSection(true);
+    metricsTable->verticalHeader()->setVisible(false);
+    metricsTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    metricsTable->setSelectionMode(QAbstractItemView::NoSelection);
+    
+    layout->addWidget(metricsTable);
+    
+    // Refresh live while the tab is showing
+    metricsRefreshTimer = new QTimer(this);
+    connect(metricsRefreshTimer, &QTimer::timeout, this, &TestPanel::refreshMetrics);
+    metricsRefreshTimer->start(1000);
+}
+
+void TestPanel::refreshMetrics()
+{
+    if (!isVisible() || tabWidget->currentWidget() != metricsTab) {
+        return;
+    }
+    
+    if (pumpController) {
+        pumpController->publishMetrics();
+    }
+    
+    QJsonObject metrics = Metrics::toJson();
+    QVector<QPair<QString, QString>> rows;
+    
+    QJsonObject counters = metrics["counters"].toObject();
+    for (auto it = counters.constBegin(); it != counters.constEnd(); ++it) {
+        rows.append(qMakePair(it.key(), QString::number(it.value().toDouble(), 'f', 0)));
+    }
+    
+    QJsonObject gauges = metrics["gauges"].toObject();
+    for (auto it = gauges.constBegin(); it != gauges.constEnd(); ++it) {
+        rows.append(qMakePair(it.key(), QString::number(it.value().toDouble())));
+    }
+    
+    QJsonObject histograms = metrics["histograms"].toObject();
+    for (auto it = histograms.constBegin(); it != histograms.constEnd(); ++it) {
+        QJsonObject summary = it.value().toObject();
+        rows.append(qMakePair(it.key(), QString("n=%1  p50 %2  p99 %3  max %4")
+                              .arg(summary["count"].toDouble(), 0, 'f', 0)
+                              .arg(formatNanoseconds(summary["p50"].toDouble()))
+                              .arg(formatNanoseconds(summary["p99"].toDouble()))
+                              .arg(formatNanoseconds(summary["max"].toDouble()))));
+    }
+    
+    metricsTable->setRowCount(rows.size());
+    for (int row = 0; row < rows.size(); ++row) {
+        metricsTable->setItem(row, 0, new QTableWidgetItem(rows[row].first));
+        metricsTable->setItem(row, 1, new QTableWidgetItem(rows[row].second));
+    }
+}
+
 void TestPanel::connectSignals()
 {
     // Basic Controls Tab
@@ -11,6 +11,8 @@
 #include <QLineEdit>
 #include <QTabWidget>
 #include <QFormLayout>
+#include <QTableWidget>
+#include <QTimer>
 #include "controllers/pumpcontroller.h"
 #include "views/pinlockscreen.h"
 
@@ -54,6 +56,9 @@ private slots:
     // Additional error states
     void onBatteryDrainButtonClicked();
     void onPinLockTestButtonClicked();
+    
+    // Metrics
+    void refreshMetrics();
 
 private:
     PumpController *pumpController;
@@ -118,6 +123,11 @@ private:
     QPushButton *pinLockTestButton;
     PinLockScreen *pinLockScreen = nullptr;
     
+    // Tab 6: Metrics
+    QWidget *metricsTab;
+    QTableWidget *metricsTable;
+    QTimer *metricsRefreshTimer;
+    
     // Close button (global)
     QPushButton *closeButton;
     
@@ -130,6 +140,7 @@ private:
     void setupInsulinDeliveryTab();
     void setupProfileTab();
     void setupSecurityTab();
+    void setupMetricsTab();
     void connectSignals();
     void updateProfileComboBox();
 };
@@ -4,6 +4,9 @@ TARGET = tslimx2simulator
 TEMPLATE = app
 CONFIG += c++17
 
+# Uncomment to compile out all TRACE_SCOPE instrumentation
+# DEFINES += TSLIM_NO_TRACING
+
 SOURCES += \
     main.cpp \
     mainwindow.cpp \
@@ -11,14 +14,19 @@ SOURCES += \
     forceresizable.cpp \
     models/pumpmodel.cpp \
     models/profilemodel.cpp \
+    models/profileschedule.cpp \
     models/glucosemodel.cpp \
     models/insulinmodel.cpp \
+    models/insulinindex.cpp \
+    models/deliveryengine.cpp \
+    models/insulinhistorycursor.cpp \
     views/homescreen.cpp \
     views/bolusscreen.cpp \
     views/profilescreen.cpp \
     views/optionsscreen.cpp \
     views/graphview.cpp \
     views/historyscreen.cpp \
+    views/historytablemodels.cpp \
     views/controliqscreen.cpp \
     views/alertsscreen.cpp \
     views/pinlockscreen.cpp \
@@ -27,9 +35,24 @@ SOURCES += \
     controllers/boluscontroller.cpp \
     controllers/alertcontroller.cpp \
     controllers/profilecontroller.cpp \
+    controllers/historyquery.cpp \
     utils/datastorage.cpp \
     utils/errorhandler.cpp \
-    utils/controliqalgorithm.cpp
+    utils/controliqalgorithm.cpp \
+    utils/timeseriesstore.cpp \
+    utils/glucoserollup.cpp \
+    utils/agpengine.cpp \
+    utils/csvexporter.cpp \
+    utils/stringpool.cpp \
+    utils/timestamp.cpp \
+    utils/tracing.cpp \
+    utils/metrics.cpp \
+    utils/stallmonitor.cpp \
+    utils/reminderscheduler.cpp \
+    utils/settingsstore.cpp \
+    utils/alertruleengine.cpp \
+    utils/alertqueue.cpp \
+    utils/controlloopmonitor.cpp
 
 HEADERS += \
     mainwindow.h \
@@ -37,14 +60,19 @@ HEADERS += \
     forceresizable.h \
     models/pumpmodel.h \
     models/profilemodel.h \
+    models/profileschedule.h \
     models/glucosemodel.h \
     models/insulinmodel.h \
+    models/insulinindex.h \
+    models/deliveryengine.h \
+    models/insulinhistorycursor.h \
     views/homescreen.h \
     views/bolusscreen.h \
     views/profilescreen.h \
     views/optionsscreen.h \
     views/graphview.h \
     views/historyscreen.h \
+    views/historytablemodels.h \
     views/controliqscreen.h \
     views/alertsscreen.h \
     views/pinlockscreen.h \
@@ -53,9 +81,26 @@ HEADERS += \
     controllers/boluscontroller.h \
     controllers/alertcontroller.h \
     controllers/profilecontroller.h \
+    controllers/historyquery.h \
     utils/datastorage.h \
     utils/errorhandler.h \
-    utils/controliqalgorithm.h
+    utils/controliqalgorithm.h \
+    utils/timeseriesstore.h \
+    utils/glucoserollup.h \
+    utils/agpengine.h \
+    utils/csvexporter.h \
+    utils/stringpool.h \
+    utils/timestamp.h \
+    utils/historyview.h \
+    utils/ringbuffer.h \
+    utils/tracing.h \
+    utils/metrics.h \
+    utils/stallmonitor.h \
+    utils/reminderscheduler.h \
+    utils/settingsstore.h \
+    utils/alertruleengine.h \
+    utils/alertqueue.h \
+    utils/controlloopmonitor.h
 
 FORMS += \
     mainwindow.ui \
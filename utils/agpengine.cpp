@@ -0,0 +1,309 @@
+#include "agpengine.h"
+#include <QtMath>
+#include <algorithm>
+#include <iterator>
+#include <limits>
+
+namespace {
+
+const qint64 HourMs = 60LL * 60 * 1000;
+const qint64 DayMs = 24 * HourMs;
+const qint64 SlotMs = AgpEngine::SlotMinutes * 60LL * 1000;
+
+// mmol/L to mg/dL
+const double MgPerDlPerMmol = 18.0182;
+
+}
+
+AgpEngine::AgpEngine(int windowDays)
+    : window(qBound(int(MinWindowDays), windowDays, int(MaxWindowDays)))
+{
+    clear();
+}
+
+void AgpEngine::setWindowDays(int days)
+{
+    window = qBound(int(MinWindowDays), days, int(MaxWindowDays));
+    if (entries.isEmpty()) {
+        return;
+    }
+    
+    // Count retained readings back in when the window grows, then drop
+    // whatever it no longer covers when it shrinks
+    const qint64 cutoff = lastTimestamp - window * DayMs;
+    while (windowStart > retainedStart && entries.at(windowStart - 1).timestamp >= cutoff) {
+        --windowStart;
+        count(entries.at(windowStart), 1);
+    }
+    slideWindow();
+}
+
+void AgpEngine::add(qint64 timestamp, double value)
+{
+    Entry entry;
+    entry.timestamp = timestamp;
+    entry.value = static_cast<float>(value);
+    entry.slot = static_cast<quint16>(slotFor(timestamp));
+    addEntry(entry);
+}
+
+void AgpEngine::add(const QDateTime &timestamp, double value)
+{
+    add(timestamp.toMSecsSinceEpoch(), value);
+}
+
+void AgpEngine::merge(const AgpEngine &other)
+{
+    if (other.entries.size() == other.retainedStart) {
+        return;
+    }
+    
+    // Interleave both sets of retained readings and count them again, so
+    // the result covers this engine's window of the combined readings
+    QVector<Entry> combined;
+    combined.reserve(entries.size() - retainedStart + other.entries.size() - other.retainedStart);
+    std::merge(entries.constBegin() + retainedStart, entries.constEnd(),
+               other.entries.constBegin() + other.retainedStart, other.entries.constEnd(),
+               std::back_inserter(combined),
+               [](const Entry &a, const Entry &b) { return a.timestamp < b.timestamp; });
+    
+    const int windowDays = window;
+    clear();
+    window = windowDays;
+    
+    entries.reserve(combined.size());
+    for (const Entry &entry : combined) {
+        addEntry(entry);
+    }
+}
+
+void AgpEngine::clear()
+{
+    // Drop the histograms rather than zeroing them; the next reading
+    // allocates them again
+    entries.clear();
+    retainedStart = 0;
+    windowStart = 0;
+    bins.clear();
+    slotTotals.clear();
+    
+    for (int band = 0; band < BandCount; ++band) {
+        bandCounts[band] = 0;
+    }
+    
+    total = 0;
+    sum = 0.0;
+    sumSquares = 0.0;
+    lastTimestamp = std::numeric_limits<qint64>::min();
+    
+    offsetValidFrom = 0;
+    offsetValidUntil = 0;
+    offsetMs = 0;
+}
+
+void AgpEngine::reserve(int readings)
+{
+    if (bins.isEmpty()) {
+        bins.fill(0, SlotCount * BinCount);
+        slotTotals.fill(0, SlotCount);
+    }
+    entries.reserve(entries.size() + readings);
+}
+
+double AgpEngine::slotPercentile(int slot, double percent) const
+{
+    const int n = slotCount(slot);
+    if (n == 0) {
+        return 0.0;
+    }
+    
+    // Walk the bins up to the requested rank and interpolate inside the bin
+    // that reaches it
+    const double rank = qBound(0.0, percent / 100.0, 1.0) * n;
+    const quint32 *slotBins = bins.constData() + slot * BinCount;
+    double seen = 0.0;
+    
+    for (int bin = 0; bin < BinCount; ++bin) {
+        const quint32 binCount = slotBins[bin];
+        if (binCount > 0 && seen + binCount >= rank) {
+            const double fraction = (rank - seen) / binCount;
+            return MinGlucose + (bin + fraction) / BinsPerUnit;
+        }
+        seen += binCount;
+    }
+    
+    return MaxGlucose;
+}
+
+QVector<AgpEngine::SlotPercentiles> AgpEngine::profile() const
+{
+    QVector<SlotPercentiles> result;
+    result.reserve(SlotCount);
+    
+    if (total == 0) {
+        return result;
+    }
+    
+    for (int slot = 0; slot < SlotCount; ++slot) {
+        if (slotTotals[slot] == 0) {
+            continue;
+        }
+        
+        SlotPercentiles percentiles;
+        percentiles.minuteOfDay = slot * SlotMinutes;
+        percentiles.count = slotTotals[slot];
+        percentiles.p5 = slotPercentile(slot, 5.0);
+        percentiles.p25 = slotPercentile(slot, 25.0);
+        percentiles.p50 = slotPercentile(slot, 50.0);
+        percentiles.p75 = slotPercentile(slot, 75.0);
+        percentiles.p95 = slotPercentile(slot, 95.0);
+        result.append(percentiles);
+    }
+    
+    return result;
+}
+
+AgpEngine::Summary AgpEngine::summary() const
+{
+    Summary result;
+    result.count = total;
+    result.mean = 0.0;
+    result.standardDeviation = 0.0;
+    result.coefficientOfVariation = 0.0;
+    result.gmiPercent = 0.0;
+    result.gmiMmolPerMol = 0.0;
+    for (int band = 0; band < BandCount; ++band) {
+        result.timeInBand[band] = 0.0;
+    }
+    
+    if (total == 0) {
+        return result;
+    }
+    
+    result.mean = sum / total;
+    result.standardDeviation = qSqrt(qMax(0.0, sumSquares / total - result.mean * result.mean));
+    result.coefficientOfVariation = result.mean > 0.0 ? 100.0 * result.standardDeviation / result.mean : 0.0;
+    
+    // Bergenstal et al. 2018: GMI (%) = 3.31 + 0.02392 * mean glucose (mg/dL)
+    result.gmiPercent = 3.31 + 0.02392 * result.mean * MgPerDlPerMmol;
+    result.gmiMmolPerMol = 12.71 + 4.70587 * result.mean;
+    
+    for (int band = 0; band < BandCount; ++band) {
+        result.timeInBand[band] = static_cast<double>(bandCounts[band]) / total;
+    }
+    
+    result.firstReading = QDateTime::fromMSecsSinceEpoch(entries.at(windowStart).timestamp);
+    result.lastReading = QDateTime::fromMSecsSinceEpoch(lastTimestamp);
+    return result;
+}
+
+AgpEngine::RangeBand AgpEngine::bandFor(double value)
+{
+    if (value < 3.0) {
+        return VeryLow;
+    }
+    if (value < 3.9) {
+        return Low;
+    }
+    if (value <= 10.0) {
+        return InRange;
+    }
+    if (value <= 13.9) {
+        return High;
+    }
+    return VeryHigh;
+}
+
+int AgpEngine::binFor(double value)
+{
+    // The small offset keeps values like 3.9 out of the bin below when
+    // (3.9 - 1.0) * 10 comes out as 28.999...
+    const int bin = static_cast<int>(qFloor((value - MinGlucose) * BinsPerUnit + 1e-9));
+    return qBound(0, bin, BinCount - 1);
+}
+
+int AgpEngine::slotFor(qint64 timestamp)
+{
+    // Time zone offsets only change on hour boundaries, so one lookup per
+    // local hour is enough
+    if (timestamp < offsetValidFrom || timestamp >= offsetValidUntil) {
+        const QDateTime local = QDateTime::fromMSecsSinceEpoch(timestamp);
+        const QTime time = local.time();
+        
+        offsetMs = local.offsetFromUtc() * 1000LL;
+        offsetValidFrom = timestamp - (time.minute() * 60000LL + time.second() * 1000LL + time.msec());
+        offsetValidUntil = offsetValidFrom + HourMs;
+    }
+    
+    qint64 msOfDay = (timestamp + offsetMs) % DayMs;
+    if (msOfDay < 0) {
+        msOfDay += DayMs;
+    }
+    
+    return static_cast<int>(msOfDay / SlotMs);
+}
+
+void AgpEngine::addEntry(const Entry &entry)
+{
+    if (!entries.isEmpty() && entry.timestamp < lastTimestamp - window * DayMs) {
+        return;
+    }
+    
+    if (bins.isEmpty()) {
+        bins.fill(0, SlotCount * BinCount);
+        slotTotals.fill(0, SlotCount);
+    }
+    
+    // Readings normally arrive in time order, which makes this an append.
+    // A late one goes in its place, so the window keeps sliding off the
+    // oldest readings first; everything before the window is older than it.
+    auto position = std::upper_bound(entries.begin() + windowStart, entries.end(), entry,
+                                     [](const Entry &a, const Entry &b) {
+                                         return a.timestamp < b.timestamp;
+                                     });
+    entries.insert(position, entry);
+    count(entry, 1);
+    lastTimestamp = qMax(lastTimestamp, entry.timestamp);
+    slideWindow();
+}
+
+void AgpEngine::count(const Entry &entry, int delta)
+{
+    const double value = entry.value;
+    
+    bins[entry.slot * BinCount + binFor(value)] += delta;
+    slotTotals[entry.slot] += delta;
+    bandCounts[bandFor(value)] += delta;
+    
+    total += delta;
+    sum += delta * value;
+    sumSquares += delta * value * value;
+}
+
+void AgpEngine::slideWindow()
+{
+    const qint64 cutoff = lastTimestamp - window * DayMs;
+    while (windowStart < entries.size() && entries.at(windowStart).timestamp < cutoff) {
+        count(entries.at(windowStart), -1);
+        ++windowStart;
+    }
+    
+    const qint64 retainedCutoff = lastTimestamp - MaxWindowDays * DayMs;
+    while (retainedStart < windowStart && entries.at(retainedStart).timestamp < retainedCutoff) {
+        ++retainedStart;
+    }
+    
+    // Shift the dead prefix out once it is as large as what is left, so
+    // trimming stays amortised O(1) per reading
+    if (retainedStart >= 1024 && retainedStart * 2 >= entries.size()) {
+        entries.remove(0, retainedStart);
+        windowStart -= retainedStart;
+        retainedStart = 0;
+    }
+    
+    // Subtracting readings back out leaves rounding behind in the sums
+    if (total == 0) {
+        sum = 0.0;
+        sumSquares = 0.0;
+    }
+}
@@ -0,0 +1,136 @@
+#ifndef AGPENGINE_H
+#define AGPENGINE_H
+
+#include <QDateTime>
+#include <QVector>
+
+// Streaming ambulatory glucose profile (AGP).
+//
+// Readings are counted into a fixed-bin histogram per 5 minute slot of the
+// local day (288 slots, 0.1 mmol/L bins from 1.0 to 30.0 mmol/L), so adding
+// a reading is O(1). Percentiles are interpolated within a bin, which keeps
+// them within 0.1 mmol/L of the exact value.
+//
+// Statistics cover the last windowDays() days before the newest reading
+// (14 to 90). Readings that fall out of the window are taken back out of
+// the histograms; the engine keeps a 16 byte record per reading for the
+// longest window so the window can be widened again without reloading.
+// Readings are expected in time order. A late one inside the window is
+// put in its place, and one older than the current window is ignored.
+//
+// The histograms (about 330 KB) are only allocated by the first reading and
+// are released by clear(). Copies share them until one of them changes.
+//
+// Engines built from disjoint sets of readings, e.g. on different threads
+// or for different patients, can be combined with merge().
+class AgpEngine
+{
+public:
+    static const int SlotMinutes = 5;
+    static const int SlotCount = 24 * 60 / SlotMinutes;
+    static const int BinsPerUnit = 10;
+    static constexpr double MinGlucose = 1.0;
+    static constexpr double MaxGlucose = 30.0;
+    static const int BinCount = static_cast<int>((MaxGlucose - MinGlucose) * BinsPerUnit);
+    static const int MinWindowDays = 14;
+    static const int MaxWindowDays = 90;
+    
+    // Consensus time-in-range bands (mmol/L)
+    enum RangeBand {
+        VeryLow,   // < 3.0
+        Low,       // 3.0 - 3.8
+        InRange,   // 3.9 - 10.0
+        High,      // 10.1 - 13.9
+        VeryHigh,  // > 13.9
+        BandCount
+    };
+    
+    struct SlotPercentiles {
+        int minuteOfDay;
+        int count;
+        double p5;
+        double p25;
+        double p50;
+        double p75;
+        double p95;
+    };
+    
+    struct Summary {
+        qint64 count;
+        double mean;
+        double standardDeviation;
+        double coefficientOfVariation; // Percent
+        double gmiPercent;             // Glucose management indicator, DCCT %
+        double gmiMmolPerMol;          // Same in IFCC units: 12.71 + 4.70587 * mean
+        double timeInBand[BandCount];  // Fraction of readings, 0-1
+        QDateTime firstReading;
+        QDateTime lastReading;
+    };
+    
+    explicit AgpEngine(int windowDays = MinWindowDays);
+    
+    // Clamped to MinWindowDays - MaxWindowDays
+    void setWindowDays(int days);
+    int windowDays() const { return window; }
+    
+    void add(qint64 timestamp, double value);
+    void add(const QDateTime &timestamp, double value);
+    void merge(const AgpEngine &other);
+    void clear();
+    
+    // Allocates the histograms and room for this many more readings
+    void reserve(int readings);
+    
+    qint64 count() const { return total; }
+    bool isEmpty() const { return total == 0; }
+    
+    // Glucose value at the given percentile (0-100) for one slot
+    double slotPercentile(int slot, double percent) const;
+    int slotCount(int slot) const { return slotTotals.isEmpty() ? 0 : slotTotals[slot]; }
+    
+    // 5/25/50/75/95th percentiles for every slot that has readings
+    QVector<SlotPercentiles> profile() const;
+    
+    Summary summary() const;
+    
+    static RangeBand bandFor(double value);
+    static int binFor(double value);
+
+private:
+    // One reading, with its value narrowed to float so that taking it back
+    // out subtracts exactly what was added
+    struct Entry {
+        qint64 timestamp;
+        float value;
+        quint16 slot;
+    };
+    
+    int window;
+    
+    // Oldest first; [retainedStart, windowStart) is kept for widening the
+    // window and [windowStart, end) is what the histograms count
+    QVector<Entry> entries;
+    int retainedStart;
+    int windowStart;
+    
+    QVector<quint32> bins;       // SlotCount x BinCount, slot major; empty until the first reading
+    QVector<int> slotTotals;
+    qint64 bandCounts[BandCount];
+    qint64 total;
+    double sum;
+    double sumSquares;
+    qint64 lastTimestamp;
+    
+    // Local time offset for the hour containing the last reading; a new
+    // offset is only looked up when a reading falls outside it
+    qint64 offsetValidFrom;
+    qint64 offsetValidUntil;
+    qint64 offsetMs;
+    
+    int slotFor(qint64 timestamp);
+    void addEntry(const Entry &entry);
+    void count(const Entry &entry, int delta);
+    void slideWindow();
+};
+
+#endif // AGPENGINE_H
@@ -0,0 +1,119 @@
+#include "alertqueue.h"
+#include "metrics.h"
+
+AlertQueue::AlertQueue(QObject *parent)
+    : QObject(parent),
+      nextSequence(0),
+      dropped(0),
+      deliveryTimer(new QTimer(this))
+{
+    pending.reserve(Capacity);
+    
+    deliveryTimer->setInterval(DeliveryIntervalMs);
+    connect(deliveryTimer, &QTimer::timeout, this, [this]() {
+        if (!deliverNext()) {
+            deliveryTimer->stop();
+        }
+    });
+}
+
+void AlertQueue::post(const QString &message, PumpModel::AlertLevel level)
+{
+    static MetricCounter *coalesced = Metrics::counter("alerts.queue.coalesced");
+    static MetricCounter *droppedAlerts = Metrics::counter("alerts.queue.dropped");
+    
+    // Critical alerts never wait
+    if (level == PumpModel::Critical) {
+        emit alertReady(message, level, 1);
+        return;
+    }
+    
+    const int existing = find(message);
+    if (existing >= 0) {
+        Pending &entry = pending[existing];
+        ++entry.count;
+        entry.level = qMax(entry.level, level);
+        coalesced->increment();
+        return;
+    }
+    
+    if (pending.size() >= Capacity) {
+        const int victim = leastUrgent();
+        ++dropped;
+        droppedAlerts->increment();
+        if (pending.at(victim).level >= level) {
+            return;
+        }
+        pending.remove(victim);
+    }
+    
+    pending.append({message, level, 1, nextSequence++});
+    
+    // The first alert after a quiet spell goes straight out; the timer
+    // spaces out the ones that follow
+    if (!deliveryTimer->isActive()) {
+        deliverNext();
+        deliveryTimer->start();
+    }
+}
+
+void AlertQueue::flush()
+{
+    deliveryTimer->stop();
+    while (deliverNext()) {
+    }
+}
+
+bool AlertQueue::deliverNext()
+{
+    if (pending.isEmpty()) {
+        return false;
+    }
+    
+    const int next = mostUrgent();
+    const Pending entry = pending.at(next);
+    pending.remove(next);
+    
+    emit alertReady(entry.message, entry.level, entry.count);
+    return true;
+}
+
+int AlertQueue::find(const QString &message) const
+{
+    for (int i = 0; i < pending.size(); ++i) {
+        if (pending.at(i).message == message) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Highest level, then oldest
+int AlertQueue::mostUrgent() const
+{
+    int best = 0;
+    for (int i = 1; i < pending.size(); ++i) {
+        const Pending &candidate = pending.at(i);
+        const Pending &current = pending.at(best);
+        if (candidate.level > current.level ||
+            (candidate.level == current.level && candidate.sequence < current.sequence)) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+// Lowest level, then oldest
+int AlertQueue::leastUrgent() const
+{
+    int worst = 0;
+    for (int i = 1; i < pending.size(); ++i) {
+        const Pending &candidate = pending.at(i);
+        const Pending &current = pending.at(worst);
+        if (candidate.level < current.level ||
+            (candidate.level == current.level && candidate.sequence < current.sequence)) {
+            worst = i;
+        }
+    }
+    return worst;
+}
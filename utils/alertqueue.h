@@ -0,0 +1,63 @@
+#ifndef ALERTQUEUE_H
+#define ALERTQUEUE_H
+
+#include <QObject>
+#include <QTimer>
+#include <QString>
+#include <QVector>
+#include "../models/pumpmodel.h"
+
+// Rate-limited delivery of alerts to the UI.
+//
+// Critical alerts are delivered as soon as they are posted. Everything else
+// waits in a small priority queue that is drained one alert per interval,
+// Warnings before Info, oldest first. Posting an alert that is already
+// waiting only bumps its count, and when the queue is full the mildest,
+// oldest alert makes way for a more severe one (or the new one is dropped).
+// An alert storm therefore costs the UI at most a few updates a second.
+class AlertQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+    static const int Capacity = 32;
+    static const int DeliveryIntervalMs = 250;
+    
+    explicit AlertQueue(QObject *parent = nullptr);
+    
+    void post(const QString &message, PumpModel::AlertLevel level);
+    
+    int pendingCount() const { return pending.size(); }
+    int droppedCount() const { return dropped; }
+    
+    // Delivers every waiting alert now, in priority order
+    void flush();
+
+signals:
+    // count is how many times the alert was posted while it waited
+    void alertReady(const QString &message, PumpModel::AlertLevel level, int count);
+
+public slots:
+    // Delivers the next waiting alert; false if there was none
+    bool deliverNext();
+
+private:
+    struct Pending {
+        QString message;
+        PumpModel::AlertLevel level;
+        int count;
+        quint64 sequence;  // Posting order, for oldest first within a level
+    };
+    
+    // Small enough that a linear scan beats keeping an index up to date
+    QVector<Pending> pending;
+    quint64 nextSequence;
+    int dropped;
+    QTimer *deliveryTimer;
+    
+    int find(const QString &message) const;
+    int mostUrgent() const;
+    int leastUrgent() const;
+};
+
+#endif // ALERTQUEUE_H
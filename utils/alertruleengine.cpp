@@ -0,0 +1,218 @@
+#include "alertruleengine.h"
+#include "../models/glucosemodel.h"
+#include <algorithm>
+
+namespace {
+
+typedef AlertRuleEngine E;
+
+// Indexed by AlertRuleEngine::Rule. Thresholds are the defaults of the alert
+// settings; the user's own are applied with setThreshold().
+const E::Definition DefaultRules[E::RuleCount] = {
+    // Glucose level; lows and highs are separate groups, so a high alert
+    // never holds back a low one
+    {E::Glucose, E::AtOrBelow, 3.1, 0.3, 15, 0, PumpModel::Critical, "GlucoseModel",
+     "URGENT LOW GLUCOSE: %1 mmol/L", 1},
+    {E::Glucose, E::AtOrAbove, 13.9, 0.5, 60, 1, PumpModel::Critical, "GlucoseModel",
+     "URGENT HIGH GLUCOSE: %1 mmol/L", 1},
+    {E::Glucose, E::Below, 3.9, 0.3, 30, 0, PumpModel::Warning, "GlucoseModel",
+     "Low glucose: %1 mmol/L", 1},
+    {E::Glucose, E::Above, 10.0, 0.5, 120, 1, PumpModel::Warning, "GlucoseModel",
+     "High glucose: %1 mmol/L", 1},
+    
+    // Glucose rate of change
+    {E::GlucoseRate, E::Above, GlucoseModel::QuickTrendRate, 1.0, 30, 2, PumpModel::Warning, "GlucoseModel",
+     "Glucose rising quickly", -1},
+    {E::GlucoseRate, E::Below, -GlucoseModel::QuickTrendRate, 1.0, 30, 2, PumpModel::Warning, "GlucoseModel",
+     "Glucose falling quickly", -1},
+    
+    // Reservoir
+    {E::InsulinRemaining, E::AtOrBelow, 10.0, 2.0, 60, 3, PumpModel::Critical, "InsulinManager",
+     "INSULIN CRITICALLY LOW: %1 units remaining", 1},
+    {E::InsulinRemaining, E::AtOrBelow, 50.0, 5.0, 240, 3, PumpModel::Warning, "InsulinManager",
+     "Insulin low: %1 units remaining", 1},
+    
+    // Battery
+    {E::BatteryLevel, E::AtOrBelow, 5, 2, 30, 4, PumpModel::Critical, "BatteryManager",
+     "BATTERY CRITICALLY LOW: %1% remaining", 0},
+    {E::BatteryLevel, E::AtOrBelow, 20, 3, 120, 4, PumpModel::Warning, "BatteryManager",
+     "Battery low: %1% remaining", 0},
+    
+    // CGM signal; clears with the next reading
+    {E::CgmGapMinutes, E::Above, 10, 0, 30, 5, PumpModel::Warning, "GlucoseModel",
+     "CGM data gap: No readings for %1 minutes", 0},
+    
+    // Bolus delivery
+    {E::BolusOverrunMinutes, E::Above, 2, 0, 15, 6, PumpModel::Warning, "InsulinModel",
+     "Bolus delivery taking longer than expected", -1}
+};
+
+bool crosses(E::Comparison comparison, double value, double threshold)
+{
+    switch (comparison) {
+    case E::Below:
+        return value < threshold;
+    case E::AtOrBelow:
+        return value <= threshold;
+    case E::Above:
+        return value > threshold;
+    case E::AtOrAbove:
+        return value >= threshold;
+    }
+    return false;
+}
+
+bool isLowerBound(E::Comparison comparison)
+{
+    return comparison == E::Below || comparison == E::AtOrBelow;
+}
+
+}
+
+AlertRuleEngine::AlertRuleEngine()
+{
+    std::copy(DefaultRules, DefaultRules + RuleCount, rules);
+    
+    std::fill(rulesByInput, rulesByInput + InputCount, 0u);
+    for (int rule = 0; rule < RuleCount; ++rule) {
+        rulesByInput[rules[rule].input] |= 1u << rule;
+        
+        moreSevere[rule] = 0;
+        for (int other = 0; other < rule; ++other) {
+            if (rules[other].group == rules[rule].group) {
+                moreSevere[rule] |= 1u << other;
+            }
+        }
+    }
+    
+    reset();
+}
+
+void AlertRuleEngine::setThreshold(Rule rule, double threshold)
+{
+    rules[rule].threshold = threshold;
+}
+
+AlertRuleEngine::Changes AlertRuleEngine::evaluate(const Sample &sample, Timestamp now)
+{
+    Changes changes;
+    
+    quint32 candidates = 0;
+    for (int input = 0; input < InputCount; ++input) {
+        if (sample.inputs & (1u << input)) {
+            candidates |= rulesByInput[input];
+        }
+    }
+    
+    // Latch and release against the thresholds
+    for (int rule = 0; rule < RuleCount; ++rule) {
+        const quint32 bit = 1u << rule;
+        if (!(candidates & bit)) {
+            continue;
+        }
+        
+        const double value = sample.values[rules[rule].input];
+        if (latched & bit) {
+            if (clears(rules[rule], value)) {
+                latched &= ~bit;
+                snoozedUntil[rule] = 0;
+                
+                // An alert whose condition has gone comes down with it
+                if (shown & bit) {
+                    shown &= ~bit;
+                    changes.withdrawn |= bit;
+                }
+            }
+        } else if (triggers(rules[rule], value)) {
+            latched |= bit;
+        }
+        
+        if (latched & bit) {
+            lastValue[rule] = value;
+        }
+    }
+    
+    // Show the most severe latched rule of each group that is not snoozed,
+    // unless a more severe alert of the group is still up. A snoozed rule
+    // lets the next one of its group through.
+    quint32 groupsTaken = 0;
+    for (int rule = 0; rule < RuleCount; ++rule) {
+        const quint32 bit = 1u << rule;
+        if (!(candidates & latched & bit)) {
+            continue;
+        }
+        
+        const quint32 groupBit = 1u << rules[rule].group;
+        if ((groupsTaken & groupBit) || now.toMSecsSinceEpoch() < snoozedUntil[rule]) {
+            continue;
+        }
+        groupsTaken |= groupBit;
+        
+        if (shown & (bit | moreSevere[rule])) {
+            continue;
+        }
+        
+        // Milder alerts of the group make way
+        for (int milder = rule + 1; milder < RuleCount; ++milder) {
+            const quint32 milderBit = 1u << milder;
+            if (rules[milder].group == rules[rule].group && (shown & milderBit)) {
+                shown &= ~milderBit;
+                changes.withdrawn |= milderBit;
+            }
+        }
+        
+        shown |= bit;
+        changes.raised |= bit;
+    }
+    
+    return changes;
+}
+
+void AlertRuleEngine::acknowledge(Rule rule, Timestamp now)
+{
+    const quint32 bit = 1u << rule;
+    shown &= ~bit;
+    
+    if (latched & bit) {
+        snoozedUntil[rule] = now.addSecs(rules[rule].snoozeMinutes * 60).toMSecsSinceEpoch();
+    }
+}
+
+void AlertRuleEngine::acknowledgeAll(Timestamp now)
+{
+    for (int rule = 0; rule < RuleCount; ++rule) {
+        if (shown & (1u << rule)) {
+            acknowledge(static_cast<Rule>(rule), now);
+        }
+    }
+}
+
+QString AlertRuleEngine::message(Rule rule) const
+{
+    const Definition &definition = rules[rule];
+    QString text = QString::fromLatin1(definition.format);
+    if (definition.precision >= 0) {
+        text = text.arg(lastValue[rule], 0, 'f', definition.precision);
+    }
+    return text;
+}
+
+void AlertRuleEngine::reset()
+{
+    latched = 0;
+    shown = 0;
+    std::fill(snoozedUntil, snoozedUntil + RuleCount, 0);
+    std::fill(lastValue, lastValue + RuleCount, 0.0);
+}
+
+bool AlertRuleEngine::triggers(const Definition &rule, double value) const
+{
+    return crosses(rule.comparison, value, rule.threshold);
+}
+
+bool AlertRuleEngine::clears(const Definition &rule, double value) const
+{
+    // Back past the threshold by the hysteresis band
+    const double band = isLowerBound(rule.comparison) ? rule.hysteresis : -rule.hysteresis;
+    return !crosses(rule.comparison, value, rule.threshold + band);
+}
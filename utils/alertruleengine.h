@@ -0,0 +1,125 @@
+#ifndef ALERTRULEENGINE_H
+#define ALERTRULEENGINE_H
+
+#include <QString>
+#include "timestamp.h"
+#include "../models/pumpmodel.h"
+
+// Threshold alerts as a table of rules, evaluated a sample at a time.
+//
+// Each rule watches one numeric input (glucose, its rate of change,
+// reservoir, battery, ...) against a threshold. A rule latches when its
+// threshold is crossed and only lets go once the input is back past the
+// threshold by its hysteresis band, so a value hovering around a threshold
+// raises one alert rather than one per sample, and its alert is withdrawn
+// when it lets go. Rules in the same group are ordered most severe first
+// and only one alert of a group is shown at a time: a more severe alert
+// replaces a milder one, and a milder one waits until the severe one has
+// been acknowledged or has cleared. Acknowledging an alert snoozes its rule
+// for a while if the condition still holds.
+//
+// The state is a few bitmasks and per-rule numbers, so evaluating a sample
+// touches only the rules for its inputs and never allocates. Messages are
+// formatted on demand, from the value the rule last saw.
+class AlertRuleEngine
+{
+public:
+    enum Input : quint8 {
+        Glucose,              // mmol/L
+        GlucoseRate,          // mmol/L per minute
+        InsulinRemaining,     // units
+        BatteryLevel,         // percent
+        CgmGapMinutes,        // since the last CGM reading
+        BolusOverrunMinutes,  // past the active bolus's expected end
+        InputCount
+    };
+    
+    // In table order: within a group, most severe first
+    enum Rule : quint8 {
+        UrgentLowGlucose,
+        UrgentHighGlucose,
+        LowGlucose,
+        HighGlucose,
+        GlucoseRisingQuickly,
+        GlucoseFallingQuickly,
+        CriticalInsulin,
+        LowInsulin,
+        CriticalBattery,
+        LowBattery,
+        CgmDataGap,
+        BolusOverrun,
+        RuleCount
+    };
+    
+    enum Comparison : quint8 {
+        Below,
+        AtOrBelow,
+        Above,
+        AtOrAbove
+    };
+    
+    struct Definition {
+        Input input;
+        Comparison comparison;
+        double threshold;
+        double hysteresis;     // How far back past the threshold clears the rule
+        int snoozeMinutes;     // Quiet time after acknowledging while it still holds
+        quint8 group;
+        PumpModel::AlertLevel level;
+        const char *source;    // Component the alert is logged against
+        const char *format;    // %1 is the value
+        int precision;         // Decimals of %1, or -1 if the format has none
+    };
+    
+    // Inputs for one evaluation; only those set are looked at
+    struct Sample {
+        quint32 inputs = 0;
+        double values[InputCount];
+        
+        void set(Input input, double value)
+        {
+            values[input] = value;
+            inputs |= 1u << input;
+        }
+    };
+    
+    // Rules whose alerts came up and went away in one evaluation
+    struct Changes {
+        quint32 raised = 0;
+        quint32 withdrawn = 0;  // Cleared, or replaced by a more severe alert of their group
+    };
+    
+    AlertRuleEngine();
+    
+    const Definition &definition(Rule rule) const { return rules[rule]; }
+    void setThreshold(Rule rule, double threshold);
+    
+    Changes evaluate(const Sample &sample, Timestamp now);
+    
+    // Takes down a shown alert; the rule is snoozed if still latched
+    void acknowledge(Rule rule, Timestamp now);
+    void acknowledgeAll(Timestamp now);
+    
+    bool isShown(Rule rule) const { return shown & (1u << rule); }
+    bool isLatched(Rule rule) const { return latched & (1u << rule); }
+    quint32 shownRules() const { return shown; }
+    
+    QString message(Rule rule) const;
+    
+    // Forgets every latch, snooze and shown alert
+    void reset();
+
+private:
+    Definition rules[RuleCount];
+    quint32 rulesByInput[InputCount];
+    quint32 moreSevere[RuleCount];  // Earlier rules of the same group
+    quint32 latched;
+    quint32 shown;
+    qint64 snoozedUntil[RuleCount];
+    double lastValue[RuleCount];
+    
+    bool triggers(const Definition &rule, double value) const;
+    bool clears(const Definition &rule, double value) const;
+};
+
+#endif // ALERTRULEENGINE_H
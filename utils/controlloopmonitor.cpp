@@ -0,0 +1,190 @@
+#include "controlloopmonitor.h"
+#include "metrics.h"
+#include <QDateTime>
+#include <QDataStream>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <limits>
+
+static_assert(sizeof(ControlLoopMonitor::CycleRecord) == 24, "CycleRecord should stay compact");
+
+namespace {
+
+qint32 toMicroseconds(qint64 ns)
+{
+    return static_cast<qint32>(qBound<qint64>(std::numeric_limits<qint32>::min(), ns / 1000,
+                                              std::numeric_limits<qint32>::max()));
+}
+
+}
+
+ControlLoopMonitor::ControlLoopMonitor(const QString &metricPrefix, int capacity)
+    : capacity(qMax(1, capacity)),
+      head(0),
+      count(0),
+      active(false),
+      wallAnchorMs(0),
+      periodNs(0),
+      lateThresholdNs(0),
+      customLateThreshold(false),
+      nextDueNs(0),
+      cycleStartNs(-1),
+      cycleScheduledNs(0),
+      cycleMissed(0),
+      sequence(0),
+      late(0),
+      missed(0),
+      cyclesCounter(Metrics::counter(metricPrefix + ".cycles")),
+      lateCounter(Metrics::counter(metricPrefix + ".cycles_late")),
+      missedCounter(Metrics::counter(metricPrefix + ".cycles_missed")),
+      overrunCounter(Metrics::counter(metricPrefix + ".cycles_overrun")),
+      startLatency(Metrics::histogram(metricPrefix + ".start_latency_ns")),
+      cycleTime(Metrics::histogram(metricPrefix + ".cycle_ns"))
+{
+    // Allocate the whole ring up front; recording never allocates
+    ring.resize(this->capacity);
+    clock.start();
+}
+
+void ControlLoopMonitor::start(int periodMs)
+{
+    active = true;
+    periodNs = qMax(1, periodMs) * 1000000LL;
+    if (!customLateThreshold) {
+        lateThresholdNs = periodNs / 10;
+    }
+    
+    const qint64 now = clock.nsecsElapsed();
+    wallAnchorMs = QDateTime::currentMSecsSinceEpoch() - now / 1000000;
+    nextDueNs = now + periodNs;
+    cycleStartNs = -1;
+}
+
+void ControlLoopMonitor::stop()
+{
+    active = false;
+    cycleStartNs = -1;
+}
+
+void ControlLoopMonitor::setLateThreshold(int milliseconds)
+{
+    lateThresholdNs = qMax(0, milliseconds) * 1000000LL;
+    customLateThreshold = true;
+}
+
+void ControlLoopMonitor::beginCycle()
+{
+    if (!isActive()) {
+        cycleStartNs = -1;
+        return;
+    }
+    
+    const qint64 now = clock.nsecsElapsed();
+    
+    // Whole periods that went by without the timer firing
+    cycleMissed = now - nextDueNs >= periodNs ? static_cast<int>((now - nextDueNs) / periodNs) : 0;
+    cycleScheduledNs = nextDueNs + cycleMissed * periodNs;
+    cycleStartNs = now;
+    
+    // After missed slots the timer counts its next period from now
+    nextDueNs = cycleMissed > 0 ? now + periodNs : nextDueNs + periodNs;
+}
+
+void ControlLoopMonitor::endCycle(bool executed)
+{
+    if (cycleStartNs < 0) {
+        return;
+    }
+    
+    const qint64 execution = clock.nsecsElapsed() - cycleStartNs;
+    const qint64 latency = cycleStartNs - cycleScheduledNs;
+    
+    CycleRecord &record = ring[head];
+    record.scheduledMs = wallAnchorMs + cycleScheduledNs / 1000000;
+    record.startLatencyUs = toMicroseconds(latency);
+    record.executionUs = toMicroseconds(execution);
+    record.sequence = ++sequence;
+    record.missedBefore = static_cast<quint16>(qMin(cycleMissed, 0xffff));
+    record.flags = execution > periodNs ? Overrun : 0;
+    
+    if (!executed) {
+        record.status = Inactive;
+    } else if (cycleMissed > 0 || latency > lateThresholdNs) {
+        record.status = Late;
+    } else {
+        record.status = OnTime;
+    }
+    
+    head = (head + 1) % capacity;
+    count = qMin(count + 1, capacity);
+    
+    // Metrics
+    cyclesCounter->increment();
+    startLatency->record(qMax<qint64>(0, latency));
+    cycleTime->record(execution);
+    
+    if (record.status == Late) {
+        ++late;
+        lateCounter->increment();
+    }
+    
+    if (cycleMissed > 0) {
+        missed += cycleMissed;
+        missedCounter->increment(cycleMissed);
+    }
+    
+    if (record.flags & Overrun) {
+        overrunCounter->increment();
+    }
+    
+    cycleStartNs = -1;
+}
+
+QVector<ControlLoopMonitor::CycleRecord> ControlLoopMonitor::records() const
+{
+    QVector<CycleRecord> result;
+    result.reserve(count);
+    
+    const int first = (head - count + capacity) % capacity;
+    for (int i = 0; i < count; ++i) {
+        result.append(ring[(first + i) % capacity]);
+    }
+    
+    return result;
+}
+
+QByteArray ControlLoopMonitor::toBinary() const
+{
+    QByteArray data;
+    data.reserve(28 + count * static_cast<int>(sizeof(CycleRecord)));
+    
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    
+    stream.writeRawData("TSCYCLE1", 8);
+    stream << static_cast<quint32>(sizeof(CycleRecord));
+    stream << static_cast<quint32>(count);
+    stream << static_cast<qint64>(periodNs);
+    
+    for (const CycleRecord &record : records()) {
+        stream << record.scheduledMs << record.startLatencyUs << record.executionUs
+               << record.sequence << record.missedBefore << record.status << record.flags;
+    }
+    
+    return data;
+}
+
+bool ControlLoopMonitor::writeBinary(const QString &filename) const
+{
+    QFileInfo info(filename);
+    info.dir().mkpath(".");
+    
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    
+    const QByteArray data = toBinary();
+    return file.write(data) == data.size();
+}
@@ -0,0 +1,108 @@
+#ifndef CONTROLLOOPMONITOR_H
+#define CONTROLLOOPMONITOR_H
+
+#include <QString>
+#include <QVector>
+#include <QByteArray>
+#include <QElapsedTimer>
+
+class MetricCounter;
+class LatencyHistogram;
+
+// Deadline accounting for a periodic control loop driven by a QTimer.
+//
+// start() fixes the schedule: cycle k is due k periods after it. Each timer
+// driven cycle is bracketed by beginCycle()/endCycle(), which compare the
+// actual start with the slot it was due in, time the execution and count
+// slots that passed without a cycle at all. Like a Qt::PreciseTimer, the
+// schedule is re-anchored after missed slots.
+//
+// Every cycle is kept in a fixed-size ring of 24 byte records that can be
+// written out as a compact binary file, and summarised as metrics under the
+// given prefix: <prefix>.start_latency_ns, <prefix>.cycle_ns and the
+// <prefix>.cycles / cycles_late / cycles_missed / cycles_overrun counters.
+class ControlLoopMonitor
+{
+public:
+    enum CycleStatus : quint8 {
+        OnTime,
+        Late,
+        Inactive // The timer fired but the loop was disabled
+    };
+    
+    enum CycleFlag : quint8 {
+        Overrun = 0x01 // Execution took longer than a period
+    };
+    
+    struct CycleRecord {
+        qint64 scheduledMs;     // ms since epoch the cycle was due
+        qint32 startLatencyUs;  // Actual start minus scheduled start
+        qint32 executionUs;
+        quint32 sequence;
+        quint16 missedBefore;   // Slots skipped since the previous cycle
+        quint8 status;          // CycleStatus
+        quint8 flags;           // CycleFlag bits
+    };
+    
+    static const int DefaultCapacity = 4096; // About 11 hours of 10 s cycles
+    
+    explicit ControlLoopMonitor(const QString &metricPrefix, int capacity = DefaultCapacity);
+    
+    // Schedule cycles every periodMs starting one period from now
+    void start(int periodMs);
+    void stop();
+    bool isActive() const { return active; }
+    
+    // Bracket one timer driven cycle; executed is false when the loop was
+    // disabled and returned straight away
+    void beginCycle();
+    void endCycle(bool executed);
+    
+    // Starts later than this count as late (default: a tenth of the period)
+    void setLateThreshold(int milliseconds);
+    
+    // Recorded cycles, oldest first
+    QVector<CycleRecord> records() const;
+    int size() const { return count; }
+    
+    quint64 totalCycles() const { return sequence; }
+    quint64 lateCycles() const { return late; }
+    quint64 missedCycles() const { return missed; }
+    
+    // "TSCYCLE1", record size, record count and period, then the records;
+    // all fields little-endian
+    QByteArray toBinary() const;
+    bool writeBinary(const QString &filename) const;
+
+private:
+    QVector<CycleRecord> ring;
+    int capacity;
+    int head;
+    int count;
+    
+    QElapsedTimer clock;
+    bool active;
+    qint64 wallAnchorMs;
+    qint64 periodNs;
+    qint64 lateThresholdNs;
+    bool customLateThreshold;
+    qint64 nextDueNs;
+    
+    // Cycle in progress
+    qint64 cycleStartNs;
+    qint64 cycleScheduledNs;
+    int cycleMissed;
+    
+    quint32 sequence;
+    quint64 late;
+    quint64 missed;
+    
+    MetricCounter *cyclesCounter;
+    MetricCounter *lateCounter;
+    MetricCounter *missedCounter;
+    MetricCounter *overrunCounter;
+    LatencyHistogram *startLatency;
+    LatencyHistogram *cycleTime;
+};
+
+#endif // CONTROLLOOPMONITOR_H
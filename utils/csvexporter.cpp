@@ -0,0 +1,264 @@
+#include "csvexporter.h"
+#include <QIODevice>
+#include <QDate>
+#include <QtMath>
+#include "../models/insulinhistorycursor.h"
+#include <cstring>
+#include <limits>
+
+namespace {
+
+const qint64 HourMs = 60LL * 60 * 1000;
+const qint64 DayMs = 24 * HourMs;
+const qint64 JulianDayOfEpoch = 2440588; // 1970-01-01
+const qint64 NoMore = std::numeric_limits<qint64>::max();
+
+qint64 floorDiv(qint64 value, qint64 divisor)
+{
+    qint64 result = value / divisor;
+    if (value % divisor != 0 && value < 0) {
+        --result;
+    }
+    return result;
+}
+
+// The exporter reads both sides of the join through the same minimal
+// forward cursor: time() of the current item (NoMore at the end), value()
+// and next()
+class SampleCursor
+{
+public:
+    explicit SampleCursor(const HistoryView<TimeSeriesStore::Sample> &view)
+        : position(view.begin()), end(view.end()) {}
+    
+    qint64 time() const { return position != end ? position->timestamp : NoMore; }
+    double value() const { return position->value; }
+    void next() { ++position; }
+
+private:
+    const TimeSeriesStore::Sample *position;
+    const TimeSeriesStore::Sample *end;
+};
+
+class EntryCursor
+{
+public:
+    explicit EntryCursor(InsulinHistoryCursor &cursor) : cursor(cursor) {}
+    
+    qint64 time() const { return cursor.atEnd() ? NoMore : cursor.current().timestamp.toMSecsSinceEpoch(); }
+    double value() const { return cursor.current().value; }
+    void next() { cursor.next(); }
+
+private:
+    InsulinHistoryCursor &cursor;
+};
+
+}
+
+CsvExporter::CsvExporter(QIODevice *device, int chunkSize)
+    : device(device),
+      chunkSize(qMax(256, chunkSize)),
+      bucketWidth(0),
+      failed(false),
+      offsetValidFrom(0),
+      offsetValidUntil(0),
+      offsetMs(0),
+      cachedDay(std::numeric_limits<qint64>::min())
+{
+    // Leave room for the row that crosses the chunk size
+    buffer.reserve(this->chunkSize + 128);
+}
+
+CsvExporter::~CsvExporter()
+{
+    flush();
+}
+
+void CsvExporter::setBucketWidth(qint64 milliseconds)
+{
+    bucketWidth = qMax<qint64>(0, milliseconds);
+}
+
+qint64 CsvExporter::writeReport(const HistoryView<TimeSeriesStore::Sample> &glucose, InsulinHistoryCursor &insulin)
+{
+    SampleCursor readings(glucose);
+    EntryCursor entries(insulin);
+    return writeRows(readings, entries);
+}
+
+qint64 CsvExporter::writeReport(const HistoryView<TimeSeriesStore::Sample> &glucose,
+                                const HistoryView<TimeSeriesStore::Sample> &insulin)
+{
+    SampleCursor readings(glucose);
+    SampleCursor entries(insulin);
+    return writeRows(readings, entries);
+}
+
+template <typename GlucoseCursor, typename InsulinCursor>
+qint64 CsvExporter::writeRows(GlucoseCursor &glucose, InsulinCursor &insulin)
+{
+    buffer.append("Timestamp,Glucose (mmol/L),Insulin (units)\n");
+    
+    qint64 nextGlucose = glucose.time();
+    qint64 nextInsulin = insulin.time();
+    qint64 rows = 0;
+    
+    while (!failed && (nextGlucose != NoMore || nextInsulin != NoMore)) {
+        qint64 rowTime = qMin(nextGlucose, nextInsulin);
+        qint64 rowEnd = rowTime + 1;
+        
+        // Buckets are aligned in local time, like the timestamps printed
+        if (bucketWidth > 0) {
+            refreshOffset(rowTime);
+            rowTime = floorDiv(rowTime + offsetMs, bucketWidth) * bucketWidth - offsetMs;
+            rowEnd = rowTime + bucketWidth;
+        }
+        
+        double glucoseSum = 0.0;
+        double glucoseLast = 0.0;
+        int glucoseCount = 0;
+        while (nextGlucose < rowEnd) {
+            glucoseLast = glucose.value();
+            glucoseSum += glucoseLast;
+            glucoseCount++;
+            glucose.next();
+            nextGlucose = glucose.time();
+        }
+        
+        double insulinSum = 0.0;
+        double insulinLast = 0.0;
+        while (nextInsulin < rowEnd) {
+            insulinLast = insulin.value();
+            insulinSum += insulinLast;
+            insulin.next();
+            nextInsulin = insulin.time();
+        }
+        
+        // Per timestamp the last value wins, as with the old QMap based report
+        if (bucketWidth > 0) {
+            writeRow(rowTime, glucoseCount > 0 ? glucoseSum / glucoseCount : 0.0, insulinSum);
+        } else {
+            writeRow(rowTime, glucoseLast, insulinLast);
+        }
+        rows++;
+    }
+    
+    if (!flush()) {
+        return -1;
+    }
+    
+    return rows;
+}
+
+bool CsvExporter::flush()
+{
+    if (!buffer.isEmpty() && !failed) {
+        failed = device->write(buffer) != buffer.size();
+    }
+    
+    // resize() keeps the reserved capacity
+    buffer.resize(0);
+    return !failed;
+}
+
+void CsvExporter::writeRow(qint64 timestamp, double glucose, double insulin)
+{
+    appendTimestamp(timestamp);
+    buffer.append(',');
+    appendFixed(glucose, 1);
+    buffer.append(',');
+    appendFixed(insulin, 2);
+    buffer.append('\n');
+    
+    if (buffer.size() >= chunkSize) {
+        flush();
+    }
+}
+
+void CsvExporter::refreshOffset(qint64 timestamp)
+{
+    // Local time offsets only change on hour boundaries
+    if (timestamp < offsetValidFrom || timestamp >= offsetValidUntil) {
+        const QDateTime local = QDateTime::fromMSecsSinceEpoch(timestamp);
+        const QTime time = local.time();
+        
+        offsetMs = local.offsetFromUtc() * 1000LL;
+        offsetValidFrom = timestamp - (time.minute() * 60000LL + time.second() * 1000LL + time.msec());
+        offsetValidUntil = offsetValidFrom + HourMs;
+    }
+}
+
+void CsvExporter::appendTimestamp(qint64 timestamp)
+{
+    refreshOffset(timestamp);
+    
+    const qint64 local = timestamp + offsetMs;
+    const qint64 day = floorDiv(local, DayMs);
+    
+    if (day != cachedDay) {
+        const QDate date = QDate::fromJulianDay(day + JulianDayOfEpoch);
+        QByteArray formatted = date.toString("yyyy-MM-dd").toLatin1();
+        memcpy(cachedDate, formatted.constData(), 10);
+        cachedDate[10] = 'T';
+        cachedDay = day;
+    }
+    
+    // "yyyy-MM-ddTHH:mm:ss", as QDateTime::toString(Qt::ISODate)
+    const int secondOfDay = static_cast<int>((local - day * DayMs) / 1000);
+    buffer.append(cachedDate, 11);
+    appendPadded(secondOfDay / 3600, 2);
+    buffer.append(':');
+    appendPadded(secondOfDay / 60 % 60, 2);
+    buffer.append(':');
+    appendPadded(secondOfDay % 60, 2);
+}
+
+void CsvExporter::appendFixed(double value, int decimals)
+{
+    static const qint64 scales[] = {1, 10, 100, 1000};
+    const qint64 scale = scales[qBound(0, decimals, 3)];
+    
+    // Values that land (almost) exactly halfway between two outputs go
+    // through QByteArray::number(), which rounds the exact binary value, so
+    // the result always matches QString::number(value, 'f', decimals)
+    const double product = value * scale;
+    const double fraction = qAbs(product - static_cast<double>(static_cast<qint64>(product)));
+    if (qAbs(fraction - 0.5) < 1e-6 || qAbs(product) > 1e15) {
+        buffer.append(QByteArray::number(value, 'f', decimals));
+        return;
+    }
+    
+    qint64 scaled = qRound64(product);
+    if (scaled < 0) {
+        buffer.append('-');
+        scaled = -scaled;
+    }
+    
+    // Integer part
+    char digits[20];
+    int length = 0;
+    qint64 whole = scaled / scale;
+    do {
+        digits[length++] = static_cast<char>('0' + whole % 10);
+        whole /= 10;
+    } while (whole > 0);
+    
+    while (length > 0) {
+        buffer.append(digits[--length]);
+    }
+    
+    if (decimals > 0) {
+        buffer.append('.');
+        appendPadded(static_cast<int>(scaled % scale), decimals);
+    }
+}
+
+void CsvExporter::appendPadded(int value, int width)
+{
+    char digits[10];
+    for (int i = width - 1; i >= 0; --i) {
+        digits[i] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    }
+    buffer.append(digits, width);
+}
@@ -0,0 +1,71 @@
+#ifndef CSVEXPORTER_H
+#define CSVEXPORTER_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include "timeseriesstore.h"
+
+class QIODevice;
+class InsulinHistoryCursor;
+
+// Writes the glucose/insulin CSV report straight to a QIODevice.
+//
+// The glucose readings and insulin entries are read through forward
+// cursors and merge-joined in timestamp order as the rows are written, so
+// neither is copied, sorted or collected first. Each row is formatted into
+// a fixed-size buffer that is flushed to the device in chunks, so memory
+// use does not grow with the length of the report. Timestamps and numbers
+// are formatted by hand; the local date is only formatted once per day and
+// the UTC offset looked up once per hour.
+//
+// By default every distinct timestamp gets a row, as generateCSVReport()
+// always did. With a bucket width set, rows are aligned to buckets instead:
+// glucose is averaged and insulin summed per bucket, which lines the
+// 5 second insulin entries up with the 5 minute glucose readings.
+class CsvExporter
+{
+public:
+    explicit CsvExporter(QIODevice *device, int chunkSize = 64 * 1024);
+    ~CsvExporter();
+    
+    // 0 for one row per timestamp
+    void setBucketWidth(qint64 milliseconds);
+    
+    // Writes the header and a row for every reading and insulin entry the
+    // view and cursor cover. Insulin values are as the cursor gives them:
+    // bolus units, or the basal rate for basal samples. The cursor is left
+    // at its end. Returns the number of data rows written, or -1 on a write
+    // error.
+    qint64 writeReport(const HistoryView<TimeSeriesStore::Sample> &glucose, InsulinHistoryCursor &insulin);
+    
+    // The same from two stored series
+    qint64 writeReport(const HistoryView<TimeSeriesStore::Sample> &glucose,
+                       const HistoryView<TimeSeriesStore::Sample> &insulin);
+    
+    // Sends anything still buffered to the device
+    bool flush();
+
+private:
+    QIODevice *device;
+    QByteArray buffer;
+    int chunkSize;
+    qint64 bucketWidth;
+    bool failed;
+    
+    // Formatting caches
+    qint64 offsetValidFrom;
+    qint64 offsetValidUntil;
+    qint64 offsetMs;
+    qint64 cachedDay;
+    char cachedDate[11];
+    
+    template <typename GlucoseCursor, typename InsulinCursor>
+    qint64 writeRows(GlucoseCursor &glucose, InsulinCursor &insulin);
+    void writeRow(qint64 timestamp, double glucose, double insulin);
+    void refreshOffset(qint64 timestamp);
+    void appendTimestamp(qint64 timestamp);
+    void appendFixed(double value, int decimals);
+    void appendPadded(int value, int width);
+};
+
+#endif // CSVEXPORTER_H
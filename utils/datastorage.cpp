@@ -1,15 +1,42 @@
 #include "datastorage.h"
+#include "tracing.h"
+#include "metrics.h"
+#include "csvexporter.h"
 #include <QJsonArray>
 #include <QJsonObject>
 #include <QTextStream>
+#include <QBuffer>
+#include <QTimer>
+#include <limits>
+
+namespace {
+
+const int MaxEventLogSize = 1000;
+const int EventLogSaveDelayMs = 1000;
+
+}
 
 DataStorage::DataStorage(QObject *parent)
-    : QObject(parent)
+    : QObject(parent),
+      eventLog(MaxEventLogSize),
+      saveTimer(new QTimer(this))
 {
+    saveTimer->setSingleShot(true);
+    saveTimer->setInterval(EventLogSaveDelayMs);
+    connect(saveTimer, &QTimer::timeout, this, &DataStorage::saveEventLogNow);
+}
+
+DataStorage::~DataStorage()
+{
+    // Don't lose events logged just before shutdown
+    if (saveTimer->isActive()) {
+        saveEventLogNow();
+    }
 }
 
 bool DataStorage::saveGlucoseData(const QVector<QPair<QDateTime, double>> &data, const QString &filename)
 {
+    TRACE_SCOPE("DataStorage::saveGlucoseData");
     // Create JSON document
     QJsonArray glucoseArray;
     
@@ -29,6 +56,7 @@ bool DataStorage::saveGlucoseData(const QVector<QPair<QDateTime, double>> &data,
 
 QVector<QPair<QDateTime, double>> DataStorage::loadGlucoseData(const QString &filename)
 {
+    TRACE_SCOPE("DataStorage::loadGlucoseData");
     QVector<QPair<QDateTime, double>> result;
     
     QJsonDocument doc = readJsonFromFile(filename);
@@ -52,6 +80,7 @@ QVector<QPair<QDateTime, double>> DataStorage::loadGlucoseData(const QString &fi
 
 bool DataStorage::saveInsulinData(const QVector<QPair<QDateTime, double>> &data, const QString &filename)
 {
+    TRACE_SCOPE("DataStorage::saveInsulinData");
     // Create JSON document
     QJsonArray insulinArray;
     
@@ -71,6 +100,7 @@ bool DataStorage::saveInsulinData(const QVector<QPair<QDateTime, double>> &data,
 
 QVector<QPair<QDateTime, double>> DataStorage::loadInsulinData(const QString &filename)
 {
+    TRACE_SCOPE("DataStorage::loadInsulinData");
     QVector<QPair<QDateTime, double>> result;
     
     QJsonDocument doc = readJsonFromFile(filename);
@@ -94,6 +124,7 @@ QVector<QPair<QDateTime, double>> DataStorage::loadInsulinData(const QString &fi
 
 bool DataStorage::saveBolusHistory(const QVector<BolusRecord> &history, const QString &filename)
 {
+    TRACE_SCOPE("DataStorage::saveBolusHistory");
     // Create JSON document
     QJsonArray bolusArray;
     
@@ -117,6 +148,7 @@ bool DataStorage::saveBolusHistory(const QVector<BolusRecord> &history, const QS
 
 QVector<DataStorage::BolusRecord> DataStorage::loadBolusHistory(const QString &filename)
 {
+    TRACE_SCOPE("DataStorage::loadBolusHistory");
     QVector<BolusRecord> result;
     
     QJsonDocument doc = readJsonFromFile(filename);
@@ -146,6 +178,7 @@ QVector<DataStorage::BolusRecord> DataStorage::loadBolusHistory(const QString &f
 
 bool DataStorage::saveBasalHistory(const QVector<BasalRecord> &history, const QString &filename)
 {
+    TRACE_SCOPE("DataStorage::saveBasalHistory");
     // Create JSON document
     QJsonArray basalArray;
     
@@ -168,6 +201,7 @@ bool DataStorage::saveBasalHistory(const QVector<BasalRecord> &history, const QS
 
 QVector<DataStorage::BasalRecord> DataStorage::loadBasalHistory(const QString &filename)
 {
+    TRACE_SCOPE("DataStorage::loadBasalHistory");
     QVector<BasalRecord> result;
     
     QJsonDocument doc = readJsonFromFile(filename);
@@ -196,6 +230,7 @@ QVector<DataStorage::BasalRecord> DataStorage::loadBasalHistory(const QString &f
 
 bool DataStorage::saveProfiles(const QVector<ProfileRecord> &profiles, const QString &filename)
 {
+    TRACE_SCOPE("DataStorage::saveProfiles");
     // Create JSON document
     QJsonArray profileArray;
     
@@ -218,6 +253,7 @@ bool DataStorage::saveProfiles(const QVector<ProfileRecord> &profiles, const QSt
 
 QVector<DataStorage::ProfileRecord> DataStorage::loadProfiles(const QString &filename)
 {
+    TRACE_SCOPE("DataStorage::loadProfiles");
     QVector<ProfileRecord> result;
     
     QJsonDocument doc = readJsonFromFile(filename);
@@ -246,6 +282,7 @@ QVector<DataStorage::ProfileRecord> DataStorage::loadProfiles(const QString &fil
 
 bool DataStorage::saveEventLog(const QVector<LogEvent> &events, const QString &filename)
 {
+    TRACE_SCOPE("DataStorage::saveEventLog");
     // Create JSON document
     QJsonArray eventArray;
     
@@ -266,6 +303,7 @@ bool DataStorage::saveEventLog(const QVector<LogEvent> &events, const QString &f
 
 QVector<DataStorage::LogEvent> DataStorage::loadEventLog(const QString &filename)
 {
+    TRACE_SCOPE("DataStorage::loadEventLog");
     QVector<LogEvent> result;
     
     QJsonDocument doc = readJsonFromFile(filename);
@@ -297,12 +335,14 @@ void DataStorage::addLogEvent(const QString &message, int level)
     event.message = message;
     event.level = level;
     
+    // Keeps only the last 1000 events
     eventLog.append(event);
-    
-    // Keep only the last 1000 events
-    while (eventLog.size() > 1000) {
-        eventLog.removeFirst();
-    }
+}
+
+void DataStorage::saveEventLogNow()
+{
+    saveTimer->stop();
+    saveEventLog(eventLog.toVector(), QDir::homePath() + "/.tslimx2simulator/event_log.json");
 }
 
 // New method to specifically handle adding alert events to history
@@ -313,17 +353,14 @@ void DataStorage::addEventLog(const QString &message, int level)
     event.message = message;
     event.level = level;
     
-    // Add to log
+    // Add to log (max 1000 entries)
     eventLog.append(event);
     
-    // Keep log to reasonable size (max 1000 entries)
-    while (eventLog.size() > 1000) {
-        eventLog.removeFirst();
+    // Auto-save the event log (deferred, see saveTimer)
+    if (!saveTimer->isActive()) {
+        saveTimer->start();
     }
     
-    // Auto-save the event log
-    saveEventLog(eventLog, QDir::homePath() + "/.tslimx2simulator/event_log.json");
-    
     // Emit signal that alert has been logged
     emit eventLogged(message, level);
 }
@@ -414,46 +451,183 @@ QVector<QPair<int, double>> DataStorage::calculateHourlyAverages(
     return result;
 }
 
-QString DataStorage::generateCSVReport(
+QVector<QPair<QString, double>> DataStorage::calculateDailyStatistics(
     const QDateTime &startDate, 
     const QDateTime &endDate,
-    const QVector<QPair<QDateTime, double>> &glucoseData,
-    const QVector<QPair<QDateTime, double>> &insulinData)
+    const HistoryView<TimeSeriesStore::Sample> &glucoseData)
 {
-    QString report;
-    QTextStream stream(&report);
-    
-    // Write header
-    stream << "Timestamp,Glucose (mmol/L),Insulin (units)\n";
+    QVector<QPair<QString, double>> result;
+    const qint64 startMs = startDate.toMSecsSinceEpoch();
+    const qint64 endMs = endDate.toMSecsSinceEpoch();
     
-    // Combine data
-    QMap<QDateTime, QPair<double, double>> combinedData;
+    // Readings are sorted, so each local day is one run and only the day
+    // boundaries need a QDateTime
+    QDate day;
+    qint64 dayEnd = std::numeric_limits<qint64>::min();
+    double sum = 0.0;
+    int count = 0;
     
-    // Add glucose data
     for (const auto &reading : glucoseData) {
-        if (reading.first >= startDate && reading.first <= endDate) {
-            combinedData[reading.first].first = reading.second;
+        // Skip readings outside date range
+        if (reading.timestamp < startMs || reading.timestamp > endMs) {
+            continue;
         }
+        
+        if (reading.timestamp >= dayEnd) {
+            if (count > 0) {
+                result.append(qMakePair(day.toString("yyyy-MM-dd"), sum / count));
+            }
+            
+            day = QDateTime::fromMSecsSinceEpoch(reading.timestamp).date();
+            dayEnd = QDateTime(day.addDays(1), QTime(0, 0)).toMSecsSinceEpoch();
+            sum = 0.0;
+            count = 0;
+        }
+        
+        sum += reading.value;
+        ++count;
     }
     
-    // Add insulin data
-    for (const auto &delivery : insulinData) {
-        if (delivery.first >= startDate && delivery.first <= endDate) {
-            combinedData[delivery.first].second = delivery.second;
-        }
+    if (count > 0) {
+        result.append(qMakePair(day.toString("yyyy-MM-dd"), sum / count));
     }
     
-    // Write data
-    for (auto it = combinedData.constBegin(); it != combinedData.constEnd(); ++it) {
-        const QDateTime &timestamp = it.key();
-        const QPair<double, double> &values = it.value();
+    return result;
+}
+
+QVector<QPair<int, double>> DataStorage::calculateHourlyAverages(
+    const QDateTime &startDate, 
+    const QDateTime &endDate,
+    const HistoryView<TimeSeriesStore::Sample> &glucoseData)
+{
+    QVector<QPair<int, double>> result;
+    result.reserve(24);
+    const qint64 startMs = startDate.toMSecsSinceEpoch();
+    const qint64 endMs = endDate.toMSecsSinceEpoch();
+    
+    double sums[24] = {};
+    int counts[24] = {};
+    
+    // Local hour of day only changes at hour boundaries, so look it up once
+    // per run of readings rather than once per reading
+    int hour = 0;
+    qint64 hourEnd = std::numeric_limits<qint64>::min();
+    
+    for (const auto &reading : glucoseData) {
+        // Skip readings outside date range
+        if (reading.timestamp < startMs || reading.timestamp > endMs) {
+            continue;
+        }
         
-        stream << timestamp.toString(Qt::ISODate) << ","
-               << QString::number(values.first, 'f', 1) << ","
-               << QString::number(values.second, 'f', 2) << "\n";
+        if (reading.timestamp >= hourEnd) {
+            const QTime time = QDateTime::fromMSecsSinceEpoch(reading.timestamp).time();
+            hour = time.hour();
+            hourEnd = reading.timestamp - (time.minute() * 60 + time.second()) * 1000LL - time.msec() + 3600 * 1000LL;
+        }
+        
+        sums[hour] += reading.value;
+        ++counts[hour];
+    }
+    
+    // Hours without readings report 0.0, as in the list based version
+    for (int h = 0; h < 24; ++h) {
+        result.append(qMakePair(h, counts[h] > 0 ? sums[h] / counts[h] : 0.0));
+    }
+    
+    return result;
+}
+
+QVector<QPair<QString, double>> DataStorage::calculateDailyStatistics(
+    const QDateTime &startDate, 
+    const QDateTime &endDate,
+    const GlucoseRollup &rollup)
+{
+    QVector<QPair<QString, double>> result;
+    
+    const QVector<GlucoseRollup::DayStatistics> days =
+        rollup.dailyStatistics(startDate.toMSecsSinceEpoch(), endDate.toMSecsSinceEpoch());
+    result.reserve(days.size());
+    
+    for (const auto &day : days) {
+        result.append(qMakePair(day.date.toString("yyyy-MM-dd"), day.stats.mean()));
+    }
+    
+    return result;
+}
+
+QVector<QPair<int, double>> DataStorage::calculateHourlyAverages(
+    const QDateTime &startDate, 
+    const QDateTime &endDate,
+    const GlucoseRollup &rollup)
+{
+    QVector<QPair<int, double>> result;
+    result.reserve(24);
+    
+    const QVector<GlucoseRollup::Aggregate> hours =
+        rollup.hourOfDayStatistics(startDate.toMSecsSinceEpoch(), endDate.toMSecsSinceEpoch());
+    
+    // Hours without readings report 0.0, as in the raw data version
+    for (int hour = 0; hour < 24; ++hour) {
+        result.append(qMakePair(hour, hours[hour].mean()));
+    }
+    
+    return result;
+}
+
+QString DataStorage::generateCSVReport(
+    const QDateTime &startDate, 
+    const QDateTime &endDate,
+    const QVector<QPair<QDateTime, double>> &glucoseData,
+    const QVector<QPair<QDateTime, double>> &insulinData)
+{
+    // The pairs need not be in time order; the stores put them in order
+    TimeSeriesStore glucose;
+    glucose.reserve(glucoseData.size());
+    for (const auto &reading : glucoseData) {
+        glucose.append(reading.first, reading.second);
     }
     
-    return report;
+    TimeSeriesStore insulin;
+    insulin.reserve(insulinData.size());
+    for (const auto &entry : insulinData) {
+        insulin.append(entry.first, entry.second);
+    }
+    
+    QByteArray report;
+    QBuffer buffer(&report);
+    buffer.open(QIODevice::WriteOnly);
+    
+    const qint64 start = startDate.toMSecsSinceEpoch();
+    const qint64 end = endDate.toMSecsSinceEpoch();
+    CsvExporter exporter(&buffer);
+    exporter.writeReport(glucose.view(start, end), insulin.view(start, end));
+    exporter.flush();
+    
+    return QString::fromLatin1(report);
+}
+
+bool DataStorage::exportCSVReport(
+    const QString &filename,
+    const HistoryView<TimeSeriesStore::Sample> &glucoseData,
+    InsulinHistoryCursor &insulinData,
+    int bucketMinutes)
+{
+    TRACE_SCOPE("DataStorage::exportCSVReport");
+    
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    
+    CsvExporter exporter(&file);
+    exporter.setBucketWidth(bucketMinutes * 60LL * 1000);
+    const qint64 rows = exporter.writeReport(glucoseData, insulinData);
+    
+    static MetricCounter *bytesWritten = Metrics::counter("storage.bytes_written");
+    bytesWritten->increment(qMax<qint64>(0, file.size()));
+    file.close();
+    
+    return rows >= 0;
 }
 
 bool DataStorage::createDirectoryIfNeeded(const QString &path)
@@ -474,19 +648,28 @@ bool DataStorage::writeJsonToFile(const QJsonDocument &doc, const QString &filen
     }
     
     // Write file
+    static LatencyHistogram *writeTime = Metrics::histogram("storage.write_json_ns");
+    LatencyTimer writeTimer(writeTime);
+    
     QFile file(filename);
     if (!file.open(QIODevice::WriteOnly)) {
         return false;
     }
     
-    file.write(doc.toJson());
+    qint64 written = file.write(doc.toJson());
     file.close();
     
+    static MetricCounter *bytesWritten = Metrics::counter("storage.bytes_written");
+    bytesWritten->increment(qMax<qint64>(0, written));
+    
     return true;
 }
 
 QJsonDocument DataStorage::readJsonFromFile(const QString &filename)
 {
+    static LatencyHistogram *readTime = Metrics::histogram("storage.read_json_ns");
+    LatencyTimer readTimer(readTime);
+    
     QFile file(filename);
     if (!file.open(QIODevice::ReadOnly)) {
         return QJsonDocument();
@@ -8,6 +8,13 @@
 #include <QFile>
 #include <QJsonDocument>
 #include <QDir>
+#include "glucoserollup.h"
+#include "timeseriesstore.h"
+#include "ringbuffer.h"
+
+class InsulinHistoryCursor;
+
+class QTimer;
 
 class DataStorage : public QObject
 {
@@ -15,6 +22,7 @@ class DataStorage : public QObject
 
 public:
     explicit DataStorage(QObject *parent = nullptr);
+    ~DataStorage();
     
     // Glucose data
     bool saveGlucoseData(const QVector<QPair<QDateTime, double>> &data, const QString &filename);
@@ -72,6 +80,7 @@ public:
     QVector<LogEvent> loadEventLog(const QString &filename);
     void addLogEvent(const QString &message, int level = 0);
     void addEventLog(const QString &message, int level); // Added this missing declaration
+    int getEventLogSize() const { return eventLog.size(); }
     
     // Statistics and reporting
     QVector<QPair<QString, double>> calculateDailyStatistics(
@@ -86,18 +95,65 @@ public:
         const QVector<QPair<QDateTime, double>> &glucoseData
     );
     
+    // Same results straight from a view of the stored readings, without
+    // copying them out or grouping them into per-day/per-hour lists
+    QVector<QPair<QString, double>> calculateDailyStatistics(
+        const QDateTime &startDate, 
+        const QDateTime &endDate,
+        const HistoryView<TimeSeriesStore::Sample> &glucoseData
+    );
+    
+    QVector<QPair<int, double>> calculateHourlyAverages(
+        const QDateTime &startDate, 
+        const QDateTime &endDate,
+        const HistoryView<TimeSeriesStore::Sample> &glucoseData
+    );
+    
+    // Same results from pre-aggregated buckets, in time proportional to the
+    // number of days/hours in the range rather than the number of readings.
+    // The range is resolved to whole hours (see GlucoseRollup).
+    QVector<QPair<QString, double>> calculateDailyStatistics(
+        const QDateTime &startDate, 
+        const QDateTime &endDate,
+        const GlucoseRollup &rollup
+    );
+    
+    QVector<QPair<int, double>> calculateHourlyAverages(
+        const QDateTime &startDate, 
+        const QDateTime &endDate,
+        const GlucoseRollup &rollup
+    );
+    
     QString generateCSVReport(
         const QDateTime &startDate, 
         const QDateTime &endDate,
         const QVector<QPair<QDateTime, double>> &glucoseData,
         const QVector<QPair<QDateTime, double>> &insulinData
     );
+    
+    // Streams the same report straight to a file in fixed-size chunks,
+    // merging the readings in the view with the insulin cursor's entries as
+    // it goes, so exports spanning months neither copy the histories nor
+    // build the report in memory. The range is the view's and the cursor's.
+    // With bucketMinutes > 0 rows are aligned to buckets of that length
+    // (glucose averaged, insulin summed). Returns false if the file cannot
+    // be written.
+    bool exportCSVReport(
+        const QString &filename,
+        const HistoryView<TimeSeriesStore::Sample> &glucoseData,
+        InsulinHistoryCursor &insulinData,
+        int bucketMinutes = 0
+    );
 
 signals:
     void eventLogged(const QString &message, int level);  // Added this missing signal declaration
     
 private:
-    QVector<LogEvent> eventLog;
+    RingBuffer<LogEvent> eventLog;  // Last 1000 events
+    
+    // Bursts of events are written out once, shortly after the last one
+    QTimer *saveTimer;
+    void saveEventLogNow();
     
     bool createDirectoryIfNeeded(const QString &path);
     bool writeJsonToFile(const QJsonDocument &doc, const QString &filename);
@@ -5,138 +5,140 @@
 #include <QJsonObject>
 #include <QDir>
 #include <QTextStream>
+#include <QTimer>
+#include "tracing.h"
+#include "metrics.h"
+
+namespace {
+
+const int MaxErrorLogSize = 1000;
+const int ErrorLogSaveDelayMs = 1000;
+
+}
 
 ErrorHandler::ErrorHandler(QObject *parent)
-    : QObject(parent)
+    : QObject(parent),
+      errorLog(MaxErrorLogSize),
+      saveTimer(new QTimer(this))
 {
+    saveTimer->setSingleShot(true);
+    saveTimer->setInterval(ErrorLogSaveDelayMs);
+    connect(saveTimer, &QTimer::timeout, this, &ErrorHandler::saveErrorLogNow);
 }
 
-void ErrorHandler::logError(const QString &message, const QString &source, ErrorLevel level)
+ErrorHandler::~ErrorHandler()
 {
-    // Create new error record
-    ErrorRecord error;
-    error.timestamp = QDateTime::currentDateTime();
-    error.message = message;
-    error.source = source;
-    error.level = level;
-    error.acknowledged = false;
-    
-    // Add to log
-    errorLog.append(error);
-    
-    // Emit signals
-    emit errorLogged(message, level);
-    
-    // For critical errors, emit special signal
-    if (level == Critical) {
-        emit criticalErrorDetected(message);
-    }
-    
-    // Keep log to reasonable size (max 1000 entries)
-    while (errorLog.size() > 1000) {
-        errorLog.removeFirst();
-    }
-    
-    // For debugging
-    qDebug("[%s] %s: %s", 
-           qPrintable(getErrorLevelString(level)),
-           qPrintable(source),
-           qPrintable(message));
-    
-    // Auto-save error log
-    saveErrorLog(QDir::homePath() + "/.tslimx2simulator/error_log.json");
-    
-    // Add to history manager if available
-    if (historyManager) {
-        historyManager->addEventLog(message, level);
+    // Don't lose errors logged just before shutdown
+    if (saveTimer->isActive()) {
+        saveErrorLogNow();
     }
 }
 
-// Specific alert methods as required
-void ErrorHandler::lowBatteryAlert(int batteryLevel)
+void ErrorHandler::logError(const QString &message, const QString &source, ErrorLevel level)
 {
-    QString message;
-    ErrorLevel level;
-    
-    if (batteryLevel <= 5) {
-        message = QString("BATTERY CRITICALLY LOW: %1% remaining").arg(batteryLevel);
-        level = Critical;
-    } else if (batteryLevel <= 20) {
-        message = QString("Battery low: %1% remaining").arg(batteryLevel);
-        level = Warning;
+    TRACE_SCOPE("ErrorHandler::logError");
+    static MetricCounter *coalesced = Metrics::counter("errors.coalesced");
+    const QDateTime now = QDateTime::currentDateTime();
+    
+    // A repeat only updates its record: no new history entry, log line or
+    // UI signal, and the deferred save below writes the count once
+    const RecordKey key = {message, source, level};
+    const int open = openRecordIndex(key);
+    if (open >= 0) {
+        ErrorRecord &error = errorLog[open];
+        ++error.count;
+        error.lastSeen = now;
+        coalesced->increment();
+        
+        // Critical errors are never held back
+        if (level == Critical) {
+            emit criticalErrorDetected(message);
+        }
     } else {
-        return; // No alert needed
+        // Create new error record
+        ErrorRecord error;
+        error.timestamp = now;
+        error.message = message;
+        error.source = source;
+        error.level = level;
+        error.acknowledged = false;
+        error.lastSeen = now;
+        
+        // Add to log; the oldest entry drops out once there are 1000
+        appendRecord(error);
+        openRecords.insert(key, appendedCount - 1);
+        
+        // Emit signals
+        emit errorLogged(message, level);
+        
+        // For critical errors, emit special signal
+        if (level == Critical) {
+            emit criticalErrorDetected(message);
+        }
+        
+        // For debugging
+        qDebug("[%s] %s: %s", 
+               qPrintable(getErrorLevelString(level)),
+               qPrintable(source),
+               qPrintable(message));
+        
+        // Add to history manager if available
+        if (historyManager) {
+            historyManager->addEventLog(message, level);
+        }
     }
     
-    logError(message, "BatteryManager", level);
+    // Auto-save error log (deferred, see saveTimer)
+    if (!saveTimer->isActive()) {
+        saveTimer->start();
+    }
 }
 
-void ErrorHandler::lowInsulinAlert(double insulinUnits)
+void ErrorHandler::appendRecord(const ErrorRecord &error)
 {
-    QString message;
-    ErrorLevel level;
-    
-    if (insulinUnits <= 10.0) {
-        message = QString("INSULIN CRITICALLY LOW: %1 units remaining").arg(insulinUnits, 0, 'f', 1);
-        level = Critical;
-    } else if (insulinUnits <= 50.0) {
-        message = QString("Insulin low: %1 units remaining").arg(insulinUnits, 0, 'f', 1);
-        level = Warning;
-    } else {
-        return; // No alert needed
+    errorLog.append(error);
+    ++appendedCount;
+    
+    // Forget records that have dropped out of the log
+    if (openRecords.size() > 2 * MaxErrorLogSize) {
+        const quint64 oldest = appendedCount - errorLog.size();
+        for (auto it = openRecords.begin(); it != openRecords.end();) {
+            if (it.value() < oldest || errorLog[static_cast<int>(it.value() - oldest)].acknowledged) {
+                it = openRecords.erase(it);
+            } else {
+                ++it;
+            }
+        }
     }
-    
-    logError(message, "InsulinManager", level);
 }
 
-void ErrorHandler::cgmDisconnectedAlert(int minutesSinceLastReading)
+// Index in errorLog of the unacknowledged record for key, or -1
+int ErrorHandler::openRecordIndex(const RecordKey &key)
 {
-    QString message = QString("CGM data gap: No readings for %1 minutes").arg(minutesSinceLastReading);
-    logError(message, "GlucoseModel", Warning);
+    auto it = openRecords.find(key);
+    if (it == openRecords.end()) {
+        return -1;
+    }
+    
+    const quint64 oldest = appendedCount - errorLog.size();
+    if (it.value() >= oldest) {
+        const int index = static_cast<int>(it.value() - oldest);
+        if (!errorLog[index].acknowledged) {
+            return index;
+        }
+    }
+    
+    openRecords.erase(it);
+    return -1;
 }
 
+// Specific alert methods as required
 void ErrorHandler::occlusionAlert()
 {
     QString message = "OCCLUSION DETECTED: Check infusion set for blockages";
     logError(message, "PumpModel", Critical);
 }
 
-void ErrorHandler::highGlucoseAlert(double glucoseValue)
-{
-    QString message;
-    ErrorLevel level;
-    
-    if (glucoseValue >= 13.9) {
-        message = QString("URGENT HIGH GLUCOSE: %1 mmol/L").arg(glucoseValue, 0, 'f', 1);
-        level = Critical;
-    } else if (glucoseValue > 10.0) {
-        message = QString("High glucose: %1 mmol/L").arg(glucoseValue, 0, 'f', 1);
-        level = Warning;
-    } else {
-        return; // No alert needed
-    }
-    
-    logError(message, "GlucoseModel", level);
-}
-
-void ErrorHandler::lowGlucoseAlert(double glucoseValue)
-{
-    QString message;
-    ErrorLevel level;
-    
-    if (glucoseValue <= 3.1) {
-        message = QString("URGENT LOW GLUCOSE: %1 mmol/L").arg(glucoseValue, 0, 'f', 1);
-        level = Critical;
-    } else if (glucoseValue < 3.9) {
-        message = QString("Low glucose: %1 mmol/L").arg(glucoseValue, 0, 'f', 1);
-        level = Warning;
-    } else {
-        return; // No alert needed
-    }
-    
-    logError(message, "GlucoseModel", level);
-}
-
 void ErrorHandler::provideTroubleshootingGuidance(const QString &errorCode)
 {
     QString guidance;
@@ -185,13 +187,14 @@ void ErrorHandler::acknowledgeAllErrors()
     for (int i = 0; i < errorLog.size(); ++i) {
         errorLog[i].acknowledged = true;
     }
+    openRecords.clear();
     
     emit allErrorsAcknowledged();
 }
 
 QVector<ErrorHandler::ErrorRecord> ErrorHandler::getAllErrors() const
 {
-    return errorLog;
+    return errorLog.toVector();
 }
 
 QVector<ErrorHandler::ErrorRecord> ErrorHandler::getActiveErrors() const
@@ -252,6 +255,7 @@ bool ErrorHandler::hasCriticalErrors() const
 void ErrorHandler::clearAllErrors()
 {
     errorLog.clear();
+    openRecords.clear();
 }
 
 bool ErrorHandler::attemptRecovery(int errorIndex)
@@ -400,6 +404,10 @@ QString ErrorHandler::generateErrorReport() const
                << error.timestamp.toString(Qt::ISODate) << "\n";
         stream << "   Source: " << error.source << "\n";
         stream << "   Message: " << error.message << "\n";
+        if (error.count > 1) {
+            stream << "   Occurrences: " << error.count << " (last "
+                   << error.lastSeen.toString(Qt::ISODate) << ")\n";
+        }
         stream << "   Status: " << (error.acknowledged ? "Acknowledged" : "Active") << "\n";
         stream << "\n";
     }
@@ -407,8 +415,15 @@ QString ErrorHandler::generateErrorReport() const
     return report;
 }
 
+void ErrorHandler::saveErrorLogNow()
+{
+    saveTimer->stop();
+    saveErrorLog(QDir::homePath() + "/.tslimx2simulator/error_log.json");
+}
+
 bool ErrorHandler::saveErrorLog(const QString &filename) const
 {
+    TRACE_SCOPE("ErrorHandler::saveErrorLog");
     // Create directory if needed
     QFileInfo fileInfo(filename);
     QDir dir(fileInfo.path());
@@ -426,6 +441,10 @@ bool ErrorHandler::saveErrorLog(const QString &filename) const
         errorObj["source"] = error.source;
         errorObj["level"] = static_cast<int>(error.level);
         errorObj["acknowledged"] = error.acknowledged;
+        if (error.count > 1) {
+            errorObj["count"] = error.count;
+            errorObj["lastSeen"] = error.lastSeen.toString(Qt::ISODate);
+        }
         errorArray.append(errorObj);
     }
     
@@ -462,8 +481,9 @@ bool ErrorHandler::loadErrorLog(const QString &filename)
     
     QJsonObject rootObj = doc.object();
     
-    // Clear current log
+    // Clear current log; loaded records are not counted on
     errorLog.clear();
+    openRecords.clear();
     
     // Load errors
     QJsonArray errorArray = rootObj["errors"].toArray();
@@ -476,8 +496,12 @@ bool ErrorHandler::loadErrorLog(const QString &filename)
         error.source = errorObj["source"].toString();
         error.level = static_cast<ErrorLevel>(errorObj["level"].toInt());
         error.acknowledged = errorObj["acknowledged"].toBool();
+        error.count = errorObj["count"].toInt(1);
+        error.lastSeen = errorObj.contains("lastSeen")
+            ? QDateTime::fromString(errorObj["lastSeen"].toString(), Qt::ISODate)
+            : error.timestamp;
         
-        errorLog.append(error);
+        appendRecord(error);
     }
     
     return true;
@@ -6,7 +6,11 @@
 #include <QString>
 #include <QVector>
 #include <QPair>
+#include <QHash>
 #include "../utils/datastorage.h" // Added for history integration
+#include "../utils/ringbuffer.h"
+
+class QTimer;
 
 class ErrorHandler : public QObject
 {
@@ -14,6 +18,7 @@ class ErrorHandler : public QObject
 
 public:
     explicit ErrorHandler(QObject *parent = nullptr);
+    ~ErrorHandler();
     
     enum ErrorLevel {
         Info,
@@ -23,25 +28,23 @@ public:
     };
     
     struct ErrorRecord {
-        QDateTime timestamp;
+        QDateTime timestamp;  // First occurrence
         QString message;
         QString source;
         ErrorLevel level;
         bool acknowledged;
+        int count = 1;        // Occurrences while unacknowledged
+        QDateTime lastSeen;
     };
     
-    // Error management
+    // Error management. An error repeated while its record is still
+    // unacknowledged is counted on that record rather than logged again.
     void logError(const QString &message, const QString &source = "", ErrorLevel level = Warning);
     bool acknowledgeError(int index);
     void acknowledgeAllErrors();
     
     // Specific alert types required by requirements
-    void lowBatteryAlert(int batteryLevel);
-    void lowInsulinAlert(double insulinUnits);
-    void cgmDisconnectedAlert(int minutesSinceLastReading);
     void occlusionAlert();
-    void highGlucoseAlert(double glucoseValue);
-    void lowGlucoseAlert(double glucoseValue);
     void provideTroubleshootingGuidance(const QString &errorCode);
     void contactSupportPrompt(const QString &errorCode);
     
@@ -72,9 +75,38 @@ signals:
     void errorRecovered(int index);
     
 private:
-    QVector<ErrorRecord> errorLog;
+    RingBuffer<ErrorRecord> errorLog;  // Last 1000 entries
+    
+    // Identifies the record a repeat of an error coalesces into. The
+    // strings are shared with the caller's, so a lookup copies nothing.
+    struct RecordKey {
+        QString message;
+        QString source;
+        ErrorLevel level;
+        
+        bool operator==(const RecordKey &other) const
+        {
+            return level == other.level && source == other.source && message == other.message;
+        }
+        
+        friend uint qHash(const RecordKey &key, uint seed = 0)
+        {
+            return qHash(key.message, seed) ^ (qHash(key.source, seed) * 31) ^ static_cast<uint>(key.level);
+        }
+    };
+    
+    // Unacknowledged records by level, source and message, as their
+    // position in the sequence of records ever appended
+    QHash<RecordKey, quint64> openRecords;
+    quint64 appendedCount = 0;
     DataStorage* historyManager = nullptr;
     
+    // Bursts of errors are written out once, shortly after the last one
+    QTimer *saveTimer;
+    void saveErrorLogNow();
+    
+    void appendRecord(const ErrorRecord &error);
+    int openRecordIndex(const RecordKey &key);
     QString getErrorLevelString(ErrorLevel level) const;
     QString generateErrorReport() const;
     bool saveErrorLog(const QString &filename) const;
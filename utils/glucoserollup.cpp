@@ -0,0 +1,232 @@
+#include "glucoserollup.h"
+#include <QtMath>
+#include <algorithm>
+
+namespace {
+
+const qint64 HourMs = 60LL * 60 * 1000;
+
+}
+
+GlucoseRollup::Aggregate::Aggregate()
+    : count(0),
+      sum(0.0),
+      sumSquares(0.0),
+      min(0.0),
+      max(0.0)
+{
+}
+
+void GlucoseRollup::Aggregate::add(double value)
+{
+    if (count == 0) {
+        min = value;
+        max = value;
+    } else {
+        min = qMin(min, value);
+        max = qMax(max, value);
+    }
+    
+    count++;
+    sum += value;
+    sumSquares += value * value;
+}
+
+void GlucoseRollup::Aggregate::merge(const Aggregate &other)
+{
+    if (other.count == 0) {
+        return;
+    }
+    
+    if (count == 0) {
+        *this = other;
+        return;
+    }
+    
+    count += other.count;
+    sum += other.sum;
+    sumSquares += other.sumSquares;
+    min = qMin(min, other.min);
+    max = qMax(max, other.max);
+}
+
+double GlucoseRollup::Aggregate::variance() const
+{
+    if (count == 0) {
+        return 0.0;
+    }
+    
+    // Population variance; rounding can push it slightly below zero
+    const double average = mean();
+    return qMax(0.0, sumSquares / count - average * average);
+}
+
+double GlucoseRollup::Aggregate::standardDeviation() const
+{
+    return qSqrt(variance());
+}
+
+void GlucoseRollup::add(qint64 timestamp, double value)
+{
+    hourBuckets[hourBucketFor(timestamp)].stats.add(value);
+    dayBuckets[dayBucketFor(timestamp)].stats.add(value);
+}
+
+void GlucoseRollup::add(const QDateTime &timestamp, double value)
+{
+    add(timestamp.toMSecsSinceEpoch(), value);
+}
+
+void GlucoseRollup::clear()
+{
+    hourBuckets.clear();
+    dayBuckets.clear();
+}
+
+void GlucoseRollup::reserve(int hours)
+{
+    hourBuckets.reserve(hourBuckets.size() + hours);
+    dayBuckets.reserve(dayBuckets.size() + hours / 24 + 2);
+}
+
+GlucoseRollup::Aggregate GlucoseRollup::total(qint64 start, qint64 end) const
+{
+    Aggregate result;
+    
+    for (const DayStatistics &day : dailyStatistics(start, end)) {
+        result.merge(day.stats);
+    }
+    
+    return result;
+}
+
+QVector<GlucoseRollup::DayStatistics> GlucoseRollup::dailyStatistics(qint64 start, qint64 end) const
+{
+    QVector<DayStatistics> result;
+    if (end < start) {
+        return result;
+    }
+    
+    // First day that ends after the range starts
+    auto day = std::upper_bound(dayBuckets.constBegin(), dayBuckets.constEnd(), start,
+                                [](qint64 t, const DayBucket &bucket) {
+                                    return t < bucket.end;
+                                });
+    
+    for (; day != dayBuckets.constEnd() && day->start <= end; ++day) {
+        DayStatistics statistics;
+        statistics.date = QDate::fromJulianDay(day->julianDay);
+        
+        if (day->start >= start && day->end - HourMs <= end) {
+            // Every hour of the day is inside the range
+            statistics.stats = day->stats;
+        } else {
+            // Partial day at an edge of the range
+            const int last = firstHourAfter(qMin(end, day->end - 1));
+            for (int i = firstHourAtOrAfter(qMax(start, day->start)); i < last; ++i) {
+                statistics.stats.merge(hourBuckets[i].stats);
+            }
+        }
+        
+        if (!statistics.stats.isEmpty()) {
+            result.append(statistics);
+        }
+    }
+    
+    return result;
+}
+
+QVector<GlucoseRollup::Aggregate> GlucoseRollup::hourOfDayStatistics(qint64 start, qint64 end) const
+{
+    QVector<Aggregate> result(24);
+    if (end < start) {
+        return result;
+    }
+    
+    const int last = firstHourAfter(end);
+    for (int i = firstHourAtOrAfter(start); i < last; ++i) {
+        result[hourBuckets[i].hour].merge(hourBuckets[i].stats);
+    }
+    
+    return result;
+}
+
+int GlucoseRollup::hourBucketFor(qint64 timestamp)
+{
+    // Readings nearly always land in the latest hour
+    if (!hourBuckets.isEmpty() && timestamp >= hourBuckets.last().start && timestamp < hourBuckets.last().end) {
+        return hourBuckets.size() - 1;
+    }
+    
+    const int index = firstHourAfter(timestamp);
+    if (index > 0 && timestamp < hourBuckets[index - 1].end) {
+        return index - 1;
+    }
+    
+    // New hour. Subtracting the local minutes and seconds gives the start of
+    // the local hour without having to resolve it back through the time zone,
+    // which is ambiguous when clocks go back.
+    const QDateTime local = QDateTime::fromMSecsSinceEpoch(timestamp);
+    const QTime time = local.time();
+    
+    HourBucket bucket;
+    bucket.start = timestamp - (time.minute() * 60000LL + time.second() * 1000LL + time.msec());
+    bucket.end = bucket.start + HourMs;
+    bucket.julianDay = local.date().toJulianDay();
+    bucket.hour = time.hour();
+    
+    // Never overlap a neighbour, e.g. around a half-hour time zone change
+    if (index > 0) {
+        bucket.start = qMax(bucket.start, hourBuckets[index - 1].end);
+    }
+    if (index < hourBuckets.size()) {
+        bucket.end = qMin(bucket.end, hourBuckets[index].start);
+    }
+    
+    hourBuckets.insert(index, bucket);
+    return index;
+}
+
+int GlucoseRollup::dayBucketFor(qint64 timestamp)
+{
+    if (!dayBuckets.isEmpty() && timestamp >= dayBuckets.last().start && timestamp < dayBuckets.last().end) {
+        return dayBuckets.size() - 1;
+    }
+    
+    auto it = std::upper_bound(dayBuckets.constBegin(), dayBuckets.constEnd(), timestamp,
+                               [](qint64 t, const DayBucket &bucket) {
+                                   return t < bucket.start;
+                               });
+    const int index = static_cast<int>(it - dayBuckets.constBegin());
+    if (index > 0 && timestamp < dayBuckets[index - 1].end) {
+        return index - 1;
+    }
+    
+    const QDate date = QDateTime::fromMSecsSinceEpoch(timestamp).date();
+    
+    DayBucket bucket;
+    bucket.julianDay = date.toJulianDay();
+    bucket.start = qMin(timestamp, QDateTime(date, QTime(0, 0)).toMSecsSinceEpoch());
+    bucket.end = qMax(timestamp + 1, QDateTime(date.addDays(1), QTime(0, 0)).toMSecsSinceEpoch());
+    
+    dayBuckets.insert(index, bucket);
+    return index;
+}
+
+int GlucoseRollup::firstHourAtOrAfter(qint64 timestamp) const
+{
+    auto it = std::lower_bound(hourBuckets.constBegin(), hourBuckets.constEnd(), timestamp,
+                               [](const HourBucket &bucket, qint64 t) {
+                                   return bucket.start < t;
+                               });
+    return static_cast<int>(it - hourBuckets.constBegin());
+}
+
+int GlucoseRollup::firstHourAfter(qint64 timestamp) const
+{
+    auto it = std::upper_bound(hourBuckets.constBegin(), hourBuckets.constEnd(), timestamp,
+                               [](qint64 t, const HourBucket &bucket) {
+                                   return t < bucket.start;
+                               });
+    return static_cast<int>(it - hourBuckets.constBegin());
+}
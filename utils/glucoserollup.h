@@ -0,0 +1,87 @@
+#ifndef GLUCOSEROLLUP_H
+#define GLUCOSEROLLUP_H
+
+#include <QDate>
+#include <QDateTime>
+#include <QVector>
+
+// Per local hour and per local day aggregates of glucose readings, updated
+// on every add. Statistics over days or hours of the day read only the
+// buckets, never the raw samples, and allocate nothing per reading.
+//
+// Buckets follow local time, so they match the "yyyy-MM-dd" days and
+// QTime::hour() hours used by the reports. Converting a timestamp to local
+// time is only needed when a reading starts a new bucket.
+class GlucoseRollup
+{
+public:
+    struct Aggregate {
+        int count;
+        double sum;
+        double sumSquares;
+        double min;
+        double max;
+        
+        Aggregate();
+        void add(double value);
+        void merge(const Aggregate &other);
+        
+        bool isEmpty() const { return count == 0; }
+        double mean() const { return count > 0 ? sum / count : 0.0; }
+        double variance() const;
+        double standardDeviation() const;
+    };
+    
+    struct HourBucket {
+        qint64 start;      // ms since epoch
+        qint64 end;
+        qint64 julianDay;  // Local date
+        int hour;          // Local hour of day, 0-23
+        Aggregate stats;
+    };
+    
+    struct DayBucket {
+        qint64 start;      // ms since epoch of local midnight
+        qint64 end;
+        qint64 julianDay;
+        Aggregate stats;
+    };
+    
+    struct DayStatistics {
+        QDate date;
+        Aggregate stats;
+    };
+    
+    void add(qint64 timestamp, double value);
+    void add(const QDateTime &timestamp, double value);
+    void clear();
+    
+    // Preallocates buckets for this many more hours of readings
+    void reserve(int hours);
+    
+    const QVector<HourBucket> &hours() const { return hourBuckets; }
+    const QVector<DayBucket> &days() const { return dayBuckets; }
+    
+    // Ranges are resolved to whole local hours: an hour counts when its
+    // start lies within [start, end]. Whole days inside the range come from
+    // the day buckets, the partial days at either edge from hour buckets.
+    Aggregate total(qint64 start, qint64 end) const;
+    QVector<DayStatistics> dailyStatistics(qint64 start, qint64 end) const;
+    
+    // Aggregates for each hour of the day (index 0-23) across the range
+    QVector<Aggregate> hourOfDayStatistics(qint64 start, qint64 end) const;
+
+private:
+    QVector<HourBucket> hourBuckets;
+    QVector<DayBucket> dayBuckets;
+    
+    // Index of the bucket containing timestamp, creating it if needed
+    int hourBucketFor(qint64 timestamp);
+    int dayBucketFor(qint64 timestamp);
+    
+    // Range of hour buckets whose start lies in [start, end]
+    int firstHourAtOrAfter(qint64 timestamp) const;
+    int firstHourAfter(qint64 timestamp) const;
+};
+
+#endif // GLUCOSEROLLUP_H
@@ -0,0 +1,66 @@
+#ifndef HISTORYVIEW_H
+#define HISTORYVIEW_H
+
+#include <QVector>
+
+// Read-only view of a contiguous range of a history vector.
+//
+// The view points into the owner's vector, so creating one costs nothing
+// and, unlike a shared copy, keeping one around never makes the owner
+// detach onto a copy of its whole history when it next appends. The view
+// is only good while the owner is unchanged: use it right away, or check
+// isCurrent() before reading a view that was kept.
+//
+// epoch() is the owner's modification count when the view was taken, and
+// isCurrent() compares it with the owner's count now.
+//
+//     for (const TimeSeriesStore::Sample &sample : store.view(start, end)) {
+//         ...
+//     }
+template <typename T>
+class HistoryView
+{
+public:
+    typedef const T *const_iterator;
+    typedef const T *iterator;
+    
+    HistoryView() : data(nullptr), first(0), last(0), sourceEpoch(0), ownerEpoch(nullptr) {}
+    HistoryView(const QVector<T> &data, int first, int last, const quint64 &epoch)
+        : data(&data),
+          first(qBound(0, first, data.size())),
+          last(qBound(this->first, last, data.size())),
+          sourceEpoch(epoch),
+          ownerEpoch(&epoch)
+    {
+    }
+    
+    const T *begin() const { return data ? data->constData() + first : nullptr; }
+    const T *end() const { return data ? data->constData() + last : nullptr; }
+    
+    int size() const { return last - first; }
+    bool isEmpty() const { return last == first; }
+    
+    const T &at(int index) const
+    {
+        Q_ASSERT(isCurrent());
+        return data->at(first + index);
+    }
+    const T &operator[](int index) const { return at(index); }
+    const T &front() const { return at(0); }
+    const T &back() const { return at(size() - 1); }
+    
+    // Position of the range in the owner's vector
+    int startIndex() const { return first; }
+    
+    quint64 epoch() const { return sourceEpoch; }
+    bool isCurrent() const { return !ownerEpoch || *ownerEpoch == sourceEpoch; }
+
+private:
+    const QVector<T> *data;
+    int first;
+    int last;
+    quint64 sourceEpoch;
+    const quint64 *ownerEpoch;  // The owner's modification count
+};
+
+#endif // HISTORYVIEW_H
@@ -0,0 +1,228 @@
+#include "metrics.h"
+#include <QMap>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <limits>
+
+namespace {
+
+const qint64 NoMinimum = std::numeric_limits<qint64>::max();
+
+int highestBit(quint64 value)
+{
+    int bit = 0;
+    while (value >>= 1) {
+        ++bit;
+    }
+    return bit;
+}
+
+struct Registry {
+    QMutex mutex;
+    QMap<QString, MetricCounter *> counters;
+    QMap<QString, MetricGauge *> gauges;
+    QMap<QString, LatencyHistogram *> histograms;
+};
+
+Registry &registry()
+{
+    static Registry instance;
+    return instance;
+}
+
+template <typename T>
+T *findOrCreate(QMap<QString, T *> &metrics, const QString &name)
+{
+    QMutexLocker locker(&registry().mutex);
+    T *&metric = metrics[name];
+    if (!metric) {
+        metric = new T;
+    }
+    return metric;
+}
+
+}
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+void LatencyHistogram::record(qint64 value)
+{
+    if (value < 0) {
+        value = 0;
+    }
+    
+    buckets[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(value, std::memory_order_relaxed);
+    
+    qint64 currentMin = minimum.load(std::memory_order_relaxed);
+    while (value < currentMin && !minimum.compare_exchange_weak(currentMin, value, std::memory_order_relaxed)) {
+    }
+    
+    qint64 currentMax = maximum.load(std::memory_order_relaxed);
+    while (value > currentMax && !maximum.compare_exchange_weak(currentMax, value, std::memory_order_relaxed)) {
+    }
+}
+
+void LatencyHistogram::reset()
+{
+    for (auto &bucket : buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    total.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    minimum.store(NoMinimum, std::memory_order_relaxed);
+    maximum.store(0, std::memory_order_relaxed);
+}
+
+qint64 LatencyHistogram::min() const
+{
+    qint64 value = minimum.load(std::memory_order_relaxed);
+    return value == NoMinimum ? 0 : value;
+}
+
+double LatencyHistogram::mean() const
+{
+    qint64 n = count();
+    return n > 0 ? static_cast<double>(sum.load(std::memory_order_relaxed)) / n : 0.0;
+}
+
+qint64 LatencyHistogram::percentile(double percent) const
+{
+    qint64 n = count();
+    if (n == 0) {
+        return 0;
+    }
+    
+    // Rank of the requested sample, 1-based
+    qint64 rank = static_cast<qint64>(percent / 100.0 * n + 0.5);
+    rank = qBound<qint64>(1, rank, n);
+    
+    qint64 seen = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            // Report the bucket's upper bound, but never beyond what was seen
+            return qMin(bucketUpperBound(i), max());
+        }
+    }
+    
+    return max();
+}
+
+int LatencyHistogram::bucketIndex(qint64 value)
+{
+    // Values below 2 * SubBucketCount get a bucket each
+    if (value < 2 * SubBucketCount) {
+        return static_cast<int>(value);
+    }
+    
+    // Values above the range land in the last bucket
+    const int exponent = highestBit(static_cast<quint64>(value));
+    if (exponent >= MaxExponent) {
+        return BucketCount - 1;
+    }
+    
+    // Top SubBucketBits + 1 bits pick the bucket within this power of two
+    const int shift = exponent - SubBucketBits;
+    const int subBucket = static_cast<int>((static_cast<quint64>(value) >> shift) & (SubBucketCount - 1));
+    return (exponent - SubBucketBits + 1) * SubBucketCount + subBucket;
+}
+
+qint64 LatencyHistogram::bucketLowerBound(int index)
+{
+    if (index < 2 * SubBucketCount) {
+        return index;
+    }
+    
+    const int exponent = index / SubBucketCount + SubBucketBits - 1;
+    const qint64 mantissa = index % SubBucketCount + SubBucketCount;
+    return mantissa << (exponent - SubBucketBits);
+}
+
+qint64 LatencyHistogram::bucketUpperBound(int index)
+{
+    if (index < 2 * SubBucketCount) {
+        return index;
+    }
+    
+    const int exponent = index / SubBucketCount + SubBucketBits - 1;
+    const qint64 mantissa = index % SubBucketCount + SubBucketCount;
+    return ((mantissa + 1) << (exponent - SubBucketBits)) - 1;
+}
+
+MetricCounter *Metrics::counter(const QString &name)
+{
+    return findOrCreate(registry().counters, name);
+}
+
+MetricGauge *Metrics::gauge(const QString &name)
+{
+    return findOrCreate(registry().gauges, name);
+}
+
+LatencyHistogram *Metrics::histogram(const QString &name)
+{
+    return findOrCreate(registry().histograms, name);
+}
+
+QJsonObject Metrics::toJson()
+{
+    QJsonObject counters;
+    QJsonObject gauges;
+    QJsonObject histograms;
+    
+    QMutexLocker locker(&registry().mutex);
+    
+    for (auto it = registry().counters.constBegin(); it != registry().counters.constEnd(); ++it) {
+        counters[it.key()] = it.value()->value();
+    }
+    
+    for (auto it = registry().gauges.constBegin(); it != registry().gauges.constEnd(); ++it) {
+        gauges[it.key()] = it.value()->value();
+    }
+    
+    for (auto it = registry().histograms.constBegin(); it != registry().histograms.constEnd(); ++it) {
+        const LatencyHistogram *histogram = it.value();
+        
+        QJsonObject summary;
+        summary["count"] = histogram->count();
+        summary["min"] = histogram->min();
+        summary["max"] = histogram->max();
+        summary["mean"] = histogram->mean();
+        summary["p50"] = histogram->percentile(50.0);
+        summary["p90"] = histogram->percentile(90.0);
+        summary["p99"] = histogram->percentile(99.0);
+        summary["p999"] = histogram->percentile(99.9);
+        histograms[it.key()] = summary;
+    }
+    
+    QJsonObject root;
+    root["timestamp"] = QDateTime::currentDateTime().toString(Qt::ISODate);
+    root["counters"] = counters;
+    root["gauges"] = gauges;
+    root["histograms"] = histograms;
+    return root;
+}
+
+bool Metrics::writeJson(const QString &filename)
+{
+    QFileInfo info(filename);
+    info.dir().mkpath(".");
+    
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    
+    QByteArray json = QJsonDocument(toJson()).toJson();
+    return file.write(json) == json.size();
+}
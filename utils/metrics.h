@@ -0,0 +1,100 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QString>
+#include <QJsonObject>
+#include <QElapsedTimer>
+#include <atomic>
+
+// Monotonic event count
+class MetricCounter
+{
+public:
+    void increment(qint64 amount = 1) { count.fetch_add(amount, std::memory_order_relaxed); }
+    qint64 value() const { return count.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<qint64> count{0};
+};
+
+// Last observed value of something that goes up and down (e.g. a history size)
+class MetricGauge
+{
+public:
+    void set(double newValue) { current.store(newValue, std::memory_order_relaxed); }
+    double value() const { return current.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<double> current{0.0};
+};
+
+// HDR-style log-linear histogram of non-negative integer values (nanoseconds
+// for latencies). Each power of two is split into 32 linear sub-buckets, so
+// any recorded value is reported within ~3% of its true value. Recording is
+// a handful of relaxed atomic operations and never allocates.
+class LatencyHistogram
+{
+public:
+    static const int SubBucketBits = 5;
+    static const int SubBucketCount = 1 << SubBucketBits;
+    static const int MaxExponent = 42; // ~73 minutes in ns
+    static const int BucketCount = (MaxExponent - SubBucketBits + 1) * SubBucketCount;
+    
+    LatencyHistogram();
+    
+    void record(qint64 value);
+    void reset();
+    
+    qint64 count() const { return total.load(std::memory_order_relaxed); }
+    qint64 min() const;
+    qint64 max() const { return maximum.load(std::memory_order_relaxed); }
+    double mean() const;
+    
+    // Value at the given percentile (0-100)
+    qint64 percentile(double percent) const;
+    
+    static int bucketIndex(qint64 value);
+    static qint64 bucketLowerBound(int index);
+    static qint64 bucketUpperBound(int index);
+
+private:
+    std::atomic<qint64> buckets[BucketCount];
+    std::atomic<qint64> total;
+    std::atomic<qint64> sum;
+    std::atomic<qint64> minimum;
+    std::atomic<qint64> maximum;
+};
+
+// Process-wide registry. Metrics are created on first use and live for the
+// rest of the process, so callers can cache the returned pointer:
+//
+//     static MetricCounter *readings = Metrics::counter("glucose.readings_ingested");
+//     readings->increment();
+class Metrics
+{
+public:
+    static MetricCounter *counter(const QString &name);
+    static MetricGauge *gauge(const QString &name);
+    static LatencyHistogram *histogram(const QString &name);
+    
+    // {"timestamp", "counters": {...}, "gauges": {...}, "histograms": {name: {count, min, ...}}}
+    static QJsonObject toJson();
+    static bool writeJson(const QString &filename);
+};
+
+// Records the lifetime of the enclosing scope into a histogram
+class LatencyTimer
+{
+public:
+    explicit LatencyTimer(LatencyHistogram *target) : histogram(target) { timer.start(); }
+    ~LatencyTimer() { histogram->record(timer.nsecsElapsed()); }
+    
+    LatencyTimer(const LatencyTimer &) = delete;
+    LatencyTimer &operator=(const LatencyTimer &) = delete;
+
+private:
+    LatencyHistogram *histogram;
+    QElapsedTimer timer;
+};
+
+#endif // METRICS_H
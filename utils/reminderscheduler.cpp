@@ -0,0 +1,252 @@
+#include "reminderscheduler.h"
+#include <QSettings>
+#include <algorithm>
+#include "tracing.h"
+
+namespace {
+
+const int ReminderSaveDelayMs = 1000;
+
+// The clock can be shifted or stopped (see SimulationClock), so a far-off
+// reminder is rechecked at least this often rather than trusted to one
+// long timer
+const int MaxTimerIntervalMs = 60000;
+
+}
+
+ReminderScheduler::ReminderScheduler(QObject *parent)
+    : QObject(parent),
+      nextId(1),
+      running(false),
+      persistent(false),
+      dueTimer(new QTimer(this)),
+      saveTimer(new QTimer(this))
+{
+    dueTimer->setSingleShot(true);
+    connect(dueTimer, &QTimer::timeout, this, &ReminderScheduler::processDue);
+    
+    saveTimer->setSingleShot(true);
+    saveTimer->setInterval(ReminderSaveDelayMs);
+    connect(saveTimer, &QTimer::timeout, this, &ReminderScheduler::saveNow);
+    
+    // One writer, so saves reach QSettings in order
+    savePool.setMaxThreadCount(1);
+}
+
+ReminderScheduler::~ReminderScheduler()
+{
+    // Don't lose changes made just before shutdown
+    if (saveTimer->isActive()) {
+        saveTimer->stop();
+        saveNow();
+    }
+    savePool.waitForDone();
+}
+
+void ReminderScheduler::load()
+{
+    TRACE_SCOPE("ReminderScheduler::load");
+    reminders.clear();
+    heap.clear();
+    
+    QSettings settings("TandemDiabetes", "tslimx2simulator");
+    settings.beginGroup("Alerts");
+    
+    const Timestamp now = Timestamp::now();
+    int reminderCount = settings.beginReadArray("Reminders");
+    reminders.reserve(reminderCount);
+    heap.reserve(reminderCount);
+    for (int i = 0; i < reminderCount; ++i) {
+        settings.setArrayIndex(i);
+        Reminder reminder;
+        reminder.id = nextId++;
+        reminder.type = settings.value("Type").toString();
+        reminder.time = Timestamp::fromDateTime(settings.value("Time").toDateTime());
+        reminder.acknowledged = settings.value("Acknowledged", false).toBool();
+        
+        // Acknowledged reminders are only kept until their time has passed
+        if (reminder.acknowledged && reminder.time <= now) {
+            continue;
+        }
+        
+        reminders.insert(reminder.id, reminder);
+        if (!reminder.acknowledged) {
+            push({reminder.time.toMSecsSinceEpoch(), reminder.id});
+        }
+    }
+    settings.endArray();
+    settings.endGroup();
+    
+    persistent = true;
+    arm();
+    emit remindersChanged();
+}
+
+void ReminderScheduler::start()
+{
+    running = true;
+    arm();
+}
+
+void ReminderScheduler::stop()
+{
+    running = false;
+    dueTimer->stop();
+}
+
+quint32 ReminderScheduler::addReminder(const QString &type, Timestamp time)
+{
+    Reminder reminder;
+    reminder.id = nextId++;
+    reminder.type = type;
+    reminder.time = time;
+    reminder.acknowledged = false;
+    reminders.insert(reminder.id, reminder);
+    
+    push({time.toMSecsSinceEpoch(), reminder.id});
+    arm();
+    
+    scheduleSave();
+    emit remindersChanged();
+    return reminder.id;
+}
+
+bool ReminderScheduler::removeReminder(quint32 id)
+{
+    // Its heap entry is dropped when it reaches the top
+    if (reminders.remove(id) == 0) {
+        return false;
+    }
+    
+    arm();
+    scheduleSave();
+    emit remindersChanged();
+    return true;
+}
+
+QVector<ReminderScheduler::Reminder> ReminderScheduler::getReminders() const
+{
+    QVector<Reminder> result;
+    result.reserve(reminders.size());
+    for (const Reminder &reminder : reminders) {
+        result.append(reminder);
+    }
+    
+    std::sort(result.begin(), result.end(), [](const Reminder &a, const Reminder &b) {
+        return a.time != b.time ? a.time < b.time : a.id < b.id;
+    });
+    return result;
+}
+
+qint64 ReminderScheduler::nextDueTime()
+{
+    dropStale();
+    return heap.isEmpty() ? -1 : heap.first().time;
+}
+
+int ReminderScheduler::processDue()
+{
+    TRACE_SCOPE("ReminderScheduler::processDue");
+    if (!running) {
+        return 0;
+    }
+    
+    const qint64 now = Timestamp::now().toMSecsSinceEpoch();
+    int count = 0;
+    while (nextDueTime() >= 0 && heap.first().time <= now) {
+        const quint32 id = heap.first().id;
+        pop();
+        
+        // Acknowledge before emitting so the reminder only goes off once,
+        // even if a receiver adds or removes reminders
+        Reminder &reminder = reminders[id];
+        reminder.acknowledged = true;
+        const QString type = reminder.type;
+        const QDateTime time = reminder.time.toDateTime();
+        ++count;
+        
+        emit reminderDue(id, type, time);
+    }
+    
+    arm();
+    
+    if (count > 0) {
+        scheduleSave();
+        emit remindersChanged();
+    }
+    return count;
+}
+
+void ReminderScheduler::saveNow()
+{
+    if (!persistent) {
+        return;
+    }
+    
+    // The worker writes a copy; the scheduler carries on meanwhile
+    const QVector<Reminder> snapshot = getReminders();
+    savePool.start([snapshot]() {
+        QSettings settings("TandemDiabetes", "tslimx2simulator");
+        settings.beginGroup("Alerts");
+        settings.beginWriteArray("Reminders", snapshot.size());
+        for (int i = 0; i < snapshot.size(); ++i) {
+            settings.setArrayIndex(i);
+            settings.setValue("Type", snapshot[i].type);
+            settings.setValue("Time", snapshot[i].time.toDateTime());
+            settings.setValue("Acknowledged", snapshot[i].acknowledged);
+        }
+        settings.endArray();
+        settings.endGroup();
+    });
+}
+
+// Heap order: earliest first
+void ReminderScheduler::push(const Entry &entry)
+{
+    heap.append(entry);
+    std::push_heap(heap.begin(), heap.end(), [](const Entry &a, const Entry &b) {
+        return a.time > b.time;
+    });
+}
+
+void ReminderScheduler::pop()
+{
+    std::pop_heap(heap.begin(), heap.end(), [](const Entry &a, const Entry &b) {
+        return a.time > b.time;
+    });
+    heap.removeLast();
+}
+
+void ReminderScheduler::dropStale()
+{
+    while (!heap.isEmpty()) {
+        auto it = reminders.constFind(heap.first().id);
+        if (it != reminders.constEnd() && !it.value().acknowledged) {
+            return;
+        }
+        pop();
+    }
+}
+
+void ReminderScheduler::arm()
+{
+    if (!running) {
+        return;
+    }
+    
+    const qint64 next = nextDueTime();
+    if (next < 0) {
+        dueTimer->stop();
+        return;
+    }
+    
+    const qint64 delay = next - Timestamp::now().toMSecsSinceEpoch();
+    dueTimer->start(static_cast<int>(qBound<qint64>(0, delay, MaxTimerIntervalMs)));
+}
+
+void ReminderScheduler::scheduleSave()
+{
+    if (persistent && !saveTimer->isActive()) {
+        saveTimer->start();
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef REMINDERSCHEDULER_H
+#define REMINDERSCHEDULER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QHash>
+#include <QVector>
+#include <QString>
+#include <QThreadPool>
+#include "timestamp.h"
+
+// User reminders (site change, CGM sensor, ...) and when they are due.
+//
+// The reminders are read from QSettings once, by load(), and kept in memory
+// with their due times in a min-heap, so a single timer armed for the
+// earliest one is all the scheduler needs; adding, removing or firing a
+// reminder is O(log n) and nothing is polled. Changes are written back to
+// QSettings on a background thread, debounced like the error log.
+//
+// A due reminder is marked acknowledged when reminderDue() is emitted, so it
+// only goes off once. Due times follow the simulation clock.
+class ReminderScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Reminder {
+        quint32 id;
+        QString type;
+        Timestamp time;
+        bool acknowledged;
+    };
+    
+    explicit ReminderScheduler(QObject *parent = nullptr);
+    ~ReminderScheduler();
+    
+    // Reads the reminders from QSettings, replacing any held. Only a
+    // scheduler loaded from QSettings writes its changes back there.
+    void load();
+    
+    // Reminders only go off while the scheduler is running
+    void start();
+    void stop();
+    bool isRunning() const { return running; }
+    
+    // Returns the new reminder's id
+    quint32 addReminder(const QString &type, Timestamp time);
+    bool removeReminder(quint32 id);
+    
+    // Every reminder, earliest first
+    QVector<Reminder> getReminders() const;
+    int count() const { return reminders.size(); }
+    
+    // Time the next unacknowledged reminder is due, or -1 if there is none
+    qint64 nextDueTime();
+
+public slots:
+    // Fires every reminder due by now and rearms the timer. Returns how
+    // many went off.
+    int processDue();
+
+signals:
+    void reminderDue(quint32 id, const QString &type, const QDateTime &time);
+    void remindersChanged();
+
+private slots:
+    void saveNow();
+
+private:
+    struct Entry {
+        qint64 time;
+        quint32 id;
+    };
+    
+    QHash<quint32, Reminder> reminders;
+    QVector<Entry> heap;  // Unacknowledged reminders; removed ones are dropped lazily
+    quint32 nextId;
+    bool running;
+    bool persistent;
+    QTimer *dueTimer;
+    QTimer *saveTimer;
+    QThreadPool savePool;
+    
+    void push(const Entry &entry);
+    void pop();
+    void dropStale();
+    void arm();
+    void scheduleSave();
+};
+
+#endif // REMINDERSCHEDULER_H
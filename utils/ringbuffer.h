@@ -0,0 +1,88 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <QVector>
+
+// Fixed-capacity buffer that keeps the most recent entries.
+//
+// Storage is allocated once up front; once the buffer is full, append()
+// overwrites the oldest entry in place instead of shifting the rest down.
+// Index 0 is the oldest entry.
+template <typename T>
+class RingBuffer
+{
+public:
+    explicit RingBuffer(int capacity)
+        : storage(qMax(1, capacity)),
+          head(0),
+          count(0)
+    {
+    }
+    
+    void append(const T &value)
+    {
+        storage[(head + count) % storage.size()] = value;
+        if (count < storage.size()) {
+            ++count;
+        } else {
+            head = (head + 1) % storage.size();
+        }
+    }
+    
+    void clear()
+    {
+        // Release what the entries hold but keep the slots
+        for (int i = 0; i < storage.size(); ++i) {
+            storage[i] = T();
+        }
+        head = 0;
+        count = 0;
+    }
+    
+    int size() const { return count; }
+    int capacity() const { return storage.size(); }
+    bool isEmpty() const { return count == 0; }
+    
+    const T &at(int index) const { return storage.at((head + index) % storage.size()); }
+    T &operator[](int index) { return storage[(head + index) % storage.size()]; }
+    const T &operator[](int index) const { return at(index); }
+    const T &last() const { return at(count - 1); }
+    
+    // Oldest to newest
+    class const_iterator
+    {
+    public:
+        const_iterator(const RingBuffer *buffer, int index) : buffer(buffer), index(index) {}
+        
+        const T &operator*() const { return buffer->at(index); }
+        const T *operator->() const { return &buffer->at(index); }
+        const_iterator &operator++() { ++index; return *this; }
+        bool operator==(const const_iterator &other) const { return index == other.index; }
+        bool operator!=(const const_iterator &other) const { return index != other.index; }
+    
+    private:
+        const RingBuffer *buffer;
+        int index;
+    };
+    
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, count); }
+    
+    // Oldest first, for callers that want a plain vector
+    QVector<T> toVector() const
+    {
+        QVector<T> result;
+        result.reserve(count);
+        for (int i = 0; i < count; ++i) {
+            result.append(at(i));
+        }
+        return result;
+    }
+
+private:
+    QVector<T> storage;
+    int head;
+    int count;
+};
+
+#endif // RINGBUFFER_H
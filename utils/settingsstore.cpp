@@ -0,0 +1,177 @@
+#include "settingsstore.h"
+#include <QSettings>
+#include "tracing.h"
+
+namespace {
+
+const int SettingsSaveDelayMs = 1000;
+
+void readAlerts(QSettings &settings, AlertSettings &alerts)
+{
+    const AlertSettings defaults;
+    
+    settings.beginGroup("Alerts");
+    alerts.alertsEnabled = settings.value("AlertsEnabled", defaults.alertsEnabled).toBool();
+    
+    alerts.lowGlucoseThreshold = settings.value("LowGlucoseThreshold", defaults.lowGlucoseThreshold).toDouble();
+    alerts.highGlucoseThreshold = settings.value("HighGlucoseThreshold", defaults.highGlucoseThreshold).toDouble();
+    alerts.urgentLowGlucoseThreshold = settings.value("UrgentLowGlucoseThreshold", defaults.urgentLowGlucoseThreshold).toDouble();
+    alerts.urgentHighGlucoseThreshold = settings.value("UrgentHighGlucoseThreshold", defaults.urgentHighGlucoseThreshold).toDouble();
+    
+    alerts.lowInsulinThreshold = settings.value("LowInsulinThreshold", defaults.lowInsulinThreshold).toDouble();
+    alerts.criticalInsulinThreshold = settings.value("CriticalInsulinThreshold", defaults.criticalInsulinThreshold).toDouble();
+    
+    alerts.lowBatteryThreshold = settings.value("LowBatteryThreshold", defaults.lowBatteryThreshold).toInt();
+    alerts.criticalBatteryThreshold = settings.value("CriticalBatteryThreshold", defaults.criticalBatteryThreshold).toInt();
+    settings.endGroup();
+}
+
+void writeAlerts(QSettings &settings, const AlertSettings &alerts)
+{
+    settings.beginGroup("Alerts");
+    settings.setValue("AlertsEnabled", alerts.alertsEnabled);
+    
+    settings.setValue("LowGlucoseThreshold", alerts.lowGlucoseThreshold);
+    settings.setValue("HighGlucoseThreshold", alerts.highGlucoseThreshold);
+    settings.setValue("UrgentLowGlucoseThreshold", alerts.urgentLowGlucoseThreshold);
+    settings.setValue("UrgentHighGlucoseThreshold", alerts.urgentHighGlucoseThreshold);
+    
+    settings.setValue("LowInsulinThreshold", alerts.lowInsulinThreshold);
+    settings.setValue("CriticalInsulinThreshold", alerts.criticalInsulinThreshold);
+    
+    settings.setValue("LowBatteryThreshold", alerts.lowBatteryThreshold);
+    settings.setValue("CriticalBatteryThreshold", alerts.criticalBatteryThreshold);
+    settings.endGroup();
+}
+
+void readSecurity(QSettings &settings, SecuritySettings &security)
+{
+    settings.beginGroup("Security");
+    security.pinEnabled = settings.value("PinEnabled", false).toBool();
+    security.pinHash = settings.value("Pin", "").toString();
+    settings.endGroup();
+}
+
+void writeSecurity(QSettings &settings, const SecuritySettings &security)
+{
+    settings.beginGroup("Security");
+    settings.setValue("PinEnabled", security.pinEnabled);
+    settings.setValue("Pin", security.pinHash);
+    settings.endGroup();
+}
+
+}
+
+bool AlertSettings::operator==(const AlertSettings &other) const
+{
+    return alertsEnabled == other.alertsEnabled &&
+           lowGlucoseThreshold == other.lowGlucoseThreshold &&
+           highGlucoseThreshold == other.highGlucoseThreshold &&
+           urgentLowGlucoseThreshold == other.urgentLowGlucoseThreshold &&
+           urgentHighGlucoseThreshold == other.urgentHighGlucoseThreshold &&
+           lowInsulinThreshold == other.lowInsulinThreshold &&
+           criticalInsulinThreshold == other.criticalInsulinThreshold &&
+           lowBatteryThreshold == other.lowBatteryThreshold &&
+           criticalBatteryThreshold == other.criticalBatteryThreshold;
+}
+
+bool SecuritySettings::operator==(const SecuritySettings &other) const
+{
+    return pinEnabled == other.pinEnabled && pinHash == other.pinHash;
+}
+
+SettingsStore::SettingsStore(QObject *parent)
+    : QObject(parent),
+      alertsDirty(false),
+      securityDirty(false),
+      persistent(false),
+      saveTimer(new QTimer(this))
+{
+    saveTimer->setSingleShot(true);
+    saveTimer->setInterval(SettingsSaveDelayMs);
+    connect(saveTimer, &QTimer::timeout, this, &SettingsStore::saveNow);
+    
+    // One writer, so batches reach QSettings in order
+    savePool.setMaxThreadCount(1);
+}
+
+SettingsStore::~SettingsStore()
+{
+    // Don't lose changes made just before shutdown
+    if (saveTimer->isActive()) {
+        saveTimer->stop();
+        saveNow();
+    }
+    savePool.waitForDone();
+}
+
+void SettingsStore::load()
+{
+    TRACE_SCOPE("SettingsStore::load");
+    QSettings settings("TandemDiabetes", "tslimx2simulator");
+    readAlerts(settings, alertSettings);
+    readSecurity(settings, securitySettings);
+    
+    alertsDirty = false;
+    securityDirty = false;
+    persistent = true;
+    
+    emit alertSettingsChanged(alertSettings);
+    emit securitySettingsChanged(securitySettings);
+}
+
+void SettingsStore::setAlerts(const AlertSettings &settings)
+{
+    if (settings == alertSettings) {
+        return;
+    }
+    
+    alertSettings = settings;
+    alertsDirty = true;
+    scheduleSave();
+    emit alertSettingsChanged(alertSettings);
+}
+
+void SettingsStore::setSecurity(const SecuritySettings &settings)
+{
+    if (settings == securitySettings) {
+        return;
+    }
+    
+    securitySettings = settings;
+    securityDirty = true;
+    scheduleSave();
+    emit securitySettingsChanged(securitySettings);
+}
+
+void SettingsStore::saveNow()
+{
+    if (!persistent || (!alertsDirty && !securityDirty)) {
+        return;
+    }
+    
+    // The worker writes a copy of the groups that changed
+    const bool writeAlertGroup = alertsDirty;
+    const bool writeSecurityGroup = securityDirty;
+    const AlertSettings alerts = alertSettings;
+    const SecuritySettings security = securitySettings;
+    alertsDirty = false;
+    securityDirty = false;
+    
+    savePool.start([writeAlertGroup, writeSecurityGroup, alerts, security]() {
+        QSettings settings("TandemDiabetes", "tslimx2simulator");
+        if (writeAlertGroup) {
+            writeAlerts(settings, alerts);
+        }
+        if (writeSecurityGroup) {
+            writeSecurity(settings, security);
+        }
+    });
+}
+
+void SettingsStore::scheduleSave()
+{
+    if (persistent && !saveTimer->isActive()) {
+        saveTimer->start();
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef SETTINGSSTORE_H
+#define SETTINGSSTORE_H
+
+#include <QObject>
+#include <QTimer>
+#include <QString>
+#include <QThreadPool>
+
+// The "Alerts" group, less the reminders (see ReminderScheduler)
+struct AlertSettings {
+    bool alertsEnabled = true;
+    
+    double lowGlucoseThreshold = 3.9;
+    double highGlucoseThreshold = 10.0;
+    double urgentLowGlucoseThreshold = 3.1;
+    double urgentHighGlucoseThreshold = 13.9;
+    
+    double lowInsulinThreshold = 50.0;
+    double criticalInsulinThreshold = 10.0;
+    
+    int lowBatteryThreshold = 20;
+    int criticalBatteryThreshold = 5;
+    
+    bool operator==(const AlertSettings &other) const;
+    bool operator!=(const AlertSettings &other) const { return !(*this == other); }
+};
+
+// The "Security" group
+struct SecuritySettings {
+    bool pinEnabled = false;
+    QString pinHash;  // SHA-256 of the PIN as hex, empty if none is set
+    
+    bool operator==(const SecuritySettings &other) const;
+    bool operator!=(const SecuritySettings &other) const { return !(*this == other); }
+};
+
+// The simulator's QSettings, held in memory.
+//
+// load() reads every group once into typed structs; after that a setting
+// is a field read and screens never touch the disk to open. Setting a group
+// emits its changed signal, so the controllers and screens that depend on
+// it update, and marks it for writing. Writes are batched: a debounce timer
+// collects the changes of the next second and a background worker writes
+// them to QSettings from a copy.
+class SettingsStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SettingsStore(QObject *parent = nullptr);
+    ~SettingsStore();
+    
+    // Only a store loaded from QSettings writes its changes back there
+    void load();
+    
+    const AlertSettings &alerts() const { return alertSettings; }
+    const SecuritySettings &security() const { return securitySettings; }
+    
+    // No-ops when nothing changed
+    void setAlerts(const AlertSettings &settings);
+    void setSecurity(const SecuritySettings &settings);
+
+signals:
+    void alertSettingsChanged(const AlertSettings &settings);
+    void securitySettingsChanged(const SecuritySettings &settings);
+
+private slots:
+    void saveNow();
+
+private:
+    AlertSettings alertSettings;
+    SecuritySettings securitySettings;
+    bool alertsDirty;
+    bool securityDirty;
+    bool persistent;
+    QTimer *saveTimer;
+    QThreadPool savePool;
+    
+    void scheduleSave();
+};
+
+#endif // SETTINGSSTORE_H
@@ -0,0 +1,233 @@
+#include "stallmonitor.h"
+#include "tracing.h"
+#include "metrics.h"
+#include <QThread>
+#include <QTimerEvent>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QDebug>
+
+namespace {
+
+const int HeartbeatIntervalMs = 100;
+const qint64 HeartbeatIntervalNs = HeartbeatIntervalMs * 1000000LL;
+const int WatchdogPollMs = 10;
+const int DefaultStallThresholdMs = 200;
+
+// At most one warning on stderr this often; every report still goes to
+// the file and the metrics
+const qint64 WarningIntervalNs = 5000LL * 1000000LL;
+
+// Reported when the GUI thread was outside any TRACE_SCOPE
+const char UntracedScope[] = "(untraced)";
+// Reported when the stall ended before the watchdog looked
+const char UnknownScope[] = "(unknown)";
+
+}
+
+StallMonitor::StallMonitor(QObject *parent)
+    : QObject(parent),
+      watchdog(nullptr),
+      lagHistogram(Metrics::histogram("ui.event_loop_lag_ns")),
+      reportFilename(QDir::homePath() + "/.tslimx2simulator/stall_report.jsonl"),
+      guiScope(Tracer::currentScopeSlot()),
+      lastBeatNs(0),
+      stallThresholdNs(DefaultStallThresholdMs * 1000000LL),
+      capturedBeatNs(-1),
+      capturedScope(nullptr),
+      lastWarningNs(-1),
+      suppressedWarnings(0)
+{
+    clock.start();
+    
+    heartbeatTimer = new QTimer(this);
+    heartbeatTimer->setTimerType(Qt::PreciseTimer);
+    heartbeatTimer->setInterval(HeartbeatIntervalMs);
+    connect(heartbeatTimer, &QTimer::timeout, this, &StallMonitor::heartbeat);
+    
+    // One writer keeps report lines in order
+    reportPool.setMaxThreadCount(1);
+    QDir().mkpath(QDir::homePath() + "/.tslimx2simulator");
+}
+
+StallMonitor::~StallMonitor()
+{
+    stop();
+    
+    // Let queued report lines reach the file
+    reportPool.waitForDone();
+}
+
+void StallMonitor::start()
+{
+    if (watchdog) {
+        return;
+    }
+    
+    lastBeatNs.store(clock.nsecsElapsed(), std::memory_order_release);
+    capturedBeatNs.store(-1, std::memory_order_relaxed);
+    heartbeatTimer->start();
+    
+    watchdog = QThread::create([this]() { watchdogLoop(); });
+    watchdog->setObjectName("StallWatchdog");
+    watchdog->start();
+}
+
+void StallMonitor::stop()
+{
+    heartbeatTimer->stop();
+    
+    if (watchdog) {
+        watchdog->requestInterruption();
+        watchdog->wait();
+        delete watchdog;
+        watchdog = nullptr;
+    }
+}
+
+void StallMonitor::setStallThreshold(int milliseconds)
+{
+    stallThresholdNs.store(qMax(1, milliseconds) * 1000000LL, std::memory_order_relaxed);
+}
+
+int StallMonitor::getStallThreshold() const
+{
+    return static_cast<int>(stallThresholdNs.load(std::memory_order_relaxed) / 1000000LL);
+}
+
+void StallMonitor::watchTimer(QTimer *timer, const QString &name)
+{
+    if (!timer || watchedTimers.contains(timer)) {
+        return;
+    }
+    
+    WatchedTimer watched;
+    watched.name = name;
+    watched.jitter = Metrics::histogram("timer." + name + ".jitter_ns");
+    watched.timerId = -1;
+    watched.lastFireNs = 0;
+    watchedTimers.insert(timer, watched);
+    
+    // The filter sees the timer event before QTimer emits timeout(), so the
+    // measurement does not include the slots connected to it
+    timer->installEventFilter(this);
+    connect(timer, &QObject::destroyed, this, [this](QObject *object) {
+        watchedTimers.remove(object);
+    });
+}
+
+QString StallMonitor::getReportFilename() const
+{
+    return reportFilename;
+}
+
+bool StallMonitor::eventFilter(QObject *watched, QEvent *event)
+{
+    if (event->type() == QEvent::Timer) {
+        auto it = watchedTimers.find(watched);
+        QTimer *timer = static_cast<QTimer *>(watched);
+        const int timerId = static_cast<QTimerEvent *>(event)->timerId();
+        
+        if (it != watchedTimers.end() && timerId == timer->timerId()) {
+            const qint64 now = clock.nsecsElapsed();
+            
+            // A new timer id means the timer was restarted; start a new baseline
+            if (it->timerId == timerId) {
+                const qint64 deviation = now - it->lastFireNs - timer->interval() * 1000000LL;
+                it->jitter->record(qAbs(deviation));
+                
+                if (deviation > stallThresholdNs.load(std::memory_order_relaxed)) {
+                    appendReport("late_timer", it->name, deviation);
+                    emit timerLate(it->name, deviation / 1000000LL);
+                }
+            }
+            
+            it->timerId = timerId;
+            it->lastFireNs = now;
+        }
+    }
+    
+    return QObject::eventFilter(watched, event);
+}
+
+void StallMonitor::heartbeat()
+{
+    const qint64 now = clock.nsecsElapsed();
+    const qint64 previousBeat = lastBeatNs.load(std::memory_order_relaxed);
+    lastBeatNs.store(now, std::memory_order_release);
+    
+    const qint64 lag = qMax<qint64>(0, now - previousBeat - HeartbeatIntervalNs);
+    lagHistogram->record(lag);
+    
+    if (lag <= stallThresholdNs.load(std::memory_order_relaxed)) {
+        return;
+    }
+    
+    // Use the watchdog's sample only if it was taken during this stall
+    const char *scope = UnknownScope;
+    if (capturedBeatNs.load(std::memory_order_acquire) == previousBeat) {
+        scope = capturedScope.load(std::memory_order_relaxed);
+    }
+    
+    appendReport("stall", scope, lag);
+    emit stallDetected(scope, lag / 1000000LL);
+}
+
+void StallMonitor::watchdogLoop()
+{
+    while (!QThread::currentThread()->isInterruptionRequested()) {
+        QThread::msleep(WatchdogPollMs);
+        
+        const qint64 beat = lastBeatNs.load(std::memory_order_acquire);
+        const qint64 overdue = clock.nsecsElapsed() - beat - HeartbeatIntervalNs;
+        
+        // Sample once per stall, while the GUI thread is still stuck in it
+        if (overdue > stallThresholdNs.load(std::memory_order_relaxed) &&
+            capturedBeatNs.load(std::memory_order_relaxed) != beat) {
+            const char *scope = guiScope->load(std::memory_order_acquire);
+            capturedScope.store(scope ? scope : UntracedScope, std::memory_order_relaxed);
+            capturedBeatNs.store(beat, std::memory_order_release);
+        }
+    }
+}
+
+void StallMonitor::appendReport(const QString &kind, const QString &source, qint64 durationNs)
+{
+    static MetricCounter *stalls = Metrics::counter("ui.stalls");
+    static MetricCounter *lateTimers = Metrics::counter("ui.late_timers");
+    (kind == "stall" ? stalls : lateTimers)->increment();
+    
+    const qint64 now = clock.nsecsElapsed();
+    if (lastWarningNs < 0 || now - lastWarningNs >= WarningIntervalNs) {
+        if (suppressedWarnings > 0) {
+            qWarning("%s: %s (%.1f ms), %d more since the last warning",
+                     qPrintable(kind), qPrintable(source), durationNs / 1e6, suppressedWarnings);
+        } else {
+            qWarning("%s: %s (%.1f ms)", qPrintable(kind), qPrintable(source), durationNs / 1e6);
+        }
+        lastWarningNs = now;
+        suppressedWarnings = 0;
+    } else {
+        ++suppressedWarnings;
+    }
+    
+    QJsonObject entry;
+    entry["timestamp"] = QDateTime::currentDateTime().toString(Qt::ISODateWithMs);
+    entry["kind"] = kind;
+    entry["source"] = source;
+    entry["duration_ms"] = durationNs / 1e6;
+    
+    const QByteArray line = QJsonDocument(entry).toJson(QJsonDocument::Compact) + '\n';
+    const QString filename = reportFilename;
+    
+    // Writing on the GUI thread could cause the next stall
+    reportPool.start([filename, line]() {
+        QFile file(filename);
+        if (file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+            file.write(line);
+        }
+    });
+}
@@ -0,0 +1,90 @@
+#ifndef STALLMONITOR_H
+#define STALLMONITOR_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QString>
+#include <QThreadPool>
+#include <atomic>
+
+class QThread;
+class LatencyHistogram;
+
+// Watches the GUI event loop for stalls.
+//
+// A heartbeat timer on the GUI thread records how late it fires into the
+// "ui.event_loop_lag_ns" histogram. A watchdog thread checks the heartbeat
+// and, once it is overdue by more than the stall threshold, samples the GUI
+// thread's innermost TRACE_SCOPE so the report names the slot that was
+// running. Watched QTimers get a "timer.<name>.jitter_ns" histogram of how
+// far each timeout strays from its interval.
+//
+// Stalls and late timers are appended as JSON lines to
+// ~/.tslimx2simulator/stall_report.jsonl by a background worker and
+// counted in "ui.stalls" and "ui.late_timers". A warning is logged for at
+// most one of them every few seconds.
+class StallMonitor : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Must be created on the GUI thread
+    explicit StallMonitor(QObject *parent = nullptr);
+    ~StallMonitor();
+    
+    void start();
+    void stop();
+    
+    // Lag above this is reported as a stall (default 200 ms)
+    void setStallThreshold(int milliseconds);
+    int getStallThreshold() const;
+    
+    // Record dispatch jitter for a timer living on the GUI thread
+    void watchTimer(QTimer *timer, const QString &name);
+    
+    QString getReportFilename() const;
+
+signals:
+    void stallDetected(const QString &scope, qint64 durationMs);
+    void timerLate(const QString &name, qint64 lateMs);
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
+private slots:
+    void heartbeat();
+
+private:
+    struct WatchedTimer {
+        QString name;
+        LatencyHistogram *jitter;
+        int timerId;
+        qint64 lastFireNs;
+    };
+    
+    QTimer *heartbeatTimer;
+    QThread *watchdog;
+    QElapsedTimer clock;
+    QHash<QObject *, WatchedTimer> watchedTimers;
+    LatencyHistogram *lagHistogram;
+    QThreadPool reportPool;
+    QString reportFilename;
+    
+    // Shared with the watchdog thread
+    std::atomic<const char *> *guiScope;
+    std::atomic<qint64> lastBeatNs;
+    std::atomic<qint64> stallThresholdNs;
+    std::atomic<qint64> capturedBeatNs;
+    std::atomic<const char *> capturedScope;
+    
+    // Rate limit of the warnings on stderr
+    qint64 lastWarningNs;
+    int suppressedWarnings;
+    
+    void watchdogLoop();
+    void appendReport(const QString &kind, const QString &source, qint64 durationNs);
+};
+
+#endif // STALLMONITOR_H
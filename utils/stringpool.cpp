@@ -0,0 +1,69 @@
+#include "stringpool.h"
+#include <QHash>
+#include <QVector>
+#include <QReadWriteLock>
+
+namespace {
+
+struct Pool {
+    QReadWriteLock lock;
+    QHash<QString, quint32> ids;
+    QVector<QString> strings;
+    
+    Pool()
+    {
+        ids.insert(QString(), 0);
+        strings.append(QString());
+    }
+};
+
+Pool &pool()
+{
+    static Pool instance;
+    return instance;
+}
+
+}
+
+quint32 StringPool::intern(const QString &value)
+{
+    if (value.isEmpty()) {
+        return 0;
+    }
+    
+    Pool &strings = pool();
+    
+    // Nearly every call is for a string that is already interned
+    {
+        QReadLocker locker(&strings.lock);
+        auto it = strings.ids.constFind(value);
+        if (it != strings.ids.constEnd()) {
+            return it.value();
+        }
+    }
+    
+    QWriteLocker locker(&strings.lock);
+    auto it = strings.ids.constFind(value);
+    if (it != strings.ids.constEnd()) {
+        return it.value();
+    }
+    
+    const quint32 id = static_cast<quint32>(strings.strings.size());
+    strings.strings.append(value);
+    strings.ids.insert(value, id);
+    return id;
+}
+
+QString StringPool::lookup(quint32 id)
+{
+    Pool &strings = pool();
+    QReadLocker locker(&strings.lock);
+    return id < static_cast<quint32>(strings.strings.size()) ? strings.strings.at(id) : QString();
+}
+
+int StringPool::size()
+{
+    Pool &strings = pool();
+    QReadLocker locker(&strings.lock);
+    return strings.strings.size();
+}
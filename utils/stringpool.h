@@ -0,0 +1,21 @@
+#ifndef STRINGPOOL_H
+#define STRINGPOOL_H
+
+#include <QString>
+
+// Process-wide table of interned strings.
+//
+// Compact records store a 32-bit id instead of a QString for fields with a
+// small set of values (bolus reasons, profile names), which keeps the
+// records trivially copyable. Strings are never removed, so only intern
+// values from a bounded set, not free text. Id 0 is the empty string.
+// Thread-safe.
+class StringPool
+{
+public:
+    static quint32 intern(const QString &value);
+    static QString lookup(quint32 id);
+    static int size();
+};
+
+#endif // STRINGPOOL_H
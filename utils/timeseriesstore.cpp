@@ -0,0 +1,335 @@
+#include "timeseriesstore.h"
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+qint64 alignDown(qint64 timestamp, qint64 width)
+{
+    qint64 aligned = (timestamp / width) * width;
+    if (aligned > timestamp) {
+        aligned -= width;
+    }
+    return aligned;
+}
+
+TimeSeriesStore::Bucket makeBucket(qint64 start, double value)
+{
+    TimeSeriesStore::Bucket bucket;
+    bucket.start = start;
+    bucket.min = value;
+    bucket.max = value;
+    bucket.sum = value;
+    bucket.count = 1;
+    return bucket;
+}
+
+}
+
+TimeSeriesStore::TimeSeriesStore()
+    : modifications(0)
+{
+}
+
+void TimeSeriesStore::append(qint64 timestamp, double value)
+{
+    ++modifications;
+    
+    // Out-of-order samples are rare (imports, merged histories); keep the
+    // raw data sorted. Either way a sample only changes the one bucket
+    // covering it at each level.
+    if (!samples.isEmpty() && timestamp < samples.last().timestamp) {
+        Sample sample = {timestamp, value};
+        int index = upperBound(timestamp);
+        samples.insert(index, sample);
+    } else {
+        samples.append({timestamp, value});
+    }
+    
+    addToLevel(FiveMinutes, timestamp, value);
+    addToLevel(OneHour, timestamp, value);
+    addToLevel(OneDay, timestamp, value);
+}
+
+void TimeSeriesStore::append(const QDateTime &timestamp, double value)
+{
+    append(timestamp.toMSecsSinceEpoch(), value);
+}
+
+void TimeSeriesStore::clear()
+{
+    ++modifications;
+    samples.clear();
+    fiveMinuteBuckets.clear();
+    hourBuckets.clear();
+    dayBuckets.clear();
+}
+
+void TimeSeriesStore::removeBefore(qint64 timestamp)
+{
+    int count = lowerBound(timestamp);
+    if (count == 0) {
+        return;
+    }
+    
+    samples.remove(0, count);
+    ++modifications;
+    
+    // Drop summary buckets that now lie entirely before the first sample and
+    // recompute the (possibly partial) bucket that straddles the cut
+    for (Resolution level : {FiveMinutes, OneHour, OneDay}) {
+        QVector<Bucket> &levelBuckets = mutableBuckets(level);
+        
+        if (samples.isEmpty()) {
+            levelBuckets.clear();
+            continue;
+        }
+        
+        int firstKept = bucketLowerBound(levelBuckets, alignDown(samples.first().timestamp, bucketWidth(level)));
+        if (firstKept > 0) {
+            levelBuckets.remove(0, firstKept);
+        }
+        
+        rebuildFirstBucket(level);
+    }
+}
+
+void TimeSeriesStore::reserve(int size)
+{
+    samples.reserve(size);
+}
+
+int TimeSeriesStore::lowerBound(qint64 timestamp) const
+{
+    auto it = std::lower_bound(samples.constBegin(), samples.constEnd(), timestamp,
+                               [](const Sample &sample, qint64 t) {
+                                   return sample.timestamp < t;
+                               });
+    return static_cast<int>(it - samples.constBegin());
+}
+
+int TimeSeriesStore::upperBound(qint64 timestamp) const
+{
+    auto it = std::upper_bound(samples.constBegin(), samples.constEnd(), timestamp,
+                               [](qint64 t, const Sample &sample) {
+                                   return t < sample.timestamp;
+                               });
+    return static_cast<int>(it - samples.constBegin());
+}
+
+HistoryView<TimeSeriesStore::Sample> TimeSeriesStore::view(qint64 start, qint64 end) const
+{
+    if (end < start) {
+        return HistoryView<Sample>(samples, 0, 0, modifications);
+    }
+    
+    return HistoryView<Sample>(samples, lowerBound(start), upperBound(end), modifications);
+}
+
+int TimeSeriesStore::countInRange(qint64 start, qint64 end) const
+{
+    if (end < start) {
+        return 0;
+    }
+    
+    return upperBound(end) - lowerBound(start);
+}
+
+const QVector<TimeSeriesStore::Bucket> &TimeSeriesStore::buckets(Resolution level) const
+{
+    switch (level) {
+        case OneHour:
+            return hourBuckets;
+        case OneDay:
+            return dayBuckets;
+        case FiveMinutes:
+        case Raw:
+            break;
+    }
+    
+    return fiveMinuteBuckets;
+}
+
+qint64 TimeSeriesStore::bucketWidth(Resolution level)
+{
+    switch (level) {
+        case Raw:
+            return 0;
+        case FiveMinutes:
+            return 5LL * 60 * 1000;
+        case OneHour:
+            return 60LL * 60 * 1000;
+        case OneDay:
+            return 24LL * 60 * 60 * 1000;
+    }
+    
+    return 0;
+}
+
+int TimeSeriesStore::bucketLowerBound(const QVector<Bucket> &levelBuckets, qint64 timestamp)
+{
+    auto it = std::lower_bound(levelBuckets.constBegin(), levelBuckets.constEnd(), timestamp,
+                               [](const Bucket &bucket, qint64 t) {
+                                   return bucket.start < t;
+                               });
+    return static_cast<int>(it - levelBuckets.constBegin());
+}
+
+TimeSeriesStore::Resolution TimeSeriesStore::levelForDensity(qint64 start, qint64 end, int pixels) const
+{
+    if (pixels <= 0 || end <= start) {
+        return Raw;
+    }
+    
+    // Raw samples are fine as long as there are fewer of them than pixels
+    if (countInRange(start, end) <= pixels) {
+        return Raw;
+    }
+    
+    // Otherwise take the coarsest level whose buckets are at most a few
+    // pixels wide
+    const qint64 maxBucketWidth = (end - start) * 4 / pixels;
+    
+    if (bucketWidth(OneDay) <= maxBucketWidth) {
+        return OneDay;
+    }
+    if (bucketWidth(OneHour) <= maxBucketWidth) {
+        return OneHour;
+    }
+    
+    return FiveMinutes;
+}
+
+bool TimeSeriesStore::minMax(qint64 start, qint64 end, double &minValue, double &maxValue) const
+{
+    minValue = std::numeric_limits<double>::max();
+    maxValue = std::numeric_limits<double>::lowest();
+    
+    int first = lowerBound(start);
+    int last = upperBound(end);
+    if (first >= last) {
+        return false;
+    }
+    
+    auto include = [&](double low, double high) {
+        minValue = qMin(minValue, low);
+        maxValue = qMax(maxValue, high);
+    };
+    
+    // Whole hours inside the range come from the hourly summaries, the
+    // partial hours at either edge from the raw samples
+    const qint64 width = bucketWidth(OneHour);
+    qint64 interiorStart = alignDown(start, width);
+    if (interiorStart < start) {
+        interiorStart += width;
+    }
+    qint64 interiorEnd = alignDown(end + 1, width);
+    
+    if (interiorEnd - interiorStart < width) {
+        for (int i = first; i < last; ++i) {
+            include(samples[i].value, samples[i].value);
+        }
+        return true;
+    }
+    
+    int headEnd = lowerBound(interiorStart);
+    for (int i = first; i < headEnd; ++i) {
+        include(samples[i].value, samples[i].value);
+    }
+    
+    int bucketIndex = bucketLowerBound(hourBuckets, interiorStart);
+    while (bucketIndex < hourBuckets.size() && hourBuckets[bucketIndex].start < interiorEnd) {
+        include(hourBuckets[bucketIndex].min, hourBuckets[bucketIndex].max);
+        ++bucketIndex;
+    }
+    
+    int tailStart = lowerBound(interiorEnd);
+    for (int i = tailStart; i < last; ++i) {
+        include(samples[i].value, samples[i].value);
+    }
+    
+    return true;
+}
+
+QVector<QPair<QDateTime, double>> TimeSeriesStore::toPairs(qint64 start, qint64 end) const
+{
+    QVector<QPair<QDateTime, double>> result;
+    
+    int first = lowerBound(start);
+    int last = upperBound(end);
+    if (first >= last) {
+        return result;
+    }
+    
+    result.reserve(last - first);
+    for (int i = first; i < last; ++i) {
+        result.append(qMakePair(QDateTime::fromMSecsSinceEpoch(samples[i].timestamp), samples[i].value));
+    }
+    
+    return result;
+}
+
+QVector<TimeSeriesStore::Bucket> &TimeSeriesStore::mutableBuckets(Resolution level)
+{
+    switch (level) {
+        case OneHour:
+            return hourBuckets;
+        case OneDay:
+            return dayBuckets;
+        case FiveMinutes:
+        case Raw:
+            break;
+    }
+    
+    return fiveMinuteBuckets;
+}
+
+void TimeSeriesStore::addToLevel(Resolution level, qint64 timestamp, double value)
+{
+    QVector<Bucket> &levelBuckets = mutableBuckets(level);
+    qint64 bucketStart = alignDown(timestamp, bucketWidth(level));
+    
+    if (levelBuckets.isEmpty() || levelBuckets.last().start < bucketStart) {
+        levelBuckets.append(makeBucket(bucketStart, value));
+        return;
+    }
+    
+    // A late sample goes into the bucket covering it, which is put in its
+    // place if there is none yet
+    int index = levelBuckets.size() - 1;
+    if (levelBuckets.last().start > bucketStart) {
+        index = bucketLowerBound(levelBuckets, bucketStart);
+        if (levelBuckets.at(index).start != bucketStart) {
+            levelBuckets.insert(index, makeBucket(bucketStart, value));
+            return;
+        }
+    }
+    
+    Bucket &bucket = levelBuckets[index];
+    bucket.min = qMin(bucket.min, value);
+    bucket.max = qMax(bucket.max, value);
+    bucket.sum += value;
+    bucket.count++;
+}
+
+void TimeSeriesStore::rebuildFirstBucket(Resolution level)
+{
+    QVector<Bucket> &levelBuckets = mutableBuckets(level);
+    if (levelBuckets.isEmpty() || samples.isEmpty()) {
+        return;
+    }
+    
+    // Samples are sorted and the first bucket starts at or before the first
+    // sample, so its contents are a prefix of the raw data
+    qint64 bucketEnd = levelBuckets.first().start + bucketWidth(level);
+    Bucket bucket = makeBucket(levelBuckets.first().start, samples.first().value);
+    
+    for (int i = 1; i < samples.size() && samples[i].timestamp < bucketEnd; ++i) {
+        bucket.min = qMin(bucket.min, samples[i].value);
+        bucket.max = qMax(bucket.max, samples[i].value);
+        bucket.sum += samples[i].value;
+        bucket.count++;
+    }
+    
+    levelBuckets.first() = bucket;
+}
@@ -0,0 +1,91 @@
+#ifndef TIMESERIESSTORE_H
+#define TIMESERIESSTORE_H
+
+#include <QDateTime>
+#include <QVector>
+#include <QPair>
+#include "historyview.h"
+
+// Time-ordered (timestamp, value) samples with min/max/mean summaries kept at
+// 5 minute, 1 hour and 1 day resolution. The summaries are updated as samples
+// are appended so long ranges can be drawn without touching every raw sample.
+// Copies are cheap: the underlying vectors are implicitly shared.
+class TimeSeriesStore
+{
+public:
+    enum Resolution {
+        Raw,
+        FiveMinutes,
+        OneHour,
+        OneDay
+    };
+    
+    struct Sample {
+        qint64 timestamp; // ms since epoch
+        double value;
+    };
+    
+    struct Bucket {
+        qint64 start;     // ms since epoch, aligned to the bucket width
+        double min;
+        double max;
+        double sum;
+        int count;
+        
+        double mean() const { return count > 0 ? sum / count : 0.0; }
+    };
+    
+    TimeSeriesStore();
+    
+    // Adding and removing samples
+    void append(qint64 timestamp, double value);
+    void append(const QDateTime &timestamp, double value);
+    void clear();
+    void removeBefore(qint64 timestamp);
+    void reserve(int size);
+    
+    // Raw sample access
+    int size() const { return samples.size(); }
+    bool isEmpty() const { return samples.isEmpty(); }
+    const Sample &at(int index) const { return samples.at(index); }
+    const Sample &last() const { return samples.last(); }
+    const QVector<Sample> &rawSamples() const { return samples; }
+    
+    // Samples in [start, end] without copying them (see HistoryView)
+    HistoryView<Sample> view(qint64 start, qint64 end) const;
+    
+    // Incremented by every change to the samples
+    quint64 epoch() const { return modifications; }
+    
+    // Index of the first sample at or after / strictly after the timestamp
+    int lowerBound(qint64 timestamp) const;
+    int upperBound(qint64 timestamp) const;
+    int countInRange(qint64 start, qint64 end) const;
+    
+    // Summary levels
+    const QVector<Bucket> &buckets(Resolution level) const;
+    static qint64 bucketWidth(Resolution level);
+    static int bucketLowerBound(const QVector<Bucket> &levelBuckets, qint64 timestamp);
+    
+    // Coarsest level that still gives at least one value per few pixels
+    Resolution levelForDensity(qint64 start, qint64 end, int pixels) const;
+    
+    // Exact min/max over [start, end] using hourly summaries for the interior
+    bool minMax(qint64 start, qint64 end, double &minValue, double &maxValue) const;
+    
+    // Conversion for existing QDateTime based callers
+    QVector<QPair<QDateTime, double>> toPairs(qint64 start, qint64 end) const;
+
+private:
+    QVector<Sample> samples;
+    QVector<Bucket> fiveMinuteBuckets;
+    QVector<Bucket> hourBuckets;
+    QVector<Bucket> dayBuckets;
+    quint64 modifications;
+    
+    QVector<Bucket> &mutableBuckets(Resolution level);
+    void addToLevel(Resolution level, qint64 timestamp, double value);
+    void rebuildFirstBucket(Resolution level);
+};
+
+#endif // TIMESERIESSTORE_H
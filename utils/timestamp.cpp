@@ -0,0 +1,55 @@
+#include "timestamp.h"
+#include <atomic>
+
+namespace {
+
+std::atomic<qint64> clockOffset{0};
+std::atomic<qint64> fixedTime{0};
+std::atomic<bool> fixedClock{false};
+
+}
+
+Timestamp SimulationClock::now()
+{
+    if (fixedClock.load(std::memory_order_acquire)) {
+        return Timestamp(fixedTime.load(std::memory_order_relaxed));
+    }
+    
+    return Timestamp(QDateTime::currentMSecsSinceEpoch() + clockOffset.load(std::memory_order_relaxed));
+}
+
+void SimulationClock::setOffset(qint64 msecs)
+{
+    clockOffset.store(msecs, std::memory_order_relaxed);
+}
+
+qint64 SimulationClock::offset()
+{
+    return clockOffset.load(std::memory_order_relaxed);
+}
+
+void SimulationClock::setFixedTime(Timestamp time)
+{
+    fixedTime.store(time.toMSecsSinceEpoch(), std::memory_order_relaxed);
+    fixedClock.store(true, std::memory_order_release);
+}
+
+bool SimulationClock::isFixed()
+{
+    return fixedClock.load(std::memory_order_acquire);
+}
+
+void SimulationClock::advance(qint64 msecs)
+{
+    if (fixedClock.load(std::memory_order_acquire)) {
+        fixedTime.fetch_add(msecs, std::memory_order_relaxed);
+    } else {
+        clockOffset.fetch_add(msecs, std::memory_order_relaxed);
+    }
+}
+
+void SimulationClock::reset()
+{
+    fixedClock.store(false, std::memory_order_release);
+    clockOffset.store(0, std::memory_order_relaxed);
+}
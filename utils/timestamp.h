@@ -0,0 +1,73 @@
+#ifndef TIMESTAMP_H
+#define TIMESTAMP_H
+
+#include <QDateTime>
+
+// Point in time as ms since the Unix epoch.
+//
+// Model and controller internals use this instead of QDateTime. It is a
+// single integer, so constructing, comparing and stepping it costs nothing
+// and never touches the time zone database. QDateTime is only built where
+// a value leaves the core: for display, signals to the UI and files.
+class Timestamp
+{
+public:
+    constexpr Timestamp() : ms(0) {}
+    constexpr explicit Timestamp(qint64 msecsSinceEpoch) : ms(msecsSinceEpoch) {}
+    
+    // Current simulation time (see SimulationClock)
+    static Timestamp now();
+    
+    static Timestamp fromDateTime(const QDateTime &dateTime) { return Timestamp(dateTime.toMSecsSinceEpoch()); }
+    QDateTime toDateTime() const { return QDateTime::fromMSecsSinceEpoch(ms); }
+    
+    constexpr qint64 toMSecsSinceEpoch() const { return ms; }
+    
+    constexpr Timestamp addMSecs(qint64 msecs) const { return Timestamp(ms + msecs); }
+    constexpr Timestamp addSecs(qint64 secs) const { return Timestamp(ms + secs * 1000); }
+    constexpr qint64 msecsTo(Timestamp other) const { return other.ms - ms; }
+    constexpr qint64 secsTo(Timestamp other) const { return (other.ms - ms) / 1000; }
+    
+    constexpr bool operator==(Timestamp other) const { return ms == other.ms; }
+    constexpr bool operator!=(Timestamp other) const { return ms != other.ms; }
+    constexpr bool operator<(Timestamp other) const { return ms < other.ms; }
+    constexpr bool operator<=(Timestamp other) const { return ms <= other.ms; }
+    constexpr bool operator>(Timestamp other) const { return ms > other.ms; }
+    constexpr bool operator>=(Timestamp other) const { return ms >= other.ms; }
+
+private:
+    qint64 ms;
+};
+
+Q_DECLARE_TYPEINFO(Timestamp, Q_PRIMITIVE_TYPE);
+
+// Source of "now" for the simulation.
+//
+// Runs on wall-clock time by default. An offset shifts simulated time, e.g.
+// to replay a scenario at a given time of day, and a fixed time stops the
+// clock entirely so benchmarks and replays are deterministic; advance()
+// then steps it. All calls are thread-safe.
+class SimulationClock
+{
+public:
+    static Timestamp now();
+    
+    static void setOffset(qint64 msecs);
+    static qint64 offset();
+    
+    static void setFixedTime(Timestamp time);
+    static bool isFixed();
+    
+    // Moves a fixed clock forward, or adds to the offset of a running one
+    static void advance(qint64 msecs);
+    
+    // Back to wall-clock time with no offset
+    static void reset();
+};
+
+inline Timestamp Timestamp::now()
+{
+    return SimulationClock::now();
+}
+
+#endif // TIMESTAMP_H
@@ -0,0 +1,300 @@
+#include "tracing.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QVector>
+
+std::atomic<bool> Tracer::enabled(false);
+
+namespace {
+
+// 64k events (2 MB) per thread is several minutes of the simulator's hot paths
+const int BufferCapacity = 1 << 16;
+
+struct TraceEvent {
+    const char *name;
+    const char *category;
+    qint64 startNs;
+    qint64 durationNs;
+};
+
+// Written only by its owning thread. A clear() never touches another
+// thread's buffer: the owner resets itself on its next event, storing the
+// new epoch before it overwrites any event. A reader therefore checks the
+// epoch before and after copying events[0, count), like a seqlock, and
+// discards the copy if the owner reset the buffer in between.
+struct ThreadBuffer {
+    int threadId;
+    QString threadName;
+    std::atomic<quint64> epoch;
+    std::atomic<int> count;
+    TraceEvent events[BufferCapacity];
+};
+
+// Events of a thread that has exited, kept until the next clear()
+struct RetiredEvents {
+    int threadId;
+    QString threadName;
+    quint64 epoch;
+    QVector<TraceEvent> events;
+};
+
+// The registry lock also keeps a buffer alive while it is being read, as
+// its thread can only free it after taking the lock
+QMutex registryMutex;
+QVector<ThreadBuffer *> registry;
+QVector<RetiredEvents> retired;
+int nextThreadId = 1;
+std::atomic<quint64> currentEpoch(1);
+std::atomic<qint64> dropped(0);
+
+void retireBuffer(ThreadBuffer *buffer);
+
+// Frees the thread's buffer when the thread exits
+struct LocalBuffer {
+    ThreadBuffer *buffer = nullptr;
+    
+    ~LocalBuffer()
+    {
+        if (buffer) {
+            retireBuffer(buffer);
+        }
+    }
+};
+
+thread_local LocalBuffer localBuffer;
+
+const QElapsedTimer &traceClock()
+{
+    static const QElapsedTimer timer = []() {
+        QElapsedTimer t;
+        t.start();
+        return t;
+    }();
+    return timer;
+}
+
+ThreadBuffer *threadBuffer()
+{
+    if (localBuffer.buffer) {
+        return localBuffer.buffer;
+    }
+    
+    ThreadBuffer *buffer = new ThreadBuffer;
+    buffer->epoch.store(currentEpoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+    buffer->count.store(0, std::memory_order_relaxed);
+    
+    QThread *thread = QThread::currentThread();
+    const bool isGuiThread = QCoreApplication::instance() && QCoreApplication::instance()->thread() == thread;
+    
+    QMutexLocker locker(&registryMutex);
+    buffer->threadId = nextThreadId++;
+    if (isGuiThread) {
+        buffer->threadName = "GUI";
+    } else if (thread && !thread->objectName().isEmpty()) {
+        buffer->threadName = thread->objectName();
+    } else {
+        buffer->threadName = QString("Worker %1").arg(buffer->threadId);
+    }
+    registry.append(buffer);
+    
+    localBuffer.buffer = buffer;
+    return buffer;
+}
+
+void retireBuffer(ThreadBuffer *buffer)
+{
+    const quint64 epoch = currentEpoch.load(std::memory_order_acquire);
+    
+    QMutexLocker locker(&registryMutex);
+    registry.removeOne(buffer);
+    
+    // Keep what the thread recorded since the last clear, but only up to
+    // one buffer's worth across all exited threads
+    int retiredCount = 0;
+    for (int i = retired.size() - 1; i >= 0; --i) {
+        if (retired.at(i).epoch != epoch) {
+            retired.removeAt(i);
+        } else {
+            retiredCount += retired.at(i).events.size();
+        }
+    }
+    
+    const int count = buffer->epoch.load(std::memory_order_relaxed) == epoch
+        ? buffer->count.load(std::memory_order_relaxed) : 0;
+    const int kept = qMin(count, BufferCapacity - retiredCount);
+    if (kept > 0) {
+        RetiredEvents events;
+        events.threadId = buffer->threadId;
+        events.threadName = buffer->threadName;
+        events.epoch = epoch;
+        events.events.reserve(kept);
+        for (int i = 0; i < kept; ++i) {
+            events.events.append(buffer->events[i]);
+        }
+        retired.append(events);
+    }
+    if (count > kept) {
+        dropped.fetch_add(count - kept, std::memory_order_relaxed);
+    }
+    
+    delete buffer;
+}
+
+void appendJsonString(QByteArray &out, const char *text)
+{
+    out += '"';
+    for (const char *c = text; *c; ++c) {
+        if (*c == '"' || *c == '\\') {
+            out += '\\';
+        }
+        out += *c;
+    }
+    out += '"';
+}
+
+// Each entry ends in a comma; the last one is chopped off
+void appendThreadName(QByteArray &out, const QByteArray &pid, const QByteArray &tid, const QString &threadName)
+{
+    out += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + pid + ",\"tid\":" + tid + ",\"args\":{\"name\":";
+    appendJsonString(out, threadName.toUtf8().constData());
+    out += "}},";
+}
+
+void appendEvent(QByteArray &out, const QByteArray &pid, const QByteArray &tid, const TraceEvent &event)
+{
+    out += "{\"name\":";
+    appendJsonString(out, event.name);
+    out += ",\"cat\":";
+    appendJsonString(out, event.category);
+    out += ",\"ph\":\"X\",\"pid\":" + pid + ",\"tid\":" + tid;
+    out += ",\"ts\":" + QByteArray::number(event.startNs / 1000.0, 'f', 3);
+    out += ",\"dur\":" + QByteArray::number(event.durationNs / 1000.0, 'f', 3);
+    out += "},";
+}
+
+}
+
+void Tracer::setEnabled(bool enable)
+{
+    // Start the clock before the first scope can read it
+    traceClock();
+    enabled.store(enable, std::memory_order_relaxed);
+}
+
+void Tracer::clear()
+{
+    currentEpoch.fetch_add(1, std::memory_order_acq_rel);
+    dropped.store(0, std::memory_order_relaxed);
+}
+
+qint64 Tracer::now()
+{
+    return traceClock().nsecsElapsed();
+}
+
+void Tracer::record(const char *name, const char *category, qint64 startNs, qint64 durationNs)
+{
+    ThreadBuffer *buffer = threadBuffer();
+    
+    // Lazily apply a clear() requested by another thread
+    const quint64 epoch = currentEpoch.load(std::memory_order_acquire);
+    if (buffer->epoch.load(std::memory_order_relaxed) != epoch) {
+        buffer->epoch.store(epoch, std::memory_order_relaxed);
+        buffer->count.store(0, std::memory_order_relaxed);
+        
+        // Readers must see the new epoch before any overwritten event
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+    
+    const int index = buffer->count.load(std::memory_order_relaxed);
+    if (index >= BufferCapacity) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    
+    TraceEvent &event = buffer->events[index];
+    event.name = name;
+    event.category = category;
+    event.startNs = startNs;
+    event.durationNs = durationNs;
+    
+    // Publish the event to readers
+    buffer->count.store(index + 1, std::memory_order_release);
+}
+
+QByteArray Tracer::toChromeTraceJson()
+{
+    const quint64 epoch = currentEpoch.load(std::memory_order_acquire);
+    const QByteArray pid = QByteArray::number(QCoreApplication::applicationPid());
+    
+    QByteArray json;
+    json.reserve(4096);
+    json += "{\"traceEvents\":[";
+    
+    QMutexLocker locker(&registryMutex);
+    
+    for (ThreadBuffer *buffer : registry) {
+        if (buffer->epoch.load(std::memory_order_acquire) != epoch) {
+            continue; // Nothing recorded since the last clear
+        }
+        
+        const int count = buffer->count.load(std::memory_order_acquire);
+        const QByteArray tid = QByteArray::number(buffer->threadId);
+        const int rollback = json.size();
+        
+        appendThreadName(json, pid, tid, buffer->threadName);
+        json.reserve(json.size() + count * 96);
+        for (int i = 0; i < count; ++i) {
+            appendEvent(json, pid, tid, buffer->events[i]);
+        }
+        
+        // The owner started over after a clear() while we were reading
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (buffer->epoch.load(std::memory_order_relaxed) != epoch) {
+            json.truncate(rollback);
+        }
+    }
+    
+    for (const RetiredEvents &thread : retired) {
+        if (thread.epoch != epoch) {
+            continue;
+        }
+        
+        const QByteArray tid = QByteArray::number(thread.threadId);
+        appendThreadName(json, pid, tid, thread.threadName);
+        for (const TraceEvent &event : thread.events) {
+            appendEvent(json, pid, tid, event);
+        }
+    }
+    
+    if (json.endsWith(',')) {
+        json.chop(1);
+    }
+    json += "],\"displayTimeUnit\":\"ms\"}";
+    return json;
+}
+
+bool Tracer::writeChromeTrace(const QString &filename)
+{
+    QFileInfo info(filename);
+    info.dir().mkpath(".");
+    
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    
+    const QByteArray json = toChromeTraceJson();
+    return file.write(json) == json.size();
+}
+
+qint64 Tracer::droppedEvents()
+{
+    return dropped.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,100 @@
+#ifndef TRACING_H
+#define TRACING_H
+
+#include <QString>
+#include <QByteArray>
+#include <atomic>
+
+// Lightweight scoped event tracing for the simulator hot paths.
+//
+// Each thread records complete ("X") events into its own fixed-size buffer,
+// so recording never takes a lock; only a thread's first event registers its
+// buffer. The buffer is freed when its thread exits, keeping a copy of the
+// events recorded since the last clear(). The collected events can be
+// written out as Chrome trace JSON and opened in chrome://tracing or
+// ui.perfetto.dev.
+//
+// Every scope also publishes its name as the thread's current scope, which
+// the stall monitor reads from its watchdog thread to see what the GUI
+// thread is stuck in. The slot is an inline thread_local and only its own
+// thread writes it, so when tracing is disabled a scope costs two plain
+// stores to it and one relaxed atomic load. Defining TSLIM_NO_TRACING
+// removes the TRACE_SCOPE macros entirely.
+class Tracer
+{
+public:
+    static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+    static void setEnabled(bool enable);
+    
+    // Drop everything recorded so far
+    static void clear();
+    
+    // Monotonic nanoseconds since the tracer was first used
+    static qint64 now();
+    
+    // Called by TraceScope; name and category must be string literals
+    static void record(const char *name, const char *category, qint64 startNs, qint64 durationNs);
+    
+    // Chrome trace event format ({"traceEvents": [...]})
+    static QByteArray toChromeTraceJson();
+    static bool writeChromeTrace(const QString &filename);
+    
+    // Number of events that did not fit in their thread's buffer
+    static qint64 droppedEvents();
+    
+    // Name of the innermost scope the calling thread is in (nullptr outside
+    // any scope). The pointer stays valid for the thread's lifetime and may
+    // be read from other threads.
+    static std::atomic<const char *> *currentScopeSlot() { return &currentScope; }
+
+private:
+    friend class TraceScope;
+    
+    static std::atomic<bool> enabled;
+    static inline thread_local std::atomic<const char *> currentScope{nullptr};
+};
+
+// Records the lifetime of the enclosing scope when tracing is enabled
+class TraceScope
+{
+public:
+    explicit TraceScope(const char *scopeName, const char *scopeCategory = "sim")
+        : parent(Tracer::currentScope.load(std::memory_order_relaxed)),
+          name(Tracer::isEnabled() ? scopeName : nullptr),
+          category(scopeCategory),
+          startNs(name ? Tracer::now() : 0)
+    {
+        // Only this thread writes its slot, so no read-modify-write is needed
+        Tracer::currentScope.store(scopeName, std::memory_order_release);
+    }
+    
+    ~TraceScope()
+    {
+        if (name) {
+            Tracer::record(name, category, startNs, Tracer::now() - startNs);
+        }
+        Tracer::currentScope.store(parent, std::memory_order_release);
+    }
+    
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+    const char *parent;
+    const char *name;
+    const char *category;
+    qint64 startNs;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#ifdef TSLIM_NO_TRACING
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_SCOPE_CAT(name, category) ((void)0)
+#else
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope_, __COUNTER__)(name)
+#define TRACE_SCOPE_CAT(name, category) TraceScope TRACE_CONCAT(traceScope_, __COUNTER__)(name, category)
+#endif
+
+#endif // TRACING_H
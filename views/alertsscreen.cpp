@@ -8,7 +8,6 @@
 #include <QGroupBox>
 #include <QScrollArea>
 #include <QMessageBox>
-#include <QSettings>
 #include <QDateTime>
 #include <QDir>
 
@@ -16,6 +15,8 @@ AlertsScreen::AlertsScreen(QWidget *parent) :
     QWidget(parent),
     ui(new Ui::AlertsScreen),
     alertController(nullptr),
+    reminderScheduler(nullptr),
+    settingsStore(nullptr),
     historyScreen(nullptr),
     dataStorage(nullptr)
 {
@@ -27,7 +28,7 @@ AlertsScreen::AlertsScreen(QWidget *parent) :
     // Connect signals to slots
     connectSignals();
     
-    // Load any saved settings
+    // Fill in the defaults; the saved settings come with setSettingsStore()
     loadSettings();
 }
 
@@ -59,6 +60,23 @@ void AlertsScreen::setAlertController(AlertController *controller)
     }
 }
 
+void AlertsScreen::setReminderScheduler(ReminderScheduler *scheduler)
+{
+    reminderScheduler = scheduler;
+    
+    if (reminderScheduler) {
+        // Reminders going off or changing elsewhere show up straight away
+        connect(reminderScheduler, &ReminderScheduler::remindersChanged, this, &AlertsScreen::updateReminders);
+        updateReminders();
+    }
+}
+
+void AlertsScreen::setSettingsStore(SettingsStore *store)
+{
+    settingsStore = store;
+    loadSettings();
+}
+
 void AlertsScreen::setHistoryScreen(HistoryScreen *screen)
 {
     historyScreen = screen;
@@ -465,134 +483,57 @@ void AlertsScreen::connectSignals()
 
 void AlertsScreen::loadSettings()
 {
-    // Load from QSettings
-    QSettings settings("TandemDiabetes", "tslimx2simulator");
-    
-    settings.beginGroup("Alerts");
+    // Defaults until the settings store is set
+    const AlertSettings settings = settingsStore ? settingsStore->alerts() : AlertSettings();
     
     // Load general settings
-    bool alertsEnabled = settings.value("AlertsEnabled", true).toBool();
-    enableAlertsCheckBox->setChecked(alertsEnabled);
+    enableAlertsCheckBox->setChecked(settings.alertsEnabled);
     
     // Load glucose thresholds
-    lowGlucoseSpinBox->setValue(settings.value("LowGlucoseThreshold", 3.9).toDouble());
-    highGlucoseSpinBox->setValue(settings.value("HighGlucoseThreshold", 10.0).toDouble());
-    urgentLowGlucoseSpinBox->setValue(settings.value("UrgentLowGlucoseThreshold", 3.1).toDouble());
-    urgentHighGlucoseSpinBox->setValue(settings.value("UrgentHighGlucoseThreshold", 13.9).toDouble());
+    lowGlucoseSpinBox->setValue(settings.lowGlucoseThreshold);
+    highGlucoseSpinBox->setValue(settings.highGlucoseThreshold);
+    urgentLowGlucoseSpinBox->setValue(settings.urgentLowGlucoseThreshold);
+    urgentHighGlucoseSpinBox->setValue(settings.urgentHighGlucoseThreshold);
     
     // Load insulin thresholds
-    lowInsulinSpinBox->setValue(settings.value("LowInsulinThreshold", 50.0).toDouble());
-    criticalInsulinSpinBox->setValue(settings.value("CriticalInsulinThreshold", 10.0).toDouble());
+    lowInsulinSpinBox->setValue(settings.lowInsulinThreshold);
+    criticalInsulinSpinBox->setValue(settings.criticalInsulinThreshold);
     
     // Load battery thresholds
-    lowBatterySpinBox->setValue(settings.value("LowBatteryThreshold", 20).toInt());
-    criticalBatterySpinBox->setValue(settings.value("CriticalBatteryThreshold", 5).toInt());
-    
-    // Load reminders
-    int reminderCount = settings.beginReadArray("Reminders");
-    reminders.clear();
-    for (int i = 0; i < reminderCount; ++i) {
-        settings.setArrayIndex(i);
-        Reminder reminder;
-        reminder.type = settings.value("Type").toString();
-        reminder.time = settings.value("Time").toDateTime();
-        reminder.acknowledged = settings.value("Acknowledged", false).toBool();
-        
-        // Only add future or unacknowledged reminders
-        if (reminder.time > QDateTime::currentDateTime() || !reminder.acknowledged) {
-            reminders.append(reminder);
-        }
-    }
-    settings.endArray();
-    
-    settings.endGroup();
-    
-    // Update the UI
-    updateReminders();
+    lowBatterySpinBox->setValue(settings.lowBatteryThreshold);
+    criticalBatterySpinBox->setValue(settings.criticalBatteryThreshold);
     
     // Update alert history
     updateAlertHistory();
-    
-    // Apply settings to the controller if it exists
-    if (alertController) {
-        alertController->enableAlerts(alertsEnabled);
-        
-        alertController->setGlucoseAlertThresholds(
-            lowGlucoseSpinBox->value(),
-            highGlucoseSpinBox->value(),
-            urgentLowGlucoseSpinBox->value(),
-            urgentHighGlucoseSpinBox->value()
-        );
-        
-        alertController->setInsulinAlertThresholds(
-            lowInsulinSpinBox->value(),
-            criticalInsulinSpinBox->value()
-        );
-        
-        alertController->setBatteryAlertThresholds(
-            lowBatterySpinBox->value(),
-            criticalBatterySpinBox->value()
-        );
-    }
 }
 
 void AlertsScreen::saveSettings()
 {
-    // Save to QSettings
-    QSettings settings("TandemDiabetes", "tslimx2simulator");
+    if (!settingsStore) {
+        return;
+    }
     
-    settings.beginGroup("Alerts");
+    AlertSettings settings;
     
     // Save general settings
-    settings.setValue("AlertsEnabled", enableAlertsCheckBox->isChecked());
+    settings.alertsEnabled = enableAlertsCheckBox->isChecked();
     
     // Save glucose thresholds
-    settings.setValue("LowGlucoseThreshold", lowGlucoseSpinBox->value());
-    settings.setValue("HighGlucoseThreshold", highGlucoseSpinBox->value());
-    settings.setValue("UrgentLowGlucoseThreshold", urgentLowGlucoseSpinBox->value());
-    settings.setValue("UrgentHighGlucoseThreshold", urgentHighGlucoseSpinBox->value());
+    settings.lowGlucoseThreshold = lowGlucoseSpinBox->value();
+    settings.highGlucoseThreshold = highGlucoseSpinBox->value();
+    settings.urgentLowGlucoseThreshold = urgentLowGlucoseSpinBox->value();
+    settings.urgentHighGlucoseThreshold = urgentHighGlucoseSpinBox->value();
     
     // Save insulin thresholds
-    settings.setValue("LowInsulinThreshold", lowInsulinSpinBox->value());
-    settings.setValue("CriticalInsulinThreshold", criticalInsulinSpinBox->value());
+    settings.lowInsulinThreshold = lowInsulinSpinBox->value();
+    settings.criticalInsulinThreshold = criticalInsulinSpinBox->value();
     
     // Save battery thresholds
-    settings.setValue("LowBatteryThreshold", lowBatterySpinBox->value());
-    settings.setValue("CriticalBatteryThreshold", criticalBatterySpinBox->value());
-    
-    // Save reminders
-    settings.beginWriteArray("Reminders");
-    for (int i = 0; i < reminders.size(); ++i) {
-        settings.setArrayIndex(i);
-        settings.setValue("Type", reminders[i].type);
-        settings.setValue("Time", reminders[i].time);
-        settings.setValue("Acknowledged", reminders[i].acknowledged);
-    }
-    settings.endArray();
+    settings.lowBatteryThreshold = lowBatterySpinBox->value();
+    settings.criticalBatteryThreshold = criticalBatterySpinBox->value();
     
-    settings.endGroup();
-    
-    // Apply settings to controller
-    if (alertController) {
-        alertController->enableAlerts(enableAlertsCheckBox->isChecked());
-        
-        alertController->setGlucoseAlertThresholds(
-            lowGlucoseSpinBox->value(),
-            highGlucoseSpinBox->value(),
-            urgentLowGlucoseSpinBox->value(),
-            urgentHighGlucoseSpinBox->value()
-        );
-        
-        alertController->setInsulinAlertThresholds(
-            lowInsulinSpinBox->value(),
-            criticalInsulinSpinBox->value()
-        );
-        
-        alertController->setBatteryAlertThresholds(
-            lowBatterySpinBox->value(),
-            criticalBatterySpinBox->value()
-        );
-    }
+    // The pump controller applies them to the alert controller
+    settingsStore->setAlerts(settings);
 }
 
 void AlertsScreen::updateActiveAlerts()
@@ -697,23 +638,23 @@ void AlertsScreen::updateReminders()
 {
     remindersList->clear();
     
-    // Sort reminders by time
-    std::sort(reminders.begin(), reminders.end(), [](const Reminder &a, const Reminder &b) {
-        return a.time < b.time;
-    });
+    // Already sorted by time
+    reminders = reminderScheduler ? reminderScheduler->getReminders()
+                                  : QVector<ReminderScheduler::Reminder>();
+    const Timestamp now = Timestamp::now();
     
     // Add reminders to list
     for (const auto &reminder : reminders) {
-        QString displayText = reminder.type + " - " + reminder.time.toString("yyyy-MM-dd hh:mm AP");
+        QString displayText = reminder.type + " - " + reminder.time.toDateTime().toString("yyyy-MM-dd hh:mm AP");
         
         QListWidgetItem *item = new QListWidgetItem(displayText);
         
         // Style based on whether the reminder is due or acknowledged
         if (reminder.acknowledged) {
             item->setForeground(QColor(128, 128, 128)); // Gray for acknowledged
-        } else if (reminder.time <= QDateTime::currentDateTime()) {
+        } else if (reminder.time <= now) {
             item->setForeground(QColor(255, 59, 48)); // Red for overdue
-        } else if (reminder.time.addSecs(-24 * 60 * 60) <= QDateTime::currentDateTime()) {
+        } else if (reminder.time.addSecs(-24 * 60 * 60) <= now) {
             item->setForeground(QColor(255, 149, 0)); // Orange for due soon (within 24 hours)
         } else {
             item->setForeground(QColor(0, 122, 255)); // Blue for future
@@ -728,21 +669,17 @@ void AlertsScreen::updateReminders()
 
 void AlertsScreen::addReminder(const QString &type, const QDateTime &time)
 {
-    Reminder reminder;
-    reminder.type = type;
-    reminder.time = time;
-    reminder.acknowledged = false;
+    if (!reminderScheduler) {
+        return;
+    }
     
-    reminders.append(reminder);
-    updateReminders();
+    // The scheduler saves it and refreshes the list (remindersChanged)
+    reminderScheduler->addReminder(type, Timestamp::fromDateTime(time));
     
     // Check if we need to show an alert for this
-    if (time <= QDateTime::currentDateTime() && alertController) {
+    if (Timestamp::fromDateTime(time) <= Timestamp::now() && alertController) {
         alertController->addAlert("Reminder: " + type, PumpModel::Warning);
     }
-    
-    // Save reminders to settings
-    saveSettings();
 }
 
 void AlertsScreen::onBackButtonClicked()
@@ -841,9 +778,9 @@ void AlertsScreen::onDeleteReminderButtonClicked()
         );
         
         if (reply == QMessageBox::Yes) {
-            reminders.remove(selectedRow);
-            updateReminders();
-            saveSettings();
+            if (reminderScheduler) {
+                reminderScheduler->removeReminder(reminders[selectedRow].id);
+            }
         }
     }
 }
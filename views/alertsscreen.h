@@ -17,6 +17,8 @@
 #include "../controllers/alertcontroller.h"
 #include "../models/pumpmodel.h"
 #include "../utils/datastorage.h"  // Added for DataStorage
+#include "../utils/reminderscheduler.h"
+#include "../utils/settingsstore.h"
 
 // Forward declaration
 class HistoryScreen;
@@ -34,6 +36,8 @@ public:
     ~AlertsScreen();
     
     void setAlertController(AlertController *controller);
+    void setReminderScheduler(ReminderScheduler *scheduler);
+    void setSettingsStore(SettingsStore *store);
     void updateActiveAlerts();
 
     // Add these new methods
@@ -71,6 +75,8 @@ private slots:
 private:
     Ui::AlertsScreen *ui;
     AlertController *alertController;
+    ReminderScheduler *reminderScheduler;
+    SettingsStore *settingsStore;
     HistoryScreen *historyScreen;  // Added member variable
     DataStorage *dataStorage;      // Added member variable
     
@@ -142,13 +148,8 @@ private:
     void updateReminders();
     void addReminder(const QString &type, const QDateTime &time);
     
-    struct Reminder {
-        QString type;
-        QDateTime time;
-        bool acknowledged;
-    };
-    
-    QVector<Reminder> reminders;
+    // As last shown in remindersList, in the same order
+    QVector<ReminderScheduler::Reminder> reminders;
 };
 
 #endif // ALERTSSCREEN_H
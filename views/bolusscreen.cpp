@@ -227,11 +227,11 @@ void BolusScreen::updateCurrentValues(PumpController *controller)
     // Get current basal rate
     currentBasalRate = controller->getCurrentBasalRate();
     
-    // Get profile settings from controller
-    Profile activeProfile = controller->getActiveProfile();
-    carbRatio = activeProfile.carbRatio;
-    correctionFactor = activeProfile.correctionFactor;
-    targetGlucose = activeProfile.targetGlucose;
+    // Get the profile settings for this time of day from controller
+    ProfileSchedule::Slot settings = controller->getScheduledSettings();
+    carbRatio = settings.carbRatio;
+    correctionFactor = settings.correctionFactor;
+    targetGlucose = settings.targetGlucose;
     
     // Reset carbs and bolus
     carbsSpinBox->setValue(0.0);
@@ -6,11 +6,16 @@
 #include <QtMath>
 #include <algorithm>
 #include <QPainterPath>
+#include <QPolygon>
 #include <QMenu>
 #include <QAction>
+#include "../utils/tracing.h"
+#include "../utils/metrics.h"
 
 GraphView::GraphView(QWidget *parent)
     : QWidget(parent),
+      glucoseData(&ownedGlucose),
+      drawnGlucoseEpoch(0),
       displayType(GlucoseData),
       targetLow(3.9),
       targetHigh(10.0),
@@ -34,13 +39,41 @@ GraphView::GraphView(QWidget *parent)
 
 void GraphView::setGlucoseData(const QVector<QPair<QDateTime, double>> &data)
 {
-    glucoseData = data;
+    ownedGlucose.clear();
+    ownedGlucose.reserve(data.size());
+    for (const auto &point : data) {
+        ownedGlucose.append(point.first, point.second);
+    }
+    glucoseData = &ownedGlucose;
     update();
 }
 
 void GraphView::setInsulinData(const QVector<QPair<QDateTime, double>> &data)
 {
-    insulinData = data;
+    insulinData.clear();
+    insulinData.reserve(data.size());
+    for (const auto &point : data) {
+        insulinData.append(point.first, point.second);
+    }
+    update();
+}
+
+void GraphView::setGlucoseSeries(const TimeSeriesStore *series)
+{
+    if (!series) {
+        ownedGlucose.clear();
+        series = &ownedGlucose;
+    } else if (series == glucoseData && series->epoch() == drawnGlucoseEpoch) {
+        return;
+    }
+    
+    glucoseData = series;
+    update();
+}
+
+void GraphView::setInsulinSeries(const TimeSeriesStore &series)
+{
+    insulinData = series;
     update();
 }
 
@@ -104,7 +137,11 @@ QSize GraphView::minimumSizeHint() const
 
 void GraphView::paintEvent(QPaintEvent *event)
 {
+    TRACE_SCOPE("GraphView::paintEvent");
+    static LatencyHistogram *paintTime = Metrics::histogram("graph.paint_ns");
+    LatencyTimer paintTimer(paintTime);
     Q_UNUSED(event);
+    drawnGlucoseEpoch = glucoseData->epoch();
     // Draw base widget
     QStyleOption opt;
     opt.init(this);
@@ -135,8 +172,8 @@ void GraphView::paintEvent(QPaintEvent *event)
     drawTimeAxis(painter, rect);
     
     if (displayType == GlucoseData || displayType == CombinedData) {
-        double minValue = qMin(2.0, findMinValue(glucoseData));
-        double maxValue = qMax(20.0, findMaxValue(glucoseData));
+        double minValue = qMin(2.0, findMinValue(*glucoseData));
+        double maxValue = qMax(20.0, findMaxValue(*glucoseData));
         drawValueAxis(painter, rect, minValue, maxValue);
     } else {
         double maxValue = qMax(5.0, findMaxValue(insulinData) * 1.2);
@@ -152,37 +189,72 @@ void GraphView::paintEvent(QPaintEvent *event)
 
 void GraphView::drawGlucoseGraph(QPainter &painter, const QRect &rect)
 {
-    if (glucoseData.isEmpty()) {
+    if (glucoseData->isEmpty()) {
         drawNoDataMessage(painter, rect);
         return;
     }
     
     // Find min and max values (with reasonable defaults)
-    double minValue = qMin(2.0, findMinValue(glucoseData));
-    double maxValue = qMax(20.0, findMaxValue(glucoseData));
+    double minValue = qMin(2.0, findMinValue(*glucoseData));
+    double maxValue = qMax(20.0, findMaxValue(*glucoseData));
     
     // Draw target range
     drawTargetRange(painter, rect, minValue, maxValue);
     
-    // Sort data by timestamp to ensure correct order
-    auto sortedData = glucoseData;
-    std::sort(sortedData.begin(), sortedData.end(), 
-             [](const QPair<QDateTime, double> &a, const QPair<QDateTime, double> &b) {
-                 return a.first < b.first;
-             });
+    const qint64 startMs = rangeStart.toMSecsSinceEpoch();
+    const qint64 endMs = rangeEnd.toMSecsSinceEpoch();
+    
+    // Long ranges are drawn from the summary level matching the pixel
+    // density: a min/max band with the mean as the line
+    TimeSeriesStore::Resolution level = glucoseData->levelForDensity(startMs, endMs, rect.width());
+    if (level != TimeSeriesStore::Raw) {
+        const QVector<TimeSeriesStore::Bucket> &buckets = glucoseData->buckets(level);
+        const qint64 width = TimeSeriesStore::bucketWidth(level);
+        int first = TimeSeriesStore::bucketLowerBound(buckets, startMs - width + 1);
+        
+        QPolygon upper;
+        QPolygon lower;
+        QPainterPath meanPath;
+        
+        for (int i = first; i < buckets.size() && buckets[i].start <= endMs; ++i) {
+            const TimeSeriesStore::Bucket &bucket = buckets[i];
+            int x = timeToX(bucket.start + width / 2, rect);
+            
+            upper.append(QPoint(x, valueToY(bucket.max, rect, minValue, maxValue)));
+            lower.prepend(QPoint(x, valueToY(bucket.min, rect, minValue, maxValue)));
+            
+            int meanY = valueToY(bucket.mean(), rect, minValue, maxValue);
+            if (meanPath.elementCount() == 0) {
+                meanPath.moveTo(x, meanY);
+            } else {
+                meanPath.lineTo(x, meanY);
+            }
+        }
+        
+        painter.save();
+        painter.setClipRect(rect);
+        painter.setPen(Qt::NoPen);
+        painter.setBrush(QColor(0, 178, 255, 60));
+        upper += lower;
+        painter.drawPolygon(upper);
+        painter.setPen(QPen(QColor(0, 178, 255), 2));
+        painter.setBrush(Qt::NoBrush);
+        painter.drawPath(meanPath);
+        painter.restore();
+        return;
+    }
+    
+    int first = glucoseData->lowerBound(startMs);
+    int last = glucoseData->upperBound(endMs);
     
     // Draw glucose line
     QPainterPath path;
     bool firstPoint = true;
     
-    for (const auto &point : sortedData) {
-        // Skip points outside the time range
-        if (point.first < rangeStart || point.first > rangeEnd) {
-            continue;
-        }
-        
-        int x = timeToX(point.first, rect);
-        int y = valueToY(point.second, rect, minValue, maxValue);
+    for (int i = first; i < last; ++i) {
+        const TimeSeriesStore::Sample &point = glucoseData->at(i);
+        int x = timeToX(point.timestamp, rect);
+        int y = valueToY(point.value, rect, minValue, maxValue);
         
         if (firstPoint) {
             path.moveTo(x, y);
@@ -197,20 +269,16 @@ void GraphView::drawGlucoseGraph(QPainter &painter, const QRect &rect)
     painter.drawPath(path);
     
     // Draw points
-    for (const auto &point : sortedData) {
-        // Skip points outside the time range
-        if (point.first < rangeStart || point.first > rangeEnd) {
-            continue;
-        }
-        
-        int x = timeToX(point.first, rect);
-        int y = valueToY(point.second, rect, minValue, maxValue);
+    for (int i = first; i < last; ++i) {
+        const TimeSeriesStore::Sample &point = glucoseData->at(i);
+        int x = timeToX(point.timestamp, rect);
+        int y = valueToY(point.value, rect, minValue, maxValue);
         
         // Different colors based on range
         QColor pointColor;
-        if (point.second < targetLow) {
+        if (point.value < targetLow) {
             pointColor = QColor(255, 59, 48); // Red for low
-        } else if (point.second > targetHigh) {
+        } else if (point.value > targetHigh) {
             pointColor = QColor(255, 149, 0); // Orange for high
         } else {
             pointColor = QColor(0, 178, 255); // Blue for in-range
@@ -221,8 +289,8 @@ void GraphView::drawGlucoseGraph(QPainter &painter, const QRect &rect)
         painter.drawEllipse(QPoint(x, y), 3, 3);
         
         // For latest point, draw a label with the current value
-        if (point.first == sortedData.last().first) {
-            QString valueLabel = QString::number(point.second, 'f', 1);
+        if (i == glucoseData->size() - 1) {
+            QString valueLabel = QString::number(point.value, 'f', 1);
             QRect textRect(x + 5, y - 10, 50, 20);
             painter.drawText(textRect, Qt::AlignLeft | Qt::AlignVCenter, valueLabel);
         }
@@ -239,38 +307,11 @@ void GraphView::drawInsulinGraph(QPainter &painter, const QRect &rect)
     // Find max value (min is always 0 for insulin)
     double maxValue = qMax(5.0, findMaxValue(insulinData) * 1.2);
     
-    // Sort data by timestamp
-    auto sortedData = insulinData;
-    std::sort(sortedData.begin(), sortedData.end(), 
-             [](const QPair<QDateTime, double> &a, const QPair<QDateTime, double> &b) {
-                 return a.first < b.first;
-             });
-    
     // Draw insulin bars
     painter.setPen(QPen(QColor(0, 122, 255), 1));
     painter.setBrush(QColor(0, 122, 255, 180));
     
-    for (const auto &point : sortedData) {
-        // Skip points outside the time range
-        if (point.first < rangeStart || point.first > rangeEnd) {
-            continue;
-        }
-        
-        int x = timeToX(point.first, rect);
-        int y = valueToY(point.second, rect, 0.0, maxValue);
-        int zeroY = valueToY(0.0, rect, 0.0, maxValue);
-        
-        // Draw a bar from zero to value
-        QRect barRect(x - 4, y, 8, zeroY - y);
-        painter.drawRect(barRect);
-        
-        // For latest point, draw a label with the current value
-        if (point.first == sortedData.last().first) {
-            QString valueLabel = QString::number(point.second, 'f', 1) + " u";
-            QRect textRect(x + 5, y - 10, 50, 20);
-            painter.drawText(textRect, Qt::AlignLeft | Qt::AlignVCenter, valueLabel);
-        }
-    }
+    drawInsulinBars(painter, rect, maxValue, false);
 }
 
 void GraphView::drawCombinedGraph(QPainter &painter, const QRect &rect)
@@ -282,29 +323,62 @@ void GraphView::drawCombinedGraph(QPainter &painter, const QRect &rect)
     if (!insulinData.isEmpty()) {
         double maxInsulin = qMax(5.0, findMaxValue(insulinData) * 1.2);
         
-        // Sort data by timestamp
-        auto sortedData = insulinData;
-        std::sort(sortedData.begin(), sortedData.end(), 
-                 [](const QPair<QDateTime, double> &a, const QPair<QDateTime, double> &b) {
-                     return a.first < b.first;
-                 });
-        
         painter.setPen(QPen(QColor(0, 122, 255, 150), 1));
         painter.setBrush(QColor(0, 122, 255, 100));
         
-        for (const auto &point : sortedData) {
-            // Skip points outside the time range
-            if (point.first < rangeStart || point.first > rangeEnd) {
-                continue;
-            }
-            
-            int x = timeToX(point.first, rect);
-            // Scale insulin values to fit in the bottom third of the graph
-            double scaledValue = point.second / maxInsulin * (rect.height() / 3.0);
+        drawInsulinBars(painter, rect, maxInsulin, true);
+    }
+}
+
+void GraphView::drawInsulinBars(QPainter &painter, const QRect &rect, double maxValue, bool scaled)
+{
+    const qint64 startMs = rangeStart.toMSecsSinceEpoch();
+    const qint64 endMs = rangeEnd.toMSecsSinceEpoch();
+    
+    // Bar height for a value: full scale on the insulin graph, the bottom
+    // third of the plot when overlaid on glucose
+    auto barTop = [&](double value) {
+        if (scaled) {
+            double scaledValue = value / maxValue * (rect.height() / 3.0);
             int barHeight = qMin(rect.height() / 3, static_cast<int>(scaledValue * rect.height()));
+            return rect.bottom() - barHeight;
+        }
+        return valueToY(value, rect, 0.0, maxValue);
+    };
+    int zeroY = scaled ? rect.bottom() : valueToY(0.0, rect, 0.0, maxValue);
+    
+    // At coarse levels one bar per bucket, as tall as the largest delivery in it
+    TimeSeriesStore::Resolution level = insulinData.levelForDensity(startMs, endMs, rect.width());
+    if (level != TimeSeriesStore::Raw) {
+        const QVector<TimeSeriesStore::Bucket> &buckets = insulinData.buckets(level);
+        const qint64 width = TimeSeriesStore::bucketWidth(level);
+        
+        for (int i = TimeSeriesStore::bucketLowerBound(buckets, startMs - width + 1);
+             i < buckets.size() && buckets[i].start <= endMs; ++i) {
+            int left = timeToX(buckets[i].start, rect);
+            int right = timeToX(buckets[i].start + width, rect);
+            int y = barTop(buckets[i].max);
             
-            QRect barRect(x - 4, rect.bottom() - barHeight, 8, barHeight);
-            painter.drawRect(barRect);
+            painter.drawRect(QRect(left, y, qMax(1, right - left - 1), zeroY - y));
+        }
+        return;
+    }
+    
+    int last = insulinData.upperBound(endMs);
+    for (int i = insulinData.lowerBound(startMs); i < last; ++i) {
+        const TimeSeriesStore::Sample &point = insulinData.at(i);
+        int x = timeToX(point.timestamp, rect);
+        int y = barTop(point.value);
+        
+        // Draw a bar from zero to value
+        QRect barRect(x - 4, y, 8, zeroY - y);
+        painter.drawRect(barRect);
+        
+        // For latest point, draw a label with the current value
+        if (!scaled && i == insulinData.size() - 1) {
+            QString valueLabel = QString::number(point.value, 'f', 1) + " u";
+            QRect textRect(x + 5, y - 10, 50, 20);
+            painter.drawText(textRect, Qt::AlignLeft | Qt::AlignVCenter, valueLabel);
         }
     }
 }
@@ -444,8 +518,8 @@ void GraphView::drawGridLines(QPainter &painter, const QRect &rect)
         min = 0.0;
         max = qMax(5.0, findMaxValue(insulinData) * 1.2);
     } else {
-        min = qMin(2.0, findMinValue(glucoseData));
-        max = qMax(20.0, findMaxValue(glucoseData));
+        min = qMin(2.0, findMinValue(*glucoseData));
+        max = qMax(20.0, findMaxValue(*glucoseData));
     }
     
     double range = max - min;
@@ -546,6 +620,18 @@ int GraphView::timeToX(const QDateTime &time, const QRect &rect) const
     return rect.left() + qRound(timeRatio * rect.width());
 }
 
+int GraphView::timeToX(qint64 msecs, const QRect &rect) const
+{
+    qint64 startMs = rangeStart.toMSecsSinceEpoch();
+    qint64 spanMs = rangeEnd.toMSecsSinceEpoch() - startMs;
+    if (spanMs == 0) {
+        return rect.left();
+    }
+    
+    double timeRatio = static_cast<double>(msecs - startMs) / spanMs;
+    return rect.left() + qRound(timeRatio * rect.width());
+}
+
 int GraphView::valueToY(double value, const QRect &rect, double min, double max) const
 {
     if (min == max) {
@@ -578,38 +664,28 @@ double GraphView::yToValue(int y, const QRect &rect, double min, double max) con
     return min + yRatio * (max - min);
 }
 
-double GraphView::findMinValue(const QVector<QPair<QDateTime, double>> &data) const
+double GraphView::findMinValue(const TimeSeriesStore &data) const
 {
-    if (data.isEmpty()) {
-        return 0.0;
-    }
+    double minValue;
+    double maxValue;
     
-    double minValue = std::numeric_limits<double>::max();
-    
-    for (const auto &point : data) {
-        if (point.first >= rangeStart && point.first <= rangeEnd) {
-            minValue = qMin(minValue, point.second);
-        }
+    if (!data.minMax(rangeStart.toMSecsSinceEpoch(), rangeEnd.toMSecsSinceEpoch(), minValue, maxValue)) {
+        return 0.0;
     }
     
-    return minValue == std::numeric_limits<double>::max() ? 0.0 : minValue;
+    return minValue;
 }
 
-double GraphView::findMaxValue(const QVector<QPair<QDateTime, double>> &data) const
+double GraphView::findMaxValue(const TimeSeriesStore &data) const
 {
-    if (data.isEmpty()) {
-        return 10.0;
-    }
-    
-    double maxValue = std::numeric_limits<double>::lowest();
+    double minValue;
+    double maxValue;
     
-    for (const auto &point : data) {
-        if (point.first >= rangeStart && point.first <= rangeEnd) {
-            maxValue = qMax(maxValue, point.second);
-        }
+    if (!data.minMax(rangeStart.toMSecsSinceEpoch(), rangeEnd.toMSecsSinceEpoch(), minValue, maxValue)) {
+        return 10.0;
     }
     
-    return maxValue == std::numeric_limits<double>::lowest() ? 10.0 : maxValue;
+    return maxValue;
 }
 
 void GraphView::mousePressEvent(QMouseEvent *event)
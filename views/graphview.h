@@ -5,6 +5,7 @@
 #include <QDateTime>
 #include <QVector>
 #include <QPair>
+#include "../utils/timeseriesstore.h"
 
 class GraphView : public QWidget
 {
@@ -21,6 +22,11 @@ public:
     
     void setGlucoseData(const QVector<QPair<QDateTime, double>> &data);
     void setInsulinData(const QVector<QPair<QDateTime, double>> &data);
+    // Draws the given store in place instead of copying it, so the store
+    // must outlive the view or be replaced first; a repaint is only queued
+    // when the store changed since it was last drawn
+    void setGlucoseSeries(const TimeSeriesStore *series);
+    void setInsulinSeries(const TimeSeriesStore &series);
     void setTimeRange(const QDateTime &start, const QDateTime &end);
     void setTimeRangeHours(int hours);
     int getTimeRangeHours() const;
@@ -47,8 +53,10 @@ protected:
     void wheelEvent(QWheelEvent *event) override;
     
 private:
-    QVector<QPair<QDateTime, double>> glucoseData;
-    QVector<QPair<QDateTime, double>> insulinData;
+    const TimeSeriesStore *glucoseData;  // ownedGlucose or a model's store
+    TimeSeriesStore ownedGlucose;        // Readings passed in as pairs
+    quint64 drawnGlucoseEpoch;
+    TimeSeriesStore insulinData;
     QDateTime rangeStart;
     QDateTime rangeEnd;
     DataType displayType;
@@ -70,16 +78,18 @@ private:
     void drawCurrentTimeMarker(QPainter &painter, const QRect &rect);
     void drawTimelineDisplay(QPainter &painter, const QRect &rect);
     void drawNoDataMessage(QPainter &painter, const QRect &rect);
+    void drawInsulinBars(QPainter &painter, const QRect &rect, double maxValue, bool scaled);
     
     // Utility methods
     int timeToX(const QDateTime &time, const QRect &rect) const;
+    int timeToX(qint64 msecs, const QRect &rect) const;
     int valueToY(double value, const QRect &rect, double min, double max) const;
     QDateTime xToTime(int x, const QRect &rect) const;
     double yToValue(int y, const QRect &rect, double min, double max) const;
     
     // Finding min/max values in data
-    double findMinValue(const QVector<QPair<QDateTime, double>> &data) const;
-    double findMaxValue(const QVector<QPair<QDateTime, double>> &data) const;
+    double findMinValue(const TimeSeriesStore &data) const;
+    double findMaxValue(const TimeSeriesStore &data) const;
 };
 
 #endif // GRAPHVIEW_H
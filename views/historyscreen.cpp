@@ -14,11 +14,17 @@
 #include <QLabel>
 #include <QGroupBox>
 #include <QRadioButton>
+#include <QFileDialog>
+#include <QMessageBox>
+#include "../utils/tracing.h"
 
 HistoryScreen::HistoryScreen(QWidget *parent) :
     QWidget(parent),
     ui(new Ui::HistoryScreen),
-    pumpController(nullptr)
+    pumpController(nullptr),
+    glucoseTableModel(new GlucoseHistoryTableModel(this)),
+    insulinTableModel(new InsulinHistoryTableModel(this)),
+    queryRunner(new HistoryQueryRunner(this))
 {
     ui->setupUi(this);
     
@@ -27,6 +33,11 @@ HistoryScreen::HistoryScreen(QWidget *parent) :
     
     // Connect signals to slots
     connectSignals();
+    
+    // Insulin history, Control-IQ decisions and alerts are gathered in the
+    // background and arrive here
+    connect(queryRunner, &HistoryQueryRunner::insulinHistoryReady, this, &HistoryScreen::onInsulinHistoryReady);
+    connect(queryRunner, &HistoryQueryRunner::eventHistoryReady, this, &HistoryScreen::onEventHistoryReady);
 }
 
 HistoryScreen::~HistoryScreen()
@@ -38,6 +49,10 @@ void HistoryScreen::setPumpController(PumpController *controller)
 {
     pumpController = controller;
     
+    // The glucose table reads the controller's series in place; find its
+    // range again whenever a reading changes the series
+    connect(pumpController, &PumpController::glucoseLevelChanged, glucoseTableModel, &GlucoseHistoryTableModel::refresh);
+    
     // Initialize date range
     QDateTime endDate = QDateTime::currentDateTime();
     QDateTime startDate = endDate.addDays(-7); // Default to 7 days of history
@@ -115,6 +130,13 @@ void HistoryScreen::setupUi()
     );
     connect(updateButton, &QPushButton::clicked, this, &HistoryScreen::updateHistoryData);
     
+    QPushButton *exportButton = new QPushButton("Export");
+    exportButton->setStyleSheet(
+        "QPushButton { background-color: #333333; color: white; font-weight: bold; border-radius: 3px; padding: 5px 15px; }"
+        "QPushButton:pressed { background-color: #444444; }"
+    );
+    connect(exportButton, &QPushButton::clicked, this, &HistoryScreen::exportHistory);
+    
     // Quick selection buttons
     QPushButton *today = new QPushButton("Today");
     QPushButton *day3 = new QPushButton("3 Days");
@@ -142,6 +164,7 @@ void HistoryScreen::setupUi()
     dateRangeLayout->addWidget(toLabel);
     dateRangeLayout->addWidget(toDateEdit, 1);
     dateRangeLayout->addWidget(updateButton);
+    dateRangeLayout->addWidget(exportButton);
     
     QVBoxLayout *dateGroupLayout = new QVBoxLayout();
     dateGroupLayout->addLayout(dateRangeLayout);
@@ -159,29 +182,15 @@ void HistoryScreen::setupUi()
         "QTabBar::tab:hover { background-color: #2a2a2a; }"
     );
     
-    // Create glucose table
-    glucoseTable = new QTableWidget();
-    glucoseTable->setColumnCount(3);
-    glucoseTable->setHorizontalHeaderLabels(QStringList() << "Time" << "Glucose (mmol/L)" << "Trend");
-    glucoseTable->setStyleSheet(
-        "QTableWidget { background-color: #333333; color: white; gridline-color: #444444; }"
-        "QHeaderView::section { background-color: #444444; color: white; padding: 4px; border: 1px solid #555555; }"
-        "QTableWidget::item { padding: 4px; }"
-    );
-    glucoseTable->horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
-    glucoseTable->verticalHeader()->setVisible(false);
+    // Create glucose table (model/view, rows are only formatted when visible)
+    glucoseTable = new QTableView();
+    glucoseTable->setModel(glucoseTableModel);
+    setupHistoryTableView(glucoseTable);
     
     // Create insulin table
-    insulinTable = new QTableWidget();
-    insulinTable->setColumnCount(3);
-    insulinTable->setHorizontalHeaderLabels(QStringList() << "Time" << "Type" << "Units");
-    insulinTable->setStyleSheet(
-        "QTableWidget { background-color: #333333; color: white; gridline-color: #444444; }"
-        "QHeaderView::section { background-color: #444444; color: white; padding: 4px; border: 1px solid #555555; }"
-        "QTableWidget::item { padding: 4px; }"
-    );
-    insulinTable->horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
-    insulinTable->verticalHeader()->setVisible(false);
+    insulinTable = new QTableView();
+    insulinTable->setModel(insulinTableModel);
+    setupHistoryTableView(insulinTable);
     
     // Create alerts table
     alertsTable = new QTableWidget();
@@ -298,6 +307,22 @@ void HistoryScreen::setupUi()
     setLayout(mainLayout);
 }
 
+void HistoryScreen::setupHistoryTableView(QTableView *table)
+{
+    table->setStyleSheet(
+        "QTableView { background-color: #333333; color: white; gridline-color: #444444; }"
+        "QHeaderView::section { background-color: #444444; color: white; padding: 4px; border: 1px solid #555555; }"
+        "QTableView::item { padding: 4px; }"
+    );
+    table->horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
+    table->verticalHeader()->setVisible(false);
+    
+    // Fixed row heights so the view never has to measure off-screen rows
+    table->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    table->setSelectionBehavior(QAbstractItemView::SelectRows);
+    table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+}
+
 void HistoryScreen::connectSignals()
 {
     connect(backButton, &QPushButton::clicked, this, &HistoryScreen::backButtonClicked);
@@ -307,226 +332,116 @@ void HistoryScreen::connectSignals()
 
 void HistoryScreen::updateHistoryData()
 {
+    TRACE_SCOPE("HistoryScreen::updateHistoryData");
     if (!pumpController) return;
     
     // Get date range
     QDateTime startDate = fromDateEdit->dateTime();
     QDateTime endDate = toDateEdit->dateTime();
     
-    // Update glucose data
-    updateGlucoseTable(startDate, endDate);
-    
-    // Update insulin data
-    updateInsulinTable(startDate, endDate);
-    
-    // Update control-IQ data
-    updateControlIQTable(startDate, endDate);
+    // Start the background query first. This supersedes any query still
+    // running for a previous range, whose results are dropped.
+    queryRunner->submit(pumpController->getHistorySnapshot(), startDate, endDate);
+    insulinTableModel->clear();
+    controlIQTable->setRowCount(0);
+    alertsTable->setRowCount(0);
+    tabWidget->setTabText(tabWidget->indexOf(insulinTable), "Insulin (loading...)");
     
-    // Update alerts data
-    updateAlertsTable(startDate, endDate);
+    // Glucose is just a range over the shared series, so show it right away
+    updateGlucoseTable(startDate, endDate);
     
     // Update graph view
     updateGraphView(startDate, endDate);
 }
 
-void HistoryScreen::updateGlucoseTable(const QDateTime &start, const QDateTime &end)
+void HistoryScreen::exportHistory()
 {
     if (!pumpController) return;
     
-    // Get glucose history
-    QVector<QPair<QDateTime, double>> glucoseHistory = pumpController->getGlucoseHistory(start, end);
-    
-    // Clear table
-    glucoseTable->setRowCount(0);
-    
-    // Add data to table
-    for (const auto &reading : glucoseHistory) {
-        int row = glucoseTable->rowCount();
-        glucoseTable->insertRow(row);
-        
-        // Time
-        QTableWidgetItem *timeItem = new QTableWidgetItem(reading.first.toString("yyyy-MM-dd hh:mm:ss"));
-        
-        // Glucose value
-        QTableWidgetItem *valueItem = new QTableWidgetItem(QString::number(reading.second, 'f', 1));
-        
-        // Trend (this would need to be stored with each reading in a real implementation)
-        QTableWidgetItem *trendItem = new QTableWidgetItem("–");
-        
-        // Color based on value
-        if (reading.second < 3.9) {
-            valueItem->setForeground(QColor(255, 59, 48)); // Red for low
-        } else if (reading.second > 10.0) {
-            valueItem->setForeground(QColor(255, 149, 0)); // Orange for high
-        } else {
-            valueItem->setForeground(QColor(0, 178, 255)); // Blue for in-range
-        }
-        
-        glucoseTable->setItem(row, 0, timeItem);
-        glucoseTable->setItem(row, 1, valueItem);
-        glucoseTable->setItem(row, 2, trendItem);
+    const QString filename = QFileDialog::getSaveFileName(this, "Export History",
+                                                          QDir::homePath() + "/tslimx2_history.csv",
+                                                          "CSV files (*.csv)");
+    if (filename.isEmpty()) {
+        return;
     }
     
-    // Sort by time (newest first)
-    glucoseTable->sortItems(0, Qt::DescendingOrder);
+    // The report covers the range on screen, one row per reading or entry
+    if (!pumpController->exportHistoryCSV(filename, fromDateEdit->dateTime(), toDateEdit->dateTime())) {
+        QMessageBox::warning(this, "Export Failed", "The history could not be written to " + filename + ".");
+    }
 }
 
-void HistoryScreen::updateInsulinTable(const QDateTime &start, const QDateTime &end)
+void HistoryScreen::onInsulinHistoryReady(quint64 generation, const InsulinHistory &history)
 {
-    if (!pumpController) return;
-    
-    // Get insulin history
-    QVector<QPair<QDateTime, double>> insulinHistory = pumpController->getInsulinHistory(start, end);
-    
-    // Clear table
-    insulinTable->setRowCount(0);
-    
-    // Add data to table
-    for (const auto &delivery : insulinHistory) {
-        int row = insulinTable->rowCount();
-        insulinTable->insertRow(row);
-        
-        // Time
-        QTableWidgetItem *timeItem = new QTableWidgetItem(delivery.first.toString("yyyy-MM-dd hh:mm:ss"));
-        
-        // Type (in a real implementation, this would distinguish between bolus and basal)
-        QTableWidgetItem *typeItem = new QTableWidgetItem("Insulin");
-        
-        // Units
-        QTableWidgetItem *unitsItem = new QTableWidgetItem(QString::number(delivery.second, 'f', 2) + " u");
-        
-        insulinTable->setItem(row, 0, timeItem);
-        insulinTable->setItem(row, 1, typeItem);
-        insulinTable->setItem(row, 2, unitsItem);
+    // Only the latest query's results belong to the range on screen
+    if (generation != queryRunner->currentGeneration()) {
+        return;
     }
     
-    // Sort by time (newest first)
-    insulinTable->sortItems(0, Qt::DescendingOrder);
+    insulinTableModel->setEntries(history.entries);
+    graphView->setInsulinSeries(history.series);
+    tabWidget->setTabText(tabWidget->indexOf(insulinTable), "Insulin");
 }
 
-void HistoryScreen::updateControlIQTable(const QDateTime &start, const QDateTime &end)
+void HistoryScreen::updateGlucoseTable(const QDateTime &start, const QDateTime &end)
 {
-    // For demo purposes - in a real implementation, we would fetch actual Control-IQ history
-    controlIQTable->setRowCount(0);
+    if (!pumpController) return;
     
-    // Sample data
-    QDateTime now = QDateTime::currentDateTime();
+    // The model reads the glucose series in place and shows the range
+    // newest first
+    glucoseTableModel->setSeries(&pumpController->getGlucoseSeries(), start, end);
+}
+
+void HistoryScreen::onEventHistoryReady(quint64 generation, const EventHistory &events)
+{
+    if (generation != queryRunner->currentGeneration()) {
+        return;
+    }
     
-    for (int i = 0; i < 10; i++) {
-        QDateTime timestamp = now.addSecs(-i * 3600); // Every hour
-        
-        if (timestamp < start || timestamp > end) {
-            continue;
-        }
+    // Events arrive newest first, so rows go in as they are
+    controlIQTable->setRowCount(events.controlIQ.size());
+    for (int row = 0; row < events.controlIQ.size(); ++row) {
+        const EventHistory::ControlIQEvent &event = events.controlIQ.at(row);
         
-        int row = controlIQTable->rowCount();
-        controlIQTable->insertRow(row);
-        
-        // Time
-        QTableWidgetItem *timeItem = new QTableWidgetItem(timestamp.toString("yyyy-MM-dd hh:mm:ss"));
-        
-        // Action
-        QString action = (i % 3 == 0) ? "Decreased Basal" : (i % 3 == 1) ? "Increased Basal" : "No Change";
-        QTableWidgetItem *actionItem = new QTableWidgetItem(action);
-        
-        // Reason
-        QString reason = (i % 3 == 0) ? "Glucose Trending Down" : 
-                        (i % 3 == 1) ? "Glucose Trending Up" : "Stable Glucose";
-        QTableWidgetItem *reasonItem = new QTableWidgetItem(reason);
-        
-        // Adjustment
-        double adjustment = (i % 3 == 0) ? -0.1 - (i % 5) * 0.1 : 
-                          (i % 3 == 1) ? 0.1 + (i % 5) * 0.1 : 0.0;
-        QTableWidgetItem *adjustmentItem = new QTableWidgetItem(QString::number(adjustment, 'f', 2) + " u");
-        
-        if (adjustment < 0) {
+        QTableWidgetItem *adjustmentItem = new QTableWidgetItem(QString::number(event.adjustment, 'f', 2) + " u");
+        if (event.adjustment < 0) {
             adjustmentItem->setForeground(QColor(255, 59, 48)); // Red for decrease
-        } else if (adjustment > 0) {
+        } else if (event.adjustment > 0) {
             adjustmentItem->setForeground(QColor(52, 199, 89)); // Green for increase
         }
         
-        controlIQTable->setItem(row, 0, timeItem);
-        controlIQTable->setItem(row, 1, actionItem);
-        controlIQTable->setItem(row, 2, reasonItem);
+        controlIQTable->setItem(row, 0, new QTableWidgetItem(event.time.toDateTime().toString("yyyy-MM-dd hh:mm:ss")));
+        controlIQTable->setItem(row, 1, new QTableWidgetItem(event.action));
+        controlIQTable->setItem(row, 2, new QTableWidgetItem(event.reason));
         controlIQTable->setItem(row, 3, adjustmentItem);
     }
     
-    // Sort by time (newest first)
-    controlIQTable->sortItems(0, Qt::DescendingOrder);
-}
-
-void HistoryScreen::updateAlertsTable(const QDateTime &start, const QDateTime &end)
-{
-    // For demo purposes - in a real implementation, we would fetch actual alert history
-    alertsTable->setRowCount(0);
-    
-    // Sample data
-    QDateTime now = QDateTime::currentDateTime();
-    
-    QStringList alertMessages = {
-        "Low Glucose: 3.2 mmol/L",
-        "High Glucose: 13.8 mmol/L",
-        "Insulin Reservoir Low",
-        "Battery Low: 15%",
-        "CGM Signal Lost",
-        "Basal Delivery Suspended"
-    };
-    
-    QStringList alertLevels = {
-        "Warning",
-        "Warning",
-        "Info",
-        "Warning",
-        "Warning",
-        "Critical"
-    };
-    
-    QList<QColor> alertColors = {
-        QColor(255, 59, 48),   // Red for critical/low glucose
-        QColor(255, 149, 0),   // Orange for high glucose
-        QColor(255, 255, 255), // White for info
-        QColor(255, 204, 0),   // Yellow for warnings
-        QColor(255, 204, 0),   // Yellow for warnings
-        QColor(255, 59, 48)    // Red for critical
-    };
-    
-    for (int i = 0; i < alertMessages.size(); i++) {
-        QDateTime timestamp = now.addSecs(-i * 7200); // Every 2 hours
-        
-        if (timestamp < start || timestamp > end) {
-            continue;
-        }
+    alertsTable->setRowCount(events.alerts.size());
+    for (int row = 0; row < events.alerts.size(); ++row) {
+        const EventHistory::AlertEvent &alert = events.alerts.at(row);
         
-        int row = alertsTable->rowCount();
-        alertsTable->insertRow(row);
+        QTableWidgetItem *alertItem = new QTableWidgetItem(alert.message);
+        alertItem->setForeground(alert.color);
         
-        // Time
-        QTableWidgetItem *timeItem = new QTableWidgetItem(timestamp.toString("yyyy-MM-dd hh:mm:ss"));
+        QTableWidgetItem *levelItem = new QTableWidgetItem(alert.level);
+        levelItem->setForeground(alert.color);
         
-        // Alert message
-        QTableWidgetItem *alertItem = new QTableWidgetItem(alertMessages[i]);
-        alertItem->setForeground(alertColors[i]);
-        
-        // Alert level
-        QTableWidgetItem *levelItem = new QTableWidgetItem(alertLevels[i]);
-        levelItem->setForeground(alertColors[i]);
-        
-        alertsTable->setItem(row, 0, timeItem);
+        alertsTable->setItem(row, 0, new QTableWidgetItem(alert.time.toDateTime().toString("yyyy-MM-dd hh:mm:ss")));
         alertsTable->setItem(row, 1, alertItem);
         alertsTable->setItem(row, 2, levelItem);
     }
-    
-    // Sort by time (newest first)
-    alertsTable->sortItems(0, Qt::DescendingOrder);
 }
 
 void HistoryScreen::updateGraphView(const QDateTime &start, const QDateTime &end)
 {
     if (!pumpController) return;
     
-    // Update graph data
-    graphView->setGlucoseData(pumpController->getGlucoseHistory(start, end));
-    graphView->setInsulinData(pumpController->getInsulinHistory(start, end));
+    // Update graph data (the glucose series is drawn in place, not copied, and the
+    // graph picks its own level of detail for the visible range)
+    graphView->setGlucoseSeries(&pumpController->getGlucoseSeries());
+    
+    // Until the background query delivers, the graph has no insulin for this range
+    graphView->setInsulinSeries(TimeSeriesStore());
     
     // Set time range
     graphView->setTimeRange(start, end);
@@ -6,10 +6,12 @@
 #include <QPushButton>
 #include <QTabWidget>
 #include <QTableWidget>
+#include <QTableView>
 #include <QDateTimeEdit>
 #include <QComboBox>
 #include <QRadioButton>
 #include "graphview.h"
+#include "historytablemodels.h"
 #include "../controllers/pumpcontroller.h"
 
 namespace Ui {
@@ -42,6 +44,9 @@ private slots:
     void set3DayRange();
     void set1WeekRange();
     void set1MonthRange();
+    void onInsulinHistoryReady(quint64 generation, const InsulinHistory &history);
+    void onEventHistoryReady(quint64 generation, const EventHistory &events);
+    void exportHistory();
     
 private:
     Ui::HistoryScreen *ui;
@@ -50,8 +55,11 @@ private:
     // UI elements
     QLabel *titleLabel;
     QTabWidget *tabWidget;
-    QTableWidget *glucoseTable;
-    QTableWidget *insulinTable;
+    QTableView *glucoseTable;
+    QTableView *insulinTable;
+    GlucoseHistoryTableModel *glucoseTableModel;
+    InsulinHistoryTableModel *insulinTableModel;
+    HistoryQueryRunner *queryRunner;
     QTableWidget *alertsTable;
     QTableWidget *controlIQTable;
     GraphView *graphView;
@@ -67,10 +75,8 @@ private:
     
     void setupUi();
     void connectSignals();
+    void setupHistoryTableView(QTableView *table);
     void updateGlucoseTable(const QDateTime &start, const QDateTime &end);
-    void updateInsulinTable(const QDateTime &start, const QDateTime &end);
-    void updateControlIQTable(const QDateTime &start, const QDateTime &end);
-    void updateAlertsTable(const QDateTime &start, const QDateTime &end);
     void updateGraphView(const QDateTime &start, const QDateTime &end);
 };
 
@@ -0,0 +1,185 @@
+#include "historytablemodels.h"
+#include <QColor>
+
+GlucoseHistoryTableModel::GlucoseHistoryTableModel(QObject *parent)
+    : QAbstractTableModel(parent),
+      series(nullptr),
+      seriesEpoch(0),
+      rangeStart(0),
+      rangeEnd(0),
+      firstIndex(0),
+      lastIndex(0)
+{
+}
+
+void GlucoseHistoryTableModel::setSeries(const TimeSeriesStore *newSeries, const QDateTime &start, const QDateTime &end)
+{
+    beginResetModel();
+    series = newSeries;
+    rangeStart = start.toMSecsSinceEpoch();
+    rangeEnd = end.toMSecsSinceEpoch();
+    findRange();
+    endResetModel();
+}
+
+void GlucoseHistoryTableModel::refresh()
+{
+    if (!series || isCurrent()) {
+        return;
+    }
+    
+    beginResetModel();
+    findRange();
+    endResetModel();
+}
+
+void GlucoseHistoryTableModel::clear()
+{
+    beginResetModel();
+    series = nullptr;
+    firstIndex = 0;
+    lastIndex = 0;
+    endResetModel();
+}
+
+void GlucoseHistoryTableModel::findRange()
+{
+    firstIndex = series ? series->lowerBound(rangeStart) : 0;
+    lastIndex = series ? qMax(firstIndex, series->upperBound(rangeEnd)) : 0;
+    seriesEpoch = series ? series->epoch() : 0;
+}
+
+int GlucoseHistoryTableModel::rowCount(const QModelIndex &parent) const
+{
+    // The row indexes are only good for the store they were found in
+    return parent.isValid() || !isCurrent() ? 0 : lastIndex - firstIndex;
+}
+
+int GlucoseHistoryTableModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : 3;
+}
+
+QVariant GlucoseHistoryTableModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= rowCount()) {
+        return QVariant();
+    }
+    
+    const TimeSeriesStore::Sample &reading = sampleForRow(index.row());
+    
+    if (role == Qt::DisplayRole) {
+        switch (index.column()) {
+            case 0:
+                return QDateTime::fromMSecsSinceEpoch(reading.timestamp).toString("yyyy-MM-dd hh:mm:ss");
+            case 1:
+                return QString::number(reading.value, 'f', 1);
+            case 2:
+                // Trend (this would need to be stored with each reading in a real implementation)
+                return QString("–");
+        }
+    } else if (role == Qt::ForegroundRole && index.column() == 1) {
+        // Color based on value
+        if (reading.value < 3.9) {
+            return QColor(255, 59, 48); // Red for low
+        } else if (reading.value > 10.0) {
+            return QColor(255, 149, 0); // Orange for high
+        }
+        return QColor(0, 178, 255); // Blue for in-range
+    }
+    
+    return QVariant();
+}
+
+QVariant GlucoseHistoryTableModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (role != Qt::DisplayRole || orientation != Qt::Horizontal) {
+        return QVariant();
+    }
+    
+    switch (section) {
+        case 0: return QString("Time");
+        case 1: return QString("Glucose (mmol/L)");
+        case 2: return QString("Trend");
+    }
+    
+    return QVariant();
+}
+
+const TimeSeriesStore::Sample &GlucoseHistoryTableModel::sampleForRow(int row) const
+{
+    // Newest first
+    return series->at(lastIndex - 1 - row);
+}
+
+InsulinHistoryTableModel::InsulinHistoryTableModel(QObject *parent)
+    : QAbstractTableModel(parent)
+{
+}
+
+void InsulinHistoryTableModel::setEntries(const QVector<InsulinHistoryCursor::Entry> &newEntries)
+{
+    beginResetModel();
+    entries = newEntries;
+    endResetModel();
+}
+
+void InsulinHistoryTableModel::clear()
+{
+    beginResetModel();
+    entries.clear();
+    endResetModel();
+}
+
+int InsulinHistoryTableModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : entries.size();
+}
+
+int InsulinHistoryTableModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : 3;
+}
+
+QVariant InsulinHistoryTableModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || role != Qt::DisplayRole || index.row() >= entries.size()) {
+        return QVariant();
+    }
+    
+    // Entries are in time order; show newest first
+    const InsulinHistoryCursor::Entry &entry = entries.at(entries.size() - 1 - index.row());
+    
+    switch (index.column()) {
+        case 0:
+            return entry.timestamp.toDateTime().toString("yyyy-MM-dd hh:mm:ss");
+        case 1:
+            switch (entry.type) {
+                case InsulinHistoryCursor::Bolus: return QString("Bolus");
+                case InsulinHistoryCursor::Basal: return QString("Basal");
+                case InsulinHistoryCursor::AutoAdjustment: return QString("Control-IQ Basal");
+            }
+            break;
+        case 2:
+            // Basal samples are a rate
+            return QString::number(entry.value, 'f', 2) +
+                   (entry.type == InsulinHistoryCursor::Bolus ? " u" : " u/hr");
+    }
+    
+    return QVariant();
+}
+
+QVariant InsulinHistoryTableModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (role != Qt::DisplayRole || orientation != Qt::Horizontal) {
+        return QVariant();
+    }
+    
+    switch (section) {
+        case 0: return QString("Time");
+        case 1: return QString("Type");
+        case 2: return QString("Units");
+    }
+    
+    return QVariant();
+}
@@ -0,0 +1,66 @@
+#ifndef HISTORYTABLEMODELS_H
+#define HISTORYTABLEMODELS_H
+
+#include <QAbstractTableModel>
+#include <QDateTime>
+#include <QVector>
+#include "../utils/timeseriesstore.h"
+#include "../models/insulinhistorycursor.h"
+
+// Read-only table over a range of a glucose series, newest reading first.
+// Rows index straight into the model's store, which must outlive the table
+// model, and cells are only formatted when the view asks for them. Once the
+// store changes the table shows nothing until refresh() finds the range
+// again.
+class GlucoseHistoryTableModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    explicit GlucoseHistoryTableModel(QObject *parent = nullptr);
+    
+    void setSeries(const TimeSeriesStore *series, const QDateTime &start, const QDateTime &end);
+    void refresh();
+    void clear();
+    
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+private:
+    const TimeSeriesStore *series;
+    quint64 seriesEpoch;  // The store's epoch when the range was found
+    qint64 rangeStart;
+    qint64 rangeEnd;
+    int firstIndex;
+    int lastIndex;
+    
+    bool isCurrent() const { return series && series->epoch() == seriesEpoch; }
+    void findRange();
+    const TimeSeriesStore::Sample &sampleForRow(int row) const;
+};
+
+// Read-only table over the merged insulin stream of an InsulinHistoryCursor,
+// newest entry first. The entries are kept exactly as the cursor produced
+// them (implicitly shared) and cells are only formatted when asked for.
+class InsulinHistoryTableModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    explicit InsulinHistoryTableModel(QObject *parent = nullptr);
+    
+    void setEntries(const QVector<InsulinHistoryCursor::Entry> &entries);
+    void clear();
+    
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+private:
+    QVector<InsulinHistoryCursor::Entry> entries;
+};
+
+#endif // HISTORYTABLEMODELS_H
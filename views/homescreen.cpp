@@ -15,6 +15,7 @@
 #include <ctime>   // For time()
 #include <algorithm>
 #include <QRandomGenerator>
+#include "../utils/tracing.h"
 
 HomeScreen::HomeScreen(QWidget *parent) :
     QWidget(parent),
@@ -438,6 +439,7 @@ void HomeScreen::resizeEvent(QResizeEvent *event)
 
 void HomeScreen::updateAllData(PumpController *controller)
 {
+    TRACE_SCOPE("HomeScreen::updateAllData");
     if (!controller) return;
     
     updateBatteryLevel(controller->getBatteryLevel());
@@ -447,10 +449,8 @@ void HomeScreen::updateAllData(PumpController *controller)
     updateInsulinOnBoard(controller->getInsulinOnBoard());
     updateControlIQAction(controller->getControlIQDelivery());
     
-    // Get glucose history for the last 3 hours by default
-    QDateTime now = QDateTime::currentDateTime();
-    QDateTime threeHoursAgo = now.addSecs(-3 * 60 * 60);
-    updateGlucoseGraph(controller->getGlucoseHistory(threeHoursAgo, now));
+    // Share the stored readings; the graph only draws its own time range
+    updateGlucoseSeries(controller->getGlucoseSeries());
     
     updateDateTime();
 }
@@ -599,6 +599,18 @@ void HomeScreen::updateGlucoseGraph(const QVector<QPair<QDateTime, double>> &dat
     update();
 }
 
+void HomeScreen::updateGlucoseSeries(const TimeSeriesStore &series)
+{
+    // The graph draws the model's store in place rather than copying it
+    graphView->setGlucoseSeries(&series);
+    
+    // Update the timeframe label
+    timeframeLabel->setText(QString("%1 HRS").arg(graphView->getTimeRangeHours()));
+    
+    // Force a repaint
+    update();
+}
+
 void HomeScreen::updateDateTime()
 {
     QDateTime now = QDateTime::currentDateTime();
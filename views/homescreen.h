@@ -40,6 +40,7 @@ public slots:
     void updateInsulinOnBoard(double units);
     void updateControlIQAction(double value);
     void updateGlucoseGraph(const QVector<QPair<QDateTime, double>> &data);
+    void updateGlucoseSeries(const TimeSeriesStore &series);
     void updateDateTime();
     void showTimelineOptions(const QPoint &pos = QPoint());
     void onTimeRangeChanged(int hours);
@@ -7,12 +7,12 @@
 
 PinLockScreen::PinLockScreen(QWidget *parent)
     : QWidget(parent),
+      settingsStore(nullptr),
       pinEnabled(false),
       failedAttempts(0)
 {
     setupUi();
     connectSignals();
-    loadSettings();
 }
 
 PinLockScreen::~PinLockScreen()
@@ -133,24 +133,38 @@ void PinLockScreen::connectSignals()
     connect(backButton, &QPushButton::clicked, this, &PinLockScreen::onBackButtonClicked);
 }
 
+void PinLockScreen::setSettingsStore(SettingsStore *store)
+{
+    settingsStore = store;
+    
+    if (settingsStore) {
+        // Picks up PIN changes made on the PIN settings screen
+        connect(settingsStore, &SettingsStore::securitySettingsChanged, this, &PinLockScreen::loadSettings);
+        loadSettings();
+    }
+}
+
 void PinLockScreen::loadSettings()
 {
-    QSettings settings("TandemDiabetes", "tslimx2simulator");
+    if (!settingsStore) {
+        return;
+    }
     
-    settings.beginGroup("Security");
-    pinEnabled = settings.value("PinEnabled", false).toBool();
-    currentPin = settings.value("Pin", "").toString();
-    settings.endGroup();
+    const SecuritySettings &settings = settingsStore->security();
+    pinEnabled = settings.pinEnabled;
+    currentPin = settings.pinHash;
 }
 
 void PinLockScreen::saveSettings()
 {
-    QSettings settings("TandemDiabetes", "tslimx2simulator");
+    if (!settingsStore) {
+        return;
+    }
     
-    settings.beginGroup("Security");
-    settings.setValue("PinEnabled", pinEnabled);
-    settings.setValue("Pin", currentPin);
-    settings.endGroup();
+    SecuritySettings settings;
+    settings.pinEnabled = pinEnabled;
+    settings.pinHash = currentPin;
+    settingsStore->setSecurity(settings);
 }
 
 bool PinLockScreen::isPinEnabled() const
@@ -7,7 +7,7 @@
 #include <QLineEdit>
 #include <QGridLayout>
 #include <QVBoxLayout>
-#include <QSettings>
+#include "../utils/settingsstore.h"
 
 class PinLockScreen : public QWidget
 {
@@ -17,6 +17,8 @@ public:
     explicit PinLockScreen(QWidget *parent = nullptr);
     ~PinLockScreen();
     
+    void setSettingsStore(SettingsStore *store);
+    
     bool isPinEnabled() const;
     void enablePin(bool enable);
     bool validatePin(const QString &pin);
@@ -46,6 +48,7 @@ private:
     QPushButton *enterButton;
     QPushButton *backButton;
     
+    SettingsStore *settingsStore;
     QString currentPin;
     bool pinEnabled;
     int failedAttempts;
@@ -5,12 +5,12 @@
 #include <QHBoxLayout>
 #include <QGroupBox>
 #include <QMessageBox>
-#include <QSettings>
 #include <QInputDialog>  // Add this include for QInputDialog
 
 PinSettingsScreen::PinSettingsScreen(QWidget *parent)
     : QWidget(parent),
-      pinLockScreen(new PinLockScreen(this))
+      pinLockScreen(new PinLockScreen(this)),
+      settingsStore(nullptr)
 {
     setupUi();
     connectSignals();
@@ -141,13 +141,16 @@ void PinSettingsScreen::connectSignals()
     connect(homeButton, &QPushButton::clicked, this, &PinSettingsScreen::onHomeButtonClicked);
 }
 
+void PinSettingsScreen::setSettingsStore(SettingsStore *store)
+{
+    settingsStore = store;
+    pinLockScreen->setSettingsStore(store);
+    loadSettings();
+}
+
 void PinSettingsScreen::loadSettings()
 {
-    QSettings settings("TandemDiabetes", "tslimx2simulator");
-    
-    settings.beginGroup("Security");
-    bool pinEnabled = settings.value("PinEnabled", false).toBool();
-    settings.endGroup();
+    bool pinEnabled = settingsStore && settingsStore->security().pinEnabled;
     
     enablePinCheckBox->setChecked(pinEnabled);
     
@@ -157,11 +160,13 @@ void PinSettingsScreen::loadSettings()
 
 void PinSettingsScreen::saveSettings()
 {
-    QSettings settings("TandemDiabetes", "tslimx2simulator");
+    if (!settingsStore) {
+        return;
+    }
     
-    settings.beginGroup("Security");
-    settings.setValue("PinEnabled", enablePinCheckBox->isChecked());
-    settings.endGroup();
+    SecuritySettings settings = settingsStore->security();
+    settings.pinEnabled = enablePinCheckBox->isChecked();
+    settingsStore->setSecurity(settings);
 }
 
 void PinSettingsScreen::updateSettings()
@@ -175,12 +180,7 @@ void PinSettingsScreen::onEnablePinToggled(bool checked)
     
     // If enabling PIN for the first time, prompt to set one
     if (checked) {
-        QSettings settings("TandemDiabetes", "tslimx2simulator");
-        settings.beginGroup("Security");
-        QString existingPin = settings.value("Pin", "").toString();
-        settings.endGroup();
-        
-        if (existingPin.isEmpty()) {
+        if (!settingsStore || settingsStore->security().pinHash.isEmpty()) {
             QMessageBox::information(this, "Set PIN", "You'll need to set a PIN to enable PIN security.");
         }
     }
@@ -195,12 +195,7 @@ void PinSettingsScreen::onEnablePinToggled(bool checked)
 void PinSettingsScreen::onChangeCurrentPinClicked()
 {
     // For a real implementation, you'd verify the current PIN first
-    QSettings settings("TandemDiabetes", "tslimx2simulator");
-    settings.beginGroup("Security");
-    QString existingPin = settings.value("Pin", "").toString();
-    settings.endGroup();
-    
-    if (existingPin.isEmpty()) {
+    if (!settingsStore || settingsStore->security().pinHash.isEmpty()) {
         QMessageBox::warning(this, "No PIN Set", "There is no PIN currently set. Please set a new PIN first.");
         return;
     }
@@ -16,6 +16,7 @@ public:
     explicit PinSettingsScreen(QWidget *parent = nullptr);
     ~PinSettingsScreen();
     
+    void setSettingsStore(SettingsStore *store);
     void updateSettings();
     
 signals:
@@ -47,6 +48,7 @@ private:
     QLineEdit *confirmPinInput;
     
     PinLockScreen *pinLockScreen;
+    SettingsStore *settingsStore;
     
     void setupUi();
     void connectSignals();
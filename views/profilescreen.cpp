@@ -349,6 +349,17 @@ Profile ProfileScreen::getProfileFromForm()
     profile.correctionFactor = correctionFactorSpinBox->value();
     profile.targetGlucose = targetGlucoseSpinBox->value();
     
+    // The form edits the settings from midnight; keep the profile's
+    // segments for the rest of the day
+    if (editMode) {
+        for (const auto &existing : profiles) {
+            if (existing.name == editingProfileName) {
+                profile.segments = existing.segments;
+                break;
+            }
+        }
+    }
+    
     return profile;
 }
 